@@ -9,31 +9,132 @@
  * | NOTES |
  *  -------
  *
- * asi bude lepsi ukladat do databaze jen struktury, ne cele objekty - s temi
- * se nejspis ukladaji i nejake "rezijni pointry", ktere jsou pri obnoveni z
- * databaze davno neplatne ...
+ * Databaze byla puvodne v gdbm, kazdy pristup (i cteni) ale znamenal
+ * vytvoreni zamku, gdbm_open(), gdbm_close() a smazani zamku - a LIST
+ * adresare se zjistuje prava ke kazdemu souboru. Proto je ted databaze
+ * jednoducha hashovaci tabulka v namapovanem souboru, kterou si kazdy proces
+ * cte primo z pameti. Starou databazi lze prevest programem vfsdb_migrate.
  *
  * KKP = Kompletni Kapesni Pruvodce Jazyky C a C++
  */
 
 #include <DirectoryDatabase.h>
-     
+#include "durable.h"
+#include "statcache.h"
+#include "metrics.h"
+#include "trace.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+}
+#include <vector>
+#include <deque>
+#include <algorithm>
+
 //#define DD_DEBUG
 
 
+/** Posun tabulky vlastniku od zacatku souboru (zarovnany na 64 bytu).
+ *
+ */
+static size_t OwnersOffset() {
+    return (sizeof(TableHeader) + 63) & ~(size_t)63;
+}
+
+
+/** Posun tabulky zaznamu od zacatku souboru.
+ *
+ */
+static size_t RecordsOffset() {
+    return OwnersOffset() + TABLE_MAX_OWNERS * sizeof(TableOwner);
+}
+
+
+/** Velikost souboru s tabulkou o slots slotech.
+ *
+ */
+static size_t TableSize(unsigned int slots) {
+    return RecordsOffset() + (size_t)slots * sizeof(TableRecord);
+}
+
+
+/** Hashovaci funkce klice (zarizeni, cislo inodu).
+ *
+ */
+static unsigned int KeyHash(unsigned long long dev, unsigned long long ino) {
+    unsigned long long h;
+
+    h  = ino * 0x9E3779B97F4A7C15ULL ^ dev;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (unsigned int)h;
+}
+
+
+/** Vrati cas vzniku souboru v nanosekundach, nebo 0, pokud ho filesystem
+ * nezna.
+ *
+ */
+static unsigned long long Birth(const struct statx &stx) {
+    if ((stx.stx_mask & STATX_BTIME) == 0) return 0;
+    return (unsigned long long)stx.stx_btime.tv_sec * 1000000000ULL + stx.stx_btime.tv_nsec;
+}
+
+
+/** Muze jit o tentyz soubor? Soubory na stejnem inodu se lisi casem vzniku,
+ * pokud ho zname u obou.
+ *
+ */
+static bool SameFile(unsigned long long birth1, unsigned long long birth2) {
+    return birth1 == 0 || birth2 == 0 || birth1 == birth2;
+}
+
+
+/** Vytvori soubor name s prazdnou tabulkou o slots slotech.
+ *
+ * Vrati file descriptor otevreneho souboru, nebo -1 pri chybe.
+ */
+static int TableCreate(const char * name, unsigned int slots) {
+    int         fd;
+    TableHeader h;
+
+    fd = open(name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) return -1;
+
+    memset(&h, 0, sizeof(h));
+    strncpy(h.magic, TABLE_MAGIC, sizeof(h.magic));
+    h.slots = slots;
+
+    if (ftruncate(fd, TableSize(slots)) == -1 || pwrite(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        close(fd);
+        unlink(name);
+        return -1;
+    }
+    return fd;
+}
+
+
 /** Konstruktor.
- * Otevre databazi pro zadany adresar (dir), predpoklada, ze se soubor databaze (name)
- * nachazi v aktualnim adresari. Pokud selze otevreni databaze (napriklad nekdo
- * zmenil prava souboru na 000), hodi vyjimku GdbmError. Databazi otevre jen
- * pro cteni.
+ * Otevre databazi ulozenou v souboru name, pokud soubor neexistuje,
+ * vytvori ho. Pokud soubor neni mozne namapovat, nebo neobsahuje tabulku,
+ * hodi vyjimku DatabaseError.
  * Implicitne da ingore_hidden na true.
- */ 
-DirectoryDatabase::DirectoryDatabase(const char *name) throw(FileError, GdbmError)
+ */
+DirectoryDatabase::DirectoryDatabase(const char *name) throw(FileError, DatabaseError)
 {
-    
+    int         fd;
+    int         ret;
+    struct stat st;
+
     db_name = name;
     lock_name = name;
-    lock_name = lock_name + "_gdbm_lock";
+    lock_name = lock_name + ".lock";
     // je mozne, ze name bude obsahovat i cestu - zamek se tedy bude vytvaret v
     // miste, kde je ulozena databaze - nemohou tam byt dva soubory stejneho
     // jmena, takze je vse OK.
@@ -44,29 +145,44 @@ DirectoryDatabase::DirectoryDatabase(const char *name) throw(FileError, GdbmErro
 #endif
 
     ignore_hidden = true;
-    num_of_deleted_items = 0;
-    locked = false;
-        
-    /* vytvorime novou databazi, nastavime souboru pravo cteni a zapisu,
-     * fatal_func() nechame defaultni (0) */
-    if (LockDatabase() == -1) {
+    locked  = false;
+    header  = 0;
+    owners  = 0;
+    records = 0;
+    map_size = 0;
+
+    lock_fd = open(lock_name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (lock_fd == -1) {
         string msg;
-        msg = "Nepodarilo se zamknout databazi. Program mozna nebyl naposledy ciste ukoncen. Zkontrolujte prosim, ";
-        msg = msg + "jestli neexistuje soubor " + lock_name + " a smazte jej.";
-        throw FileError(msg.c_str(), -1);
+        msg = "Nepodarilo se otevrit zamek databaze " + lock_name + ".";
+        throw FileError(msg.c_str(), errno);
     }
-    
+
+    if (LockDatabase() == -1) throw FileError("Nepodarilo se zamknout databazi.", -1);
+
 // --- zacatek KRITICKE SEKCE ---
 
     //pokud databaze neexistuje, vytvorime ji
-    
-    db_file = gdbm_open((char *)db_name.c_str(), GDBM_BLOCK_SIZE, GDBM_WRCREAT, S_IRUSR | S_IWUSR, 0);
-    if (db_file == 0) throw GdbmError();
-    gdbm_close(db_file);
-    if (UnlockDatabase() == -1) throw FileError("DirectoryDatabase(): Nepodarilo se odemknout databazi.", -1);
-    
+    if (stat(db_name.c_str(), &st) == -1 && errno == ENOENT) {
+        fd = TableCreate(db_name.c_str(), TABLE_MIN_SLOTS);
+        if (fd == -1) {
+            UnlockDatabase();
+            throw DatabaseError("Nepodarilo se vytvorit databazi.", errno);
+        }
+        close(fd);
+    }
+
+    ret = Map();
+    UnlockDatabase();
+
 // --- konec KRITICKE SEKCE ---
-    
+
+    if (ret == -1) throw DatabaseError("Nepodarilo se otevrit databazi.", errno);
+    if (ret == -2) {
+        string msg;
+        msg = "Soubor " + db_name + " neobsahuje databazi smallFTPd (starou databazi gdbm lze prevest programem vfsdb_migrate).";
+        throw DatabaseError(msg.c_str());
+    }
 }
 
 
@@ -75,70 +191,131 @@ DirectoryDatabase::DirectoryDatabase(const char *name) throw(FileError, GdbmErro
 
 DirectoryDatabase::~DirectoryDatabase() {
 #ifdef DD_DEBUG
-    cout << getpid()<< " - destroying database " << db_name << endl;  
+    cout << getpid()<< " - destroying database " << db_name << endl;
 #endif
-    int ret=0;
-
-/*
-    if (num_of_deleted_items > 0) ret = gdbm_reorganize(db_file); //je-li potreba, procistime databazi
-#ifdef DD_DEBUG
-    if (ret!=0) cout << "Nepovedla se reorganizace databaze v destruktoru.";
-    cout << gdbm_strerror(gdbm_errno) << endl;
-#endif 
-*/
 
+    Unmap();
+    if (lock_fd != -1) close(lock_fd);
 }
 
 
 
 
-/** K danemu souboru vytvori jednoznacny klic.
- * 
- * K zadanemu souboru vytvori string s jednoznacnym klicem, kterym je cislo
- * i-nodu daneho souboru. Pokud nebude mozne cislo i-nodu zjistit, vrati -1.
- * Pokud uspeje vrati 1.
- * 
- */
-int DirectoryDatabase::File2Key(const char *path, string &key) { 
-    struct stat buf;
-    // polozka st_ino struktury stat je typu UQUAD_TYPE, ci tak nejak --> mel by to byt unsigned long long
-    // (viz types.h a dalsi ...)
-
-    // stat nam vrati informace o souboru na ktery pripadny soft link ukazuje
-    // (jinak se musi pouzit lstat)
-    if (stat(path, &buf) == -1) {
-        //perror("File2Key: stat");
-	//cout << "stat se provadel na " << path << endl;
-	/* char *error_msg;
-        
-        error_msg = strerror(errno);
-        string tmp("In File2Key: stat(\"");
-        tmp = tmp + path + "\", ...):  " + error_msg;
-        throw( FileError(tmp.c_str(),errno) ); */
+/** Namapuje soubor s tabulkou.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK.
+ *      - -1      soubor nelze otevrit nebo namapovat
+ *      - -2      soubor neobsahuje tabulku
+ */
+int DirectoryDatabase::Map() {
+    int             fd;
+    struct stat     st;
+    void          * p;
+    TableHeader   * h;
+
+    fd = open(db_name.c_str(), O_RDWR);
+    if (fd == -1) return -1;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
         return -1;
     }
+    if ((size_t)st.st_size < RecordsOffset()) {
+        close(fd);
+        return -2;
+    }
+
+    p = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); //namapovani zustane i po zavreni souboru
+    if (p == MAP_FAILED) return -1;
+
+    h = (TableHeader *)p;
+    if (strncmp(h->magic, TABLE_MAGIC, sizeof(h->magic)) != 0 || h->slots == 0
+            || (h->slots & (h->slots - 1)) != 0 || TableSize(h->slots) != (size_t)st.st_size) {
+        munmap(p, st.st_size);
+        return -2;
+    }
+
+    header   = h;
+    owners   = (TableOwner *)((char *)p + OwnersOffset());
+    records  = (TableRecord *)((char *)p + RecordsOffset());
+    map_size = st.st_size;
+    return 1;
+}
+
+
+
+/** Zrusi namapovani souboru s tabulkou.
+ *
+ */
+void DirectoryDatabase::Unmap() {
+    if (header != 0) munmap(header, map_size);
+    header  = 0;
+    owners  = 0;
+    records = 0;
+    map_size = 0;
+}
+
+
+
+/** Namapuje znovu soubor s tabulkou - pouziva se, kdyz jiny proces tabulku
+ * prestavil a nahradil jejim novym souborem.
+ *
+ * Navratove hodnoty viz. Map().
+ */
+int DirectoryDatabase::Remap() {
+    Unmap();
+    return Map();
+}
 
-    
-    // 2^64 = 1.844674407371e+19...cili unsigned long long bude mit max.20 cifer
-    char tmp[25]; //koncova nula = +1, plus radsi neco navic
 
-    //PROBLEM: sprintf(tmp,"%llu",buf.st_ino) dava spatny vysledky! takze
-    //bohuzel pouzijeme jen %lu, to se zda ze uz funguje...
 
-    if (sprintf(tmp,"%lu",buf.st_ino) < 0) { 
+/** K danemu souboru vytvori jednoznacny klic.
+ *
+ * Klicem je zarizeni a cislo i-nodu souboru a k nemu cas vzniku souboru,
+ * ktere se vrati ve strukture key. Pokud nebude mozne udaje o souboru
+ * zjistit, vrati -1.
+ * Pokud uspeje vrati 1.
+ *    Pokud cached je true, smi se udaje vzit ze sdilene cache stat() (pri
+ * cteni). Zapis a mazani zaznamu se ptaji primo jadra - soubor se mohl
+ * zrovna zmenit a zneplatneni cache jeste nemuselo probehnout.
+ *
+ */
+int DirectoryDatabase::File2Key(const char *path, TableKey &key, bool cached) {
+    struct statx    stx;
+    struct stat     st;
+
+    if (cached) {
+        if (StatCacheStat(path, st, &key.birth) == -1) return -1;
+        key.dev = st.st_dev;
+        key.ino = st.st_ino;
 #ifdef DD_DEBUG
-        cout << "selhal sprintf ve File2Key ... spatne .... spatne ..." << endl;
+        cout << getpid() << " - File2Key - mame pozadavek \"" << path << "\" odpovidajici klic (z cache) je "
+             << key.dev << ":" << key.ino << ":" << key.birth << endl;
 #endif
-        return -1;
+        return 1;
+    }
+
+    // statx nam vrati informace o souboru na ktery pripadny soft link ukazuje
+    // (jinak se musi pouzit AT_SYMLINK_NOFOLLOW)
+    if (statx(AT_FDCWD, path, 0, STATX_INO | STATX_BTIME, &stx) == 0) {
+        key.dev   = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        key.ino   = stx.stx_ino;
+        key.birth = Birth(stx);
+    } else {
+        if (errno != ENOSYS || stat(path, &st) == -1) return -1;
+        key.dev   = st.st_dev;
+        key.ino   = st.st_ino;
+        key.birth = 0;
     }
-    
-    string result(tmp);
-    
+
 #ifdef DD_DEBUG
-    cout << getpid() << " - File2Key - mame pozadavek \"" << path << "\" odpovidajici klic je " << result << endl;
+    cout << getpid() << " - File2Key - mame pozadavek \"" << path << "\" odpovidajici klic je "
+         << key.dev << ":" << key.ino << ":" << key.birth << endl;
 #endif
-    
-    key = result;
+
     return 1;
 }
 
@@ -146,38 +323,37 @@ int DirectoryDatabase::File2Key(const char *path, string &key) {
 
 /** Zamyka databazi pro zapis.
  *
- * Pokousi se kazdych LOCKING_SLEEP_TIME mikrosekund zamknout databazi. Pokud se to
- * behem LOCKING_TIMEOUT pokusu nepovede, skonci a vrati -1.
- * Pokud uspeje, vrati 1.
+ * Pokud je wait true, ceka, dokud zamek drzi jiny proces, jinak se hned
+ * vrati. Zamek fcntl() se pri skonceni procesu sam uvolni, takze po padu
+ * procesu nezustane databaze zamcena.
+ * Pokud uspeje, vrati 1, pokud zamek drzi jiny proces (a wait je false),
+ * vrati 0, jinak -1.
  *
  */
-int DirectoryDatabase::LockDatabase() {
-    int fd;
-    int pokus = 0;
+int DirectoryDatabase::LockDatabase(bool wait) {
+    struct flock        fl;
+    unsigned long long  start;
 
-    while (!locked && pokus < LOCKING_TIMEOUT) {
-        pokus++;
-#ifdef DD_DEBUG
-        cout << endl << getpid() << " - zkousime zamknout databazi, pokus c. " << pokus << " ... ";
-#endif
-        fd = open(lock_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0444);
-        if (fd != -1) {
-            locked = true;
-            close(fd);
-#ifdef DD_DEBUG
-            cout << "OK :)" << endl;
-#endif
-        } else { 
+    if (locked) return 1;
+    TraceSpan span("db lock", "db");
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+
+    start = MetricsNow();
+    while (fcntl(lock_fd, wait ? F_SETLKW : F_SETLK, &fl) == -1) {
+        if (errno == EINTR) continue;
+        if (!wait && (errno == EAGAIN || errno == EACCES)) return 0;
 #ifdef DD_DEBUG
-            cout << "failed .... dem si pospat." << endl;
-            cout << "zamek = " << lock_name << endl;
-            perror("open");
+        perror("LockDatabase()");
 #endif
-            usleep(LOCKING_SLEEP_TIME);
-        }//else
-    }//while
+        return -1;
+    }
+    if (wait) MetricsRecord(METRIC_DB_LOCK_WAIT, MetricsNow() - start);
 
-    if (locked) return 1; else return -1;
+    locked = true;
+    return 1;
 }
 
 
@@ -185,28 +361,300 @@ int DirectoryDatabase::LockDatabase() {
 /** Odemyka zamknutou databazi.
  *
  * Pokud uspeje vrati 1, jinak -1.
- * 
+ *
  */
 int DirectoryDatabase::UnlockDatabase() {
-    int result;
+    struct flock    fl;
 
-    result = unlink(lock_name.c_str());
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = F_UNLCK;
+    fl.l_whence = SEEK_SET;
 
+    if (fcntl(lock_fd, F_SETLK, &fl) == -1) {
 #ifdef DD_DEBUG
-    if (result != 0) {
-        cout << getpid() << " - Nebylo mozne odstranit zamek " << lock_name << endl;
         perror("UnlockDatabase()");
+#endif
+        return -1;
+    }
+
+    locked = false;
+    return 1;
+}
+
+
+
+/** Vrati poradove cislo vlastnika name v tabulce vlastniku.
+ *
+ * Pokud tam jeste neni, prida ho - do volne polozky, nebo na konec tabulky.
+ * Kdyz je tabulka plna, uvolni nejdriv jmena, na ktera uz neodkazuje zadny
+ * zaznam (viz. ReclaimOwners()). Databaze musi byt zamcena. Vrati 0 pro
+ * prazdne jmeno a -1, pokud je tabulka vlastniku plna.
+ */
+int DirectoryDatabase::OwnerId(const string &name) {
+    char            tmp[MAX_USER_NAME_LEN];
+    unsigned int    i;
+
+    if (name == "") return 0;
+
+    //jmeno se orizne stejne, jako se orezavalo v gdbm zaznamu
+    strncpy(tmp, name.c_str(), MAX_USER_NAME_LEN);
+    tmp[MAX_USER_NAME_LEN-1] = 0;
+
+    for (i = 0; i < header->owners; i++)
+        if (strncmp(owners[i].name, tmp, MAX_USER_NAME_LEN) == 0) return i + 1;
+
+    //volna polozka (viz. ReclaimOwners())
+    for (i = 0; i < header->owners && owners[i].name[0] != 0; i++);
+    if (i >= TABLE_MAX_OWNERS && ReclaimOwners() > 0)
+        for (i = 0; owners[i].name[0] != 0; i++);
+    if (i >= TABLE_MAX_OWNERS) return -1;
+
+    if (i < header->owners) {
+        //uvolnenou polozku mohl jeste pred chvili cist ctenar zaznamu, ktery
+        //na ni odkazoval - zapis je proto uvnitr seqlocku
+        header->seq++;
+        __sync_synchronize();
+        memcpy(owners[i].name, tmp, MAX_USER_NAME_LEN);
+        __sync_synchronize();
+        header->seq++;
+        return i + 1;
+    }
+
+    //na konec tabulky zatim nic neodkazuje, ctenari se k novemu jmenu
+    //dostanou az pres zaznam, ktery se zapise pozdeji
+    memcpy(owners[i].name, tmp, MAX_USER_NAME_LEN);
+    __sync_synchronize();
+    header->owners++;
+    return i + 1;
+}
+
+
+
+/** Uvolni v tabulce vlastniku jmena, na ktera neodkazuje zadny zaznam.
+ *
+ * Projde celou tabulku zaznamu, proto se vola jen pri plne tabulce
+ * vlastniku (viz. OwnerId()) a na konci pruchodu kontroly zaznamu (viz.
+ * ReconcilePurge()). Uvolnena polozka ma prazdne jmeno a OwnerId() ji
+ * pouzije pro dalsiho vlastnika. Databaze musi byt zamcena.
+ *
+ * Vrati pocet uvolnenych jmen.
+ */
+int DirectoryDatabase::ReclaimOwners() {
+    vector<bool>    referenced(TABLE_MAX_OWNERS, false);
+    unsigned int    i;
+    int             freed = 0;
+
+    for (i = 0; i < header->slots; i++)
+        if (records[i].state == SLOT_USED && records[i].owner > 0 && records[i].owner <= TABLE_MAX_OWNERS)
+            referenced[records[i].owner - 1] = true;
+
+    for (i = 0; i < header->owners; i++)
+        if (!referenced[i] && owners[i].name[0] != 0) break;
+    if (i >= header->owners) return 0;
+
+    header->seq++;
+    __sync_synchronize();
+    for (; i < header->owners; i++)
+        if (!referenced[i] && owners[i].name[0] != 0) {
+            memset(owners[i].name, 0, MAX_USER_NAME_LEN);
+            freed++;
+        }
+    __sync_synchronize();
+    header->seq++;
+
+#ifdef DD_DEBUG
+    cout << getpid() << " - tabulka vlastniku: uvolneno " << freed << " jmen" << endl;
+#endif
+
+    return freed;
+}
+
+
+
+/** Najde v tabulce zaznam se zadanym klicem.
+ *
+ * Databaze musi byt zamcena. Vrati ukazatel na zaznam, nebo 0.
+ */
+TableRecord * DirectoryDatabase::Find(TableKey &key) {
+    unsigned int    mask = header->slots - 1;
+    unsigned int    i, n;
+
+    for (i = KeyHash(key.dev, key.ino) & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+        if (records[i].state == SLOT_EMPTY) return 0;
+        if (records[i].state == SLOT_USED && records[i].dev == key.dev && records[i].ino == key.ino)
+            return &records[i];
+    }
+    return 0;
+}
+
+
+
+/** Odstrani zaznam r z tabulky.
+ *
+ * Databaze musi byt zamcena.
+ */
+void DirectoryDatabase::Remove(TableRecord * r) {
+    header->seq++;
+    __sync_synchronize();
+
+    //pokud za zaznamem nic neni, muze byt slot rovnou prazdny, jinak by se
+    //prerusilo hledani zaznamu, ktere jsou za nim
+    header->used--;
+    if (records[(r - records + 1) & (header->slots - 1)].state == SLOT_EMPTY) r->state = SLOT_EMPTY;
+    else {
+        r->state = SLOT_DELETED;
+        header->deleted++;
+    }
+
+    __sync_synchronize();
+    header->seq++;
+}
+
+
+
+/** Prestavi tabulku do noveho souboru se slots sloty.
+ *
+ * Smazane sloty se pritom zahodi. Novy soubor nahradi puvodni a ostatni
+ * procesy si ho namapuji, jakmile uvidi priznak stale. Databaze musi byt
+ * zamcena.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK.
+ *      - -1      chyba pri vytvareni nebo mapovani noveho souboru
+ */
+int DirectoryDatabase::Rebuild(unsigned int slots) {
+    string          tmp_name;
+    int             fd;
+    void          * p;
+    TableHeader   * h;
+    TableRecord   * r;
+    unsigned int    mask = slots - 1;
+    unsigned int    i, j;
+
+    tmp_name = db_name + ".new";
+    fd = TableCreate(tmp_name.c_str(), slots);
+    if (fd == -1) return -1;
+
+    p = mmap(0, TableSize(slots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+    h = (TableHeader *)p;
+    r = (TableRecord *)((char *)p + RecordsOffset());
+
+    memcpy((char *)p + OwnersOffset(), owners, TABLE_MAX_OWNERS * sizeof(TableOwner));
+    h->owners    = header->owners;
+    h->reclaimed = header->reclaimed;
+    h->epoch     = header->epoch;
+    h->moved     = header->moved;
+
+    for (i = 0; i < header->slots; i++) {
+        if (records[i].state != SLOT_USED) continue;
+        for (j = KeyHash(records[i].dev, records[i].ino) & mask; r[j].state != SLOT_EMPTY; j = (j + 1) & mask);
+        r[j] = records[i];
+        h->used++;
+    }
+
+    //novy soubor musi byt cely na disku driv, nez nahradi ten stary
+    if (msync(p, TableSize(slots), MS_SYNC) == -1 || fdatasync(fd) == -1) {
+        munmap(p, TableSize(slots));
+        close(fd);
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+    munmap(p, TableSize(slots));
+    close(fd);
+
+    if (rename(tmp_name.c_str(), db_name.c_str()) == -1) {
+        unlink(tmp_name.c_str());
+        return -1;
     }
-    else {cout << getpid() << " - databaze odemknuta" << endl; }
+
+#ifdef DD_DEBUG
+    cout << getpid() << " - tabulka prestavena: " << header->used << " zaznamu, " << slots << " slotu" << endl;
 #endif
 
-    if (result == 0) { locked = false; return 1; } else return -1;
+    header->stale = 1;
+    return (Remap() == 1) ? 1 : -1;
+}
+
+
+
+/** Ulozi do tabulky zaznam se zadanym klicem.
+ *
+ * Pokud zaznam uz existuje a replace je false, necha ho byt (pokud ovsem
+ * nepatri drivejsimu souboru se stejnym inodem). Databaze musi byt zamcena.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      zaznam byl ulozen
+ *      -  0      zaznam uz existoval a replace je false
+ *      - -1      tabulku se nepodarilo zvetsit
+ */
+int DirectoryDatabase::Store(TableKey &key, int user_rights, int others_rights, unsigned int owner, bool replace) {
+    unsigned int    mask;
+    unsigned int    i, n;
+    unsigned int    slots;
+    TableRecord   * target = 0;
+    TableRecord   * tombstone = 0;
+
+    //je-li tabulka moc plna, prestavime ji - tak, aby byla zaplnena
+    //nanejvys z poloviny TABLE_MAX_LOAD
+    if ((unsigned long long)(header->used + header->deleted + 1) * 100 > (unsigned long long)header->slots * TABLE_MAX_LOAD) {
+        slots = TABLE_MIN_SLOTS;
+        while ((unsigned long long)(header->used + 1) * 200 > (unsigned long long)slots * TABLE_MAX_LOAD) slots *= 2;
+        if (Rebuild(slots) < 0) return -1;
+    }
+
+    mask = header->slots - 1;
+    for (i = KeyHash(key.dev, key.ino) & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+        if (records[i].state == SLOT_EMPTY) {
+            target = &records[i];
+            break;
+        }
+        if (records[i].state == SLOT_DELETED) {
+            if (tombstone == 0) tombstone = &records[i];
+            continue;
+        }
+        if (records[i].dev == key.dev && records[i].ino == key.ino) {
+            if (!replace && SameFile(records[i].birth, key.birth)) return 0;
+            target = &records[i];
+            break;
+        }
+    }
+    //zaznam v tabulce neni, pouzijeme radsi smazany slot, ktery jsme minuli
+    if (tombstone != 0 && (target == 0 || target->state == SLOT_EMPTY)) target = tombstone;
+    if (target == 0) return -1;
+
+    header->seq++; //zacatek zapisu - ctenari budou cekat
+    __sync_synchronize();
+
+    if (target->state == SLOT_DELETED) {
+        header->deleted--;
+        header->used++;
+    } else if (target->state == SLOT_EMPTY) header->used++;
+
+    target->dev           = key.dev;
+    target->ino           = key.ino;
+    target->birth         = key.birth;
+    target->owner         = owner;
+    target->user_rights   = user_rights;
+    target->others_rights = others_rights;
+    target->epoch         = header->epoch;
+    target->state         = SLOT_USED;
+
+    __sync_synchronize();
+    header->seq++; //konec zapisu
+    return 1;
 }
 
 
 
 /** Uklada do databaze informace o souboru.
- * 
+ *
  * K vytvoreni klice pouziva File2Key.
  *
  * Navratove hodnoty:
@@ -215,150 +663,135 @@ int DirectoryDatabase::UnlockDatabase() {
  *      - -1      chyba pri vytvareni klice k souboru
  *      - -2      chyba pri zamykani/odemykani databaze
  *      - -3      chyba pri praci s databazi
+ *      - -4      zmenu se nepodarilo zapsat na disk (jen pri DURABILITY_FULL)
  */
 int DirectoryDatabase::PutFileInfo(FileInfo &file) {
-    string              key;
-    datum               keyd, datad;
-    FileInfoGdbmRecord  file_record; //data, ktera budou ulozena do databaze
-    int                 store_err;
-    int                 open_err;
+    TableKey            key;
+    int                 owner;
     int                 ret;
-    
+
     ret = File2Key(file.name.c_str(), key);
     if (ret != 1) return -1;
-    
-    keyd.dptr   = (char *)key.c_str();
-    keyd.dsize  = key.size();
-    
-    file_record = (FileInfoGdbmRecord) file; //pretypujeme FileInfo na nas zaznam
-    datad.dptr  = (char *)&file_record;
-    datad.dsize = sizeof(struct FileInfoGdbmRecord);
-
-    
+
 #ifdef DD_DEBUG
-    cout << getpid() << " - DD::PutFileInfo ... storing " << file_record.name << " juzra: " << file_record.user_name
-         << " with i-node# " << key << " user_rights = " << file_record.user_rights << " in da dejtabejz" << endl;
+    cout << getpid() << " - DD::PutFileInfo ... storing " << file.name << " juzra: " << file.user_name
+         << " user_rights = " << file.user_rights << " in da dejtabejz" << endl;
 #endif
-    
+
 // --- zacatek KRITICKE SEKCE ---
     if (LockDatabase() != 1) return -2;
 
-    // otevreme databazi pro zapis
-    db_file = gdbm_open((char *)db_name.c_str(), GDBM_BLOCK_SIZE, GDBM_WRITER, S_IRUSR | S_IWUSR, 0);
-    if (db_file == 0) { //nastala chyba
-#ifdef DD_DEBUG
-        cout << getpid() << "DD::PFI open gdbm_errno = " << gdbm_errno << " ... " << gdbm_strerror(gdbm_errno) << endl;
-#endif
-        UnlockDatabase(); 
-        return -3; 
-    }
-    
-    //ulozime data
-    int err = gdbm_store(db_file, keyd, datad, GDBM_REPLACE);
-    if (err != 0) { 
-#ifdef DD_DEBUG
-        cout << getpid() << "DD::PFI store gdbm_errno = " << gdbm_errno << " ... " << gdbm_strerror(gdbm_errno) << endl;
-#endif
-        gdbm_close(db_file); //musime, viz komentar niz
-        UnlockDatabase(); 
-        return -3; 
-    }
-    
-    //databazi zase musime zavrit!!! aby ostatni procesy mohly cist a
-    //zapisovat !!!
-    gdbm_close(db_file);
-    ret = UnlockDatabase();
-    if (ret != 1){ 
-        return -2;
+    //mezitim mohl tabulku prestavit jiny proces
+    if (header->stale && Remap() != 1) {
+        UnlockDatabase();
+        return -3;
     }
+
+    owner = OwnerId(file.user_name);
+    if (owner < 0) ret = -1;
+        else ret = Store(key, file.user_rights, file.others_rights, owner, true);
+
+    if (UnlockDatabase() != 1) return -2;
 // --- konec KRITICKE SEKCE ---
-    
+
+    if (ret < 0) return -3;
+    StatCacheInvalidate(file.name); //vlastnik je soucasti vypisu adresare (viz. listcache.cpp)
+
+    //az po odemknuti, aby se do stejne skupiny vesly i zmeny ostatnich
+    if (GroupCommit(db_name.c_str()) < 0) return -4;
+
 #ifdef DD_DEBUG
     cout << getpid() << " - DD::PutFileInfo ... stored" << endl;
 #endif
-    
+
     return 1;
 }
 
 
 
 /** Ziska z databaze informace o zadanem souboru.
- * 
+ *
+ * Nic nezamyka - zaznam se cte primo z namapovane tabulky a pokud se behem
+ * cteni zmenilo poradove cislo seqlocku, cte se znovu.
+ *
  * Navratove hodnoty:
  *
  *      -  1      vse OK.
  *      - -1      chyba pri vytvareni klice k souboru
- *      - -3      chyba pri praci s databazi
+ *      - -3      soubor v databazi neni (nebo chyba pri praci s databazi)
  *
  */
 int DirectoryDatabase::GetFileInfo(string name, FileInfo &info) {
-    string      key;
-    datum       keyd, datad;
-    int         ret;
-    
-    
-    ret = File2Key(name.c_str(), key);
+    TableKey            key;
+    TableRecord         rec;
+    unsigned int        seq;
+    unsigned int        mask;
+    unsigned int        i, n;
+    bool                found;
+    int                 spins = 0;
+    int                 ret;
+    string              user_name;
+    TraceSpan           span("db GetFileInfo", "db");
+
+    ret = File2Key(name.c_str(), key, true);
     if (ret != 1) return -1;
-    
-    keyd.dptr   = (char *) key.c_str();
-    keyd.dsize  = key.size();
-    
-// --- zacatek KRITICKE SEKCE ---
-    if (LockDatabase() != 1) return -2;
 
-    // otevreme databazi pro cteni
-    db_file = gdbm_open((char *)db_name.c_str(), GDBM_BLOCK_SIZE, GDBM_READER, S_IRUSR | S_IWUSR, 0);
-    if (db_file == 0) { //nastala chyba
-#ifdef DD_DEBUG
-        cout << getpid() << "DD::GFI open gdbm_errno = " << gdbm_errno << " ... " << gdbm_strerror(gdbm_errno) << endl;
-#endif
-        UnlockDatabase(); 
-        return -3; 
+    if (header == 0) return -3;
+
+    while (1) {
+        if (header->stale && Remap() != 1) return -3;
+
+        seq = header->seq;
+        __sync_synchronize();
+
+        if ((seq & 1) == 0) {
+            found = false;
+            mask  = header->slots - 1;
+            for (i = KeyHash(key.dev, key.ino) & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+                rec = records[i];
+                if (rec.state == SLOT_EMPTY) break;
+                if (rec.state == SLOT_USED && rec.dev == key.dev && rec.ino == key.ino) {
+                    //zaznam drivejsiho souboru se stejnym inodem neplati
+                    found = SameFile(rec.birth, key.birth);
+                    break;
+                }
+            }
+            if (found && rec.owner > 0 && rec.owner <= TABLE_MAX_OWNERS)
+                user_name.assign(owners[rec.owner-1].name, strnlen(owners[rec.owner-1].name, MAX_USER_NAME_LEN));
+                else user_name = "";
+
+            __sync_synchronize();
+            if (header->seq == seq) break; //behem cteni se nic nezmenilo
+        }
+
+        //zapisujici proces mohl umrit uprostred zapisu - pokud ziskame
+        //zamek a zapis porad "probiha", uvedeme seqlock do poradku
+        if (++spins >= TABLE_SPIN_LIMIT) {
+            spins = 0;
+            if (LockDatabase() == 1) {
+                if (header->seq & 1) header->seq++;
+                UnlockDatabase();
+            }
+        }
     }
 
-    datad = gdbm_fetch(db_file, keyd);
-    if (datad.dptr == 0) {
+    if (!found) {
 #ifdef DD_DEBUG
-        cout << getpid() << " - soubor " << name << " nebyl v databazi nalezen. ";
-        cout << "gdbm_errno = " << gdbm_errno << " ... " << gdbm_strerror(gdbm_errno) << endl;
+        cout << getpid() << " - soubor " << name << " nebyl v databazi nalezen." << endl;
 #endif
-        gdbm_close(db_file);
-        UnlockDatabase(); 
         return -3;
     }
 
-    //databazi zase musime zavrit!!! aby ostatni procesy mohly cist a
-    //zapisovat !!!
-    gdbm_close(db_file);
-    
-    ret = UnlockDatabase();
-    if (ret != 1){ 
-        return -2;
-    }
-// --- konec KRITICKE SEKCE ---
-    
-    FileInfoGdbmRecord record;
-    memcpy(&record, datad.dptr, datad.dsize);
-    //cout << "get file info: free(datad.dptr)" << endl;
-    free(datad.dptr); // nutne uvolnit misto na ktere ukazuje datad.dptr --> gdbm to samo neudela!!!
+    info.user_rights   = rec.user_rights;
+    info.others_rights = rec.others_rights;
+    info.user_name     = user_name;
+    info.name          = name;
 
-#ifdef DD_DEBUG
-    cout << getpid() << " - GetFileInfo: ke klici " << key << "jsme dostali informace o " << record.name << endl;
-#endif
-    
-    FileInfo result;
-    result = record;
-   
-    info = result;
-    
     return 1;
 }
 
 
 /** Maze z databaze informace o souboru.
- *
- * Presahne-li pocet smazanych polozek MAX_DELETED_ITEMS, reorganizuje
- * databazi.
  *
  * Navratove hodnoty:
  *
@@ -366,224 +799,939 @@ int DirectoryDatabase::GetFileInfo(string name, FileInfo &info) {
  *      - -1      chyba pri vytvareni klice k souboru
  *      - -2      chyba pri zamykani/odemykani databaze
  *      - -3      chyba pri praci s databazi
+ *      - -4      zmenu se nepodarilo zapsat na disk (jen pri DURABILITY_FULL)
  *
  */
 int DirectoryDatabase::DeleteFileInfo(string &name) {
-    string      key;
-    datum       keyd, datad;
-    int         ret;
+    TableKey        key;
+    TableRecord   * r;
+    int             ret;
 
     ret = File2Key(name.c_str(), key);
     if (ret != 1) return -1;
-    
-    keyd.dptr   = (char *) key.c_str();
-    keyd.dsize  = key.size();
 
 // --- zacatek KRITICKE SEKCE ---
-    if (LockDatabase() != 1) return -2; 
+    if (LockDatabase() != 1) return -2;
 
-    // otevreme databazi pro zapis
-    db_file = gdbm_open((char *)db_name.c_str(), GDBM_BLOCK_SIZE, GDBM_WRITER, S_IRUSR | S_IWUSR, 0);
-    if (db_file == 0) { 
-#ifdef DD_DEBUG
-        cout << getpid() << "DD::DFI open gdbm_errno = " << gdbm_errno << " ... " << gdbm_strerror(gdbm_errno) << endl;
-#endif
-        UnlockDatabase(); 
-        return -3; 
+    if (header->stale && Remap() != 1) {
+        UnlockDatabase();
+        return -3;
     }
-    
 
-    if (gdbm_delete(db_file, keyd) != 0) {
+    r = Find(key);
+    if (r == 0) {
 #ifdef DD_DEBUG
         cout << getpid() << " - Informace o souboru " << name << " nelze z databaze odstranit." << endl;
 #endif
-        gdbm_close(db_file);
         UnlockDatabase();
         return -3;
-    } else {
-        
-        num_of_deleted_items++; 
-        if (num_of_deleted_items >= MAX_DELETED_ITEMS) {
-            // gdbm samo nezmensi velikost souboru databaze, je potreba ho
-            // donutit pomoci gdbm_reorganize(), ktere by se nemelo volat moc
-            // casto
-            if (gdbm_reorganize(db_file) != 0) {
-#ifdef DD_DEBUG
-                cout << getpid() << " - Nejspis se nepovedla reorganizace databaze ..." << endl;
-#endif
-            }
-        
-        }
-        
-    }//else
-    
-    gdbm_close(db_file);
+    }
+
+    Remove(r);
+
     if (UnlockDatabase() != 1) return -2;
 // --- konec KRITICKE SEKCE ---
+    StatCacheInvalidate(name);
+
+    if (GroupCommit(db_name.c_str()) < 0) return -4;
 
     return 1;
 }
 
 
-
-/** Nahraje do databaze soubory ze zadaneho adresare.
- * Pokud uz v databazi nektery ze souboru je, nebude prepsan.
+/** Prejmenuje soubor from na to, ulozi zaznam souboru (vlastnik a prava
+ * z file) a smaze zaznam souboru, ktery tim zanikne.
+ *
+ * Zaznamy jsou klicovane inodem, takze by zaznam nahrazeneho souboru v
+ * databazi zustal (a dostal by ho pozdeji soubor, ktery by jeho inode
+ * zdedil). Zaznam noveho souboru se ulozi jeste pred prejmenovanim a vse
+ * probehne pod zamkem databaze - soubor pod jmenem to tak nikdo neuvidi bez
+ * zaznamu (s vychozimi pravy) a zadny jiny proces mezitim zaznam
+ * nahrazeneho souboru nepouzije. Zaznam se nemaze, pokud ma nahrazovany
+ * soubor jeste jine jmeno (pevny odkaz), nebo pokud je to symbolicky odkaz
+ * (prejmenovanim zanikne jen odkaz).
  *
  * Navratove hodnoty:
  *
  *      -  1      vse OK.
- *      - -1      chyba pri vytvareni klice k souboru
- *      - -2      chyba pri zamykani/odemykani databaze
- *      - -3      chyba pri praci s databazi
- *      - -5      chyba pri otvirani adresare
- * 
+ *      - -1      soubor se nepodarilo prejmenovat (errno)
+ *      - -2      chyba pri zamykani databaze, soubor neni prejmenovany
+ *      - -3      zaznam se nepodarilo ulozit, soubor neni prejmenovany
+ *      - -4      soubor je prejmenovany, ale zmenu databaze se nepodarilo
+ *                zapsat na disk (jen pri DURABILITY_FULL)
+ *
  */
-int DirectoryDatabase::LoadSubDir(string &name) {
-    DIR                 *dir;
-    struct dirent       *entry;
-    int                 ret;
-    
-    if ((dir = opendir(name.c_str()) ) == 0) {
-       // string msg;
-       // msg = "Adresar " + name + " nebylo mozne otevrit.";
-        return -5;
-    }
-    
-    string              tmp;
-    string              key;
-    datum               keyd, datad;
-    FileInfoGdbmRecord  file_record; //data, ktera budou ulozena do databaze
-    
+int DirectoryDatabase::ReplaceFile(const string &from, const string &to, FileInfo &file) {
+    TableKey        key;
+    TableKey        new_key;
+    TableRecord   * r = 0;
+    struct stat     st;
+    bool            replaced;
+    int             owner;
+    int             ret;
+
+    if (File2Key(from.c_str(), new_key) != 1) return -3;
+    replaced = (lstat(to.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink == 1
+                && File2Key(to.c_str(), key) == 1);
+
 // --- zacatek KRITICKE SEKCE ---
-    if (LockDatabase() != 1) return -2; 
-    gdbm_close(db_file);
-    // otevreme databazi pro zapis
-    db_file = gdbm_open((char *)db_name.c_str(), GDBM_BLOCK_SIZE, GDBM_WRITER, S_IRUSR | S_IWUSR, 0);
-    if (db_file == 0) { UnlockDatabase(); return -3; }
+    if (LockDatabase() != 1) return -2;
+
+    //mezitim mohl tabulku prestavit jiny proces
+    if (header->stale && Remap() != 1) {
+        UnlockDatabase();
+        return -3;
+    }
+
+    owner = OwnerId(file.user_name);
+    if (owner < 0 || Store(new_key, file.user_rights, file.others_rights, owner, true) < 0) {
+        UnlockDatabase();
+        return -3;
+    }
+
+    ret = rename(from.c_str(), to.c_str());
+    if (ret == -1) {
+        //docasny soubor se smaze, jeho zaznam by zustal
+        r = Find(new_key);
+    } else if (replaced) r = Find(key);
+    if (r != 0) Remove(r);
+
+    UnlockDatabase();
+// --- konec KRITICKE SEKCE ---
+    if (ret == -1) return -1;
+    StatCacheInvalidate(to);
+
+    if (GroupCommit(db_name.c_str()) < 0) return -4;
+
+    return 1;
+}
+
+
+
+/** Precte adresar path a ke kazde jeho polozce vytvori zaznam s vychozimi
+ * pravy (R_ALL, R_ALL, bez vlastnika).
+ *
+ * Polozky se stat()uji pres statx() relativne k otevrenemu adresari, takze
+ * jadro nemusi pro kazdou znovu prochazet celou cestu. Stejne jako
+ * File2Key() se nasleduji symbolicke odkazy. Pokud subdirs neni 0, ulozi do
+ * nej cesty k podadresarum (jen skutecnym, ne k odkazum na adresare, ktere
+ * by mohly vest do smycky). Odkazy na adresare ulozi do links, pokud neni 0.
+ * Polozka, ktera mezi readdir() a statx() zmizela (nebo odkaz, ktery nikam
+ * nevede), se za chybu nepocita.
+ *
+ * Vrati pocet nalezenych polozek, nebo -1, pokud adresar nelze otevrit.
+ */
+static int ScanDir(const string &path, bool ignore_hidden, vector<TableRecord> &found,
+                   vector<string> * subdirs, unsigned long long &errors, vector<string> * links = 0) {
+    int             fd;
+    DIR           * dir;
+    struct dirent * entry;
+    struct statx    stx;
+    TableRecord     rec;
+    string          sub;
+    int             type;
+    int             n = 0;
+
+    fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd == -1) return -1;
+    dir = fdopendir(fd);
+    if (dir == 0) {
+        close(fd);
+        return -1;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.state         = SLOT_USED;
+    rec.user_rights   = R_ALL;
+    rec.others_rights = R_ALL;
 
     while ((entry = readdir(dir)) != 0) {
-        tmp = entry->d_name;
-        if (tmp == "." || tmp == "..") continue;
-        if (tmp.substr(0,1) == "." && ignore_hidden) continue;
-    
-        ret = File2Key(tmp.c_str(), key);
-        if (ret != 1) return -1;
-        keyd.dptr   = (char *)key.c_str();
-        keyd.dsize  = key.size();
-    
-        file_record.user_name[0] = 0;
-        strncpy(file_record.name, tmp.c_str(), MAX_FILE_NAME_LEN);
-        file_record.name[MAX_FILE_NAME_LEN-1] = 0;// pro jistotu, kdyby byl nazev souboru moc dlouhy
-        file_record.user_rights   = R_ALL;
-        file_record.others_rights = R_ALL;
-        
-        datad.dptr  = (char *)&file_record;
-        datad.dsize = sizeof(struct FileInfoGdbmRecord);
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (entry->d_name[0] == '.' && ignore_hidden) continue;
 
+        if (statx(fd, entry->d_name, 0, STATX_TYPE | STATX_INO | STATX_BTIME, &stx) == -1) {
+            if (errno != ENOENT) errors++;
+            continue;
+        }
+        rec.dev   = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        rec.ino   = stx.stx_ino;
+        rec.birth = Birth(stx);
+        found.push_back(rec);
+        n++;
+
+        if ((subdirs != 0 || links != 0) && S_ISDIR(stx.stx_mode)) {
+            type = entry->d_type;
+            if (type == DT_UNKNOWN && statx(fd, entry->d_name, AT_SYMLINK_NOFOLLOW, STATX_TYPE, &stx) == 0) {
+                if (S_ISDIR(stx.stx_mode)) type = DT_DIR;
+                if (S_ISLNK(stx.stx_mode)) type = DT_LNK;
+            }
+            sub = (path == "/") ? string("/") + entry->d_name : path + "/" + entry->d_name;
+            if (type == DT_DIR && subdirs != 0) subdirs->push_back(sub);
+            if (type == DT_LNK && links != 0) links->push_back(sub);
+        }
+    }
+    closedir(dir);
+    return n;
+}
+
+
+
+/** Ulozi zaznam rec do tabulky r o mask+1 slotech (mimo namapovanou
+ * databazi - pouziva se pri stavbe nove tabulky).
+ *
+ * Existujici zaznam se stejnym klicem prepise, jen pokud je replace true
+ * a jde o tentyz soubor - jinak plati zaznam, ktery uz v tabulce je (ten je
+ * z cerstveho pruchodu adresaru). Vrati 1, pokud pribyl novy zaznam, jinak 0.
+ */
+static int TablePut(TableRecord * r, unsigned int mask, TableRecord &rec, bool replace) {
+    unsigned long long  birth;
+    unsigned int        i;
+
+    for (i = KeyHash(rec.dev, rec.ino) & mask; r[i].state != SLOT_EMPTY; i = (i + 1) & mask)
+        if (r[i].dev == rec.dev && r[i].ino == rec.ino) {
+            if (replace && SameFile(r[i].birth, rec.birth)) {
+                birth = r[i].birth ? r[i].birth : rec.birth;
+                r[i]  = rec;
+                r[i].birth = birth;
+            }
+            return 0;
+        }
+    r[i] = rec;
+    return 1;
+}
+
+
+
+/** Porovnava zaznamy podle jejich domovskeho slotu v tabulce o mask+1
+ * slotech (a pak podle klice, aby stejne klice byly vedle sebe).
+ *
+ */
+struct HomeSlotLess {
+    unsigned int mask;
+
+    HomeSlotLess(unsigned int m) : mask(m) {}
+    bool operator()(const TableRecord &a, const TableRecord &b) const {
+        unsigned int ha = KeyHash(a.dev, a.ino) & mask;
+        unsigned int hb = KeyHash(b.dev, b.ino) & mask;
+
+        if (ha != hb) return ha < hb;
+        if (a.dev != b.dev) return a.dev < b.dev;
+        return a.ino < b.ino;
+    }
+};
+
+
+
+/** Nahraje do databaze soubory ze zadaneho adresare.
+ * Pokud uz v databazi nektery ze souboru je, nebude prepsan.
+ *
+ * Adresar se precte (viz. ScanDir()) jeste pred zamknutim databaze, zamcena
+ * je jen po dobu ukladani zaznamu. Na cele stromy adresaru je urcena
+ * BulkLoad().
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK.
+ *      - -1      nektere soubory nebylo mozne stat()nout (ostatni se ulozily)
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *      - -5      chyba pri otvirani adresare
+ *
+ */
+int DirectoryDatabase::LoadSubDir(string &name) {
+    vector<TableRecord> found;
+    TableKey            key;
+    unsigned long long  errors = 0;
+    unsigned int        i;
+    int                 ret = 1;
+
+    if (ScanDir(name, ignore_hidden, found, 0, errors) < 0) return -5;
+    if (errors > 0) ret = -1;
+    if (found.empty()) return ret;
+
+    //zaznamy se budou ukladat postupne od zacatku tabulky do konce
+    sort(found.begin(), found.end(), HomeSlotLess(header->slots - 1));
+    memset(&key, 0, sizeof(key));
+
+// --- zacatek KRITICKE SEKCE ---
+    if (LockDatabase() != 1) return -2;
+
+    if (header->stale && Remap() != 1) ret = -3;
+
+    for (i = 0; ret != -3 && i < found.size(); i++) {
+        key.dev   = found[i].dev;
+        key.ino   = found[i].ino;
+        key.birth = found[i].birth;
 
-#ifdef DD_DEBUG
-        cout << getpid() << " - LoadSubDir ... storing " << file_record.name << " juzra: " << file_record.user_name 
-            << " with i-node# " << key << " rights = " << file_record.user_rights << " in da dejtabejz" << endl;
-#endif
-    
-        int err = gdbm_store(db_file, keyd, datad, GDBM_INSERT);
-        if (err != 0 && gdbm_errno != GDBM_CANNOT_REPLACE) return -3;
         // pokud bychom prepsali data v databazi, mohli bychom prijit o
-        // spravne udaje o pravech a juzrovi, proto store s GDBM_INSERT
-        // pokud uz zaznam existuje hodi, hodi chybu GDBM_CANNOT_REPLACE,
-        // definice kodu chyb je v /usr/inlcude/gdbm/gdbm.h
-    } //while
-    
-    gdbm_close(db_file);
+        // spravne udaje o pravech a juzrovi, proto replace = false
+        if (Store(key, R_ALL, R_ALL, 0, false) < 0) ret = -3;
+    }
+
     if (UnlockDatabase() != 1) return -2;
 // --- konec KRITICKE SEKCE ---
-    
-    //otevreme databazi zpet pro cteni
-    db_file = gdbm_open((char *)db_name.c_str(), GDBM_BLOCK_SIZE, GDBM_READER, S_IRUSR | S_IWUSR, 0);
-    if (db_file == 0)  { UnlockDatabase(); return -3; }
-    return 1;
+
+    return ret;
 }
 
 
-/** Pomocna funkce, vytiskne obsah databaze na stdout.
+
+struct BulkShared;
+
+/** Jedno vlakno hromadneho nahravani.
  *
+ * Kazde vlakno ma vlastni frontu adresaru. Nove nalezene podadresare si
+ * pridava na jeji konec a odtud je i bere (do hloubky, adresare jsou tak
+ * jeste v cache). Kdyz mu fronta dojde, ukradne adresar ze zacatku fronty
+ * jineho vlakna - tam jsou adresare bliz koreni, ktere slibuji nejvic prace.
  */
-void DirectoryDatabase::PrintContent() {
-    datum keyd;
-    datum nextkeyd;
-    datum datad;
-    FileInfoGdbmRecord record;
-    
-    keyd = gdbm_firstkey(db_file);
-    while (keyd.dptr) {
-        datad = gdbm_fetch(db_file, keyd);
-        if (datad.dptr == 0) {
-#ifdef DD_DEBUG
-            cout << getpid() << " - soubor nebyl v databazi nalezen. ";
-            cout << "gdbm_errno = " << gdbm_errno << " ... " << gdbm_strerror(gdbm_errno) << endl;
-#endif
+struct BulkWorker {
+    pthread_mutex_t     lock;
+    deque<string>       dirs;      ///< adresare, ktere cekaji na precteni
+    vector<TableRecord> found;     ///< zaznamy nalezenych souboru
+    unsigned long long  dirs_read;
+    unsigned long long  errors;
+    pthread_t           thread;
+    bool                started;
+    int                 id;
+    BulkShared        * shared;
+};
+
+
+/** Stav sdileny vsemi vlakny hromadneho nahravani.
+ *
+ */
+struct BulkShared {
+    BulkWorker        * workers;
+    int                 count;
+    volatile long       pending; ///< adresare ve frontach a prave ctene - az klesne na 0, je hotovo
+    bool                recursive;
+    bool                ignore_hidden;
+};
+
+
+/** Hlavni funkce vlakna hromadneho nahravani.
+ *
+ */
+static void * BulkWorkerMain(void * arg) {
+    BulkWorker    * w = (BulkWorker *)arg;
+    BulkShared    * s = w->shared;
+    BulkWorker    * v;
+    vector<string>  subdirs;
+    string          dir;
+    bool            have;
+    unsigned int    i;
+    int             k;
+
+    while (1) {
+        have = false;
+        pthread_mutex_lock(&w->lock);
+        if (!w->dirs.empty()) {
+            dir = w->dirs.back();
+            w->dirs.pop_back();
+            have = true;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        for (k = 1; !have && k < s->count; k++) {
+            v = &s->workers[(w->id + k) % s->count];
+            pthread_mutex_lock(&v->lock);
+            if (!v->dirs.empty()) {
+                dir = v->dirs.front();
+                v->dirs.pop_front();
+                have = true;
+            }
+            pthread_mutex_unlock(&v->lock);
+        }
+
+        if (!have) {
+            if (s->pending == 0) break; //nikdo uz nic necte, novou praci nikdo neprida
+            sched_yield();
+            continue;
         }
-        
-        nextkeyd = gdbm_nextkey(db_file, keyd);
-        memcpy(&record, datad.dptr, datad.dsize);
-        free(datad.dptr); // nutne uvolnit misto na ktere ukazuje datad.dptr --> gdbm to samo neudela!!!
+
+        subdirs.clear();
+        if (ScanDir(dir, s->ignore_hidden, w->found, s->recursive ? &subdirs : 0, w->errors) < 0) w->errors++;
+            else w->dirs_read++;
+
+        if (!subdirs.empty()) {
+            __sync_fetch_and_add(&s->pending, (long)subdirs.size());
+            pthread_mutex_lock(&w->lock);
+            for (i = 0; i < subdirs.size(); i++) w->dirs.push_back(subdirs[i]);
+            pthread_mutex_unlock(&w->lock);
+        }
+        __sync_fetch_and_sub(&s->pending, 1);
+    }
+    return 0;
+}
+
+
+
+/** Hromadne nahraje do databaze soubory z adresaru roots (a pri recursive
+ * i ze vsech jejich podadresaru).
+ *
+ * Adresare prochazi threads vlaken (viz. BulkWorker), nalezene zaznamy se
+ * seradi podle domovskeho slotu a nova tabulka se postavi bokem v souboru
+ * db_name.bulk - databaze pritom neni zamcena. Zamkne se az nakonec, kdyz
+ * se do nove tabulky prenesou vsechny zaznamy puvodni tabulky (ty maji
+ * prednost, stejne jako v LoadSubDir()) a nova tabulka nahradi puvodni
+ * (stejne jako pri Rebuild()).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK.
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *      - -5      zadny z adresaru roots nelze otevrit
+ *
+ */
+int DirectoryDatabase::BulkLoad(vector<string> &roots, bool recursive, int threads, BulkLoadStats &stats) {
+    BulkShared          shared;
+    BulkWorker        * workers;
+    vector<TableRecord> all;
+    struct timespec     start, end;
+    string              tmp_name;
+    TableHeader       * h;
+    TableRecord       * r;
+    void              * p;
+    unsigned long long  total;
+    unsigned int        slots;
+    unsigned int        unique;
+    unsigned int        i;
+    int                 fd;
+    int                 k;
+    int                 ret;
+
+    memset(&stats, 0, sizeof(stats));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (header == 0) return -3;
+    if (roots.empty()) return -5;
+
+    if (threads < 1) threads = 1;
+    if (threads > BULK_MAX_THREADS) threads = BULK_MAX_THREADS;
+
+    // --- pruchod adresaru ---
+    workers = new BulkWorker[threads];
+    shared.workers       = workers;
+    shared.count         = threads;
+    shared.pending       = roots.size();
+    shared.recursive     = recursive;
+    shared.ignore_hidden = ignore_hidden;
+    for (k = 0; k < threads; k++) {
+        pthread_mutex_init(&workers[k].lock, 0);
+        workers[k].dirs_read = 0;
+        workers[k].errors    = 0;
+        workers[k].started   = false;
+        workers[k].id        = k;
+        workers[k].shared    = &shared;
+    }
+    for (i = 0; i < roots.size(); i++) workers[i % threads].dirs.push_back(roots[i]);
+
+    //vlakno 0 je to volajici, pokud se nektere vlakno nepodari spustit,
+    //jeho frontu vykradou ostatni
+    for (k = 1; k < threads; k++)
+        workers[k].started = (pthread_create(&workers[k].thread, 0, BulkWorkerMain, &workers[k]) == 0);
+    BulkWorkerMain(&workers[0]);
+
+    total = 0;
+    for (k = 0; k < threads; k++) {
+        if (workers[k].started) pthread_join(workers[k].thread, 0);
+        total        += workers[k].found.size();
+        stats.dirs   += workers[k].dirs_read;
+        stats.errors += workers[k].errors;
+    }
+    stats.files = total;
+
+    all.reserve(total);
+    for (k = 0; k < threads; k++) {
+        all.insert(all.end(), workers[k].found.begin(), workers[k].found.end());
+        vector<TableRecord>().swap(workers[k].found);
+        pthread_mutex_destroy(&workers[k].lock);
+    }
+    delete [] workers;
+
+    if (stats.dirs == 0) return -5;
+
+    // --- stavba nove tabulky ---
+    tmp_name = db_name + ".bulk";
+    slots    = TABLE_MIN_SLOTS;
+    while (1) {
+        //stejne jako v Store(): nova tabulka bude zaplnena nanejvys z poloviny TABLE_MAX_LOAD
+        while ((total + header->used + 1) * 200 > (unsigned long long)slots * TABLE_MAX_LOAD) slots *= 2;
+
+        fd = TableCreate(tmp_name.c_str(), slots);
+        if (fd == -1) return -3;
+        p = mmap(0, TableSize(slots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            unlink(tmp_name.c_str());
+            return -3;
+        }
+        h = (TableHeader *)p;
+        r = (TableRecord *)((char *)p + RecordsOffset());
+
+        //vsechny nalezene soubory jsou v aktualnim pruchodu kontroly videt
+        for (i = 0; i < all.size(); i++) all[i].epoch = header->epoch;
+
+        //serazene podle domovskeho slotu se zaznamy zapisuji do tabulky
+        //postupne od zacatku do konce a stejne klice (hard linky) jsou vedle sebe
+        sort(all.begin(), all.end(), HomeSlotLess(slots - 1));
+        unique = 0;
+        for (i = 0; i < all.size(); i++) unique += TablePut(r, slots - 1, all[i], false);
+
+// --- zacatek KRITICKE SEKCE ---
+        if (LockDatabase() != 1) {
+            munmap(p, TableSize(slots));
+            close(fd);
+            unlink(tmp_name.c_str());
+            return -2;
+        }
+        if (header->stale && Remap() != 1) ret = -3;
+            else ret = 1;
+
+        //behem pruchodu mohla puvodni tabulka narust natolik, ze by se do
+        //nove nevesla - postavime ji znovu vetsi
+        if (ret == 1 && (unsigned long long)(unique + header->used + 1) * 100 > (unsigned long long)slots * TABLE_MAX_LOAD) {
+            UnlockDatabase();
+            munmap(p, TableSize(slots));
+            close(fd);
+            slots *= 2;
+            continue;
+        }
+        break;
+    }
+
+    if (ret == 1) {
+        h->used = unique;
+        for (i = 0; i < header->slots; i++)
+            if (records[i].state == SLOT_USED) h->used += TablePut(r, slots - 1, records[i], true);
+        memcpy((char *)p + OwnersOffset(), owners, TABLE_MAX_OWNERS * sizeof(TableOwner));
+        h->owners    = header->owners;
+        h->reclaimed = header->reclaimed;
+        h->epoch     = header->epoch;
+        h->moved     = header->moved;
+
+        if (msync(p, TableSize(slots), MS_SYNC) == -1 || fdatasync(fd) == -1
+                || rename(tmp_name.c_str(), db_name.c_str()) == -1) ret = -3;
+    }
+    stats.records = h->used;
+    munmap(p, TableSize(slots));
+    close(fd);
+
+    if (ret == 1) {
+        header->stale = 1;
+        if (Remap() != 1) ret = -3;
+    } else unlink(tmp_name.c_str());
+
+    if (UnlockDatabase() != 1) return -2;
+// --- konec KRITICKE SEKCE ---
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
 #ifdef DD_DEBUG
-        cout << record.name << " user = " << record.user_name << " user_rights = " << record.user_rights << endl;
+    cout << getpid() << " - BulkLoad: " << stats.files << " souboru, " << stats.records << " zaznamu, "
+         << stats.seconds << " s" << endl;
 #endif
-        free(keyd.dptr);
-        keyd = nextkeyd;
+
+    return ret;
+}
+
+
+
+/** Zahaji novy pruchod kontroly zaznamu.
+ *
+ * Kontrola zaznamu projde vsechny sdilene adresare (viz. ReconcileDir()) a
+ * u kazdeho zaznamu, jehoz soubor najde, si poznamena cislo pruchodu. Na
+ * konci pruchodu ReconcilePurge() smaze zaznamy, ktere cislo aktualniho
+ * pruchodu nemaji - jejich soubory uz neexistuji. Nove ulozene zaznamy
+ * dostavaji cislo aktualniho pruchodu rovnou.
+ *
+ * Vrati cislo noveho pruchodu, nebo -2 (chyba pri zamykani) ci -3 (chyba
+ * pri praci s databazi).
+ */
+int DirectoryDatabase::ReconcileBegin() {
+    int     ret;
+
+    if (header == 0) return -3;
+    if (LockDatabase() != 1) return -2;
+
+    if (header->stale && Remap() != 1) ret = -3;
+    else {
+        header->epoch = (header->epoch + 1) & 0xFF; //v zaznamu je na cislo pruchodu jeden byte
+        header->moved = 0;
+        ret = header->epoch;
     }
+
+    if (UnlockDatabase() != 1) return -2;
+    return ret;
 }
 
 
-/* ------------------------- class FileInfo -------------------------------- */
 
-/** Copy constructor.
+/** Zkontroluje zaznamy souboru v adresari path (a samotneho adresare).
+ *
+ * Zaznam, jehoz inode mezitim dostal jiny soubor (lisi se cas vzniku), se
+ * smaze, zaznamu bez casu vzniku (z tabulky starsi verze) se cas vzniku
+ * doplni. Ostatnim zaznamum se poznamena cislo aktualniho pruchodu. Adresar
+ * se cte pred zamknutim databaze, vcetne skrytych souboru. Do subdirs se
+ * pridaji podadresare, ktere je treba zkontrolovat, do links symbolicke
+ * odkazy na adresare (ty se samy neprochazeji, viz. ScanDir()).
+ *
+ * Navratove hodnoty:
+ *
+ *      - >=0     pocet zkontrolovanych souboru
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *      - -4      zmenu se nepodarilo zapsat na disk (jen pri DURABILITY_FULL)
+ *      - -5      chyba pri otvirani adresare
+ *      - -6      adresar uz neexistuje
+ *
  */
-FileInfo::FileInfo(const FileInfo &x) {
-    this->user_name     = x.user_name;
-    this->name          = x.name;
-    this->user_rights   = x.user_rights;
-    this->others_rights = x.others_rights;
+int DirectoryDatabase::ReconcileDir(const string &path, vector<string> &subdirs, vector<string> &links, ReconcileStats &stats) {
+    vector<TableRecord> found;
+    TableRecord       * r;
+    TableKey            key;
+    struct stat         st;
+    unsigned long long  changed = 0;
+    unsigned int        i;
+    int                 ret = 1;
+
+    if (header == 0) return -3;
+
+    if (File2Key(path.c_str(), key) == 1) {
+        found.resize(1);
+        found[0].dev   = key.dev;
+        found[0].ino   = key.ino;
+        found[0].birth = key.birth;
+    }
+    if (ScanDir(path, false, found, &subdirs, stats.errors, &links) < 0) {
+        //smazany adresar - jeho zaznamy opravdu nikdo nepotrebuje
+        if (errno == ENOENT && lstat(path.c_str(), &st) == -1 && errno == ENOENT) return -6;
+        stats.errors++;
+        return -5;
+    }
+    stats.dirs++;
+    stats.entries += found.size();
+
+// --- zacatek KRITICKE SEKCE ---
+    if (LockDatabase() != 1) return -2;
+
+    if (header->stale && Remap() != 1) ret = -3;
+
+    for (i = 0; ret == 1 && i < found.size(); i++) {
+        key.dev   = found[i].dev;
+        key.ino   = found[i].ino;
+        key.birth = found[i].birth;
+
+        r = Find(key);
+        if (r == 0) continue; //soubor nema zaznam, plati pro nej vychozi prava
+
+        if (!SameFile(r->birth, key.birth)) {
+            Remove(r);
+            stats.purged++;
+            changed++;
+            continue;
+        }
+        if (r->birth == 0 && key.birth != 0) {
+            header->seq++;
+            __sync_synchronize();
+            r->birth = key.birth;
+            __sync_synchronize();
+            header->seq++;
+            stats.repaired++;
+            changed++;
+        }
+        r->epoch = header->epoch;
+    }
+
+    if (UnlockDatabase() != 1) return -2;
+// --- konec KRITICKE SEKCE ---
+
+    if (ret < 0) return ret;
+    if (changed > 0 && GroupCommit(db_name.c_str()) < 0) return -4;
+    return found.size();
+}
+
+
+
+/** Provede jeden krok mazani zaznamu, ktere v aktualnim pruchodu kontroly
+ * nikdo nevidel (viz. ReconcileBegin()).
+ *
+ * Projde nanejvys max_slots slotu od pozice pos, kterou posune. Stejne jako
+ * Compact() na klienty neceka - pokud databazi prave zamyka jiny proces,
+ * krok se neprovede. Pokud se behem pruchodu prejmenoval adresar (viz.
+ * DirMoved()), pruchod jeho soubory mohl minout a nemaze se nic.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      tabulka je prosla cela, pruchod kontroly skoncil
+ *      -  0      je treba pokracovat dalsim krokem
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *      - -4      zmenu se nepodarilo zapsat na disk (jen pri DURABILITY_FULL)
+ *      - -5      behem pruchodu se prejmenoval adresar
+ *
+ */
+int DirectoryDatabase::ReconcilePurge(unsigned int max_slots, unsigned int &pos, ReconcileStats &stats) {
+    unsigned int    n;
+    int             removed = 0;
+    int             ret;
+
+    if (header == 0) return -3;
+
+// --- zacatek KRITICKE SEKCE ---
+    ret = LockDatabase(false);
+    if (ret == 0) return 0;
+    if (ret != 1) return -2;
+
+    if (header->stale && Remap() != 1) {
+        UnlockDatabase();
+        return -3;
+    }
+    if (header->moved) {
+        UnlockDatabase();
+        return -5;
+    }
+
+    for (n = 0; n < max_slots && pos < header->slots; n++, pos++)
+        if (records[pos].state == SLOT_USED && records[pos].epoch != (unsigned char)header->epoch) {
+            Remove(&records[pos]);
+            removed++;
+        }
+    ret = (pos >= header->slots) ? 1 : 0;
+
+    //smazane zaznamy mohly byt posledni, ktere na nejake jmeno odkazovaly
+    if (ret == 1) ReclaimOwners();
+
+    if (UnlockDatabase() != 1) return -2;
+// --- konec KRITICKE SEKCE ---
+
+    stats.orphans += removed;
+    if (removed > 0 && GroupCommit(db_name.c_str()) < 0) return -4;
+    return ret;
+}
+
+
+
+/** Poznamena, ze se prejmenoval adresar.
+ *
+ * Cesty ke vsem souborum pod nim se zmenily - pokud ho kontrola zaznamu
+ * jeste neprosla pod starym jmenem, nemusi ho uz najit ani pod novym. Az do
+ * zacatku dalsiho pruchodu (viz. ReconcileBegin()) proto ReconcilePurge()
+ * nic nesmaze.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK.
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *
+ */
+int DirectoryDatabase::DirMoved() {
+    int     ret = 1;
+
+    if (header == 0) return -3;
+    if (LockDatabase() != 1) return -2;
+
+    if (header->stale && Remap() != 1) ret = -3;
+        else header->moved = 1;
+
+    if (UnlockDatabase() != 1) return -2;
+    return ret;
+}
+
+
+
+/** Poznamena u zaznamu souboru path, ze ho aktualni pruchod kontroly videl.
+ *
+ * Vola ho proces sledovani zmen pro soubor, ktery se v nekterem sdilenem
+ * adresari objevil (presunem nebo novym pevnym odkazem) - mohl prijit z
+ * adresare, ktery pruchod jeste neprosel, do uz prosleho, a ReconcilePurge()
+ * by pak jeho zaznam smazala.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK (i kdyz soubor zaznam nema nebo uz neexistuje)
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *
+ */
+int DirectoryDatabase::ReconcileSeen(const string &path) {
+    TableRecord   * r;
+    TableKey        key;
+    int             ret = 1;
+
+    if (header == 0) return -3;
+    if (File2Key(path.c_str(), key) != 1) return 1;
+
+// --- zacatek KRITICKE SEKCE ---
+    if (LockDatabase() != 1) return -2;
+
+    if (header->stale && Remap() != 1) ret = -3;
+    else {
+        r = Find(key);
+        if (r != 0 && SameFile(r->birth, key.birth)) r->epoch = header->epoch;
+    }
+
+    if (UnlockDatabase() != 1) return -2;
+// --- konec KRITICKE SEKCE ---
+
+    return ret;
 }
 
 
 
-/** Umozni FileInfu operatorem = priradit FileInfoGdbmRecord.
+/** Vlozi zaznam rec do prvniho prazdneho slotu od jeho domovske pozice.
+ *
+ * Pouziva se jen pri uklidu (viz. CompactCluster()), kde je jiste, ze zaznam
+ * v tabulce neni a prazdny slot se najde. Databaze musi byt zamcena a zapis
+ * musi byt uvnitr seqlocku.
  */
-FileInfo& FileInfo::operator=(FileInfoGdbmRecord &x) {
-    user_rights         = x.user_rights;
-    others_rights       = x.others_rights;
-    user_name           = x.user_name;
-    name                = x.name;
-    
-    return *this; //aby slo operator = retezit za sebe, viz str. 144 KKP
+void DirectoryDatabase::Insert(TableRecord &rec) {
+    unsigned int    mask = header->slots - 1;
+    unsigned int    i;
+
+    for (i = KeyHash(rec.dev, rec.ino) & mask; records[i].state != SLOT_EMPTY; i = (i + 1) & mask);
+    records[i] = rec;
 }
 
 
 
+/** Uklidi shluk (souvisly usek neprazdnych slotu), ve kterem lezi slot pos.
+ *
+ * Platne zaznamy shluku se vyjmou, cely shluk se vyprazdni a zaznamy se do
+ * nej vlozi znovu - smazane sloty tim zmizi a zaznamy se pripadne posunou
+ * blize ke sve domovske pozici. Zaznam se pri linearnim hledani nikdy
+ * nedostane za prazdny slot, takze novy shluk nepresahne puvodni.
+ * Databaze musi byt zamcena.
+ *
+ * Vrati pocet uvolnenych smazanych slotu.
+ */
+int DirectoryDatabase::CompactCluster(unsigned int pos) {
+    vector<TableRecord> keep;
+    unsigned int        mask = header->slots - 1;
+    unsigned int        start, len, i;
+    int                 tombstones = 0;
+
+    //zacatek shluku - za prvnim prazdnym slotem pred pos
+    for (start = pos, len = 0; records[(start - 1) & mask].state != SLOT_EMPTY; start = (start - 1) & mask)
+        if (++len > mask) return 0; //tabulka bez prazdneho slotu (nemelo by nastat)
+
+    for (len = 0; records[(start + len) & mask].state != SLOT_EMPTY; len++) {
+        if (len > mask) return 0;
+        if (records[(start + len) & mask].state == SLOT_USED) keep.push_back(records[(start + len) & mask]);
+            else tombstones++;
+    }
+    if (tombstones == 0) return 0;
+
+    header->seq++; //zacatek zapisu - ctenari budou cekat
+    __sync_synchronize();
+
+    for (i = 0; i < len; i++) memset(&records[(start + i) & mask], 0, sizeof(TableRecord));
+    for (i = 0; i < keep.size(); i++) Insert(keep[i]);
+    header->deleted   -= tombstones;
+    header->reclaimed += tombstones;
 
-/** Umozni pretypovani FileInfa na FileInfoGdbmRecord
- * Pokud bude string user nebo name delsi nez je kapacita odpovidajicich
- * polozek ve strukture FileInfoGdbmRecord, pak bude oriznut.
+    __sync_synchronize();
+    header->seq++; //konec zapisu
+    return tombstones;
+}
+
+
+
+/** Vrati, kolik procent slotu tabulky zabiraji smazane zaznamy.
+ *
+ * Podle toho se proces udrzby rozhoduje, jestli ma tabulku uklidit.
+ * Smazane sloty zbytecne prodluzuji hledani zaznamu a zabiraji misto, ktere
+ * se pocita do zaplneni tabulky (viz. TABLE_MAX_LOAD).
  */
-FileInfo::operator FileInfoGdbmRecord() {
-    FileInfoGdbmRecord result;
+int DirectoryDatabase::Fragmentation() {
+    if (header == 0) return 0;
+    if (header->stale && Remap() != 1) return 0;
+    return (int)((unsigned long long)header->deleted * 100 / header->slots);
+}
 
-    result.user_rights   = user_rights;
-    result.others_rights = others_rights;
-    
-    strncpy(result.user_name, user_name.c_str(),MAX_USER_NAME_LEN);
-    strncpy(result.name, name.c_str(),MAX_FILE_NAME_LEN);
-    
-    //pokud by nakej cvok mel fajly s silene dlouhejma jmenama, nemuseli bychom
-    //po strncpy dostat nulou ukoncenej string. radsi si tam tu nulu dame.
-    result.user_name[MAX_USER_NAME_LEN-1] = 0;
-    result.name[MAX_FILE_NAME_LEN-1] = 0;
-    
-    return result;
+
+
+/** Provede jeden krok uklidu smazanych slotu tabulky.
+ *
+ * Projde nanejvys zhruba max_slots slotu od mista, kde skoncil minuly krok
+ * (pozice se uklada v hlavicce tabulky, takze na ni navaze i jiny proces),
+ * a kazdy shluk, ve kterem najde smazany slot, uklidi (viz.
+ * CompactCluster()). Ctenari cekaji jen po dobu uklidu jednoho shluku.
+ *    Pokud databazi prave zamyka jiny proces, krok se neprovede vubec -
+ * uklid nikdy neceka na klienty.
+ *
+ * Navratove hodnoty:
+ *
+ *      - >=0     pocet uvolnenych smazanych slotu
+ *      - -2      chyba pri zamykani/odemykani databaze
+ *      - -3      chyba pri praci s databazi
+ *      - -4      zmenu se nepodarilo zapsat na disk (jen pri DURABILITY_FULL)
+ *
+ */
+int DirectoryDatabase::Compact(unsigned int max_slots) {
+    unsigned int    mask;
+    unsigned int    pos, n;
+    int             reclaimed = 0;
+    int             ret;
+
+    if (header == 0) return -3;
+
+// --- zacatek KRITICKE SEKCE ---
+    ret = LockDatabase(false);
+    if (ret == 0) return 0; //databazi prave nekdo meni, zkusime to priste
+    if (ret != 1) return -2;
+
+    if (header->stale && Remap() != 1) {
+        UnlockDatabase();
+        return -3;
+    }
+
+    mask = header->slots - 1;
+    pos  = header->compact_pos & mask;
+    for (n = 0; n < max_slots && n <= mask && header->deleted > 0; n++, pos = (pos + 1) & mask)
+        if (records[pos].state == SLOT_DELETED) reclaimed += CompactCluster(pos);
+    header->compact_pos = pos;
+
+    if (UnlockDatabase() != 1) return -2;
+// --- konec KRITICKE SEKCE ---
+
+#ifdef DD_DEBUG
+    if (reclaimed > 0) cout << getpid() << " - uklid tabulky: uvolneno " << reclaimed << " smazanych slotu" << endl;
+#endif
+
+    if (reclaimed > 0 && GroupCommit(db_name.c_str()) < 0) return -4;
+    return reclaimed;
 }
 
 
 
+/** Pomocna funkce, vytiskne obsah databaze na stdout.
+ *
+ */
+void DirectoryDatabase::PrintContent() {
+    unsigned int    i;
+
+    if (header == 0) return;
+    for (i = 0; i < header->slots; i++) {
+        if (records[i].state != SLOT_USED) continue;
+        cout << records[i].dev << ":" << records[i].ino;
+        if (records[i].owner > 0) cout << " user = " << owners[records[i].owner-1].name;
+        cout << " user_rights = " << (int)records[i].user_rights
+             << " others_rights = " << (int)records[i].others_rights << endl;
+    }
+}
+
 
+/* ------------------------- class FileInfo -------------------------------- */
+
+/** Copy constructor.
+ */
+FileInfo::FileInfo(const FileInfo &x) {
+    this->user_name     = x.user_name;
+    this->name          = x.name;
+    this->user_rights   = x.user_rights;
+    this->others_rights = x.others_rights;
+}
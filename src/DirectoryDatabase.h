@@ -14,22 +14,30 @@ extern "C" {
 #include <stdio.h>
 #include <fcntl.h>
 #include <dirent.h>
-#include <gdbm.h>
 #include <errno.h>
 }
 #include "my_exceptions.h"
 #include <iostream>
 #include <string>
-
-#define GDBM_BLOCK_SIZE 512
+#include <vector>
 
 #define MAX_USER_NAME_LEN 20
 #define MAX_FILE_NAME_LEN 256
-#define MAX_DELETED_ITEMS 50 //pocet smazanych polozek, po kterem se provede reorganizace databaze
-#define LOCKING_TIMEOUT 200  //kolikrat se budeme pokouset ziskat pristup k databazi, nez to polozime
-#define LOCKING_SLEEP_TIME 10000 //na kolik mikrosekund usneme, nez zkusime opet ziskat pristup k databazi
 #define R_ALL 3
 
+#define TABLE_MAGIC      "sFTPt01" //< 7 znaku + nula, oznacuje soubor s tabulkou
+#define TABLE_MIN_SLOTS  1024      //< nejmensi pocet slotu tabulky (mocnina 2)
+#define TABLE_MAX_LOAD   70        //< pri jakem zaplneni (v %, vcetne smazanych slotu) se tabulka prestavi
+#define TABLE_MAX_OWNERS 1024      //< kolik ruznych vlastniku souboru muze tabulka obsahovat
+#define TABLE_SPIN_LIMIT 100000    //< po kolika neuspesnych pokusech o cteni ctenar overi, jestli zapisujici proces zije
+#define TABLE_COMPACT_THRESHOLD 5  //< od kolika % smazanych slotu (z celkoveho poctu slotu) zacne udrzba tabulku uklizet
+#define TABLE_COMPACT_STEP 4096    //< kolik slotu nanejvys projde jeden krok uklidu (zhruba, shluk se vzdy uklidi cely)
+#define BULK_MAX_THREADS   64      //< nejvyssi pocet vlaken hromadneho nahravani (viz. BulkLoad())
+
+#define SLOT_EMPTY   0
+#define SLOT_USED    1
+#define SLOT_DELETED 2
+
 using namespace std;
 // v knihovnach by se tohle nemelo delat. nam to ale nevadi :-)
 
@@ -38,25 +46,95 @@ extern int errno;
 
 
 
-/** Struktura zapouzdrujici data ukladana do databaze.
- *  Nelze ukladat primo objekt kvuli pointrum, ktere obsahuje, proto tato
- *  struktura obsahuje pouze cista data.
+/** Hlavicka souboru s tabulkou.
+ *
+ * Za hlavickou nasleduje tabulka vlastniku (TABLE_MAX_OWNERS polozek
+ * TableOwner) a za ni samotna tabulka zaznamu (slots polozek TableRecord).
  */
-struct FileInfoGdbmRecord {
-    int         user_rights;
-    int         others_rights;
-    char        user_name[MAX_USER_NAME_LEN];
-    char        name[MAX_FILE_NAME_LEN];
+struct TableHeader {
+    char                    magic[8];
+    unsigned int            slots;   ///< pocet slotu tabulky zaznamu (mocnina 2)
+    unsigned int            used;    ///< pocet platnych zaznamu
+    unsigned int            deleted; ///< pocet smazanych slotu (jeste nevyuzitych)
+    unsigned int            owners;  ///< pocet jmen v tabulce vlastniku
+    volatile unsigned int   seq;     ///< seqlock: liche = prave probiha zapis
+    volatile unsigned int   stale;   ///< soubor byl nahrazen prestavenou tabulkou, je treba ho namapovat znovu
+    unsigned int            compact_pos; ///< odkud bude pokracovat dalsi krok uklidu (viz. Compact())
+    unsigned int            reclaimed;   ///< kolik smazanych slotu uz uklid uvolnil (jen pro statistiku)
+    unsigned int            epoch;       ///< cislo aktualniho pruchodu kontroly zaznamu (viz. ReconcileBegin())
+    volatile unsigned int   moved;       ///< behem pruchodu kontroly se prejmenoval adresar (viz. DirMoved())
+};
+
+
+/** Jmeno vlastnika souboru, zaznamy na ne odkazuji jeho poradim (od 1).
+ *
+ */
+struct TableOwner {
+    char        name[MAX_USER_NAME_LEN];
+};
+
+
+/** Zaznam o jednom souboru, klicem je zarizeni a cislo inodu.
+ *
+ * Cislo inodu muze po smazani souboru dostat jiny soubor, proto zaznam
+ * obsahuje i cas vzniku souboru (birth) - zaznam s jinym casem vzniku patri
+ * drivejsimu souboru a neplati.
+ */
+struct TableRecord {
+    unsigned long long  dev;
+    unsigned long long  ino;
+    unsigned long long  birth;         ///< cas vzniku souboru v ns (statx() btime), 0 = neznamy
+    unsigned int        owner;         ///< 0 = bez vlastnika, jinak poradi v tabulce vlastniku
+    unsigned char       state;         ///< SLOT_EMPTY, SLOT_USED nebo SLOT_DELETED
+    unsigned char       user_rights;
+    unsigned char       others_rights;
+    unsigned char       epoch;         ///< ve kterem pruchodu kontroly byl soubor naposledy videt
+};
+
+
+/** Klic zaznamu - identifikace souboru (viz. DirectoryDatabase::File2Key()).
+ *
+ */
+struct TableKey {
+    unsigned long long  dev;
+    unsigned long long  ino;
+    unsigned long long  birth; ///< 0 = filesystem cas vzniku souboru nezna
+};
+
+
+
+/** Vysledky hromadneho nahravani adresaru do databaze (viz. BulkLoad()).
+ *
+ */
+struct BulkLoadStats {
+    unsigned long long  files;   ///< pocet nalezenych souboru (a adresaru)
+    unsigned long long  dirs;    ///< pocet prectenych adresaru
+    unsigned long long  errors;  ///< pocet adresaru a souboru, ktere neslo precist
+    unsigned int        records; ///< pocet zaznamu v nove tabulce
+    double              seconds; ///< jak dlouho nahravani trvalo
+};
+
+
+
+/** Vysledky kontroly zaznamu databaze (viz. ReconcileDir() a ReconcilePurge()).
+ *
+ */
+struct ReconcileStats {
+    unsigned long long  dirs;     ///< pocet zkontrolovanych adresaru
+    unsigned long long  entries;  ///< pocet zkontrolovanych souboru
+    unsigned long long  purged;   ///< smazane zaznamy, jejichz inode mezitim dostal jiny soubor
+    unsigned long long  repaired; ///< zaznamy, kterym se doplnil cas vzniku souboru
+    unsigned long long  orphans;  ///< smazane zaznamy souboru, ktere uz neexistuji
+    unsigned long long  errors;   ///< adresare a soubory, ktere neslo precist
 };
 
 
 
 /** Informace o souboru.
- * 
- * Trida umoznuje pohodlne zachazeni s informacemi o souboru a jejich automaticky
- * prevod na strukturu FileInfoGdbmRecord, kterou pouziva trida
- * DirectoryDatabase k ukladani polozek do databaze.
- * 
+ *
+ * Trida umoznuje pohodlne zachazeni s informacemi o souboru. Jmeno souboru
+ * slouzi jen k nalezeni souboru (a tedy klice), do databaze se neuklada.
+ *
  */
 class FileInfo {
 public:
@@ -64,61 +142,86 @@ public:
     int others_rights; ///< prava ostatnich
     string user_name;  ///< jmeno vlastnika
     string name;       ///< jmeno souboru
-    
+
     FileInfo(const FileInfo &x); ///<copy konstruktor
     FileInfo(){} ///<konstruktor
-    FileInfo& operator=(FileInfoGdbmRecord &x);
-    operator FileInfoGdbmRecord();
 };
 
 
-/** Trida zapouzdrujici "databazi" gdbm.
- * 
+/** Trida zapouzdrujici databazi informaci o souborech.
+ *
  * Slouzi k praci s informacemi o souborech a adresarich. Umoznuje vkladani
- * informaci, jejich ziskavani a mazani. 
- *    Zajistuje, ze operace probehnou bezpecne - pristup k databazi gdbm totiz 
- * muze mit v jeden okamzik pouze jeden proces, tudiz to tato trida resi 
- * zamykanim souboru s databazi (doporucujicim zamkem). Lze nastavit 
- * LOCKING_TIMEOUT, tj. kolikrat se bude trida pokouset databazi zamknout, a 
- * LOCKING_SLEEP_TIME, coz je casovy interval v mikrosekundach mezi 
- * jednotlivymi pokusy.
- *    Vytvareni klice zajistuje privatni funkce File2Key, ktera jako klic vraci
- * cislo inodu zadaneho souboru.
- *    Pokud pocet smazanych polozek presahne MAX_DELETED_ITEMS, provede se
- * reorganizace databaze (coz ma za nasledek napriklad zmenseni souboru
- * databaze).
+ * informaci, jejich ziskavani a mazani.
+ *    Databaze je hashovaci tabulka s otevrenym adresovanim ulozena v souboru,
+ * ktery si kazdy proces namapuje (mmap MAP_SHARED). Klicem je zarizeni a
+ * cislo inodu souboru (viz. File2Key), vlastnici se ukladaji do zvlastni
+ * tabulky a zaznam obsahuje jen jejich poradove cislo.
+ *    Cteni nic nezamyka a nevola zadne systemove volani (krome stat() pro
+ * zjisteni klice) - konzistenci precteneho zaznamu zajistuje seqlock v
+ * hlavicce tabulky. Zapisujici procesy se vylucuji zamkem fcntl() na
+ * souboru db_name.lock, ktery se pri padu procesu sam uvolni.
+ *    Pokud zaplneni tabulky (vcetne smazanych slotu) presahne
+ * TABLE_MAX_LOAD procent, tabulka se prestavi do noveho souboru, ktery
+ * nahradi puvodni. Ostatni procesy to poznaji podle priznaku stale v
+ * hlavicce stareho souboru a namapuji si novy.
+ *    Smazane sloty (fragmentaci, viz. Fragmentation()) uklizi po malych
+ * krocich funkce Compact(), kterou vola proces udrzby mimo obsluhu klientu.
+ *    Velke mnozstvi souboru najednou (cele sdilene adresare) nahraje
+ * BulkLoad() - tabulku postavi bokem a zamkne databazi jen na jeji vymenu.
+ *    Zaznamy souboru smazanych mimo server a zaznamy, jejichz inode dostal
+ * jiny soubor, odstranuje kontrola zaznamu (ReconcileBegin(), ReconcileDir()
+ * a ReconcilePurge()), kterou po castech provadi proces udrzby.
  *    Konstruktor databaze muze hodit vyjimky FileError (v pripade chyby prace
- * se souborem) a GdbmError (napr. pokud se databazi nepodari vytvorit).
- * 
+ * se souborem) a DatabaseError (napr. pokud soubor neobsahuje tabulku).
+ *
  */
 class DirectoryDatabase {
 public:
-    DirectoryDatabase(const char *db_name) throw(FileError, GdbmError);
+    DirectoryDatabase(const char *db_name) throw(FileError, DatabaseError);
    ~DirectoryDatabase();
     int PutFileInfo(FileInfo &file);
     int GetFileInfo(string name, FileInfo &info);
     int DeleteFileInfo(string &name);
+    int ReplaceFile(const string &from, const string &to, FileInfo &file);
     int LoadSubDir(string &name);
+    int BulkLoad(vector<string> &roots, bool recursive, int threads, BulkLoadStats &stats);
+    int ReconcileBegin();
+    int ReconcileDir(const string &path, vector<string> &subdirs, vector<string> &links, ReconcileStats &stats);
+    int ReconcilePurge(unsigned int max_slots, unsigned int &pos, ReconcileStats &stats);
+    int DirMoved();
+    int ReconcileSeen(const string &path);
     void IgnoreHidden(bool x) { ignore_hidden = x; }
     bool IgnoreHidden() { return ignore_hidden; }
     void PrintContent();
+    int Fragmentation();
+    int Compact(unsigned int max_slots);
 
 private:
-    GDBM_FILE db_file; ///< file descriptor databaze
     string db_name;  ///< jmeno souboru databaze
     string lock_name; ///< jmeno zamku pro uzamceni databaze pro zapis
+    int lock_fd; ///< otevreny soubor zamku
     bool locked; ///< je databaze uzamcena pro zapis?
     bool ignore_hidden; ///< zahrnout do databaze i skryte soubory?
-    int num_of_deleted_items; ///< pocet smazanych polozek z databaze - kvuli reorganizaci
-    
-    int File2Key(const char *path, string &key);
-    int LockDatabase();
+    TableHeader * header; ///< namapovany soubor s tabulkou
+    TableOwner * owners; ///< tabulka vlastniku (v namapovanem souboru)
+    TableRecord * records; ///< tabulka zaznamu (v namapovanem souboru)
+    size_t map_size; ///< velikost namapovaneho souboru
+
+    int File2Key(const char *path, TableKey &key, bool cached = false);
+    int LockDatabase(bool wait = true);
     int UnlockDatabase();
+    int Map();
+    void Unmap();
+    int Remap();
+    int Rebuild(unsigned int slots);
+    int OwnerId(const string &name);
+    int ReclaimOwners();
+    TableRecord * Find(TableKey &key);
+    int Store(TableKey &key, int user_rights, int others_rights, unsigned int owner, bool replace);
+    void Remove(TableRecord * r);
+    void Insert(TableRecord &rec);
+    int CompactCluster(unsigned int pos);
 };
 
 
-
-
 #endif //__DirectoryDatabase_h
-
-
@@ -8,6 +8,10 @@
 
 //#define DEBUG
 #include "VFS.h"
+#include "statcache.h"
+#include "metrics.h"
+#include "trace.h"
+#include "upload.h"
 #include "VFS_pomocne.cpp"
 /** Konstruktor tridy VFS_node, inicializuje promenne.
  *
@@ -17,6 +21,7 @@ VFS::VFS_node::VFS_node(const char * _vname, const char * _pname, VFS_node * _pa
     virtual_name = _vname;
     physical_name = _pname;
     child_it = children.begin();
+    cache_policy = CACHE_POLICY_NORMAL;
 }
 
 
@@ -116,7 +121,7 @@ string VFS::VFS_node::FullVirtualName() {
  *           informace o pravech a uzivateli jednotlivych souboru)
  * 
  */
-VFS::VFS(const char * path, const char * db_name)throw (VFSError, GdbmError, FileError):root_db(db_name)  {
+VFS::VFS(const char * path, const char * db_name)throw (VFSError, DatabaseError, FileError):root_db(db_name)  {
     int    ret;
     string s;
     
@@ -164,6 +169,8 @@ int VFS::LoadConfigFile(const char * name) {
     FILE *      f;
     char        bafr[MAX_CFG_LINE_LEN];
     char        temp[MAX_CFG_LINE_LEN];
+    char        policy[20];
+    int         cache_policy;
     char *      p;
     int         radek = 0; //cislo prave zpracovavaneho radku
     string      root_dir;
@@ -181,9 +188,11 @@ int VFS::LoadConfigFile(const char * name) {
     }
     
     radek++;
-    //nacteme korenovy adresar - musi byt na prvni radce
+    //nacteme korenovy adresar - musi byt na prvni radce, muze za nim byt
+    //nastaveni page cache (viz. pagecache.h)
+    policy[0] = 0;
     if (fgets(bafr, MAX_CFG_LINE_LEN, f)) {
-        ret = sscanf(bafr, "%s", temp);
+        ret = sscanf(bafr, "%s %19s", temp, policy);
         if (ret == 0 || ret == EOF) {
 #ifdef DEBUG
         PRINT_CFG_ERR(2)
@@ -212,6 +221,15 @@ int VFS::LoadConfigFile(const char * name) {
     
     root_node = new VFS_node("/", root_dir.c_str(), 0);
     current_node = root_node;
+    if (policy[0] != 0) {
+        if ((cache_policy = CachePolicyFromName(policy)) < 0) {
+#ifdef DEBUG
+            PRINT_CFG_ERR(12)
+#endif
+            return -radek;
+        }
+        root_node->SetCachePolicy(cache_policy);
+    }
 
     string          physical_dir; 
     string          virtual_dir;
@@ -231,7 +249,7 @@ int VFS::LoadConfigFile(const char * name) {
         if (!args.empty()) args.erase(args.begin(), args.end());
         s = bafr;
         ret = VFSCutIntoParts(s, args);
-        if (args.size() != 5 || ret == -1) {
+        if (args.size() < 5 || args.size() > 6 || ret == -1) {
 #ifdef DEBUG
             PRINT_CFG_ERR(4)
             cout << "ret = " << ret << " args.size() = " << args.size() << endl;
@@ -248,6 +266,16 @@ int VFS::LoadConfigFile(const char * name) {
         user_name     = args.front(); args.pop_front();
         usrr          = args.front(); args.pop_front();
         othr          = args.front(); args.pop_front();
+        cache_policy  = CACHE_POLICY_NORMAL;
+        if (!args.empty()) {
+            cache_policy = CachePolicyFromName(args.front().c_str()); args.pop_front();
+            if (cache_policy < 0) {
+#ifdef DEBUG
+                PRINT_CFG_ERR(12)
+#endif
+                return -radek;
+            }
+        }
         
         if ((sscanf(usrr.c_str(), "%d", &user_rights)   != 1) || 
             (sscanf(othr.c_str(), "%d", &others_rights) != 1)   ) {
@@ -335,6 +363,7 @@ int VFS::LoadConfigFile(const char * name) {
                 if (parts.empty()) { 
                     //zpracovavame posledni, tj. nejhlubsi adresar
                     tmp = new VFS_node(s.c_str(), physical_dir.c_str(), node);    
+                    tmp->SetCachePolicy(cache_policy);
                 } else tmp = new VFS_node(s.c_str(), "", node);
                 
                 
@@ -359,6 +388,7 @@ int VFS::LoadConfigFile(const char * name) {
                     return -radek;
                 } else { //OK, tenhle virtualni adresar jeste zadny fyzicky nema, priradime mu ho
                     tmp->PhysicalName(physical_dir);
+                    tmp->SetCachePolicy(cache_policy);
                 }//else
             }//else
             
@@ -443,6 +473,78 @@ void VFS::PrintVirtualTree() {
 }
 
 
+
+/** Vrati fyzicke adresare vsech uzlu virtualniho stromu.
+ *
+ * Adresare, ktere lezi uvnitr jineho z nich, se vynechaji - pri prochazeni
+ * vsech sdilenych souboru by se jinak prosly dvakrat.
+ *
+ */
+void VFS::PhysicalDirs(vector<string> &dirs) {
+    vector<VFS_node *>  stack;
+    vector<VFS_node *>  children;
+    vector<string>      all;
+    VFS_node          * n;
+    unsigned int        i, j;
+    bool                inside;
+
+    dirs.clear();
+    if (root_node == 0) return;
+
+    stack.push_back(root_node);
+    while (!stack.empty()) {
+        n = stack.back();
+        stack.pop_back();
+        if (n->PhysicalName() != "") all.push_back(n->PhysicalName());
+        n->GetChildren(children);
+        for (i = 0; i < children.size(); i++) stack.push_back(children[i]);
+    }
+
+    //po serazeni je nadrazeny adresar vzdy pred tim, ktery lezi v nem
+    sort(all.begin(), all.end());
+    for (i = 0; i < all.size(); i++) {
+        inside = false;
+        for (j = 0; j < dirs.size() && !inside; j++)
+            inside = all[i] == dirs[j] || dirs[j] == "/" || (all[i].compare(0, dirs[j].size(), dirs[j]) == 0
+                                                             && all[i][dirs[j].size()] == '/');
+        if (!inside) dirs.push_back(all[i]);
+    }
+}
+
+
+/** Vrati virtualni jmeno sdileneho adresare, ve kterem lezi fyzicka cesta
+ * physical.
+ *
+ * Pri vnorenych sdilenych adresarich vrati ten nejhloubeji vnoreny. Pokud
+ * cesta nelezi v zadnem, vrati "".
+ */
+string VFS::ShareName(const string &physical) {
+    vector<VFS_node *>  stack;
+    vector<VFS_node *>  children;
+    VFS_node          * n;
+    VFS_node          * best = 0;
+    string              name;
+    unsigned int        i;
+
+    if (root_node == 0) return "";
+
+    stack.push_back(root_node);
+    while (!stack.empty()) {
+        n = stack.back();
+        stack.pop_back();
+        name = n->PhysicalName();
+        if (name != "" && (best == 0 || name.size() > best->PhysicalName().size())
+                && (physical == name || name == "/" || (physical.compare(0, name.size(), name) == 0
+                                                         && physical[name.size()] == '/')))
+            best = n;
+        n->GetChildren(children);
+        for (i = 0; i < children.size(); i++) stack.push_back(children[i]);
+    }
+
+    return (best != 0) ? best->FullVirtualName() : "";
+}
+
+
 /** Pomocna funkce pro DestroyVirtualTree() */
 int DeleteNode(VFS::VFS_node * node, int) {
     delete node;
@@ -694,7 +796,7 @@ int VFS::SimpleCd(const char *dir) {
     //aktualniho current_node, takze zkusime normalni prechod    
 
     FileInfo info;
-    ret = root_db.GetFileInfo(s, info); //mame o tomhle adresari informace v databazi ?
+    ret = LookupFileInfo(s, info); //mame o tomhle adresari informace v databazi ?
     if (ret == 1) //ano, mame
         if ( ! ((info.user_name==ftp_user_name && (info.user_rights & R_READ)) || (info.others_rights & R_READ)) ) {
             //k tomuhle adresari nemame dostatecna (virtualni) prava! koncime
@@ -747,6 +849,7 @@ int VFS::ChangeDir(const char * path) {
     VFS_node *    old_node = current_node;
     string        old_dir  = current_dir;   
     VFS_node *    ret_node;
+    TraceSpan     span("vfs ChangeDir", "vfs");
 
     ret = CutPathIntoParts(s, parts);
     switch (ret) {
@@ -868,6 +971,25 @@ string VFS::CurrentPhysicalDir() {
 
 
 
+/** Vrati fyzicky adresar, jehoz obsah vraci NextFile() (bez virtualnich
+ * adresaru).
+ *
+ * Pokud aktualni adresar obsahuje virtualni podadresare nebo nema fyzicky
+ * ekvivalent, vrati "".
+ */
+string VFS::ListingDir() {
+    vector<VFS_node *> children;
+
+    if (current_dir != ".") return current_dir;
+
+    current_node->GetChildren(children);
+    if (!children.empty()) return "";
+    return current_node->PhysicalName();
+}
+
+
+
+
 /** Postupne vraci soubory a adresare v aktualnim adresari.
  *
  * V pripade chyby nebo vycerpani vsech podadresaru vrati 0. Po zavolani
@@ -931,7 +1053,7 @@ VFS_file * VFS::NextFile() {
         // relativni jmeno, a byli bychom ve spatnem adresari (coz nejsme) mohl by se najit
         // spatny vysledek...
         if (path!="/") absolute_name = path + "/" + name; else absolute_name = "/" + name;
-        ret = root_db.GetFileInfo(absolute_name, info); //mame o tomhle souboru informace v databazi ?
+        ret = LookupFileInfo(absolute_name, info); //mame o tomhle souboru informace v databazi ?
         if (ret == 1) { //ano, mame
 #ifdef DEBUG
             cout << "udaj o " << name << " je z databaze." << endl;
@@ -987,6 +1109,7 @@ int VFS::ConvertToPhysicalPath(string virtual_path, string &physical_path) {
     string              dir;
     VFS_node          * node;
     VFS_node          * next_node;
+    TraceSpan           span("vfs ConvertToPhysicalPath", "vfs");
 
     ret = CutPathIntoParts(virtual_path, parts);
     if (ret < 0) return -1;
@@ -1079,6 +1202,7 @@ int VFS::GetFileInfo(const char * path, VFS_file &x) {
     string      old_dir  = current_dir;
     VFS_node  * old_node = current_node;
     string      dir;
+    TraceSpan   span("vfs GetFileInfo", "vfs");
     
     //if (!IsFile(path)) {cout << "GFI: prej to neni soubor" << endl; return -7; }//neni to soubor
     
@@ -1108,6 +1232,9 @@ int VFS::GetFileInfo(const char * path, VFS_file &x) {
         x.Name(s.substr(n+1, s.size()-n));
     }
 
+    //docasne soubory rozpracovanych uploadu nejsou videt (viz. upload.cpp)
+    if (IsUploadTemp(x.Name())) return -7;
+
     //cout << "GFI: x.name = " << x.Name() << endl;
     //cout << "GFI: x.path = " << x.Path() << endl;
     //cout << "GFI vdir = " << CurrentDir()<< endl;
@@ -1121,11 +1248,12 @@ int VFS::GetFileInfo(const char * path, VFS_file &x) {
 #endif
         return ret;
     }
+    x.CachePolicy(current_node->CachePolicy());
     //cout << "GFI vdir = " << CurrentDir()<< endl;
     //cout << "GFI pdir = " << CurrentPhysicalDir() << endl;
     
     
-    ret = root_db.GetFileInfo(x.Name(), info); //mame o tomhle souboru informace v databazi ?
+    ret = LookupFileInfo(x.Name(), info); //mame o tomhle souboru informace v databazi ?
     if (ret == 1) { //ano, mame
 #ifdef DEBUG
         cout << "GFI: udaj o " << x.Name() << " je z databaze." << endl;
@@ -1151,6 +1279,36 @@ int VFS::GetFileInfo(const char * path, VFS_file &x) {
 
 
 
+/** Zjisti z databaze informace o souboru name, dobu dotazu zapocita do metrik.
+ *
+ * Navratove hodnoty stejne jako DirectoryDatabase::GetFileInfo().
+ */
+int VFS::LookupFileInfo(const string &name, FileInfo &info) {
+    unsigned long long  start = MetricsNow();
+    int                 ret;
+
+    ret = root_db.GetFileInfo(name, info);
+    MetricsRecord(METRIC_DB_LOOKUP, MetricsNow() - start);
+    return ret;
+}
+
+
+/** Vrati absolutni fyzickou cestu k souboru name v aktualnim adresari.
+ *
+ * Pokud aktualni adresar nema fyzicky ekvivalent, vrati name (pak se
+ * stat() nepovede, stejne jako driv).
+ */
+string VFS::PhysicalPath(const string &name) {
+    string  dir;
+
+    dir = (current_dir == ".") ? current_node->PhysicalName() : current_dir;
+    if (dir == "") return name;
+    if (dir[dir.size()-1] == '/') return dir + name;
+    return dir + "/" + name;
+}
+
+
+
 /** Zjisti zda file ukazuje na (pristupny) soubor.
  *
  */
@@ -1184,7 +1342,7 @@ bool VFS::IsFile(const char * file) {
     ret = ChangeDir(path.c_str());
     if (ret < 0) return false;
                                 //VIRTUALNI SOUBORY - tady kdyztak dodelat
-    ret = stat(name.c_str(), &statbuf);
+    ret = StatCacheStat(PhysicalPath(name).c_str(), statbuf);
 
     current_node = old_node;
     current_dir  = old_dir;
@@ -1253,7 +1411,7 @@ bool VFS::IsDir(const char * dir) {
         return true; //VIRTUALNI SOUBORY - prekontrolovat pokud je doprogramujeme
     }
     
-    ret = stat(name.c_str(), &statbuf);
+    ret = StatCacheStat(PhysicalPath(name).c_str(), statbuf);
     
     current_node = old_node;
     current_dir  = old_dir;
@@ -1404,6 +1562,25 @@ int VFS::PutFileInfo(VFS_file file) {
 }
 
 
+/** Prejmenuje soubor from na to a ulozi zaznam souboru s udaji z file.
+ *
+ * Navratove hodnoty:
+ *
+ * viz. DirectoryDatabase::ReplaceFile()
+ *
+ */
+int VFS::ReplaceFile(const string &from, const string &to, VFS_file file) {
+    FileInfo    info;
+
+    info.user_rights   = file.UserRights();
+    info.user_name     = file.UserName();
+    info.others_rights = file.OthersRights();
+    info.name          = from;
+
+    return root_db.ReplaceFile(from, to, info);
+}
+
+
 /** Funkce maze informace o souboru file z databaze root_db;
  *
  * Navratove hodntoty:
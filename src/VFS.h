@@ -17,6 +17,7 @@
 #include <vector>
 #include <list>
 #include <deque>
+#include <algorithm>
 #include <string>
 #include "DirectoryDatabase.h"
 
@@ -69,13 +70,14 @@
  */
 class VFS {
 public:
-    VFS(const char * path, const char * db_name) throw(VFSError, GdbmError, FileError);
+    VFS(const char * path, const char * db_name) throw(VFSError, DatabaseError, FileError);
     ~VFS();
     int         ReloadConfigFile(const char * path);
     
     int         ChangeDir(const char * path);
     string      CurrentDir();
     string      CurrentPhysicalDir();
+    string      ListingDir();
     int         ConvertToPhysicalPath(string virtual_path, string &physical_path);
     bool        AllowedToWriteToDir(string dir); 
 
@@ -84,10 +86,20 @@ public:
     int         GetFileInfo(const char * path, VFS_file &x);
     int         PutFileInfo(VFS_file file);
     int         DeleteFileInfo(VFS_file file); 
+    int         ReplaceFile(const string &from, const string &to, VFS_file file);
     
     bool        IgnoreHidden()     { return ignore_hidden; }
     void        IgnoreHidden(bool x) { ignore_hidden = x; root_db.IgnoreHidden(x); }
     void        PrintDb() { root_db.PrintContent(); }
+    int         DbFragmentation() { return root_db.Fragmentation(); }
+    int         CompactDb(unsigned int max_slots) { return root_db.Compact(max_slots); }
+    int         ReconcileBegin() { return root_db.ReconcileBegin(); }
+    int         ReconcileDir(const string &path, vector<string> &subdirs, vector<string> &links, ReconcileStats &stats) { return root_db.ReconcileDir(path, subdirs, links, stats); }
+    int         ReconcilePurge(unsigned int max_slots, unsigned int &pos, ReconcileStats &stats) { return root_db.ReconcilePurge(max_slots, pos, stats); }
+    int         DirMoved() { return root_db.DirMoved(); }
+    int         ReconcileSeen(const string &path) { return root_db.ReconcileSeen(path); }
+    void        PhysicalDirs(vector<string> &dirs);
+    string      ShareName(const string &physical);
     bool        IsFile(const char * path);
     bool        IsDir(const char * path);
     string      FtpUserName() {string s; s = ftp_user_name; return s; }
@@ -96,6 +108,8 @@ public:
 private:
     int  LoadConfigFile(const char * path);
     int  SimpleCd(const char *dir);
+    string PhysicalPath(const string &name);
+    int  LookupFileInfo(const string &name, FileInfo &info);
     
     class VFS_node {
     public:
@@ -114,6 +128,7 @@ private:
         void SetUserName(string &s)  { user_name = s; }
         void SetUserRights(int r)    { user_rights = r; }
         void SetOthersRights(int r)  { others_rights = r; }
+        void SetCachePolicy(int x)   { cache_policy = x; }
         bool IsDir()     { return is_dir; }
         bool IsFile()    { return is_file; }
         bool IsLeaf()    { return children.empty(); }
@@ -124,6 +139,7 @@ private:
         string UserName()     { string s; s=user_name; return s; }
         int UserRights()      { return user_rights; }
         int OthersRights()    { return others_rights; }
+        int CachePolicy()     { return cache_policy; }
 
     private:
         bool is_dir;
@@ -136,6 +152,7 @@ private:
         string user_name;
         int user_rights;
         int others_rights;
+        int cache_policy;    ///< jak zachazet s page cache pri cteni souboru (CACHE_POLICY_*)
     }; //class VFS_node
     
     
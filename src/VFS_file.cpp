@@ -4,6 +4,7 @@
  */
  
 #include "VFS_file.h"
+#include "statcache.h"
 
 /** Konstruktor tridy VFS_file.
  *
@@ -14,6 +15,7 @@ VFS_file::VFS_file(string _name, string _path) {
     path = _path;
     if (_path == "") is_virtual = true; else is_virtual = false;
     descriptor = 0;
+    cache_policy = CACHE_POLICY_NORMAL;
 }
 
 
@@ -55,7 +57,7 @@ int VFS_file::GetLslInfo(string &result)
   if (!is_virtual) {
       
         p = prava;
-        int ret = stat(file_name.c_str(), &statbuf);
+        int ret = StatCacheStat(file_name.c_str(), statbuf);
         if (ret == -1)
             switch (errno) {
                 case ENOENT: return -3; //soubor s danou cestou neexisstuje
@@ -111,7 +113,7 @@ bool VFS_file::IsRegularFile() {
     string      file_name;
 
     file_name = path + "/" + name;
-    ret = stat(file_name.c_str(), &statbuf);
+    ret = StatCacheStat(file_name.c_str(), statbuf);
     if (ret == -1) return false;
     if (S_ISREG(statbuf.st_mode)) return true; else return false;
 }
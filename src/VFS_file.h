@@ -19,6 +19,8 @@ extern "C" {
 
 #include <iostream>
 
+#include "pagecache.h"
+
 using namespace std;
 
 
@@ -39,12 +41,14 @@ public:
     void UserName(string x)    { user_name = x; }
     void UserRights(int x)      { user_rights = x; }
     void OthersRights(int x)    { others_rights = x; }
+    void CachePolicy(int x)     { cache_policy = x; }
 
     string Name()       { string s; s=name; return s; }
     string Path()       { string s; s=path; return s; }
     string UserName()   { string s; s=user_name; return s; }
     int UserRights()    { return user_rights; }
     int OthersRights()  { return others_rights; }
+    int CachePolicy()   { return cache_policy; }
     bool IsVirtual()    { return is_virtual; }
     void IsVirtual(bool x) { is_virtual = x; }
     bool IsRegularFile();
@@ -59,6 +63,7 @@ private:
     string      user_name;
     int         user_rights;
     int         others_rights;
+    int         cache_policy; ///< nastaveni page cache sdileneho adresare, ve kterem soubor lezi
 };
 
 
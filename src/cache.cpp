@@ -0,0 +1,192 @@
+/** @file cache.cpp
+ *  \brief Implementace funkci pro praci s pomocnymi (cache) soubory.
+ *
+ * Nektere informace o souborech je drahe pocitat (napr. pocty znaku LF v
+ * souboru kvuli obnove prenosu v ASCII rezimu), proto si je server uklada do
+ * adresare cache_dir. Jmeno cache souboru je odvozeno od zarizeni a cisla
+ * inodu puvodniho souboru a od pripony, ktera urcuje o jaka data se jedna.
+ * Kazdy cache soubor zacina hlavickou CacheStamp - pokud se puvodni soubor
+ * zmeni (velikost nebo cas modifikace), hlavicka uz nesouhlasi a cache soubor
+ * se povazuje za neplatny.
+ *      Zapis probiha vzdy do docasneho souboru, ktery se pak prejmenuje na
+ * vysledne jmeno - ostatni procesy tak nikdy neuvidi napul zapsany soubor a
+ * neni potreba nic zamykat.
+ *
+ */
+
+#include "cache.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+
+
+/** Vyplni hlavicku cache souboru podle informaci o puvodnim souboru.
+ *
+ */
+void MakeCacheStamp(struct stat &st, CacheStamp &stamp) {
+    memset(&stamp, 0, sizeof(stamp));
+    strncpy(stamp.magic, CACHE_MAGIC, sizeof(stamp.magic));
+    stamp.dev        = st.st_dev;
+    stamp.ino        = st.st_ino;
+    stamp.size       = st.st_size;
+    stamp.mtime      = st.st_mtim.tv_sec;
+    stamp.mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+
+/** Sestavi jmeno cache souboru (s absolutni cestou).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      jmeno by bylo prilis dlouhe
+ *
+ */
+int CacheFileName(CacheStamp &stamp, const char * suffix, string &name) {
+    char        tmp[100];
+    int         ret;
+
+    ret = snprintf(tmp, 100, "/%llx-%llx.%s", stamp.dev, stamp.ino, suffix);
+    if (ret >= 100 || ret < 0) return -1;
+
+    name = cache_dir + tmp;
+    return 1;
+}
+
+
+/** Zapise do souboru vsech size bytu.
+ *
+ * Vrati 1, pokud se to povede, jinak -1.
+ *
+ */
+int CacheWrite(int fd, const void * data, int size) {
+    int          ret;
+    const char * p = (const char *)data;
+
+    while (size > 0) {
+        ret = write(fd, p, size);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) return -1;
+        p    += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+
+/** Precte ze souboru presne size bytu.
+ *
+ * Vrati 1, pokud se to povede, jinak -1 (chyba nebo predcasny konec souboru).
+ *
+ */
+int CacheRead(int fd, void * data, int size) {
+    int          ret;
+    char       * p = (char *)data;
+
+    while (size > 0) {
+        ret = read(fd, p, size);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) return -1;
+        p    += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+
+/** Otevre platny cache soubor pro cteni.
+ *
+ * Pokud soubor existuje a jeho hlavicka odpovida stamp, vrati file
+ * descriptor nastaveny tesne za hlavicku. Jinak vrati -1.
+ *
+ */
+int CacheOpen(CacheStamp &stamp, const char * suffix) {
+    string      name;
+    CacheStamp  stored;
+    int         fd;
+
+    if (CacheFileName(stamp, suffix, name) < 0) return -1;
+
+    fd = open(name.c_str(), O_RDONLY);
+    if (fd == -1) return -1;
+
+    if (CacheRead(fd, &stored, sizeof(stored)) < 0 || memcmp(&stored, &stamp, sizeof(stamp)) != 0) {
+        //cache soubor patri ke starsi verzi souboru - neplati
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/** Vytvori docasny cache soubor a zapise do nej hlavicku.
+ *
+ * Do tmp_name ulozi jmeno docasneho souboru, ktere je potreba predat
+ * funkci CacheCommit(). Vrati file descriptor otevreny pro zapis, nebo -1.
+ *
+ */
+int CacheCreate(CacheStamp &stamp, const char * suffix, string &tmp_name) {
+    string      name;
+    char        pid[30];
+    int         fd;
+
+    if (CacheFileName(stamp, suffix, name) < 0) return -1;
+
+    snprintf(pid, 30, ".tmp%d", getpid());
+    tmp_name = name + pid;
+
+    fd = open(tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) return -1;
+
+    if (CacheWrite(fd, &stamp, sizeof(stamp)) < 0) {
+        close(fd);
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/** Uzavre docasny cache soubor a prejmenuje ho na vysledne jmeno.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      chyba, docasny soubor byl smazan
+ *
+ */
+int CacheCommit(int fd, CacheStamp &stamp, const char * suffix, string &tmp_name) {
+    string      name;
+    int         ret;
+
+    ret = close(fd);
+    if (ret == -1 || CacheFileName(stamp, suffix, name) < 0) {
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+
+    ret = rename(tmp_name.c_str(), name.c_str());
+    if (ret == -1) {
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+    return 1;
+}
+
+
+/** Vytvori adresar pro cache soubory, pokud jeste neexistuje.
+ *
+ * Vrati 1, pokud adresar existuje nebo se ho povedlo vytvorit, jinak -1.
+ *
+ */
+int CacheInit() {
+    int ret;
+
+    ret = mkdir(cache_dir.c_str(), 0700);
+    if (ret == -1 && errno != EEXIST) return -1;
+    return 1;
+}
@@ -0,0 +1,51 @@
+/** @file cache.h
+ *  \brief Deklarace funkci pro praci s pomocnymi (cache) soubory.
+ *
+ */
+
+#ifndef __cache_h
+#define __cache_h
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define CACHE_DIR_NAME "cache" //< jmeno adresare s cache soubory (v pracovnim adresari)
+#define CACHE_MAGIC    "sFTPc01" //< 7 znaku + nula, oznacuje platny cache soubor
+
+extern string cache_dir;
+
+
+/** Hlavicka kazdeho cache souboru.
+ *
+ * Cache soubor patri vzdy k jednomu souboru ve sdilene strukture a je platny
+ * jen dokud se tento soubor nezmeni - tj. dokud souhlasi zarizeni, cislo
+ * inodu, velikost a cas posledni modifikace.
+ */
+struct CacheStamp {
+    char                magic[8];
+    unsigned long long  dev;
+    unsigned long long  ino;
+    unsigned long long  size;
+    long long           mtime;
+    long long           mtime_nsec;
+};
+
+void MakeCacheStamp(struct stat &st, CacheStamp &stamp);
+int  CacheFileName(CacheStamp &stamp, const char * suffix, string &name);
+int  CacheOpen(CacheStamp &stamp, const char * suffix);
+int  CacheCreate(CacheStamp &stamp, const char * suffix, string &tmp_name);
+int  CacheCommit(int fd, CacheStamp &stamp, const char * suffix, string &tmp_name);
+int  CacheRead(int fd, void * data, int size);
+int  CacheWrite(int fd, const void * data, int size);
+int  CacheInit();
+
+#endif //__cache_h
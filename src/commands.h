@@ -0,0 +1,60 @@
+/** @file commands.h
+ *  \brief Seznam prikazu FTP - jmeno, napoveda, handler a nejvyssi pocet
+ *  argumentu.
+ *
+ * Nema ochranu proti vicenasobnemu vlozeni: kdo ho vklada, nadefinuje si
+ * makro COMMAND(jmeno, napoveda, handler, argumenty) tak, aby z kazdeho
+ * radku vznikla polozka jeho tabulky. Tabulku command_table z nej sklada
+ * smallFTPd.cpp; microbench, ktery server nelinkuje, z nej sklada tutez
+ * tabulku s nulovou napovedou a handlery.
+ *
+ */
+
+COMMAND("user", user_help, fuser, 1)//1
+COMMAND("pass", pass_help, fpass, 1)
+COMMAND("pasv", pasv_help, fpasv, 0)
+COMMAND("port", port_help, fport, 6)
+COMMAND("type", type_help, ftype, 2)
+COMMAND("mode", mode_help, fmode, 1)
+COMMAND("stru", stru_help, fstru, 1)
+COMMAND("help", help_help, fhelp, 1)
+COMMAND("quit", quit_help, fquit, 0)
+COMMAND("noop", noop_help, fnoop, 0)//10
+COMMAND("pwd", pwd_help, fpwd, 0)
+COMMAND("list", list_help, flist, 1)
+COMMAND("cwd", cwd_help, fcwd, 1)
+COMMAND("cdup", cdup_help, fcdup, 0)
+COMMAND("retr", retr_help, fretr, 1)
+COMMAND("stor", stor_help, fstor, 1)
+COMMAND("syst", syst_help, fsyst, 0)
+COMMAND("rein", rein_help, frein, 0)
+COMMAND("stou", stou_help, fstou, 0)
+COMMAND("appe", appe_help, fappe, 1)//20
+COMMAND("allo", allo_help, fallo, 2)
+COMMAND("rnfr", rnfr_help, frnfr, 1)
+COMMAND("rnto", rnto_help, frnto, 1)
+COMMAND("dele", dele_help, fdele, 1)
+COMMAND("rmd", rmd_help, frmd, 1)
+COMMAND("mkd", mkd_help, fmkd, 1)
+COMMAND("site", site_help, fsite, 3)
+COMMAND("size", size_help, fsize, 1)
+COMMAND("mdtm", mdtm_help, fmdtm, 1)
+COMMAND("rest", rest_help, frest, 1)//30
+COMMAND("abor", abor_help, fnoop, 0)
+COMMAND("auth", auth_help, fauth, 1)
+COMMAND("pbsz", pbsz_help, fpbsz, 1)
+COMMAND("prot", prot_help, fprot, 1)
+COMMAND("denyip", denyip_help, fdenyip, 4)
+COMMAND("finish", finish_help, ffinish, 0)
+COMMAND("settings", settings_help, fsettings, 0)
+COMMAND("feat", feat_help, ffeat, 0)
+COMMAND("opts", opts_help, fopts, 2)//40
+COMMAND("hash", hash_help, fhash, 1)
+COMMAND("xcrc", xcrc_help, fxcrc, 1)
+COMMAND("xmd5", xmd5_help, fxmd5, 1)
+COMMAND("xsha1", xsha1_help, fxsha1, 1)
+COMMAND("xsha256", xsha256_help, fxsha256, 1)
+COMMAND("rang", rang_help, frang, 2)
+COMMAND("metrics", metrics_help, fmetrics, 0)
+COMMAND("epsv", epsv_help, fepsv, 1)
+COMMAND("eprt", eprt_help, feprt, 1)
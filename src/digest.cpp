@@ -0,0 +1,361 @@
+/** @file digest.cpp
+ *  \brief Implementace kontrolnich souctu souboru pro prikazy HASH, XCRC, ...
+ *
+ * MD5, SHA-1 a SHA-256 se pocitaji pres EVP rozhrani OpenSSL (ktere samo
+ * pouzije instrukce SHA-NI/AVX2, pokud je procesor ma), CRC32 pres crc32()
+ * ze zlib. Kontrolni soucet celeho souboru se uklada do cache souboru (viz.
+ * cache.h), takze opakovane overovani nezmeneneho souboru uz soubor necte.
+ *
+ */
+
+#include "digest.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+}
+
+
+static const char * digest_names[DIGEST_COUNT]    = { "CRC32", "MD5", "SHA-1", "SHA-256" };
+static const char * digest_suffixes[DIGEST_COUNT] = { "crc32", "md5", "sha1", "sha256" };
+static const int    digest_hex_len[DIGEST_COUNT]  = { 8, 32, 40, 64 };
+
+#define DIGEST_BUF_SIZE (64*1024)
+
+
+/** Vrati EVP popis algoritmu, pro CRC32 vrati 0.
+ *
+ */
+static const EVP_MD * DigestMD(int id) {
+    switch (id) {
+        case DIGEST_MD5:    return EVP_md5();
+        case DIGEST_SHA1:   return EVP_sha1();
+        case DIGEST_SHA256: return EVP_sha256();
+    }
+    return 0;
+}
+
+
+/** Prevede binarni vysledek na retezec hexadecimalnich cislic.
+ *
+ */
+static void Bin2Hex(const unsigned char * bin, int size, string &hex) {
+    const char  cifry[] = "0123456789abcdef";
+    int         i;
+
+    hex = "";
+    for (i = 0; i < size; i++) {
+        hex += cifry[bin[i] >> 4];
+        hex += cifry[bin[i] & 0x0f];
+    }
+}
+
+
+/** Ulozi kontrolni soucet celeho souboru popsaneho st do cache.
+ *
+ */
+static int StoreDigest(struct stat &st, int id, string &hex) {
+    CacheStamp  stamp;
+    string      tmp_name;
+    int         fd;
+
+    MakeCacheStamp(st, stamp);
+    fd = CacheCreate(stamp, digest_suffixes[id], tmp_name);
+    if (fd == -1) return -1;
+
+    if (CacheWrite(fd, hex.c_str(), hex.size()) < 0) {
+        close(fd);
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+    return CacheCommit(fd, stamp, digest_suffixes[id], tmp_name);
+}
+
+
+/** Nacte kontrolni soucet celeho souboru popsaneho st z cache.
+ *
+ */
+static int LoadDigest(struct stat &st, int id, string &hex) {
+    CacheStamp  stamp;
+    char        buf[2*EVP_MAX_MD_SIZE];
+    int         fd;
+
+    MakeCacheStamp(st, stamp);
+    fd = CacheOpen(stamp, digest_suffixes[id]);
+    if (fd == -1) return -1;
+
+    if (CacheRead(fd, buf, digest_hex_len[id]) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    hex.assign(buf, digest_hex_len[id]);
+    return 1;
+}
+
+
+/** Vrati cislo algoritmu podle jmena (napr. "SHA-256"), nebo -1.
+ *
+ * Jmena se porovnavaji bez ohledu na velikost pismen.
+ */
+int DigestByName(const char * name) {
+    int i;
+
+    for (i = 0; i < DIGEST_COUNT; i++)
+        if (strcasecmp(name, digest_names[i]) == 0) return i;
+    return -1;
+}
+
+
+/** Vrati jmeno algoritmu tak, jak se uvadi v odpovedich na HASH a OPTS HASH.
+ *
+ */
+const char * DigestName(int id) {
+    if (id < 0 || id >= DIGEST_COUNT) return "";
+    return digest_names[id];
+}
+
+
+DigestSet::DigestSet() : mask(0), done(0), crc(0) {
+    int i;
+    for (i = 0; i < DIGEST_COUNT; i++) ctx[i] = 0;
+}
+
+
+DigestSet::~DigestSet() {
+    int i;
+    for (i = 0; i < DIGEST_COUNT; i++) if (ctx[i] != 0) EVP_MD_CTX_destroy(ctx[i]);
+}
+
+
+/** Zacne pocitat kontrolni soucty algoritmu zadanych v _mask.
+ *
+ */
+void DigestSet::Start(int _mask) {
+    int i;
+
+    mask = 0;
+    done = 0;
+    for (i = 0; i < DIGEST_COUNT; i++) {
+        if (!(_mask & (1 << i))) continue;
+
+        if (i == DIGEST_CRC32) {
+            crc = crc32(0L, Z_NULL, 0);
+        } else {
+            if (ctx[i] == 0) ctx[i] = EVP_MD_CTX_create();
+            if (ctx[i] == 0 || EVP_DigestInit_ex(ctx[i], DigestMD(i), 0) != 1) continue;
+        }
+        mask |= 1 << i;
+    }
+}
+
+
+/** Zapocita do vsech rozpocitanych kontrolnich souctu dalsi data.
+ *
+ */
+void DigestSet::Update(const char * data, int size) {
+    int i;
+
+    if (mask == 0 || size <= 0) return;
+
+    if (mask & (1 << DIGEST_CRC32)) crc = crc32(crc, (const Bytef *)data, size);
+    for (i = DIGEST_CRC32 + 1; i < DIGEST_COUNT; i++)
+        if (mask & (1 << i)) EVP_DigestUpdate(ctx[i], data, size);
+}
+
+
+/** Zapocita prvnich length bytu souboru name.
+ *
+ * Pouziva se pri APPE a obnovenem STOR, kdy soubor uz nejaka data obsahuje.
+ * Pokud je puvodni obsah delsi nez DIGEST_PRIME_MAX, vypocet se zrusi -
+ * soucet se pak spocita az na vyzadani.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      vypocet byl zrusen
+ *
+ */
+int DigestSet::Prime(const char * name, unsigned long long length) {
+    int                 fd;
+    char              * buffer;
+    int                 nacteno;
+
+    if (mask == 0) return -1;
+    if (length == 0) return 1;
+    if (length > DIGEST_PRIME_MAX) {
+        mask = 0;
+        return -1;
+    }
+
+    fd = open(name, O_RDONLY);
+    if (fd == -1) {
+        mask = 0;
+        return -1;
+    }
+
+    buffer = new char[DIGEST_BUF_SIZE];
+    while (length > 0) {
+        nacteno = read(fd, buffer, (length < DIGEST_BUF_SIZE) ? length : DIGEST_BUF_SIZE);
+        if (nacteno == -1 && errno == EINTR) continue;
+        if (nacteno <= 0) {
+            mask = 0;
+            break;
+        }
+        Update(buffer, nacteno);
+        length -= nacteno;
+    }
+    delete [] buffer;
+    close(fd);
+
+    return (mask == 0) ? -1 : 1;
+}
+
+
+/** Dokonci vypocet vsech rozpocitanych kontrolnich souctu.
+ *
+ * Vysledky jsou pak k dispozici pres Result() a Store().
+ */
+void DigestSet::Final() {
+    unsigned char   md[EVP_MAX_MD_SIZE];
+    unsigned int    md_len;
+    unsigned char   crc_bin[4];
+    int             i;
+
+    done = 0;
+    for (i = 0; i < DIGEST_COUNT; i++) {
+        if (!(mask & (1 << i))) continue;
+
+        if (i == DIGEST_CRC32) {
+            crc_bin[0] = (crc >> 24) & 0xff;
+            crc_bin[1] = (crc >> 16) & 0xff;
+            crc_bin[2] = (crc >>  8) & 0xff;
+            crc_bin[3] =  crc        & 0xff;
+            Bin2Hex(crc_bin, 4, result[i]);
+        } else {
+            if (EVP_DigestFinal_ex(ctx[i], md, &md_len) != 1) continue;
+            Bin2Hex(md, md_len, result[i]);
+        }
+        done |= 1 << i;
+    }
+    mask = 0;
+}
+
+
+/** Vrati vysledek algoritmu id (po zavolani Final()).
+ *
+ * Vrati 1, pokud byl vysledek spocitan, jinak -1.
+ */
+int DigestSet::Result(int id, string &hex) {
+    if (id < 0 || id >= DIGEST_COUNT || !(done & (1 << id))) return -1;
+    hex = result[id];
+    return 1;
+}
+
+
+/** Ulozi spocitane vysledky do cache k souboru name.
+ *
+ * Soubor uz musi byt zavreny, aby se do cache dostala jeho konecna velikost
+ * a cas modifikace.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      -  0      nic se nepocitalo
+ *      - -1      chyba
+ *
+ */
+int DigestSet::Store(const char * name) {
+    struct stat     st;
+    int             i;
+    int             ret = 1;
+
+    if (done == 0) return 0;
+    if (stat(name, &st) == -1) return -1;
+
+    for (i = 0; i < DIGEST_COUNT; i++)
+        if ((done & (1 << i)) && StoreDigest(st, i, result[i]) < 0) ret = -1;
+
+    return ret;
+}
+
+
+/** Spocita kontrolni soucet casti souboru.
+ *
+ * Pocita se od bytu start az po byte pred end. Pokud je end rovno
+ * DIGEST_TO_EOF nebo za koncem souboru, pocita se do konce souboru a do end
+ * se ulozi velikost souboru. Soucet celeho souboru se bere z cache, pokud
+ * tam je, a po spocitani se tam ulozi.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, vysledek je v hex
+ *      - -1      chyba pri praci se souborem
+ *      - -2      spatny rozsah
+ *
+ */
+int FileDigest(const char * name, int id, unsigned long long start, unsigned long long &end, string &hex) {
+    int                 fd;
+    struct stat         st, now;
+    DigestSet           digest;
+    char              * buffer;
+    int                 nacteno;
+    unsigned long long  pos;
+    bool                whole;
+    string              cached;
+
+    if (id < 0 || id >= DIGEST_COUNT) return -2;
+
+    fd = open(name, O_RDONLY);
+    if (fd == -1) return -1;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    if (end > (unsigned long long)st.st_size) end = st.st_size;
+    if (start > end) {
+        close(fd);
+        return -2;
+    }
+
+    whole = (start == 0 && end == (unsigned long long)st.st_size);
+    if (whole && LoadDigest(st, id, cached) > 0) {
+        close(fd);
+        hex = cached;
+        return 1;
+    }
+
+    digest.Start(1 << id);
+    buffer = new char[DIGEST_BUF_SIZE];
+    pos    = start;
+    while (pos < end) {
+        nacteno = pread(fd, buffer, (end - pos < DIGEST_BUF_SIZE) ? end - pos : DIGEST_BUF_SIZE, pos);
+        if (nacteno == -1 && errno == EINTR) continue;
+        if (nacteno <= 0) {
+            delete [] buffer;
+            close(fd);
+            return -1;
+        }
+        digest.Update(buffer, nacteno);
+        pos += nacteno;
+    }
+    delete [] buffer;
+
+    digest.Final();
+    if (digest.Result(id, hex) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    //pokud se soubor mezitim nezmenil, ulozime soucet do cache
+    if (whole && fstat(fd, &now) == 0 && now.st_mtime == st.st_mtime && now.st_size == st.st_size)
+        StoreDigest(st, id, hex);
+    close(fd);
+
+    return 1;
+}
@@ -0,0 +1,64 @@
+/** @file digest.h
+ *  \brief Deklarace funkci pro vypocet kontrolnich souctu souboru.
+ *
+ */
+
+#ifndef __digest_h
+#define __digest_h
+
+#include <string>
+
+#include <openssl/evp.h>
+
+#include "cache.h"
+
+using namespace std;
+
+#define DIGEST_CRC32    0
+#define DIGEST_MD5      1
+#define DIGEST_SHA1     2
+#define DIGEST_SHA256   3
+#define DIGEST_COUNT    4 //< pocet podporovanych algoritmu
+
+#define DIGEST_DEFAULT  DIGEST_SHA256 //< algoritmus pro HASH, dokud ho klient nezmeni prikazem OPTS HASH
+
+#define DIGEST_TO_EOF   (~0ULL) //< konec rozsahu pro FileDigest() = konec souboru
+
+#define DIGEST_PRIME_MAX (64*1024*1024) //< nejvetsi puvodni obsah souboru, ktery se pri APPE/REST dopocita predem
+
+extern int hash_algorithm;
+extern int digest_mask;
+
+
+/** Soucasny vypocet vice kontrolnich souctu nad jednim proudem dat.
+ *
+ * Pouziva se pri uploadu - data se do kontrolnich souctu zapocitavaji
+ * prubezne tak, jak se zapisuji do souboru, a po skonceni prenosu se
+ * vysledky ulozi do cache (viz. cache.h). Nasledny HASH nebo XCRC, XMD5, ...
+ * uz pak soubor nemusi cist.
+ */
+class DigestSet {
+public:
+    DigestSet();
+    ~DigestSet();
+
+    void Start(int _mask);
+    void Update(const char * data, int size);
+    int  Prime(const char * name, unsigned long long length);
+    void Final();
+    int  Result(int id, string &hex);
+    int  Store(const char * name);
+
+private:
+    int             mask;   ///< ktere algoritmy se pocitaji (bit 1<<DIGEST_xxx)
+    int             done;   ///< ktere algoritmy uz maji vysledek
+    EVP_MD_CTX    * ctx[DIGEST_COUNT];
+    unsigned long   crc;
+    string          result[DIGEST_COUNT];
+};
+
+int          DigestByName(const char * name);
+const char * DigestName(int id);
+int          FileDigest(const char * name, int id, unsigned long long start, unsigned long long &end, string &hex);
+
+#endif //__digest_h
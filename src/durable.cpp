@@ -0,0 +1,220 @@
+/** @file durable.cpp
+ *  \brief Implementace zapisu dat na disk podle nastavene urovne durability.
+ *
+ * Uroven se nastavuje prepinacem -y:
+ *
+ *      - DURABILITY_NONE   - o zapis na disk se stara jadro, kdy se mu hodi
+ *      - DURABILITY_DATA   - data uploadu se pred odpovedi 226 zapisou
+ *                            (fdatasync()), behem prenosu se zapis
+ *                            prubezne startuje pres sync_file_range()
+ *      - DURABILITY_FULL   - navic se kazda zmena databaze pred odpovedi
+ *                            klientovi dostane na disk
+ *
+ * Aby kazda zmena databaze nestala jeden fdatasync(), zmeny ze vsech procesu
+ * se potvrzuji skupinove (group commit, viz. GroupCommitState): dokud jeden
+ * proces synchronizuje, ostatni se radi za nim a po jeho skonceni je vsechny
+ * pokryje jediny dalsi fdatasync().
+ *
+ */
+
+#include "durable.h"
+#include "trace.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+}
+
+
+static GroupCommitState * group_commit = 0; //< sdileny stav, 0 = skupinovy commit neni k dispozici
+
+
+/** Pripravi sdileny stav skupinoveho commitu.
+ *
+ * Musi se zavolat pred prvnim fork(), aby stav sdilely vsechny procesy.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se vytvorit sdilenou pamet nebo zamek
+ *
+ */
+int DurableInit() {
+    pthread_mutexattr_t mattr;
+    pthread_condattr_t  cattr;
+    void              * p;
+
+    if (durability < DURABILITY_FULL) return 1;
+
+    p = mmap(0, sizeof(GroupCommitState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return -1;
+    group_commit = (GroupCommitState *)p;
+
+    //zamek musi prezit i smrt procesu, ktery ho zrovna drzi
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+
+    if (pthread_mutex_init(&group_commit->lock, &mattr) != 0
+            || pthread_cond_init(&group_commit->done, &cattr) != 0) {
+        munmap(p, sizeof(GroupCommitState));
+        group_commit = 0;
+        return -1;
+    }
+    pthread_mutexattr_destroy(&mattr);
+    pthread_condattr_destroy(&cattr);
+
+    return 1;
+}
+
+
+/** Zamkne sdileny stav, pripadne po procesu, ktery zemrel se zamcenym stavem.
+ *
+ */
+static void GroupCommitLock() {
+    if (pthread_mutex_lock(&group_commit->lock) == EOWNERDEAD) {
+        group_commit->syncing = 0;
+        pthread_mutex_consistent(&group_commit->lock);
+    }
+}
+
+
+/** Zapise na disk soubor name.
+ *
+ */
+static int SyncFile(const char * name) {
+    int fd;
+    int ret;
+
+    fd = open(name, O_RDWR);
+    if (fd == -1) return -1;
+    ret = fdatasync(fd);
+    close(fd);
+    return (ret == 0) ? 1 : -1;
+}
+
+
+/** Pocka, az budou na disku vsechny dosud provedene zmeny souboru name.
+ *
+ * Vola se po kazde zmene databaze (uz po odemknuti databaze, aby do stejne
+ * skupiny mohly pribyt zmeny ostatnich procesu). Pri uroven durability nizsi
+ * nez DURABILITY_FULL nedela nic.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, zmena je na disku
+ *      - -1      chyba pri zapisu na disk
+ *
+ */
+int GroupCommit(const char * name) {
+    unsigned long long  ticket;
+    unsigned long long  target;
+    struct timespec     limit;
+    int                 ret;
+
+    if (durability < DURABILITY_FULL) return 1;
+    TraceSpan span("group commit", "disk");
+    if (group_commit == 0) return SyncFile(name);
+
+    GroupCommitLock();
+    ticket = ++group_commit->requested;
+
+    while (group_commit->durable < ticket) {
+        if (group_commit->syncing == 0) {
+            //nikdo nesynchronizuje - potvrdime vsechno, co se zatim nasbiralo
+            group_commit->syncing = getpid();
+            target = group_commit->requested;
+            pthread_mutex_unlock(&group_commit->lock);
+
+            ret = SyncFile(name);
+
+            GroupCommitLock();
+            group_commit->syncing = 0;
+            group_commit->batches++;
+            if (ret > 0) {
+                group_commit->commits += target - group_commit->durable;
+                group_commit->durable  = target;
+            }
+            pthread_cond_broadcast(&group_commit->done);
+            if (ret < 0) {
+                pthread_mutex_unlock(&group_commit->lock);
+                return -1;
+            }
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &limit);
+        limit.tv_sec += GROUP_COMMIT_TIMEOUT;
+        ret = pthread_cond_timedwait(&group_commit->done, &group_commit->lock, &limit);
+        if (ret == EOWNERDEAD) {
+            group_commit->syncing = 0;
+            pthread_mutex_consistent(&group_commit->lock);
+        }
+        //proces, ktery synchronizoval, mohl mezitim zemrit
+        if (ret == ETIMEDOUT && group_commit->syncing != 0
+                && kill(group_commit->syncing, 0) == -1 && errno == ESRCH)
+            group_commit->syncing = 0;
+    }
+
+    pthread_mutex_unlock(&group_commit->lock);
+    return 1;
+}
+
+
+/** Nastartuje zapis jiz zapsanych dat souboru na disk, ale neceka na nej.
+ *
+ * Vola se prubezne behem uploadu - zaverecny DataSync() pak uz jen dopise
+ * zbytek a klient na 226 neceka tak dlouho.
+ */
+void DataWriteback(int fd) {
+    if (durability < DURABILITY_DATA) return;
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+}
+
+
+/** Zapise data souboru na disk.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      chyba pri zapisu na disk
+ *
+ */
+int DataSync(int fd) {
+    if (durability < DURABILITY_DATA) return 1;
+    TraceSpan span("fdatasync", "disk");
+    return (fdatasync(fd) == 0) ? 1 : -1;
+}
+
+
+/** Zapise na disk adresar, ve kterem lezi soubor name.
+ *
+ * Pouziva se po rename(), aby i nove jmeno souboru preckalo pad systemu.
+ */
+int DirSync(const string &name) {
+    int                 fd;
+    int                 ret;
+    string::size_type   n;
+    string              dir;
+
+    if (durability < DURABILITY_DATA) return 1;
+    TraceSpan span("dir fsync", "disk");
+
+    n = name.rfind('/');
+    if (n == string::npos) dir = ".";
+        else if (n == 0) dir = "/";
+        else dir = name.substr(0, n);
+
+    fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd == -1) return -1;
+    ret = fsync(fd);
+    close(fd);
+    return (ret == 0) ? 1 : -1;
+}
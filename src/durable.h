@@ -0,0 +1,53 @@
+/** @file durable.h
+ *  \brief Deklarace funkci, ktere zajistuji, ze zapsana data jsou na disku.
+ *
+ */
+
+#ifndef __durable_h
+#define __durable_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define DURABILITY_NONE  0 //< nic se nesynchronizuje (puvodni chovani)
+#define DURABILITY_DATA  1 //< data uploadu jsou na disku drive, nez klient dostane 226
+#define DURABILITY_FULL  2 //< navic i zmeny databaze, synchronizuji se skupinove
+
+#define DURABLE_WRITEBACK_CHUNK (8*1024*1024) //< po kolika zapsanych bytech se nastartuje zapis na disk
+#define GROUP_COMMIT_TIMEOUT    1 //< po kolika sekundach cekani se overi, jestli proces, ktery synchronizuje, jeste zije
+
+extern int durability;
+
+
+/** Sdileny stav skupinoveho commitu (mmap MAP_SHARED, vytvari se pred fork()).
+ *
+ * Kazda zmena databaze dostane poradove cislo (requested). Proces, ktery
+ * chce mit svou zmenu na disku, bud sam zavola fdatasync() (pokud to zrovna
+ * nikdo nedela) a tim potvrdi vsechny zmeny az do aktualniho poradoveho
+ * cisla, nebo pocka, az to udela jiny proces. Vsechny zmeny, ktere prijdou
+ * behem jednoho fdatasync(), tak pokryje jediny dalsi fdatasync().
+ */
+struct GroupCommitState {
+    pthread_mutex_t     lock;
+    pthread_cond_t      done;
+    unsigned long long  requested; ///< poradove cislo posledni zmeny
+    unsigned long long  durable;   ///< vsechny zmeny az do tohoto cisla jsou na disku
+    pid_t               syncing;   ///< kdo prave vola fdatasync() (0 = nikdo)
+    unsigned long long  batches;   ///< pocet provedenych fdatasync()
+    unsigned long long  commits;   ///< pocet potvrzenych zmen
+};
+
+int  DurableInit();
+int  GroupCommit(const char * name);
+void DataWriteback(int fd);
+int  DataSync(int fd);
+int  DirSync(const string &name);
+
+#endif //__durable_h
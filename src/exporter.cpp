@@ -0,0 +1,350 @@
+/** @file exporter.cpp
+ *  \brief Implementace HTTP exportu metrik ve formatu OpenMetrics.
+ *
+ * Pokud je zadany prepinac -m, spusti hlavni proces dalsi proces (pres
+ * MaintenanceStart()), ktery na zadanem portu prijima HTTP pozadavky a na
+ * GET /metrics odpovi metrikami vsech procesu serveru ve formatu OpenMetrics
+ * (ten umi cist napr. Prometheus). Metriky cte jen ze sdilene pameti (viz.
+ * MetricsSnapshot() a FileCacheCounters()), takze stahovani metrik nikdy
+ * nezdrzi obsluhu klientu.
+ *
+ * Doby jsou v sekundach, histogramy maji hranice v mocninach 4 (hranice
+ * intervalu histogramu v metrics.cpp, proto jsou pocty presne).
+ *    Pozadavky se obsluhuji postupne v jedinem procesu, kazdy nejdele
+ * EXPORTER_TIMEOUT sekund, takze pomaly klient export nezablokuje.
+ *
+ */
+
+#include "exporter.h"
+#include "metrics.h"
+#include "filecache.h"
+#include "pomocne.h"
+
+extern "C" {
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+}
+
+extern bool run;
+
+#include <map>
+
+
+/** Otevre socket, na kterem export posloucha.
+ *
+ * Vola se v hlavnim procesu, aby se pripadna chyba (port je obsazeny)
+ * ukazala hned pri startu. Prazdna adresa address znamena vsechna
+ * rozhrani.
+ *
+ * Vrati socket, nebo -1 pri chybe.
+ */
+int ExporterOpen(const string &address, int port) {
+    struct sockaddr_in  addr;
+    int                 sock;
+    int                 on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address != "" && inet_aton(address.c_str(), &addr.sin_addr) == 0) return -1;
+
+    sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (sock == -1) return -1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(sock, 16) == -1) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+
+/** Prida do out jeden radek s hodnotou.
+ *
+ */
+static void Sample(string &out, const char * name, const char * labels, unsigned long long value) {
+    char tmp[200];
+
+    snprintf(tmp, sizeof(tmp), "%s%s %llu\n", name, labels, value);
+    out += tmp;
+}
+
+
+/** Prida do out hlavicku rodiny metrik.
+ *
+ */
+static void Family(string &out, const char * name, const char * type, const char * unit, const char * help) {
+    out += string("# TYPE ") + name + " " + type + "\n";
+    if (unit != 0) out += string("# UNIT ") + name + " " + unit + "\n";
+    out += string("# HELP ") + name + " " + help + "\n";
+}
+
+
+/** Prida do out histogram h rodiny name s popiskem label (muze byt "").
+ *
+ * Hodnoty v histogramu jsou v jednotkach 1/scale (napr. us pro scale 1e6),
+ * hranice se vypisuji v zakladnich jednotkach. Hranice jsou mocniny 4 od
+ * first do last.
+ */
+static void HistogramSamples(string &out, const char * name, const string &label, const Histogram &h,
+                             double scale, unsigned long long first, unsigned long long last) {
+    char                tmp[300];
+    string              sep = (label == "") ? "" : ",";
+    unsigned long long  le;
+
+    for (le = first; le <= last; le *= 4) {
+        snprintf(tmp, sizeof(tmp), "%s_bucket{%s%sle=\"%.10g\"} %llu\n", name, label.c_str(), sep.c_str(),
+                 le / scale, HistogramAtMost(h, le));
+        out += tmp;
+    }
+    snprintf(tmp, sizeof(tmp), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, label.c_str(), sep.c_str(), h.count);
+    out += tmp;
+    if (label == "") snprintf(tmp, sizeof(tmp), "%s_count %llu\n%s_sum %.6f\n", name, h.count, name, h.sum / scale);
+        else snprintf(tmp, sizeof(tmp), "%s_count{%s} %llu\n%s_sum{%s} %.6f\n", name, label.c_str(), h.count,
+                      name, label.c_str(), h.sum / scale);
+    out += tmp;
+}
+
+
+/** Vrati hodnotu popisku s escapovanymi znaky \, " a LF.
+ *
+ */
+static string LabelValue(const string &s) {
+    string          r;
+    unsigned int    i;
+
+    for (i = 0; i < s.size(); i++) {
+        if (s[i] == '\\' || s[i] == '"') r += '\\';
+        if (s[i] == '\n') r += "\\n"; else r += s[i];
+    }
+    return r;
+}
+
+
+/** Vytvori text se vsemi metrikami serveru ve formatu OpenMetrics.
+ *
+ */
+void ExporterRender(string &out) {
+    MetricsTotals                   * t;
+    map<string, unsigned long long>   sent, received;
+    map<string, unsigned long long>::iterator it;
+    unsigned long long                hits, misses, bytes;
+    string                            s;
+    char                              tmp[300];
+    int                               i;
+
+    out = "";
+    t = new MetricsTotals;
+    if (MetricsSnapshot(*t) < 0) {
+        delete t;
+        out = "# EOF\n";
+        return;
+    }
+
+    Family(out, "smallftpd_start_time_seconds", "gauge", "seconds", "Time the server was started.");
+    Sample(out, "smallftpd_start_time_seconds", "", t->started);
+
+    Family(out, "smallftpd_sessions", "gauge", 0, "Client sessions currently served.");
+    Sample(out, "smallftpd_sessions", "", t->workers);
+
+    Family(out, "smallftpd_accepts", "counter", 0, "Accepted control connections.");
+    Sample(out, "smallftpd_accepts_total", "", t->accepts);
+
+    Family(out, "smallftpd_commands", "counter", 0, "Commands handled.");
+    for (i = 0; i < number_of_commands && i < METRICS_MAX_COMMANDS; i++)
+        if (t->commands[i].count > 0) {
+            snprintf(tmp, sizeof(tmp), "{command=\"%s\"}", command_table[i].name);
+            Sample(out, "smallftpd_commands_total", tmp, t->commands[i].count);
+        }
+
+    Family(out, "smallftpd_command_duration_seconds", "histogram", "seconds", "Time spent handling a command.");
+    for (i = 0; i < number_of_commands && i < METRICS_MAX_COMMANDS; i++)
+        if (t->commands[i].count > 0) {
+            s = string("command=\"") + command_table[i].name + "\"";
+            HistogramSamples(out, "smallftpd_command_duration_seconds", s, t->commands[i], 1e6, 16, 67108864);
+        }
+
+    Family(out, "smallftpd_data_connect_seconds", "histogram", "seconds", "Time to open a data connection, including TLS.");
+    HistogramSamples(out, "smallftpd_data_connect_seconds", "", t->other[METRIC_DATA_CONNECT], 1e6, 16, 67108864);
+
+    Family(out, "smallftpd_tls_handshake_seconds", "histogram", "seconds", "TLS handshake time.");
+    HistogramSamples(out, "smallftpd_tls_handshake_seconds", "", t->other[METRIC_TLS_HANDSHAKE], 1e6, 16, 67108864);
+
+    Family(out, "smallftpd_db_lookup_seconds", "histogram", "seconds", "File database lookup time.");
+    HistogramSamples(out, "smallftpd_db_lookup_seconds", "", t->other[METRIC_DB_LOOKUP], 1e6, 1, 1048576);
+
+    Family(out, "smallftpd_db_lock_wait_seconds", "histogram", "seconds", "Time spent waiting for the file database lock.");
+    HistogramSamples(out, "smallftpd_db_lock_wait_seconds", "", t->other[METRIC_DB_LOCK_WAIT], 1e6, 1, 67108864);
+
+    Family(out, "smallftpd_transfer_rate_bytes_per_second", "histogram", 0, "Throughput of finished transfers.");
+    HistogramSamples(out, "smallftpd_transfer_rate_bytes_per_second", "", t->other[METRIC_TRANSFER_RATE], 1, 1024, 17179869184ULL);
+
+    //stejne jmeno muze byt ve sdilene tabulce dvakrat (viz. MetricsShare)
+    for (i = 0; i < t->shares; i++)
+        if (t->share_names[i][0] != 0) {
+            sent[t->share_names[i]]     += t->share_sent[i];
+            received[t->share_names[i]] += t->share_received[i];
+        }
+
+    Family(out, "smallftpd_sent_bytes", "counter", "bytes", "Data sent to clients.");
+    Sample(out, "smallftpd_sent_bytes_total", "", t->bytes_sent);
+    for (it = sent.begin(); it != sent.end(); it++) {
+        s = "{share=\"" + LabelValue(it->first) + "\"}";
+        Sample(out, "smallftpd_sent_bytes_total", s.c_str(), it->second);
+    }
+
+    Family(out, "smallftpd_received_bytes", "counter", "bytes", "Data received from clients.");
+    Sample(out, "smallftpd_received_bytes_total", "", t->bytes_received);
+    for (it = received.begin(); it != received.end(); it++) {
+        s = "{share=\"" + LabelValue(it->first) + "\"}";
+        Sample(out, "smallftpd_received_bytes_total", s.c_str(), it->second);
+    }
+
+    FileCacheCounters(hits, misses, bytes);
+    Family(out, "smallftpd_cache_hits", "counter", 0, "Cache hits.");
+    Sample(out, "smallftpd_cache_hits_total", "{cache=\"stat\"}", t->cache_hits[METRICS_CACHE_STAT]);
+    Sample(out, "smallftpd_cache_hits_total", "{cache=\"list\"}", t->cache_hits[METRICS_CACHE_LIST]);
+    Sample(out, "smallftpd_cache_hits_total", "{cache=\"file\"}", hits);
+    Family(out, "smallftpd_cache_misses", "counter", 0, "Cache misses.");
+    Sample(out, "smallftpd_cache_misses_total", "{cache=\"stat\"}", t->cache_misses[METRICS_CACHE_STAT]);
+    Sample(out, "smallftpd_cache_misses_total", "{cache=\"list\"}", t->cache_misses[METRICS_CACHE_LIST]);
+    Sample(out, "smallftpd_cache_misses_total", "{cache=\"file\"}", misses);
+
+    out += "# EOF\n";
+    delete t;
+}
+
+
+/** Pocka, az pujde se socketem sock provest events (POLLIN/POLLOUT), nejdele
+ * do casu deadline (CLOCK_MONOTONIC, v ms).
+ *
+ * Vrati 1, pokud socket je pripraveny, jinak -1 (vyprsel cas, chyba).
+ */
+static int WaitFor(int sock, short events, long long deadline) {
+    struct pollfd   pfd;
+    struct timespec now;
+    long long       left;
+    int             n;
+
+    pfd.fd     = sock;
+    pfd.events = events;
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = deadline - ((long long)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+        if (left <= 0) return -1;
+        n = poll(&pfd, 1, left);
+        if (n == -1 && errno == EINTR) {
+            if (!run) return -1;
+            continue;
+        }
+        return (n > 0) ? 1 : -1;
+    }
+}
+
+
+/** Posle cely buffer data klientovi (nejdele do casu deadline, viz.
+ * WaitFor()).
+ *
+ */
+static int SendAll(int sock, const char * data, int size, long long deadline) {
+    int n;
+
+    while (size > 0) {
+        if (WaitFor(sock, POLLOUT, deadline) < 0) return -1;
+        n = send(sock, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) return -1;
+        data += n;
+        size -= n;
+    }
+    return 1;
+}
+
+
+/** Obslouzi jeden HTTP pozadavek.
+ *
+ * Cely pozadavek (prijeti i odeslani odpovedi) smi trvat nejdele
+ * EXPORTER_TIMEOUT sekund - klient, ktery posila nebo cte po bytech, by
+ * jinak export zablokoval na libovolne dlouho.
+ */
+static void ExporterRequest(int client) {
+    char            request[EXPORTER_REQUEST_MAX + 1];
+    int             len = 0;
+    int             n;
+    char            header[300];
+    string          body;
+    const char    * status = "200 OK";
+    const char    * type   = EXPORTER_CONTENT_TYPE;
+    bool            head   = false;
+    struct timespec now;
+    long long       deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    deadline = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + EXPORTER_TIMEOUT * 1000;
+
+    //staci nam cely prvni radek pozadavku, zbytek hlavicky nas nezajima
+    while (len < EXPORTER_REQUEST_MAX && memchr(request, '\n', len) == 0) {
+        if (WaitFor(client, POLLIN, deadline) < 0) return;
+        n = recv(client, request + len, EXPORTER_REQUEST_MAX - len, MSG_DONTWAIT);
+        if (n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) return;
+        len += n;
+    }
+    request[len] = 0;
+
+    if (strncmp(request, "HEAD ", 5) == 0) head = true;
+    if (strncmp(request, "GET ", 4) != 0 && !head) {
+        status = "405 Method Not Allowed";
+        type   = "text/plain";
+        body   = "Only GET is supported.\n";
+    } else if (strncmp(request + (head ? 5 : 4), "/metrics ", 9) != 0
+            && strncmp(request + (head ? 5 : 4), "/metrics?", 9) != 0) {
+        status = "404 Not Found";
+        type   = "text/plain";
+        body   = "Metrics are at /metrics.\n";
+    } else ExporterRender(body);
+
+    snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+             status, type, (unsigned int)body.size());
+    if (SendAll(client, header, strlen(header), deadline) < 0 || head) return;
+    SendAll(client, body.data(), body.size(), deadline);
+}
+
+
+/** Hlavni smycka procesu exportu metrik.
+ *
+ * Pozadavky obsluhuje postupne jeden po druhem, pomalemu klientovi po
+ * EXPORTER_TIMEOUT sekundach spojeni zavre. Na spojeni ceka pres poll() s
+ * timeoutem (accept() by se po signalu diky SA_RESTART jen zopakoval), takze
+ * skonci po SIGTERM (viz. TermHandler()) i po skonceni hlavniho procesu
+ * serveru.
+ */
+void Exporter(int sock) {
+    struct pollfd   pfd;
+    int             client;
+
+    pfd.fd     = sock;
+    pfd.events = POLLIN;
+
+    while (run) {
+        if (getppid() == 1) break;
+        if (poll(&pfd, 1, 1000) <= 0) continue;
+
+        client = accept(sock, 0, 0);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) continue;
+            return;
+        }
+        ExporterRequest(client);
+        close(client);
+    }
+}
@@ -0,0 +1,30 @@
+/** @file exporter.h
+ *  \brief Deklarace HTTP exportu metrik ve formatu OpenMetrics.
+ *
+ */
+
+#ifndef __exporter_h
+#define __exporter_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define EXPORTER_REQUEST_MAX  4096 //< nejvetsi delka HTTP pozadavku
+#define EXPORTER_TIMEOUT      2    //< za kolik sekund se spojeni s pomalym klientem zavre (celkem za pozadavek)
+#define EXPORTER_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+extern int    metrics_port;
+extern string metrics_address;
+
+
+int  ExporterOpen(const string &address, int port);
+void Exporter(int sock);
+void ExporterRender(string &out);
+
+#endif //__exporter_h
@@ -0,0 +1,225 @@
+/** @file filecache.cpp
+ *  \brief Implementace sdilene cache obsahu malych souboru.
+ *
+ * Velka cast stahovani jsou tytez male soubory (seznamy, kontrolni soucty,
+ * indexy), ktere stahuji tisice klientu. Obsah souboru do velikosti
+ * file_cache_max (prepinac -c) se proto drzi ve sdilene pameti vsech
+ * procesu a RETR ho posle jednim zapisem, bez otevirani a cteni souboru.
+ *    Obsah plati, dokud souhlasi zarizeni, inode, velikost a cas modifikace
+ * souboru - ty se zjisti pres sdilenou cache stat() (viz. statcache.cpp),
+ * takze RETR souboru z cache nevola zadne systemove volani nad souborem.
+ *    Pamet je rozdelena na sloty o velikosti file_cache_max, soubor muze byt
+ * v kteremkoli z FILE_CACHE_WAYS slotu podle hashe inodu a pri ulozeni
+ * noveho souboru se z nich vyhodi ten nejdele nepouzity. Data se pred
+ * odeslanim zkopiruji ze slotu (overi se, ze je mezitim nikdo neprepsal),
+ * takze se nic nezamyka a smrt procesu uprostred prenosu cache neposkodi.
+ *
+ */
+
+#include "filecache.h"
+#include "statcache.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+}
+
+
+static FileCacheHeader  * cache = 0; //< sdilena cache, 0 = cache je vypnuta
+static FileCacheSlot    * slots = 0;
+static char             * space = 0; //< data slotu
+
+
+/** Vytvori sdilenou cache.
+ *
+ * Musi se zavolat pred prvnim fork(). Pri file_cache_max == 0 nedela nic.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se vytvorit sdilenou pamet
+ *
+ */
+int FileCacheInit() {
+    unsigned int    n;
+    size_t          size;
+    void          * p;
+
+    if (file_cache_max == 0) return 1;
+
+    n = FILE_CACHE_MEMORY / file_cache_max;
+    if (n > FILE_CACHE_MAX_SLOTS) n = FILE_CACHE_MAX_SLOTS;
+    n -= n % FILE_CACHE_WAYS;
+    if (n == 0) n = FILE_CACHE_WAYS;
+
+    //stranky se skutecne alokuji, az kdyz se do nich neco zapise
+    size = sizeof(FileCacheHeader) + n * sizeof(FileCacheSlot) + (size_t)n * file_cache_max;
+    p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return -1;
+
+    cache = (FileCacheHeader *)p;
+    slots = (FileCacheSlot *)((char *)p + sizeof(FileCacheHeader));
+    space = (char *)(slots + n);
+    cache->max_size = file_cache_max;
+    cache->slots    = n;
+    return 1;
+}
+
+
+/** Souhlasi slot s udaji o souboru st?
+ *
+ */
+static bool SlotMatches(FileCacheSlot * s, struct stat &st) {
+    return s->length == (unsigned long long)st.st_size && s->size == (unsigned long long)st.st_size
+        && s->dev == (unsigned long long)st.st_dev && s->ino == (unsigned long long)st.st_ino
+        && s->mtime == st.st_mtim.tv_sec && s->mtime_nsec == st.st_mtim.tv_nsec;
+}
+
+
+/** Najde obsah souboru st v cache a zkopiruje ho do data.
+ *
+ * Vrati 1, pokud soubor v cache byl, jinak -1.
+ */
+static int CacheGet(struct stat &st, unsigned int set, string &data) {
+    FileCacheSlot * s;
+    unsigned int    seq;
+    unsigned int    i;
+
+    for (i = 0; i < FILE_CACHE_WAYS; i++) {
+        s   = &slots[set + i];
+        seq = s->seq;
+        __sync_synchronize();
+        if ((seq & 1) || s->length == 0 || !SlotMatches(s, st)) continue;
+
+        data.assign(space + (size_t)(set + i) * cache->max_size, st.st_size);
+        __sync_synchronize();
+        if (s->seq != seq) continue; //mezitim ho nekdo prepsal
+
+        s->last_used = __sync_add_and_fetch(&cache->tick, 1);
+        return 1;
+    }
+    return -1;
+}
+
+
+/** Ulozi obsah data souboru st do cache (do nejdele nepouziteho slotu).
+ *
+ */
+static void CacheStore(struct stat &st, unsigned int set, const string &data) {
+    FileCacheSlot     * s;
+    FileCacheSlot     * victim = 0;
+    unsigned int        seq;
+    unsigned int        i;
+
+    for (i = 0; i < FILE_CACHE_WAYS; i++) {
+        s = &slots[set + i];
+        if (s->length == 0) {
+            victim = s;
+            break;
+        }
+        if (victim == 0 || s->last_used < victim->last_used) victim = s;
+    }
+
+    //slot, ktery prave nekdo zapisuje, nechame byt
+    seq = victim->seq;
+    if ((seq & 1) || !__sync_bool_compare_and_swap(&victim->seq, seq, seq + 1)) return;
+
+    victim->length     = 0;
+    victim->dev        = st.st_dev;
+    victim->ino        = st.st_ino;
+    victim->size       = st.st_size;
+    victim->mtime      = st.st_mtim.tv_sec;
+    victim->mtime_nsec = st.st_mtim.tv_nsec;
+    memcpy(space + (size_t)(victim - slots) * cache->max_size, data.data(), data.size());
+    victim->length     = data.size();
+    victim->last_used  = __sync_add_and_fetch(&cache->tick, 1);
+    __sync_synchronize();
+    victim->seq = seq + 2;
+}
+
+
+/** Nacte obsah souboru name, pokud je to obycejny soubor velky nanejvys
+ * limit bytu (a nanejvys file_cache_max) - z cache, nebo ze souboru (a
+ * ulozi ho do cache).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      obsah souboru je v data (z cache)
+ *      -  2      obsah souboru je v data (precteny ze souboru)
+ *      -  0      soubor se do cache nehodi, ma se poslat normalne
+ *      - -1      soubor se nepodarilo precist
+ *
+ */
+int FileCacheLoad(const string &name, unsigned int limit, string &data) {
+    struct stat         st;
+    struct stat         now;
+    unsigned long long  h;
+    unsigned int        set;
+    int                 fd;
+    int                 n;
+    int                 r;
+
+    if (cache == 0) return 0;
+    if (limit > cache->max_size) limit = cache->max_size;
+    if (StatCacheStat(name.c_str(), st) == -1 || !S_ISREG(st.st_mode) || st.st_size > limit) return 0;
+
+    h   = ((unsigned long long)st.st_dev * 0x9E3779B97F4A7C15ULL) ^ ((unsigned long long)st.st_ino * 0xFF51AFD7ED558CCDULL);
+    set = (h >> 17) % (cache->slots / FILE_CACHE_WAYS) * FILE_CACHE_WAYS;
+
+    if (CacheGet(st, set, data) == 1) {
+        __sync_fetch_and_add(&cache->hits, 1);
+        return 1;
+    }
+    __sync_fetch_and_add(&cache->misses, 1);
+
+    fd = open(name.c_str(), O_RDONLY);
+    if (fd == -1) return -1;
+    if (fstat(fd, &now) == -1 || !S_ISREG(now.st_mode) || now.st_size > limit) {
+        close(fd);
+        return 0;
+    }
+
+    //o bajt vic, abychom poznali, ze soubor mezitim narostl
+    data.resize(now.st_size + 1);
+    n = 0;
+    while ((size_t)n < data.size()) {
+        r = read(fd, &data[n], data.size() - n);
+        if (r == -1 && errno == EINTR) continue;
+        if (r <= 0) break;
+        n += r;
+    }
+    close(fd);
+    data.resize(n);
+
+    //ulozime jen obsah, ktery odpovida velikosti i po precteni
+    if (n == now.st_size && stat(name.c_str(), &st) == 0 && st.st_ino == now.st_ino && st.st_size == now.st_size
+            && st.st_mtim.tv_sec == now.st_mtim.tv_sec && st.st_mtim.tv_nsec == now.st_mtim.tv_nsec)
+        CacheStore(now, set, data);
+    return 2;
+}
+
+
+/** Zapocita bytes bytu poslanych z cache.
+ *
+ */
+void FileCacheServed(unsigned long long bytes) {
+    if (cache == 0) return;
+    __sync_fetch_and_add(&cache->bytes, bytes);
+}
+
+
+/** Vrati pocet zasahu a minuti cache a pocet bytu poslanych z cache (za
+ * vsechny procesy).
+ *
+ */
+void FileCacheCounters(unsigned long long &hits, unsigned long long &misses, unsigned long long &bytes) {
+    if (cache == 0) {
+        hits = misses = bytes = 0;
+        return;
+    }
+    hits   = cache->hits;
+    misses = cache->misses;
+    bytes  = cache->bytes;
+}
@@ -0,0 +1,63 @@
+/** @file filecache.h
+ *  \brief Deklarace sdilene cache obsahu malych souboru (prikaz RETR).
+ *
+ */
+
+#ifndef __filecache_h
+#define __filecache_h
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define FILE_CACHE_DEFAULT_MAX  (64*1024)          //< vychozi nejvetsi velikost souboru v cache (viz. prepinac -c)
+#define FILE_CACHE_MEMORY       (64*1024*1024)     //< kolik pameti cache nanejvys zabere
+#define FILE_CACHE_WAYS         4                  //< v kolika slotech muze byt jeden soubor (ze vsech se vyhazuje nejdele nepouzity)
+#define FILE_CACHE_MAX_SLOTS    65536              //< nejvetsi pocet slotu (pri velmi malem -c)
+
+extern unsigned int file_cache_max;
+
+
+/** Jeden slot cache - obsah jednoho souboru.
+ *
+ * Soubor identifikuje zarizeni a inode, obsah plati jen pri stejne
+ * velikosti a casu modifikace. Konzistenci cteni zajistuje seqlock seq
+ * (liche = prave probiha zapis), data slotu lezi v oblasti za sloty.
+ */
+struct FileCacheSlot {
+    volatile unsigned int       seq;
+    unsigned int                length;    ///< 0 = prazdny slot
+    unsigned long long          dev;
+    unsigned long long          ino;
+    unsigned long long          size;
+    long long                   mtime;
+    long long                   mtime_nsec;
+    volatile unsigned long long last_used; ///< hodnota FileCacheHeader::tick pri poslednim pouziti
+};
+
+
+/** Hlavicka sdilene cache (mmap MAP_SHARED, vytvari se pred fork()).
+ *
+ */
+struct FileCacheHeader {
+    unsigned int                max_size;  ///< nejvetsi velikost souboru (velikost dat jednoho slotu)
+    unsigned int                slots;     ///< pocet slotu (nasobek FILE_CACHE_WAYS)
+    volatile unsigned long long tick;      ///< citac pouziti (kvuli vyhazovani)
+    volatile unsigned long long hits;      ///< kolikrat se soubor poslal z cache
+    volatile unsigned long long misses;    ///< kolikrat se musel cist z disku
+    volatile unsigned long long bytes;     ///< kolik bytu se poslalo z cache
+};
+
+
+int  FileCacheInit();
+int  FileCacheLoad(const string &name, unsigned int limit, string &data);
+void FileCacheServed(unsigned long long bytes);
+void FileCacheCounters(unsigned long long &hits, unsigned long long &misses, unsigned long long &bytes);
+
+#endif //__filecache_h
@@ -0,0 +1,1264 @@
+/** @file ftpbench.cpp
+ *  \brief Zatezovy test serveru - spusti smallFTPd nad vygenerovanymi daty
+ *  a zmeri ho vice soucasnymi klienty.
+ *
+ * Program vytvori v pracovnim adresari konfiguraci (vfs.cfg, account.cfg,
+ * pro TLS novy certifikat) a sdilena data: adresar s velkym poctem
+ * souboru pro LIST, male soubory a jeden velky soubor pro RETR a adresar pro
+ * upload. Pak na loopbacku spusti server a postupne mu posila jednotlive
+ * scenare - kazdy bezi zadany pocet sekund ve zvolenem poctu vlaken, kazde
+ * vlakno jako jeden klient:
+ *
+ *      - login         pripojeni, USER, PASS a QUIT (mnoho prihlaseni naraz)
+ *      - list          LIST adresare s mnoha soubory
+ *      - retr_small    RETR nahodneho maleho souboru
+ *      - retr_large    RETR velkeho souboru
+ *      - retr_rang     RETR velkeho souboru po usecich (RANG) pres -R
+ *                      soucasnych spojeni; meri se jednou jednim proudem a
+ *                      jednou -R proudy, aby se dala porovnat celkova
+ *                      propustnost
+ *      - retr_modez    RETR textovych souboru v MODE S a v MODE Z; porovnava
+ *                      spotrebu CPU serveru s usetrenymi byty (soubory jsou
+ *                      mensi nez 64 KiB, takze je server komprimuje pri
+ *                      kazdem RETR a nebere je z cache komprimovanych dat)
+ *      - stor_small    STOR maleho souboru
+ *      - stor_large    STOR velkeho souboru
+ *      - mix           nahodna smes predchozich prikazu (kazde vlakno
+ *                      zvlast, vahy viz. MixOperation())
+ *
+ * Scenare s prenosem dat se spousti pro PASV i PORT, s prepinacem -T navic
+ * i se sifrovanim (AUTH TLS, PROT P). Scenare s uploadem (stor_small,
+ * stor_large a mix) se opakuji pro kazdou uroven durability serveru ze
+ * seznamu -y (vychozi 0,1,2) - server se pro kazdou uroven spusti znovu. Vysledky (pocet operaci za sekundu,
+ * MB/s, latence p50/p99/p999 jedne operace, CPU a pamet serveru) vypise ve
+ * formatu JSON, aby se daly porovnavat mezi verzemi.
+ *
+ * Pouziti: ftpbench [-s server] [-w adresar] [-p port] [-c vlaken]
+ *                   [-t sekund] [-S scenar,...] [-m pasv|port|both] [-T]
+ *                   [-D souboru] [-L MB] [-R useku] [-z uroven]
+ *                   [-y uroven,...] [-o vystup.json]
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+}
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/dh.h>
+#include <openssl/bio.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#define BENCH_USER          "bench"
+#define BENCH_PASSWORD      "bench"
+#define BENCH_SMALL_FILES   256         //< pocet malych souboru pro RETR
+#define BENCH_SMALL_SIZE    4096        //< velikost maleho souboru
+#define BENCH_TEXT_FILES    64          //< pocet textovych souboru pro retr_modez
+#define BENCH_TEXT_SIZE     (48*1024)   //< velikost textoveho souboru
+#define BENCH_BUF_SIZE      (256*1024)  //< buffer pro prenos dat
+#define BENCH_REPLY_MAX     8192
+#define BENCH_START_TIMEOUT 10          //< kolik sekund se ceka, nez server zacne prijimat spojeni
+#define BENCH_SAMPLE_MSEC   50          //< jak casto se meri pamet serveru
+#define BENCH_MAX_SEGMENTS  64          //< nejvic useku pro retr_rang
+
+#define OP_LOGIN        0
+#define OP_LIST         1
+#define OP_RETR_SMALL   2
+#define OP_RETR_LARGE   3
+#define OP_RETR_RANG    4
+#define OP_RETR_MODEZ   5
+#define OP_STOR_SMALL   6
+#define OP_STOR_LARGE   7
+#define OP_MIX          8
+#define OP_COUNT        9
+
+static const char * op_names[OP_COUNT] = {
+    "login", "list", "retr_small", "retr_large", "retr_rang", "retr_modez", "stor_small", "stor_large", "mix"
+};
+
+
+/** Nastaveni testu (z prepinacu).
+ *
+ */
+struct BenchConfig {
+    string      server;         ///< cesta k smallFTPd
+    string      dir;            ///< pracovni adresar s daty a konfiguraci
+    string      output;         ///< kam zapsat JSON, "" = stdout
+    int         port;
+    int         threads;
+    int         seconds;
+    int         list_files;     ///< pocet souboru v adresari pro LIST
+    long long   large_size;     ///< velikost velkeho souboru (B)
+    int         segments;       ///< pocet soucasnych useku pro retr_rang
+    int         zlevel;         ///< uroven komprese pro retr_modez (-1 = vychozi serveru)
+    bool        tls;
+    bool        pasv;
+    bool        port_mode;
+    bool        scenario[OP_COUNT];
+    vector<int> durability;     ///< urovne durability serveru (-y)
+};
+
+static BenchConfig  cfg;
+static SSL_CTX    * ssl_ctx = 0;
+static char       * upload_buf = 0;   //< data pro STOR (velikost cfg.large_size)
+
+
+/** Vrati aktualni cas v mikrosekundach.
+ *
+ */
+static unsigned long long Now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+
+/*************************************************************************
+ *                               Klient                                  *
+ *************************************************************************/
+
+/** Spojeni s jednim klientem (control connection a pripadne TLS).
+ *
+ */
+struct FtpClient {
+    int         sock;
+    SSL       * ssl;
+    bool        prot;           ///< data connection se sifruje (PROT P)
+    char        buf[BENCH_REPLY_MAX];
+    int         len;            ///< kolik bytu je v buf
+    unsigned int seed;
+};
+
+
+/** Posle po spojeni (pripadne sifrovanem) size bytu.
+ *
+ */
+static int SendAll(int sock, SSL * ssl, const char * data, int size) {
+    int n;
+
+    while (size > 0) {
+        if (ssl != 0) n = SSL_write(ssl, data, size);
+            else n = send(sock, data, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (ssl == 0 && n == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 1;
+}
+
+
+/** Precte ze spojeni nejvyse size bytu.
+ *
+ */
+static int Recv(int sock, SSL * ssl, char * data, int size) {
+    int n;
+
+    if (ssl != 0) return SSL_read(ssl, data, size);
+    do {
+        n = recv(sock, data, size, 0);
+    } while (n == -1 && errno == EINTR);
+    return n;
+}
+
+
+/** Precte jednu odpoved serveru (vcetne viceradkove) a vrati jeji kod,
+ * pripadne -1 pri chybe. Posledni radek odpovedi ulozi do line.
+ *
+ */
+static int ReadReply(FtpClient &c, string &line) {
+    char      * eol;
+    int         n;
+    int         code;
+
+    while (1) {
+        eol = (char *)memchr(c.buf, '\n', c.len);
+        if (eol == 0) {
+            if (c.len == BENCH_REPLY_MAX) return -1;
+            n = Recv(c.sock, c.ssl, c.buf + c.len, BENCH_REPLY_MAX - c.len);
+            if (n <= 0) return -1;
+            c.len += n;
+            continue;
+        }
+
+        line.assign(c.buf, eol - c.buf);
+        n = eol - c.buf + 1;
+        memmove(c.buf, eol + 1, c.len - n);
+        c.len -= n;
+
+        //radek "xyz-" nebo radek bez kodu pokracuje viceradkovou odpoved
+        if (line.size() >= 4 && isdigit(line[0]) && isdigit(line[1]) && isdigit(line[2]) && line[3] != '-') {
+            code = atoi(line.c_str());
+            return code;
+        }
+    }
+}
+
+
+/** Posle prikaz cmd a vrati kod odpovedi (-1 pri chybe).
+ *
+ */
+static int Command(FtpClient &c, const string &cmd, string &line) {
+    string  s = cmd + "\r\n";
+
+    if (SendAll(c.sock, c.ssl, s.c_str(), s.size()) < 0) return -1;
+    return ReadReply(c, line);
+}
+
+
+/** Vytvori TCP spojeni na 127.0.0.1:port.
+ *
+ */
+static int ConnectTo(int port) {
+    struct sockaddr_in  a;
+    int                 s;
+    int                 one = 1;
+
+    s = socket(PF_INET, SOCK_STREAM, 0);
+    if (s == -1) return -1;
+    memset(&a, 0, sizeof(a));
+    a.sin_family      = AF_INET;
+    a.sin_port        = htons(port);
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (struct sockaddr *)&a, sizeof(a)) == -1) {
+        close(s);
+        return -1;
+    }
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return s;
+}
+
+
+/** Ukonci spojeni s klientem c (bez QUIT).
+ *
+ */
+static void Disconnect(FtpClient &c) {
+    if (c.ssl != 0) {
+        SSL_shutdown(c.ssl);
+        SSL_free(c.ssl);
+        c.ssl = 0;
+    }
+    if (c.sock != -1) close(c.sock);
+    c.sock = -1;
+}
+
+
+/** Pripoji se k serveru, pripadne zapne TLS, a prihlasi se.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      chyba (spojeni je zavrene)
+ *
+ */
+static int Login(FtpClient &c, bool tls) {
+    string  line;
+
+    c.ssl  = 0;
+    c.len  = 0;
+    c.prot = false;
+    c.sock = ConnectTo(cfg.port);
+    if (c.sock == -1) return -1;
+    if (ReadReply(c, line) != 220) goto CHYBA;
+
+    if (tls) {
+        if (Command(c, "AUTH TLS", line) != 234) goto CHYBA;
+        c.ssl = SSL_new(ssl_ctx);
+        SSL_set_fd(c.ssl, c.sock);
+        if (SSL_connect(c.ssl) != 1) goto CHYBA;
+        if (Command(c, "PBSZ 0", line) != 200) goto CHYBA;
+        if (Command(c, "PROT P", line) != 200) goto CHYBA;
+        c.prot = true;
+    }
+
+    if (Command(c, "USER " BENCH_USER, line) != 331) goto CHYBA;
+    if (Command(c, "PASS " BENCH_PASSWORD, line) != 230) goto CHYBA;
+    if (Command(c, "TYPE I", line) != 200) goto CHYBA;
+    return 1;
+
+CHYBA:
+    Disconnect(c);
+    return -1;
+}
+
+
+/** Pripravi data connection (PASV nebo PORT). Vrati soket - u PASV uz
+ * pripojeny, u PORT naslouchajici.
+ *
+ */
+static int DataPrepare(FtpClient &c, bool pasv) {
+    struct sockaddr_in  a;
+    socklen_t           l = sizeof(a);
+    string              line;
+    unsigned            h1, h2, h3, h4, p1, p2;
+    size_t              n;
+    int                 s;
+    char                tmp[100];
+
+    if (pasv) {
+        if (Command(c, "PASV", line) != 227) return -1;
+        n = line.find('(');
+        if (n == string::npos || sscanf(line.c_str() + n + 1, "%u,%u,%u,%u,%u,%u", &h1, &h2, &h3, &h4, &p1, &p2) != 6)
+            return -1;
+        return ConnectTo(p1 * 256 + p2);
+    }
+
+    s = socket(PF_INET, SOCK_STREAM, 0);
+    if (s == -1) return -1;
+    memset(&a, 0, sizeof(a));
+    a.sin_family      = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, (struct sockaddr *)&a, sizeof(a)) == -1 || listen(s, 1) == -1
+            || getsockname(s, (struct sockaddr *)&a, &l) == -1) {
+        close(s);
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "PORT 127,0,0,1,%d,%d", ntohs(a.sin_port) / 256, ntohs(a.sin_port) % 256);
+    if (Command(c, tmp, line) != 200) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+
+/** Provede jeden prenos: prikaz cmd (RETR, STOR, LIST) s data connection.
+ * Pri uploadu posle size bytu z upload_buf. Do bytes pricte prenesena data.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      chyba (control connection muze byt v nedefinovanem stavu)
+ *
+ */
+static int Transfer(FtpClient &c, bool pasv, const string &cmd, bool upload, long long size,
+                    unsigned long long &bytes) {
+    char            sink[BENCH_BUF_SIZE];
+    string          line;
+    SSL           * ssl = 0;
+    int             data;
+    int             s;
+    int             n;
+    int             ret = -1;
+    long long       sent;
+
+    data = DataPrepare(c, pasv);
+    if (data == -1) return -1;
+
+    n = Command(c, cmd, line);
+    if (n != 150 && n != 125) {
+        close(data);
+        return -1;
+    }
+
+    if (!pasv) { //PORT - server se pripojuje k nam
+        do {
+            s = accept(data, 0, 0);
+        } while (s == -1 && errno == EINTR);
+        close(data);
+        if (s == -1) return -1;
+        data = s;
+    }
+
+    if (c.prot) {
+        ssl = SSL_new(ssl_ctx);
+        SSL_set_fd(ssl, data);
+        if (SSL_connect(ssl) != 1) goto KONEC;
+    }
+
+    if (upload) {
+        for (sent = 0; sent < size; sent += n) {
+            n = (size - sent > BENCH_BUF_SIZE) ? BENCH_BUF_SIZE : size - sent;
+            if (SendAll(data, ssl, upload_buf + sent, n) < 0) goto KONEC;
+        }
+        //neprectena data od serveru (napr. TLS session ticket) by pri close()
+        //zpusobila RST a server by prisel o konec souboru - docteme je
+        if (ssl != 0) SSL_shutdown(ssl);
+        shutdown(data, SHUT_WR);
+        while (recv(data, sink, sizeof(sink), 0) > 0) ;
+        bytes += size;
+    } else {
+        while ((n = Recv(data, ssl, sink, sizeof(sink))) > 0) bytes += n;
+        if (n < 0) goto KONEC;
+    }
+    ret = 1;
+
+KONEC:
+    if (ssl != 0) {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+    close(data);
+    if (ret < 0) return ret;
+    return (ReadReply(c, line) == 226) ? 1 : -1;
+}
+
+
+/*************************************************************************
+ *                              Scenare                                  *
+ *************************************************************************/
+
+/** Vysledky jednoho vlakna.
+ *
+ */
+struct ThreadResult {
+    vector<unsigned int>    latency;    ///< latence operaci (us)
+    unsigned long long      bytes;      ///< prenesena data (u MODE Z komprimovana)
+    unsigned long long      payload;    ///< retr_modez: velikost stazenych souboru
+    unsigned long long      errors;
+};
+
+
+/** Zadani pro jedno vlakno.
+ *
+ */
+struct ThreadArg {
+    int                 id;
+    int                 op;
+    int                 variant;    ///< retr_rang: pocet useku, retr_modez: 1 = MODE Z
+    bool                pasv;
+    bool                tls;
+    unsigned long long  deadline;
+    vector<FtpClient> * extra;      ///< dalsi spojeni vlakna (useky retr_rang)
+    ThreadResult        result;
+};
+
+
+/** Jeden usek velkeho souboru pro scenar retr_rang.
+ *
+ */
+struct RangSegment {
+    FtpClient         * c;
+    bool                pasv;
+    long long           start;
+    long long           end;        ///< posledni byte useku (vcetne)
+    unsigned long long  bytes;
+    int                 ret;
+};
+
+
+/** Vybere operaci pro scenar mix: 50 % RETR malych souboru, 25 % STOR malych
+ * souboru, 15 % LIST, 5 % RETR a 5 % STOR velkeho souboru.
+ *
+ */
+static int MixOperation(unsigned int &seed) {
+    int r = rand_r(&seed) % 100;
+
+    if (r < 50) return OP_RETR_SMALL;
+    if (r < 75) return OP_STOR_SMALL;
+    if (r < 90) return OP_LIST;
+    if (r < 95) return OP_RETR_LARGE;
+    return OP_STOR_LARGE;
+}
+
+
+/** Stahne jeden usek velkeho souboru (RANG a RETR).
+ *
+ */
+static void * RangWorker(void * arg) {
+    RangSegment   & s = *(RangSegment *)arg;
+    string          line;
+    char            tmp[100];
+
+    s.ret = -1;
+    snprintf(tmp, sizeof(tmp), "RANG %lld %lld", s.start, s.end);
+    if (Command(*s.c, tmp, line) != 350) return 0;
+    s.ret = Transfer(*s.c, s.pasv, "RETR /large.bin", false, 0, s.bytes);
+    return 0;
+}
+
+
+/** Stahne velky soubor rozdeleny na a.variant useku, kazdy po vlastnim
+ * spojeni (c a a.extra) a ve vlastnim vlakne. Dalsi spojeni se prihlasi pri
+ * prvnim pouziti a zustavaji otevrena.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      chyba (spojeni c muze byt v nedefinovanem stavu)
+ *
+ */
+static int RangDownload(FtpClient &c, ThreadArg &a) {
+    vector<FtpClient>   & extra = *a.extra;
+    vector<RangSegment>   seg(a.variant);
+    vector<pthread_t>     threads(a.variant);
+    long long             part = (cfg.large_size + a.variant - 1) / a.variant;
+    int                   ret = 1;
+    int                   i;
+
+    for (i = 0; i < a.variant - 1; i++)
+        if (extra[i].sock == -1 && Login(extra[i], a.tls) < 0) return -1;
+
+    for (i = 0; i < a.variant; i++) {
+        seg[i].c     = (i == 0) ? &c : &extra[i - 1];
+        seg[i].pasv  = a.pasv;
+        seg[i].start = i * part;
+        seg[i].end   = min(cfg.large_size, (i + 1) * part) - 1;
+        seg[i].bytes = 0;
+        if (i > 0) pthread_create(&threads[i], 0, RangWorker, &seg[i]);
+    }
+    RangWorker(&seg[0]);
+
+    for (i = 0; i < a.variant; i++) {
+        if (i > 0) pthread_join(threads[i], 0);
+        a.result.bytes += seg[i].bytes;
+        if (seg[i].ret > 0 && seg[i].bytes == (unsigned long long)(seg[i].end - seg[i].start + 1)) continue;
+        ret = -1;
+        if (i > 0) Disconnect(extra[i - 1]); //spojeni muze byt v nedefinovanem stavu
+    }
+    return ret;
+}
+
+
+/** Provede jednu operaci op v prihlasenem spojeni c.
+ *
+ */
+static int Operation(FtpClient &c, ThreadArg &a, int op) {
+    char    tmp[100];
+
+    switch (op) {
+        case OP_LIST:
+            return Transfer(c, a.pasv, "LIST /big", false, 0, a.result.bytes);
+        case OP_RETR_SMALL:
+            snprintf(tmp, sizeof(tmp), "RETR /small/f%03d", rand_r(&c.seed) % BENCH_SMALL_FILES);
+            return Transfer(c, a.pasv, tmp, false, 0, a.result.bytes);
+        case OP_RETR_LARGE:
+            return Transfer(c, a.pasv, "RETR /large.bin", false, 0, a.result.bytes);
+        case OP_RETR_RANG:
+            return RangDownload(c, a);
+        case OP_RETR_MODEZ:
+            snprintf(tmp, sizeof(tmp), "RETR /text/t%03d", rand_r(&c.seed) % BENCH_TEXT_FILES);
+            if (Transfer(c, a.pasv, tmp, false, 0, a.result.bytes) < 0) return -1;
+            a.result.payload += BENCH_TEXT_SIZE;
+            return 1;
+        case OP_STOR_SMALL:
+            snprintf(tmp, sizeof(tmp), "STOR /up/s%d.bin", a.id);
+            return Transfer(c, a.pasv, tmp, true, BENCH_SMALL_SIZE, a.result.bytes);
+        case OP_STOR_LARGE:
+            snprintf(tmp, sizeof(tmp), "STOR /up/l%d.bin", a.id);
+            return Transfer(c, a.pasv, tmp, true, cfg.large_size, a.result.bytes);
+    }
+    return -1;
+}
+
+
+/** Nastavi v prave prihlasenem spojeni c rezim prenosu pro scenar.
+ *
+ */
+static int SessionSetup(FtpClient &c, ThreadArg &a) {
+    string  line;
+    char    tmp[100];
+
+    if (a.op != OP_RETR_MODEZ || a.variant == 0) return 1;
+    if (Command(c, "MODE Z", line) != 200) return -1;
+    if (cfg.zlevel < 0) return 1;
+    snprintf(tmp, sizeof(tmp), "OPTS MODE Z LEVEL %d", cfg.zlevel);
+    return (Command(c, tmp, line) == 200) ? 1 : -1;
+}
+
+
+/** Telo vlakna - dokud nevyprsi cas, opakuje operace scenare a meri je.
+ *
+ */
+static void * Worker(void * arg) {
+    ThreadArg         & a = *(ThreadArg *)arg;
+    FtpClient           c;
+    vector<FtpClient>   extra((a.op == OP_RETR_RANG) ? a.variant - 1 : 0);
+    string              line;
+    unsigned long long  start;
+    bool                connected = false;
+    int                 ret;
+    size_t              i;
+
+    c.sock = -1;
+    c.ssl  = 0;
+    c.seed = a.id * 7919 + 1;
+    for (i = 0; i < extra.size(); i++) {
+        extra[i].sock = -1;
+        extra[i].ssl  = 0;
+    }
+    a.extra = &extra;
+
+    while (Now() < a.deadline) {
+        start = Now();
+
+        if (a.op == OP_LOGIN) {
+            ret = Login(c, a.tls);
+            if (ret > 0) {
+                ret = (Command(c, "QUIT", line) == 221) ? 1 : -1;
+                Disconnect(c);
+            }
+        } else {
+            if (!connected) {
+                if (Login(c, a.tls) < 0 || SessionSetup(c, a) < 0) {
+                    Disconnect(c);
+                    a.result.errors++;
+                    usleep(10000);
+                    continue;
+                }
+                connected = true;
+                start = Now(); //prihlaseni se do operace nepocita
+            }
+            ret = Operation(c, a, (a.op == OP_MIX) ? MixOperation(c.seed) : a.op);
+            if (ret < 0) { //spojeni muze byt v nedefinovanem stavu, zacneme znovu
+                Disconnect(c);
+                connected = false;
+            }
+        }
+
+        if (ret > 0) a.result.latency.push_back(Now() - start);
+            else a.result.errors++;
+    }
+
+    if (connected) {
+        Command(c, "QUIT", line);
+        Disconnect(c);
+    }
+    for (i = 0; i < extra.size(); i++) {
+        if (extra[i].sock == -1) continue;
+        Command(extra[i], "QUIT", line);
+        Disconnect(extra[i]);
+    }
+    return 0;
+}
+
+
+/*************************************************************************
+ *                         Mereni serveru                                *
+ *************************************************************************/
+
+static pid_t            server_pid = 0;
+static int              server_durability = 0; //< uroven durability prave spusteneho serveru
+static volatile bool    sampling   = false;
+static volatile long    rss_peak   = 0;       //< nejvetsi soucet RSS vsech procesu serveru (kB)
+
+
+/** Precte z /proc/pid/stat rodice, spotrebovany cas CPU (v tiku, vcetne
+ * skoncenych potomku) a RSS (ve strankach).
+ *
+ */
+static int ProcStat(pid_t pid, pid_t &ppid, unsigned long long &cpu, long &rss) {
+    char                tmp[100];
+    char                buf[1024];
+    char              * p;
+    unsigned long long  ut, st;
+    long long           cut, cst;
+    int                 fd;
+    int                 n;
+
+    snprintf(tmp, sizeof(tmp), "/proc/%d/stat", (int)pid);
+    fd = open(tmp, O_RDONLY);
+    if (fd == -1) return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = 0;
+
+    //jmeno procesu muze obsahovat mezery, polozky zacinaji az za ')'
+    p = strrchr(buf, ')');
+    if (p == 0) return -1;
+    n = sscanf(p + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld %*d %*d %*d %*d %*u %*u %ld",
+               &ppid, &ut, &st, &cut, &cst, &rss);
+    if (n != 6) return -1;
+    cpu = ut + st + cut + cst;
+    return 1;
+}
+
+
+/** Secte CPU (tiky) a RSS (kB) serveru a vsech jeho zijicich potomku.
+ *
+ */
+static void ServerUsage(unsigned long long &cpu, long &rss) {
+    DIR               * d;
+    struct dirent     * e;
+    pid_t               pid, ppid;
+    unsigned long long  c;
+    long                r;
+    long                page = sysconf(_SC_PAGESIZE) / 1024;
+
+    cpu = 0;
+    rss = 0;
+    if (ProcStat(server_pid, ppid, c, r) < 0) return;
+    cpu += c;
+    rss += r * page;
+
+    d = opendir("/proc");
+    if (d == 0) return;
+    while ((e = readdir(d)) != 0) {
+        pid = atoi(e->d_name);
+        if (pid <= 0 || pid == server_pid) continue;
+        if (ProcStat(pid, ppid, c, r) < 0 || ppid != server_pid) continue;
+        cpu += c;
+        rss += r * page;
+    }
+    closedir(d);
+}
+
+
+/** Vlakno, ktere behem scenare meri pamet serveru.
+ *
+ */
+static void * Sampler(void *) {
+    unsigned long long  cpu;
+    long                rss;
+
+    while (sampling) {
+        ServerUsage(cpu, rss);
+        if (rss > rss_peak) rss_peak = rss;
+        usleep(BENCH_SAMPLE_MSEC * 1000);
+    }
+    return 0;
+}
+
+
+/*************************************************************************
+ *                        Priprava a spusteni                            *
+ *************************************************************************/
+
+/** Zapise do souboru name retezec data.
+ *
+ */
+static int WriteFile(const string &name, const char * data, long long size) {
+    int         fd;
+    long long   done;
+    int         n;
+
+    fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+    for (done = 0; done < size; done += n) {
+        n = (size - done > BENCH_BUF_SIZE) ? BENCH_BUF_SIZE : size - done;
+        n = write(fd, data + done, n);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 1;
+}
+
+
+/** Vyplni buf size byty textu podobneho logu (slova z male slovni zasoby a
+ * cisla), aby se komprimoval zhruba jako skutecne textove soubory.
+ *
+ */
+static void FillText(char * buf, int size, unsigned int seed) {
+    static const char * words[] = {
+        "GET", "PUT", "user", "file", "transfer", "complete", "error", "session",
+        "directory", "/pub/linux/kernel", "/home/ftp", "bytes", "OK", "timeout"
+    };
+    char    line[200];
+    int     done = 0;
+    int     n, i;
+
+    while (done < size) {
+        n = snprintf(line, sizeof(line), "%u.%03u ", 1000000 + rand_r(&seed) % 1000, rand_r(&seed) % 1000);
+        for (i = rand_r(&seed) % 6 + 3; i > 0; i--)
+            n += snprintf(line + n, sizeof(line) - n, "%s ", words[rand_r(&seed) % (sizeof(words) / sizeof(words[0]))]);
+        n += snprintf(line + n, sizeof(line) - n, "%u\n", rand_r(&seed) % 100000);
+        if (n > size - done) n = size - done;
+        memcpy(buf + done, line, n);
+        done += n;
+    }
+}
+
+
+/** Vytvori pro server certifikat podepsany sam sebou (server.pem s klicem,
+ * root.pem) a parametry DH (dh1024.pem - jmeno, ktere server ocekava).
+ *
+ * Certifikaty z adresare example maji na soucasne verze OpenSSL prilis
+ * kratky klic.
+ */
+static int CreateCertificate() {
+    EVP_PKEY_CTX  * kctx;
+    EVP_PKEY      * key = 0;
+    X509          * x509;
+    X509_NAME     * name;
+    EVP_PKEY      * dh = 0;
+    BIO           * bio;
+    FILE          * fd;
+    int             ret = -1;
+
+    kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, 0);
+    if (kctx == 0) return -1;
+    if (EVP_PKEY_keygen_init(kctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) <= 0
+            || EVP_PKEY_keygen(kctx, &key) <= 0) {
+        EVP_PKEY_CTX_free(kctx);
+        return -1;
+    }
+    EVP_PKEY_CTX_free(kctx);
+
+    x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_get_notBefore(x509), 0);
+    X509_gmtime_adj(X509_get_notAfter(x509), 30L * 86400);
+    X509_set_pubkey(x509, key);
+    name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    if (X509_sign(x509, key, EVP_sha256()) <= 0) goto KONEC;
+
+    fd = fopen((cfg.dir + "/server.pem").c_str(), "w");
+    if (fd == 0) goto KONEC;
+    PEM_write_X509(fd, x509);
+    PEM_write_PrivateKey(fd, key, 0, 0, 0, 0, 0);
+    fclose(fd);
+
+    fd = fopen((cfg.dir + "/root.pem").c_str(), "w");
+    if (fd == 0) goto KONEC;
+    PEM_write_X509(fd, x509);
+    fclose(fd);
+
+    //parametry DH - pevna skupina ffdhe2048 (RFC 7919), server je cte jako
+    //PKCS#3 "DH PARAMETERS"
+    kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_DH, 0);
+    if (kctx == 0) goto KONEC;
+    if (EVP_PKEY_paramgen_init(kctx) <= 0 || EVP_PKEY_CTX_set_dh_nid(kctx, NID_ffdhe2048) <= 0
+            || EVP_PKEY_paramgen(kctx, &dh) <= 0) {
+        EVP_PKEY_CTX_free(kctx);
+        goto KONEC;
+    }
+    EVP_PKEY_CTX_free(kctx);
+
+    bio = BIO_new_file((cfg.dir + "/dh1024.pem").c_str(), "w");
+    if (bio == 0) goto KONEC;
+    if (PEM_write_bio_Parameters(bio, dh) > 0) ret = 1;
+    BIO_free(bio);
+
+KONEC:
+    EVP_PKEY_free(dh);
+    X509_free(x509);
+    EVP_PKEY_free(key);
+    return ret;
+}
+
+
+/** Vytvori v cfg.dir konfiguraci serveru a sdilena data. Soubory, ktere uz
+ * existuji se spravnou velikosti, necha byt.
+ *
+ */
+static int CreateFixture() {
+    string      share = cfg.dir + "/share";
+    string      s;
+    char        tmp[100];
+    char        text[BENCH_TEXT_SIZE];
+    struct stat st;
+    int         i;
+
+    mkdir(cfg.dir.c_str(), 0755);
+    mkdir(share.c_str(), 0755);
+    mkdir((share + "/big").c_str(), 0755);
+    mkdir((share + "/small").c_str(), 0755);
+    mkdir((share + "/text").c_str(), 0755);
+    mkdir((cfg.dir + "/up").c_str(), 0755);
+
+    s = share + "\n" + cfg.dir + "/up /up " BENCH_USER " 3 3\n";
+    if (WriteFile(cfg.dir + "/vfs.cfg", s.c_str(), s.size()) < 0) return -1;
+    s = BENCH_USER " " BENCH_PASSWORD " 0\n";
+    if (WriteFile(cfg.dir + "/account.cfg", s.c_str(), s.size()) < 0) return -1;
+    if (WriteFile(cfg.dir + "/deny_list.cfg", "", 0) < 0) return -1;
+
+    for (i = 0; i < cfg.list_files; i++) {
+        snprintf(tmp, sizeof(tmp), "/big/file%06d.dat", i);
+        if (stat((share + tmp).c_str(), &st) == 0) continue;
+        if (WriteFile(share + tmp, "", 0) < 0) return -1;
+    }
+    for (i = 0; i < BENCH_SMALL_FILES; i++) {
+        snprintf(tmp, sizeof(tmp), "/small/f%03d", i);
+        if (stat((share + tmp).c_str(), &st) == 0 && st.st_size == BENCH_SMALL_SIZE) continue;
+        if (WriteFile(share + tmp, upload_buf, BENCH_SMALL_SIZE) < 0) return -1;
+    }
+    for (i = 0; i < BENCH_TEXT_FILES; i++) {
+        snprintf(tmp, sizeof(tmp), "/text/t%03d", i);
+        if (stat((share + tmp).c_str(), &st) == 0 && st.st_size == BENCH_TEXT_SIZE) continue;
+        FillText(text, BENCH_TEXT_SIZE, i + 1);
+        if (WriteFile(share + tmp, text, BENCH_TEXT_SIZE) < 0) return -1;
+    }
+    if (stat((share + "/large.bin").c_str(), &st) != 0 || st.st_size != cfg.large_size)
+        if (WriteFile(share + "/large.bin", upload_buf, cfg.large_size) < 0) return -1;
+
+    if (cfg.tls && CreateCertificate() < 0) {
+        cerr << "Nepodarilo se vytvorit certifikat pro TLS." << endl;
+        return -1;
+    }
+    return 1;
+}
+
+
+/** Spusti server s urovni durability level a pocka, az zacne prijimat
+ * spojeni.
+ *
+ */
+static int StartServer(int level) {
+    char                port[20];
+    char                durability[20];
+    string              log = cfg.dir + "/server.log";
+    unsigned long long  limit;
+    int                 fd;
+    int                 s;
+
+    snprintf(port, sizeof(port), "%d", cfg.port);
+    snprintf(durability, sizeof(durability), "%d", level);
+    server_durability = level;
+    server_pid = fork();
+    if (server_pid == -1) return -1;
+    if (server_pid == 0) {
+        fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd != -1) {
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+        }
+        if (cfg.tls) execl(cfg.server.c_str(), cfg.server.c_str(), "-d", "-w", cfg.dir.c_str(), "-p", port, "-y", durability,
+                           "-s", "-s", (char *)0);
+            else execl(cfg.server.c_str(), cfg.server.c_str(), "-d", "-w", cfg.dir.c_str(), "-p", port, "-y", durability,
+                       (char *)0);
+        _exit(127);
+    }
+
+    limit = Now() + BENCH_START_TIMEOUT * 1000000ULL;
+    while (Now() < limit) {
+        s = ConnectTo(cfg.port);
+        if (s != -1) {
+            close(s);
+            return 1;
+        }
+        if (waitpid(server_pid, 0, WNOHANG) == server_pid) break;
+        usleep(100000);
+    }
+    cerr << "Server se nepodarilo spustit, viz. " << log << endl;
+    return -1;
+}
+
+
+/** Ukonci server.
+ *
+ */
+static void StopServer() {
+    if (server_pid <= 0) return;
+    kill(server_pid, SIGTERM);
+    //server ceka v accept(), ktery se po signalu restartuje - probudime ho
+    close(ConnectTo(cfg.port));
+    waitpid(server_pid, 0, 0);
+}
+
+
+/** Vrati q-kvantil serazenych latenci v.
+ *
+ */
+static unsigned int Quantile(const vector<unsigned int> &v, double q) {
+    size_t i;
+
+    if (v.empty()) return 0;
+    i = (size_t)(q * v.size());
+    if (i >= v.size()) i = v.size() - 1;
+    return v[i];
+}
+
+
+/** Spusti jeden scenar a jeho vysledek prida (jako objekt JSON) do json.
+ *
+ */
+static void RunScenario(int op, int variant, bool pasv, bool tls, string &json) {
+    vector<ThreadArg>       args(cfg.threads);
+    vector<pthread_t>       threads(cfg.threads);
+    vector<unsigned int>    latency;
+    pthread_t               sampler;
+    unsigned long long      cpu_start, cpu_end, bytes = 0, payload = 0, errors = 0;
+    unsigned long long      start, elapsed;
+    long                    rss;
+    double                  sec, cpu;
+    char                    tmp[1024];
+    char                    extra[100] = "";
+    int                     i;
+
+    ServerUsage(cpu_start, rss);
+    rss_peak = rss;
+    sampling = true;
+    pthread_create(&sampler, 0, Sampler, 0);
+
+    start = Now();
+    for (i = 0; i < cfg.threads; i++) {
+        args[i].id       = i;
+        args[i].op       = op;
+        args[i].variant  = variant;
+        args[i].pasv     = pasv;
+        args[i].tls      = tls;
+        args[i].deadline = start + cfg.seconds * 1000000ULL;
+        args[i].result.bytes   = 0;
+        args[i].result.payload = 0;
+        args[i].result.errors  = 0;
+        pthread_create(&threads[i], 0, Worker, &args[i]);
+    }
+    for (i = 0; i < cfg.threads; i++) {
+        pthread_join(threads[i], 0);
+        latency.insert(latency.end(), args[i].result.latency.begin(), args[i].result.latency.end());
+        bytes   += args[i].result.bytes;
+        payload += args[i].result.payload;
+        errors  += args[i].result.errors;
+    }
+    elapsed = Now() - start;
+
+    sampling = false;
+    pthread_join(sampler, 0);
+    ServerUsage(cpu_end, rss);
+
+    sort(latency.begin(), latency.end());
+    sec = elapsed / 1e6;
+    cpu = (double)(cpu_end - cpu_start) / sysconf(_SC_CLK_TCK);
+    if (op == OP_RETR_RANG) snprintf(extra, sizeof(extra), ", \"segments\": %d", variant);
+    if (op == OP_RETR_MODEZ)
+        snprintf(extra, sizeof(extra), ", \"mode\": \"%s\", \"payload_bytes\": %llu, \"wire_bytes\": %llu",
+                 variant ? "Z" : "S", payload, bytes);
+
+    snprintf(tmp, sizeof(tmp),
+             "    {\"scenario\": \"%s\"%s, \"data\": \"%s\", \"tls\": %s, \"durability\": %d, \"threads\": %d,\n"
+             "     \"seconds\": %.3f,"
+             "     \"ops\": %lu, \"errors\": %llu, \"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f,\n"
+             "     \"latency_us\": {\"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u},\n"
+             "     \"server_cpu_sec\": %.2f, \"server_cpu_util\": %.3f, \"server_rss_peak_kb\": %ld}",
+             op_names[op], extra, (op == OP_LOGIN) ? "none" : (pasv ? "pasv" : "port"), tls ? "true" : "false",
+             server_durability, cfg.threads, sec, (unsigned long)latency.size(), errors, latency.size() / sec,
+             bytes / sec / (1024 * 1024), Quantile(latency, 0.5), Quantile(latency, 0.99),
+             Quantile(latency, 0.999), latency.empty() ? 0 : latency.back(),
+             cpu, cpu / sec, (long)rss_peak);
+    if (json != "") json += ",\n";
+    json += tmp;
+
+    cerr << op_names[op];
+    if (op == OP_RETR_RANG) cerr << " " << variant << "x";
+    if (op == OP_RETR_MODEZ) cerr << (variant ? " Z" : " S");
+    if (op == OP_STOR_SMALL || op == OP_STOR_LARGE || op == OP_MIX) cerr << " y" << server_durability;
+    cerr << (op == OP_LOGIN ? "" : (pasv ? " pasv" : " port")) << (tls ? " tls" : "")
+         << ": " << (unsigned long)(latency.size() / sec) << " op/s, p99 " << Quantile(latency, 0.99)
+         << " us, chyb " << errors;
+    if (op == OP_RETR_MODEZ && payload > 0) cerr << ", prenoseno " << bytes * 100 / payload << " % dat";
+    cerr << endl;
+}
+
+
+static void Usage(const char * name) {
+    cerr << "Pouziti: " << name << " [-s server] [-w adresar] [-p port] [-c vlaken]" << endl;
+    cerr << "        [-t sekund] [-S scenar,...] [-m pasv|port|both] [-T] [-D souboru] [-L MB] [-R useku]" << endl;
+    cerr << "        [-z uroven] [-y uroven,...] [-o vystup.json]" << endl;
+    cerr << "Scenare: login, list, retr_small, retr_large, retr_rang, retr_modez, stor_small, stor_large, mix" << endl;
+}
+
+
+/** Nastavi urovne durability podle seznamu oddeleneho carkami.
+ *
+ */
+static int ParseDurability(const char * list) {
+    const char    * p = list;
+    char          * end;
+    long            level;
+
+    cfg.durability.clear();
+    while (1) {
+        level = strtol(p, &end, 10);
+        if (end == p || level < 0 || level > 2) return -1;
+        cfg.durability.push_back(level);
+        if (*end == 0) return 1;
+        if (*end != ',') return -1;
+        p = end + 1;
+    }
+}
+
+
+/** Nastavi scenare podle seznamu oddeleneho carkami.
+ *
+ */
+static int ParseScenarios(const char * list) {
+    string  s = list;
+    string  name;
+    size_t  n;
+    int     i;
+
+    for (i = 0; i < OP_COUNT; i++) cfg.scenario[i] = false;
+    while (s != "") {
+        n = s.find(',');
+        name = s.substr(0, n);
+        s = (n == string::npos) ? "" : s.substr(n + 1);
+        for (i = 0; i < OP_COUNT; i++)
+            if (name == op_names[i]) break;
+        if (i == OP_COUNT) return -1;
+        cfg.scenario[i] = true;
+    }
+    return 1;
+}
+
+
+int main(int argc, char ** argv) {
+    string      json;
+    string      out;
+    char        tmp[300];
+    char        cwd[1024];
+    FILE      * fd;
+    int         zn;
+    int         op;
+    int         t, m, v;
+    int         base_port;
+    size_t      l;
+    int         variants[2];
+    int         nvariants;
+
+    cfg.server     = "./smallFTPd";
+    cfg.dir        = "/tmp/ftpbench";
+    cfg.port       = 2121;
+    cfg.threads    = 16;
+    cfg.seconds    = 5;
+    cfg.list_files = 10000;
+    cfg.large_size = 32LL * 1024 * 1024;
+    cfg.segments   = 8;
+    cfg.zlevel     = -1;
+    cfg.tls        = false;
+    cfg.pasv       = true;
+    cfg.port_mode  = true;
+    for (op = 0; op < OP_COUNT; op++) cfg.scenario[op] = true;
+    ParseDurability("0,1,2");
+
+    while ((zn = getopt(argc, argv, "s:w:p:c:t:S:m:TD:L:R:z:y:o:")) != -1) {
+        switch (zn) {
+            case 's': cfg.server  = optarg; break;
+            case 'w': cfg.dir     = optarg; break;
+            case 'o': cfg.output  = optarg; break;
+            case 'p': cfg.port    = atoi(optarg); break;
+            case 'c': cfg.threads = atoi(optarg); break;
+            case 't': cfg.seconds = atoi(optarg); break;
+            case 'D': cfg.list_files = atoi(optarg); break;
+            case 'L': cfg.large_size = atoll(optarg) * 1024 * 1024; break;
+            case 'R': cfg.segments   = atoi(optarg); break;
+            case 'z': cfg.zlevel     = atoi(optarg); break;
+            case 'T': cfg.tls = true; break;
+            case 'y':
+                if (ParseDurability(optarg) < 0) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                if (ParseScenarios(optarg) < 0) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm':
+                cfg.pasv      = (strcmp(optarg, "pasv") == 0 || strcmp(optarg, "both") == 0);
+                cfg.port_mode = (strcmp(optarg, "port") == 0 || strcmp(optarg, "both") == 0);
+                if (!cfg.pasv && !cfg.port_mode) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || cfg.threads < 1 || cfg.seconds < 1 || cfg.port < 1 || cfg.list_files < 0
+            || cfg.large_size < 1 || cfg.segments < 1 || cfg.segments > BENCH_MAX_SEGMENTS
+            || cfg.zlevel < -1 || cfg.zlevel > 9) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    //server dostane cesty relativne k jinemu pracovnimu adresari
+    if (getcwd(cwd, sizeof(cwd)) == 0) return 1;
+    if (cfg.dir[0] != '/') cfg.dir = string(cwd) + "/" + cfg.dir;
+    if (cfg.server.find('/') != string::npos && cfg.server[0] != '/') cfg.server = string(cwd) + "/" + cfg.server;
+
+    upload_buf = (char *)malloc(cfg.large_size);
+    if (upload_buf == 0) {
+        cerr << "Nedostatek pameti." << endl;
+        return 1;
+    }
+    memset(upload_buf, 'x', cfg.large_size);
+
+    SSL_library_init();
+    SSL_load_error_strings();
+    ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+    if (ssl_ctx == 0) return 1;
+
+    if (CreateFixture() < 0) {
+        cerr << "Nepodarilo se pripravit data v " << cfg.dir << endl;
+        return 1;
+    }
+
+    //port serveru zustava chvili obsazeny spojenimi v TIME_WAIT, kazde dalsi
+    //spusteni serveru proto dostane dalsi port
+    base_port = cfg.port;
+    for (l = 0; l < cfg.durability.size(); l++) {
+        cfg.port = base_port + l;
+        if (StartServer(cfg.durability[l]) < 0) return 1;
+
+        for (op = 0; op < OP_COUNT; op++) {
+            if (!cfg.scenario[op]) continue;
+            //na urovni durability zavisi jen scenare s uploadem
+            if (l > 0 && op != OP_STOR_SMALL && op != OP_STOR_LARGE && op != OP_MIX) continue;
+
+            //retr_rang se meri jednim proudem a -R proudy, retr_modez v MODE S a Z
+            nvariants   = 1;
+            variants[0] = 0;
+            if (op == OP_RETR_RANG) {
+                variants[0] = 1;
+                if (cfg.segments > 1) variants[nvariants++] = cfg.segments;
+            }
+            if (op == OP_RETR_MODEZ) variants[nvariants++] = 1;
+
+            for (v = 0; v < nvariants; v++)
+                for (t = 0; t < (cfg.tls ? 2 : 1); t++)
+                    for (m = 0; m < 2; m++) {
+                        if (op == OP_LOGIN && m == 1) continue;
+                        if (op != OP_LOGIN && ((m == 0 && !cfg.pasv) || (m == 1 && !cfg.port_mode))) continue;
+                        RunScenario(op, variants[v], m == 0, t == 1, json);
+                    }
+        }
+
+        StopServer();
+    }
+
+    snprintf(tmp, sizeof(tmp), "{\n  \"threads\": %d,\n  \"seconds\": %d,\n  \"list_files\": %d,\n"
+             "  \"large_size\": %lld,\n  \"small_size\": %d,\n  \"results\": [\n",
+             cfg.threads, cfg.seconds, cfg.list_files, cfg.large_size, BENCH_SMALL_SIZE);
+    out = string(tmp) + json + "\n  ]\n}\n";
+
+    if (cfg.output == "") fputs(out.c_str(), stdout);
+    else {
+        fd = fopen(cfg.output.c_str(), "w");
+        if (fd == 0 || fputs(out.c_str(), fd) < 0) {
+            cerr << "Nelze zapsat " << cfg.output << endl;
+            return 1;
+        }
+        fclose(fd);
+    }
+    return 0;
+}
@@ -20,11 +20,22 @@ bool pbsz       = false; //< pred PROT musi byt PBSZ 0, byl uz?
 
 long restart_offset = 0; //< odkud zacit prenos
 
+bool range = false; //< byl zadan rozsah prikazem RANG?
+unsigned long long range_start = 0; //< prvni byte rozsahu
+unsigned long long range_end   = 0; //< posledni byte rozsahu (vcetne)
+
 char transfer_type      = TYPE_ASCII; //< pro type command, implicitne ASCII
 char transfer_typep     = 'N'; //< parametr transfer type, implicitne Non-print, nepouziva se
 char transfer_mode      = MODE_STREAM; //< pro mode command, implicitne Stream
 char file_structure     = STRU_FILE; //< pro stru command, implicitne File
 
+int mode_z_level    = 6; //< uroven komprese pro MODE Z (0-9), meni se prikazem OPTS MODE Z LEVEL
+
+int hash_algorithm  = DIGEST_DEFAULT; //< algoritmus pro HASH, meni se prikazem OPTS HASH
+int digest_mask     = 1 << DIGEST_DEFAULT; //< ktere kontrolni soucty pocitat uz behem uploadu
+
+unsigned long long allo_size = 0; //< velikost souboru ohlasena prikazem ALLO (0 = nebyla)
+
 char FTP_EOR[2]     = {255, 1}; //< EOR kod pro record structure
 char FTP_EOF[2]     = {255, 2}; //< EOF kod pro record structure
 char FTP_EOR_EOF[2] = {255, 3}; //< kombinace EOR a EOF kodu pro record structure
@@ -59,6 +70,7 @@ int fuser(list<string> &args, VFS &vfs) {
         current_user.Clear(); 
         logged_in = false;
         vfs.ChangeDir("/");
+        SessionUser("");
     }
 
     if (args.size() == 1) {
@@ -127,6 +139,7 @@ int fpass (list<string> &args, VFS &vfs) {
         } else { // OK, user se uspesne nalogoval:
             //dame VFS vedet, kdo se nalogoval, aby spravne vracel jen jemu pristupne soubory;
             vfs.FtpUserName(current_user.name); 
+            SessionUser(current_user.name);
 
             ret = FTPReply(230,"Logged in, proceed.");
             return ret;
@@ -137,119 +150,145 @@ int fpass (list<string> &args, VFS &vfs) {
 
 
 
+static char pasv_reply_address[ADDR_LENGTH_MAX+1] = ""; //< adresa pro odpoved na PASV (192,168,1,1)
+static bool epsv_all = false; //< klient poslal EPSV ALL, data connection se smi pripravit jen prikazem EPSV
+
+/** Pripravi adresu, kterou server ohlasi v odpovedi na PASV.
+ *
+ * Je to adresa zadana prepinacem -i (server za NATem), jinak lokalni adresa
+ * control connection - na tu se klient uz jednou pripojil, takze je pro nej
+ * dosazitelna (adresa z gethostbyname(gethostname()) byt nemusi a jeji
+ * zjisteni muze trvat dlouho kvuli DNS). Zjistuje se jen pri prvnim PASV,
+ * dal se pouziva ulozena v pasv_reply_address.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      adresa je v pasv_reply_address
+ *      - -1      adresu control connection se nepodarilo zjistit
+ *      - -2      klient je pripojeny pres IPv6, PASV neumi IPv6 adresu predat
+ *
+ */
+static int PasvAddress() {
+    struct sockaddr_storage addr;
+    socklen_t               delka = sizeof(addr);
+    char                    ip[INET6_ADDRSTRLEN];
+    char                  * p;
+
+    if (pasv_reply_address[0] != 0) return 1;
+
+    if (pasv_address != "") {
+        strncpy(pasv_reply_address, pasv_address.c_str(), ADDR_LENGTH_MAX);
+    } else {
+        if (getsockname(client_socket, (struct sockaddr*)&addr, &delka) == -1) return -1;
+        if (AddressToString((struct sockaddr*)&addr, ip, sizeof(ip)) == -1) return -1;
+        if (strchr(ip, ':') != 0) return -2;
+        strncpy(pasv_reply_address, ip, ADDR_LENGTH_MAX);
+    }
+    pasv_reply_address[ADDR_LENGTH_MAX] = 0;
+
+    //adresu tvaru 192.168.1.1 prevedeme na 192,168,1,1
+    for (p = pasv_reply_address; *p; p++)
+        if (*p == '.') *p = ',';
+
+    return 1;
+}
+
+
+
+/** Pripravi socket pro pasivni data connection (PASV, EPSV) a nastavi
+ * globalni promennou passive na true.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, do port zapise port, na kterem server posloucha
+ *      -  0      v rozsahu -P neni volny port
+ *      - -1      jina chyba
+ *      - -4      nedostatek pameti
+ *      - -5      protokol neni podporovan
+ *
+ */
+static int PassiveListen(int &port) {
+    if (passive) PasvRelease(server_data_socket); // predchozi PASV nebylo pouzito
+
+    // kopie poslouchajiciho socketu obsluhy pro data connection
+    server_data_socket = PasvListen(port);
+    if (server_data_socket == -1) {
+        passive = false;
+        switch (errno) {
+            case ENOBUFS:
+            case ENOMEM: //nedostatek pameti
+            case ENFILE:
+                return -4;
+            case EINVAL: //protokol neni podporovan
+                return -5;
+            case EADDRINUSE: //vsechny porty z rozsahu -P jsou obsazene
+                return 0;
+            default: return -1;
+        }
+    }
+
+    passive = true;
+    return 1;
+}
+
+
+
 /** Funkce obsluhujici FTP prikaz PASV.
  *
  * Pripravi server na pasivni roli pri vytvareni data connection. Nastavi
  * globalni promennou passive na true.
  * 
- * Socket nebudeme nepojmenovavat.
- *
  * Prikazem PASV nas klient zada, abychom poslouchali na nedefaultnim
- * dataportu (viz RFC959 str. 19), pokud mozno pokazde jinem - resp. volnem,
- * cimz se vyresi problem s posilanim vic souboru v kratkem case (ve STREAM
- * modu, kde je jako EOF potreba ukoncit spojeni) (aby TCP zajistilo
- * spolehlive spojeni, musi jeste na portu chvili cekat).
- * 
- * Pokud socket pomoci bindu nepojmenujeme, nasledne volani listen nebo
- * accept mu prideli nahodny volny port a lokalni adresu nastavi na
- * INADDR_ANY (viz man 7 ip), coz je presne co potrebujeme. 
+ * dataportu (viz RFC959 str. 19). Poslouchajici socket si proces obsluhy
+ * vytvori pri prvnim PASV a nechava ho otevreny az do konce obsluhy (viz.
+ * pasvpool.cpp), server_data_socket je jen jeho kopie. Problem s posilanim
+ * vic souboru v kratkem case (ve STREAM modu, kde je jako EOF potreba
+ * ukoncit spojeni) to nezpusobi - kazde data connection prijde z jineho
+ * portu klienta, takze cekajici spojeni v TIME_WAIT novemu neprekazi.
+ *
+ * Adresu v odpovedi pripravi PasvAddress(). Klientum pripojenym pres IPv6
+ * PASV odmitne, IPv6 adresu predat neumi (maji pouzit EPSV).
  *
  * Navratove hodnoty:
  *
  * jako FTPReply() + :
  *      - -4      nedostatek pameti
  *      - -5      protokol neni podporovan
- *      - -6      pocitac na kterem server bezi nema pridelenou IP
+ *      - -6      nepodarilo se zjistit adresu control connection
  *
  */
 int fpasv(list<string> &, VFS &) {
     int         ret;
-    int         delka;
-    struct sockaddr_in tmp_addr;
+    int         port;
     union  WORD w;
-    struct hostent * info;  // info o host, plne jmeno a jeho ip
-    char   host_name[HOST_NAME_MAX+1];
-    char   ip[ADDR_LENGTH_MAX+1];
-    char * p;
     char   sreply[200];
-    char * jmeno;
 
     if (!logged_in) {
         ret = FTPReply(530,"Not logged in.");
         return ret;
     }
 
-    passive = true;
-
-    // vytvorime socket pro data connection, na kterem budeme poslouchat
-    server_data_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_data_socket == -1) {
-        switch (errno) {
-            case ENOBUFS:
-            case ENOMEM: //nedostatek pameti
-            case ENFILE:
-                return -4;
-            case EINVAL: //protokol neni podporovan
-                return -5;
-        }
+    if (epsv_all) {
+        ret = FTPReply(503, "Only EPSV is allowed after EPSV ALL.");
+        return ret;
     }
-    
 
-    // vytvorime frontu na cekani - tentokrat nam uplne staci delky 1
-    ret = listen(server_data_socket,1);
-    if (ret == -1) {
-        switch (errno) {
-            case EADDRINUSE: return -1; //tohle nenastane - listen si samo vybere volny port
-            case EBADF: return -2; //spatny deskriptor
-            case ENOTSOCK: return -2; //neni to socket
-            default: return -1;
-        } 
-    }
-    
-    // zjistime jaky port nam listen priradil
-    delka = sizeof(tmp_addr);
-    ret = getsockname(server_data_socket,(struct sockaddr*)&tmp_addr,(socklen_t *)&delka);
-    if (ret == -1) {
-        switch (errno) {
-            case EBADF: return -2;
-            case ENOTSOCK: return -2;
-            case ENOBUFS: return -4; //nedostatek sys. zdroju
-            default: return -1;
-        }
+    ret = PasvAddress();
+    if (ret == -1) return -6;
+    if (ret == -2) {
+        ret = FTPReply(425, "PASV is not available over IPv6, use EPSV.");
+        return ret;
     }
 
-    w.w = ntohs(tmp_addr.sin_port);    
-    jmeno = inet_ntoa(tmp_addr.sin_addr);
-#ifdef DEBUG
-   // cout << "fpasv(): getsockname tvrdi, ze se jmenujeme \'" << jmeno << "\'" << endl;
-#endif
-
-    // zjistime svou IP adresu:
-    ret = gethostname(host_name, HOST_NAME_MAX);
-    if (ret == -1) return -1;
-    
-    info = gethostbyname(host_name);
-    if (info == NULL)
-        switch (errno) {
-            case HOST_NOT_FOUND: return -1; // nezname sami sebe??
-            case NO_ADDRESS:
-#ifdef DEBUG
-                cout << "fpasv(): gethostbyname - pry nemame pridelenou zadnou IP." << endl;
-#endif
-                return -6;
-            default: return -1;
-        }
-    
-    strncpy(ip,inet_ntoa(*(struct in_addr*)info->h_addr_list[0]), ADDR_LENGTH_MAX);
-    
-    //adresu tvaru 192.168.1.1 prevedeme na 192,168,1,1
-    p = ip;
-    while (*p){
-        if (*p=='.') *p=',';
-        p++;
+    ret = PassiveListen(port);
+    if (ret < 0) return ret;
+    if (ret == 0) {
+        ret = FTPReply(425, "No free passive port, try again later.");
+        return ret;
     }
+    w.w = port;
     
-    ret = snprintf(sreply, 200, "Entering passive mode (%s,%d,%d).", ip, w.x.h, w.x.l);
+    ret = snprintf(sreply, 200, "Entering passive mode (%s,%d,%d).", pasv_reply_address, w.x.h, w.x.l);
     if (ret >= 200 || ret < 0) return -1; //nepodarilo se vytvorit zpravu
     
     ret = FTPReply(227, sreply);
@@ -278,11 +317,17 @@ int fport(list<string> &args, VFS &) {
     long        cislo;
     char      * p;
     string      c[7];
+    struct sockaddr_in * sin = (struct sockaddr_in *)&client_data_address;
 
     if (!logged_in) {
         ret = FTPReply(530, "Not logged in."); 
         return ret;
     }
+
+    if (epsv_all) {
+        ret = FTPReply(503, "Only EPSV is allowed after EPSV ALL.");
+        return ret;
+    }
   
     if (args.size() < 7) {
         ret = FTPReply(501, "PORT: too few parameters."); 
@@ -318,10 +363,12 @@ int fport(list<string> &args, VFS &) {
     }
     port.x.l = cislo;
   
-    client_data_address.sin_family         = AF_INET;
-    client_data_address.sin_addr.s_addr    = inet_addr(adresa);
-    client_data_address.sin_port           = htons(port.w);
+    memset(&client_data_address, 0, sizeof(client_data_address));
+    sin->sin_family         = AF_INET;
+    sin->sin_addr.s_addr    = inet_addr(adresa);
+    sin->sin_port           = htons(port.w);
     
+    if (passive) PasvRelease(server_data_socket);
     passive = false;
 
     ret = FTPReply(200,"PORT command okay.");
@@ -329,6 +376,152 @@ int fport(list<string> &args, VFS &) {
 }
 
 
+
+
+/** Funkce obsluhujici FTP prikaz EPSV (RFC 2428).
+ *
+ * Jako PASV, ale v odpovedi je jen port (|||port|), klient se pripoji na
+ * stejnou adresu, na kterou je pripojeny control connection - funguje tedy
+ * pro IPv4 i IPv6 a server nemusi zjistovat a formatovat svou adresu.
+ * Argument 1 nebo 2 urcuje protokol (IPv4, IPv6), ktery musi odpovidat
+ * control connection. Po EPSV ALL server odmita PORT, EPRT a PASV.
+ *
+ * Navratove hodnoty:
+ *
+ * jako fpasv()
+ *
+ */
+int fepsv(list<string> &args, VFS &) {
+    int         ret;
+    int         port;
+    int         proto;
+    string      s;
+    char        sreply[100];
+    struct sockaddr_storage addr;
+    socklen_t   delka = sizeof(addr);
+
+    if (!logged_in) {
+        ret = FTPReply(530,"Not logged in.");
+        return ret;
+    }
+
+    if (args.size() == 2) {
+        s = args.back();
+        ToLower(s);
+        if (s == "all") {
+            epsv_all = true;
+            ret = FTPReply(200, "EPSV ALL command successful.");
+            return ret;
+        }
+
+        if (getsockname(client_socket, (struct sockaddr*)&addr, &delka) == -1) return -6;
+        proto = (addr.ss_family == AF_INET6 && !IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *)&addr)->sin6_addr)) ? 2 : 1;
+
+        if (s != "1" && s != "2") {
+            ret = FTPReply(501, "Syntax error in parameter.");
+            return ret;
+        }
+        if (s[0] - '0' != proto) {
+            ret = FTPReply(522, (proto == 1) ? "Network protocol not supported, use (1)" : "Network protocol not supported, use (2)");
+            return ret;
+        }
+    }
+
+    ret = PassiveListen(port);
+    if (ret < 0) return ret;
+    if (ret == 0) {
+        ret = FTPReply(425, "No free passive port, try again later.");
+        return ret;
+    }
+
+    snprintf(sreply, sizeof(sreply), "Entering Extended Passive Mode (|||%d|).", port);
+    ret = FTPReply(229, sreply);
+    return ret;
+}
+
+
+
+
+/** Funkce obsluhujici FTP prikaz EPRT (RFC 2428).
+ *
+ * Jako PORT, ale adresa je ve tvaru <d>protokol<d>adresa<d>port<d>, kde
+ * <d> je oddelovac (obvykle |), protokol 1 je IPv4 a 2 IPv6. Napr. 
+ * EPRT |2|2001:db8::1|5282|
+ *
+ * Navratove hodnoty:
+ *
+ * viz. FTPReply()
+ *
+ */
+int feprt(list<string> &args, VFS &) {
+    int                     ret;
+    string                  s;
+    string                  proto, ip, port_s;
+    string::size_type       n1, n2, n3;
+    long                    port;
+    char                  * p;
+    struct sockaddr_storage addr;
+
+    if (!logged_in) {
+        ret = FTPReply(530, "Not logged in."); 
+        return ret;
+    }
+
+    if (epsv_all) {
+        ret = FTPReply(503, "Only EPSV is allowed after EPSV ALL.");
+        return ret;
+    }
+
+    if (args.size() != 2 || args.back().size() < 7) {
+        ret = FTPReply(501, "Syntax error in parameters.");
+        return ret;
+    }
+
+    s  = args.back();
+    n1 = s.find(s[0], 1);
+    n2 = (n1 == string::npos) ? string::npos : s.find(s[0], n1 + 1);
+    n3 = (n2 == string::npos) ? string::npos : s.find(s[0], n2 + 1);
+    if (n3 != s.size() - 1) {
+        ret = FTPReply(501, "Syntax error in parameters.");
+        return ret;
+    }
+    proto  = s.substr(1, n1 - 1);
+    ip     = s.substr(n1 + 1, n2 - n1 - 1);
+    port_s = s.substr(n2 + 1, n3 - n2 - 1);
+
+    port = strtol(port_s.c_str(), &p, 10);
+    if (p == port_s.c_str() || *p != 0 || port < 1 || port > 65535) {
+        ret = FTPReply(501, "Syntax error in parameters.");
+        return ret;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    if (proto == "1") {
+        addr.ss_family = AF_INET;
+        ((struct sockaddr_in *)&addr)->sin_port = htons(port);
+        ret = inet_pton(AF_INET, ip.c_str(), &((struct sockaddr_in *)&addr)->sin_addr);
+    } else if (proto == "2") {
+        addr.ss_family = AF_INET6;
+        ((struct sockaddr_in6 *)&addr)->sin6_port = htons(port);
+        ret = inet_pton(AF_INET6, ip.c_str(), &((struct sockaddr_in6 *)&addr)->sin6_addr);
+    } else {
+        ret = FTPReply(522, "Network protocol not supported, use (1,2)");
+        return ret;
+    }
+    if (ret != 1) {
+        ret = FTPReply(501, "Syntax error in network address.");
+        return ret;
+    }
+
+    client_data_address = addr;
+    if (passive) PasvRelease(server_data_socket);
+    passive = false;
+
+    ret = FTPReply(200, "EPRT command successful.");
+    return ret;
+}
+
+
 /** Funkce obsluhujici FTP prikaz TYPE.
  *
  * Nastavi typ prenosu po data connection, podle ktereho se budou ridit
@@ -420,6 +613,10 @@ int fmode(list<string> &args, VFS &) {
             case MODE_COMPRESSED:
                 ret = FTPReply(504,"Command not implemented for that parameter.");
                 break;
+            case MODE_ZLIB:
+                transfer_mode = MODE_ZLIB;
+                ret = FTPReply(200,"Mode Z (deflate) set.");
+                break;
             default:
                 ret = FTPReply(501,"Syntax error - unknown parameter.");
         }
@@ -586,9 +783,10 @@ int fpwd(list<string> &, VFS &vfs) {
  *
  * Posila klientovi obsah zadaneho adresare. Informace posila vzdy ve tvaru
  * prikazu ls -l. Pokud klient zada prikaz "LIST -a" nebo "LIST -aL", tak
- * argument jednoduse ignoruje. Pro ziskani informaci o souborech se pouzivaji
- * funkce NextFile(), ResetFiles() a GetLslInfo(), uzivatel musi mit dostatecna
- * prava, aby mohl provest prikaz LIST.
+ * argument jednoduse ignoruje. Vypis adresare se bere z cache vypisu (viz.
+ * listcache.cpp), ktera ho pripadne sestavi pomoci NextFile(), ResetFiles() a
+ * GetLslInfo(), uzivatel musi mit dostatecna prava, aby mohl provest prikaz
+ * LIST.
  *
  */
 int flist(list<string> &args, VFS &vfs) { 
@@ -621,7 +819,9 @@ int flist(list<string> &args, VFS &vfs) {
 
     //jen pokud je to adresar....!!!
     if (vfs.IsDir(path.c_str())) {
-        VFS_file  * file;
+        DirListing      listing;
+        unsigned int    sent;
+        int             n;
         
         ret = vfs.ChangeDir(path.c_str());
         if (ret < 0) 
@@ -643,30 +843,25 @@ int flist(list<string> &args, VFS &vfs) {
 //        ret = FTPReply(150,"Ok, about to open data connection.");
 //        if (ret < 0) return ret;
         
+        SessionFile(false, vfs.CurrentPhysicalDir());
         ret = CreateDataConnection();
                 //Data connection nam sice nejde vytvorit, ale treba jeste bude mozna
                 //pokracovat a vyjde to priste, proto vracime 1
         if (ret < 0) return 1;
  
-        vfs.ResetFiles();
-        while ((file = vfs.NextFile()) != 0) {
-            ret = file->GetLslInfo(s);
-            if (ret < 0) continue; //nelze ziskat info o souboru, jdem na dalsi
-           
-            //pokud tenhle uzivatel s tim souborem nesmi pracovat, tak ho ani neuvidi 
-            if (file->UserName() != current_user.name && 
-                file->UserName() != NO_USER && 
-                file->UserName() != "anonymous" &&
-                file->IsRegularFile()) continue; //adresare nepreskakujeme
-            
-            if (transfer_type == TYPE_ASCII) s = s + "\r\n"; //pridame na konec CRLF    
-                else s = s + "\n";
-            
-            if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) {
-                s = s + FTP_EOR;
-            }
+        ret = ListCacheGet(vfs, listing);
+        if (ret > 0) MetricsCache(METRICS_CACHE_LIST, ret == 1, ret == 2);
+        
+        //pokud tenhle uzivatel s nekterym souborem nesmi pracovat, tak ho ani
+        //neuvidi (adresare nepreskakujeme)
+        ListCachePayload(listing, current_user.name, transfer_type == TYPE_ASCII,
+                         transfer_mode == MODE_STREAM && file_structure == STRU_RECORD, s);
+        
+        for (sent = 0; sent < s.size(); sent += n) {
+            n = s.size() - sent;
+            if (n > LIST_SEND_CHUNK) n = LIST_SEND_CHUNK;
             
-            ret = SendDataLine(s.c_str());
+            ret = SendData(s.data() + sent, n);
             if (ret < 0) {  //nelze posilat data, koncime
                 FTPReply(426, "Data connection lost.");
                 
@@ -676,8 +871,7 @@ int flist(list<string> &args, VFS &vfs) {
                 
                 return 1;
             }
-            delete file;    
-        }//while
+        }//for
         
         if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) {
             //at mame typ ASCII nebo IMAGE musime ted poslat EOF
@@ -713,6 +907,8 @@ int flist(list<string> &args, VFS &vfs) {
 //        ret = FTPReply(150,"Ok, about to open data connection.");
 //        if (ret < 0) return ret;
         
+        if (file.Path() != "/") SessionFile(false, file.Path() + "/" + file.Name());
+            else SessionFile(false, "/" + file.Name());
         ret = CreateDataConnection();
                 //Data connection nam sice nejde vytvorit, ale treba jeste bude mozna
                 //pokracovat a vyjde to priste, proto vracime 1
@@ -739,6 +935,16 @@ int flist(list<string> &args, VFS &vfs) {
     }//byl to soubor
 
     
+    ret = FinishData();
+    if (ret < 0) {
+        FTPReply(426, "Data connection lost.");
+        if (passive) close(server_data_socket);
+        passive = false;
+        close(client_data_socket);
+        return 1;
+    }
+    
+    DataStreamDone(false, vfs.ShareName(vfs.CurrentPhysicalDir()));
     ret = FTPReply(226,"Closing data connection. LIST successful.");
     if (passive) close(server_data_socket); 
     passive = false;
@@ -845,6 +1051,69 @@ int fcdup(list<string> &, VFS &vfs) {
 
 
 
+/** Posle klientovi cely obsah souboru content jednim zapisem (viz.
+ * FileCacheLoad()) a dokonci prikaz RETR. Pokud cached je true, obsah
+ * souboru byl v cache. share je sdileny adresar souboru (pro metriky).
+ *
+ */
+static int RetrFromMemory(string &content, bool cached, const string &share) {
+    string      converted;
+    string    * data = &content;
+    int         ret;
+
+    ret = CreateDataConnection();
+    //Data connection nam sice nejde vytvorit, ale treba jeste bude mozna
+    //pokracovat a vyjde to priste, proto vracime 1
+    if (ret < 0) return 1;
+
+    DataStreamOffset(0);
+
+    if (transfer_type == TYPE_ASCII && content.size() > 0) {
+        converted.resize(2 * content.size());
+        converted.resize(LF2CRLF(&converted[0], &content[0], content.size()));
+        data = &converted;
+    }
+
+    if (data->size() > 0) {
+        ret = SendData(data->data(), data->size());
+        if (ret < 0) {  //nelze posilat data, koncime
+            FTPReply(426, "Data connection lost.");
+
+            if (secure_dc) TLSDataShutdown();
+                else close(client_data_socket);
+            if (passive) close(server_data_socket);
+            passive = false;
+
+            return 1;
+        }
+        if (cached) FileCacheServed(data->size());
+    }
+
+    ret = FinishData();
+    if (ret < 0) {
+        FTPReply(426, "Data connection lost.");
+        if (secure_dc) TLSDataShutdown();
+            else close(client_data_socket);
+        if (passive) close(server_data_socket);
+        passive = false;
+        return 1;
+    }
+
+    DataStreamDone(false, share);
+    FTPReply(226,"Closing data connection. RETR successful.");
+    if (secure_dc) TLSDataShutdown();
+        else close(client_data_socket);
+
+    if (passive) {
+        close(server_data_socket);
+        passive = false;
+    }
+
+    return 1;
+}
+
+
+
 /** Funkce obsluhujici FTP prikaz RETR.
  *
  * Posila vyzadany soubor klientovi. Kontroluje, zda k tomu ma dostatecna
@@ -863,6 +1132,16 @@ int fretr(list<string> &args, VFS &vfs) {
     char        buffer2[2*BUF_SIZE]; //do nej se prevede buffer s tim, ze misto LF se zapise CRLF
     int         nacteno;
     unsigned long long   transferred = 0;
+    bool        lf_only = false; //< obnova v rezimu ASCII zacina uprostred CRLF
+    bool        ranged  = false; //< posilame jen rozsah zadany prikazem RANG
+    unsigned long long   remaining = 0; //< kolik bytu rozsahu zbyva poslat
+    unsigned long long   start_offset = 0; //< odkud prenos zacina (v prenasenych datech)
+    bool        zcached = false; //< posilame zkomprimovana data z cache (MODE Z)
+    bool        zcache_store = false; //< ulozit zkomprimovana data do cache
+    CacheStamp  zstamp;
+    char        zsuffix[20];
+    LFIndex     index;
+    PageCacheStream stream;
     
     if (!logged_in) {
         ret = FTPReply(530,"Not logged in."); 
@@ -896,22 +1175,104 @@ int fretr(list<string> &args, VFS &vfs) {
     }
  
     if (file.Path()!="/") name = file.Path() + "/" + file.Name(); else name = "/" + file.Name();
+    DataStreamFile(false, name);
+
+    //maly soubor posilany cely muzeme vzit ze sdilene cache (viz. filecache.cpp)
+    if (!restart && !range && file_structure == STRU_FILE) {
+        string          content;
+        unsigned int    limit = file_cache_max;
+
+        //u vetsich souboru se v MODE Z uklada komprimovany proud a v TYPE A
+        //index pro obnovu prenosu - ty posilame normalne
+        if (transfer_mode == MODE_ZLIB && limit >= ZCACHE_MIN_SIZE) limit = ZCACHE_MIN_SIZE - 1;
+        if (transfer_type == TYPE_ASCII && limit >= RESUME_BLOCK_SIZE) limit = RESUME_BLOCK_SIZE - 1;
+
+        ret = FileCacheLoad(name, limit, content);
+        if (ret > 0) return RetrFromMemory(content, ret == 1, vfs.ShareName(name));
+    }
     
     fd = fopen(name.c_str(),"r");
     if (fd == 0) { 
         ret = FTPReply(450, "File busy."); 
         return ret;
     }
+    setvbuf(fd, 0, _IOFBF, STREAM_BUF_SIZE);
+
+    if (restart || range) {
+        long    offset = restart ? restart_offset : range_start;
+
+        start_offset = offset;
+
+        //pri RANG posleme jen range_end - range_start + 1 bytu
+        if (range) {
+            ranged    = true;
+            remaining = range_end - range_start + 1;
+        }
+
+        restart = false;
+        restart_offset = 0;
+        range = false;
+
+        //v rezimu ASCII klient pocita offset v prenasenych datech, tj. kazdy
+        //LF jako CRLF - musime ho prevest na offset v souboru
+        if (transfer_type == TYPE_ASCII && offset > 0) {
+            unsigned long long file_offset;
+
+            ret = AsciiOffset2FileOffset(name.c_str(), offset, file_offset, lf_only);
+            if (ret < 0) {
+                fclose(fd);
+                if (ret == -2) ret = FTPReply(554, "Restart offset beyond end of file.");
+                    else ret = FTPReply(450, "Error while resuming file transfer.");
+                return ret;
+            }
+            offset = file_offset;
+        }
+
+        struct stat st;
+        if (ranged && transfer_type != TYPE_ASCII && fstat(fileno(fd), &st) == 0 && offset > st.st_size) {
+            fclose(fd);
+            ret = FTPReply(554, "Range start beyond end of file.");
+            return ret;
+        }
 
-    if (restart) {
-        ret = fseek(fd, restart_offset, SEEK_SET);
+        ret = fseek(fd, offset, SEEK_SET);
         if (ret < 0) {
+            fclose(fd);
             ret = FTPReply(450, "Error while resuming file transfer.");
             return ret;
         }
-        restart = false;
-        restart_offset = 0;
+    } else {
+        struct stat st;
+
+        if (fstat(fileno(fd), &st) == 0) {
+            //v MODE Z muzeme poslat uz drive zkomprimovana data z cache, pokud
+            //tam nejsou, ulozime je tam pri tomto prenosu
+            if (transfer_mode == MODE_ZLIB && file_structure == STRU_FILE && st.st_size >= ZCACHE_MIN_SIZE) {
+                int zcache;
+
+                MakeCacheStamp(st, zstamp);
+                snprintf(zsuffix, 20, "z%c%d", transfer_type, mode_z_level);
+                zcache = CacheOpen(zstamp, zsuffix);
+                if (zcache != -1) {
+                    fclose(fd);
+                    fd = fdopen(zcache, "r");
+                    if (fd == 0) {
+                        close(zcache);
+                        ret = FTPReply(450, "File busy.");
+                        return ret;
+                    }
+                    zcached = true;
+                } else zcache_store = true;
+            }
+
+            //posilame cely soubor, muzeme pritom spocitat index pro pripadnou
+            //pozdejsi obnovu prenosu
+            if (!zcached && transfer_type == TYPE_ASCII && st.st_size >= RESUME_BLOCK_SIZE) index.Start(st);
+        }
     }
+
+    //soubor se cte sekvencne - rekneme to jadru (viz. pagecache.cpp)
+    PageCacheStart(stream, fileno(fd), zcached ? CACHE_POLICY_HOT : file.CachePolicy(), ftell(fd));
     
 //    ret = FTPReply(150,"File status Okay, about to open data connection.");
 //    if (ret < 0) return ret;
@@ -924,12 +1285,35 @@ int fretr(list<string> &args, VFS &vfs) {
         return 1;
     }
 
-    while (cti) {
-        nacteno = fread(buffer, 1, BUF_SIZE, fd);
-        if (feof(fd)) { cti = false; }
-        if (ferror(fd)) {
-            cti = false;
-            FTPReply(451,"Requested action aborted: local error in processing.");
+    if (zcache_store) ZCacheStart(zstamp, zsuffix);
+    DataStreamOffset(start_offset);
+
+    if (lf_only) {
+        //klient uz ma CR z posledniho konce radku, chybi mu jen LF
+        ret = SendData("\n", 1);
+        if (ret < 0) {
+            FTPReply(426, "Data connection lost.");
+            fclose(fd);
+            if (secure_dc) TLSDataShutdown();
+                else close(client_data_socket);
+            if (passive) close(server_data_socket);
+            passive = false;
+            return 1;
+        }
+        fseek(fd, 1, SEEK_CUR);
+        if (ranged && --remaining == 0) cti = false;
+    }
+
+    while (cti) {
+        {
+            TraceSpan span("fread", "disk", TRACE_IO_MIN_USEC);
+            nacteno = fread(buffer, 1, BUF_SIZE, fd);
+        }
+        PageCacheAdvance(stream, nacteno);
+        if (feof(fd)) { cti = false; }
+        if (ferror(fd)) {
+            cti = false;
+            FTPReply(451,"Requested action aborted: local error in processing.");
             fclose(fd);
             if (secure_dc) TLSDataShutdown();
             if (passive) close(server_data_socket); 
@@ -943,6 +1327,7 @@ int fretr(list<string> &args, VFS &vfs) {
 #ifdef DEBUG
             cout << getpid() << "fretr(): aborting" << endl;
 #endif
+            ZCacheDiscard();
             ret = FTPReply(426,"Transfer aborted.");
             if (ret < 0) { 
                 ftp_abort = false; passive = false; 
@@ -955,6 +1340,7 @@ int fretr(list<string> &args, VFS &vfs) {
                 close(client_data_socket); if (passive) close(server_data_socket); 
                 return ret;
             }
+            PageCacheEnd(stream);
             fclose(fd);
             if (secure_dc) TLSDataShutdown();
                 else close(client_data_socket);
@@ -964,8 +1350,33 @@ int fretr(list<string> &args, VFS &vfs) {
             return 1;            
         }
 
-        if (transfer_type == TYPE_ASCII) nacteno = LF2CRLF(buffer2, buffer, nacteno);
-            else memcpy(buffer2, buffer, nacteno); //pro IMAGE type
+        if (zcached) { //data z cache uz jsou zkomprimovana
+            ret = SendCompressedStream(buffer, nacteno);
+            if (ret < 0) {
+                FTPReply(426, "Data connection lost.");
+                fclose(fd);
+                if (secure_dc) TLSDataShutdown();
+                    else close(client_data_socket);
+                if (passive) close(server_data_socket);
+                passive = false;
+                return 1;
+            }
+            continue;
+        }
+
+        if (transfer_type == TYPE_ASCII) {
+            index.Feed(buffer, nacteno);
+            nacteno = LF2CRLF(buffer2, buffer, nacteno);
+        } else memcpy(buffer2, buffer, nacteno); //pro IMAGE type
+
+        //konec rozsahu zadaneho prikazem RANG - pocita se v prenasenych datech
+        if (ranged) {
+            if ((unsigned long long)nacteno >= remaining) {
+                nacteno = remaining;
+                cti     = false;
+            }
+            remaining -= nacteno;
+        }
         ret = SendData(buffer2, nacteno);
         if (ret < 0) {  //nelze posilat data, koncime
             FTPReply(426, "Data connection lost.");
@@ -985,7 +1396,26 @@ int fretr(list<string> &args, VFS &vfs) {
         SendData(FTP_EOF, sizeof(FTP_EOF));
     }//if
 
+    if (transfer_type == TYPE_ASCII && !zcached) {
+        //index ulozime jen pokud se soubor behem prenosu nezmenil
+        struct stat st;
+        if (fstat(fileno(fd), &st) == 0 && index.Matches(st)) index.Store();
+    }
+
+    PageCacheEnd(stream);
     fclose(fd);
+
+    ret = FinishData();
+    if (ret < 0) {
+        FTPReply(426, "Data connection lost.");
+        if (secure_dc) TLSDataShutdown();
+            else close(client_data_socket);
+        if (passive) close(server_data_socket);
+        passive = false;
+        return 1;
+    }
+
+    DataStreamDone(false, vfs.ShareName(name));
     FTPReply(226,"Closing data connection. RETR successful.");
     if (secure_dc) TLSDataShutdown();
         else close(client_data_socket);
@@ -1020,13 +1450,28 @@ int fstor(list<string> &args, VFS &vfs) {
     char        buffer2[BUF_SIZE]; //do nej se prevede buffer s tim, ze misto LF se zapise CRLF
     int         nacteno;
     bool        CR = false;
+    DigestSet   digests; //< kontrolni soucty pocitane behem prenosu
+    unsigned long long start_offset = 0; //< odkud prenos zacina (v prenasenych datech)
+    unsigned long long prealloc = allo_size; //< kolik mista vyhradit (z ALLO)
+    string      temp_name; //< docasny soubor, do ktereho se zapisuje (viz. upload.h)
+    unsigned long long unsynced = 0; //< kolik bytu se zapsalo od posledniho DataWriteback()
+    bool        renamed; //< docasny soubor se prejmenoval na cilovy
+    bool        synced;  //< soubor i jeho jmeno jsou na disku
 
     
+    allo_size = 0; //ALLO plati jen pro nasledujici prikaz
+
     if (!logged_in) {
         ret = FTPReply(530,"Not logged in."); 
         return ret;
     }
 
+    if (range) {
+        range = false;
+        ret = FTPReply(504, "RANG is supported only for RETR and HASH.");
+        return ret;
+    }
+
     if (args.size() == 1) {
         ret = FTPReply(501,"STOR command needs a parameter specifying a file to be transfered."); 
         return ret;
@@ -1057,7 +1502,7 @@ int fstor(list<string> &args, VFS &vfs) {
         file.Path(path);
     }
     
-    if ( !vfs.AllowedToWriteToDir(dir) ) {
+    if ( !vfs.AllowedToWriteToDir(dir) || IsUploadTemp(file.Name()) ) {
         ret = FTPReply(553, "Filename or directory not allowed.");
 #ifdef DEBUG
         cout << "fstor: dir = " << dir << endl;
@@ -1077,6 +1522,29 @@ int fstor(list<string> &args, VFS &vfs) {
     }
 */    
     
+    if (restart) start_offset = restart_offset;
+
+    if (restart && transfer_type == TYPE_ASCII && restart_offset > 0) {
+        //offset je v prenasenych datech (LF jako CRLF), prevedeme ho na
+        //offset v souboru; pokud soubor neexistuje, resi to az truncate()
+        unsigned long long file_offset;
+        bool               lf_only;
+
+        ret = AsciiOffset2FileOffset(tmp.c_str(), restart_offset, file_offset, lf_only);
+        if (ret == -2) {
+            restart = false;
+            restart_offset = 0;
+            ret = FTPReply(554, "Restart offset beyond end of file.");
+            return ret;
+        }
+        if (ret > 0) {
+            restart_offset = file_offset;
+            //klient uz poslal CR, LF jeste ne - ten LF v souboru zahodime a
+            //pockame si na nej
+            if (lf_only) CR = true;
+        }
+    }
+
     if (restart) {         
         ret = truncate(tmp.c_str(), restart_offset);
         if (ret < 0) {
@@ -1101,15 +1569,20 @@ int fstor(list<string> &args, VFS &vfs) {
             ret = FTPReply(550,"Unable to open file.");
             return ret;
         }
+
+        //do kontrolnich souctu musime zapocitat i to, co uz v souboru je
+        digests.Start(digest_mask);
+        digests.Prime(tmp.c_str(), restart_offset);
         
         restart = false;
         restart_offset = 0;
     } else { 
-        fd = fopen(tmp.c_str(), "w"); 
+        fd = UploadOpen(tmp, prealloc, temp_name);
         if (fd == 0) {
             ret = FTPReply(450,"STOR not taken, error while creating/accessing the file."); 
             return ret;
         }
+        digests.Start(digest_mask);
     }
 
 
@@ -1117,13 +1590,15 @@ int fstor(list<string> &args, VFS &vfs) {
 //    ret = FTPReply(150,"File status Okay, about to open data connection.");
 //    if (ret < 0) return ret;
 
+    DataStreamFile(true, tmp);
     ret = CreateDataConnection();
     if (ret < 0) {
-        fclose(fd);
+        UploadAbort(fd, temp_name);
         //Data connection nam sice nejde vytvorit, ale treba jeste bude mozna
         //pokracovat a vyjde to priste, proto vracime 1
         return 1;
     }
+    DataStreamOffset(start_offset);
     
     while (1) {
         nacteno = ReceiveData(buffer, BUF_SIZE);
@@ -1132,7 +1607,7 @@ int fstor(list<string> &args, VFS &vfs) {
             if (secure_dc) TLSDataShutdown();
             if (passive) close(server_data_socket);
             passive = false;
-            fclose(fd);
+            UploadAbort(fd, temp_name);
             return ret;
         }
 
@@ -1151,7 +1626,7 @@ int fstor(list<string> &args, VFS &vfs) {
                 close(client_data_socket); if (passive) close(server_data_socket); 
                 return ret;
             }
-            fclose(fd);
+            UploadAbort(fd, temp_name);
             if (secure_dc) TLSDataShutdown();
                 else close(client_data_socket);
             if (passive) close(server_data_socket); 
@@ -1173,6 +1648,7 @@ int fstor(list<string> &args, VFS &vfs) {
             } else if (buffer[0] != '\n' && CR) {
                 CR = false;
                 fwrite("\r", 1, 1, fd);
+                digests.Update("\r", 1);
             }
         
             if (buffer[nacteno-1] == '\r') { 
@@ -1186,28 +1662,43 @@ int fstor(list<string> &args, VFS &vfs) {
         
         if (transfer_type == TYPE_ASCII) {
             if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) nacteno = EraseEOR(buffer2, nacteno);
-            n = fwrite(buffer2, 1, nacteno, fd);
+            {
+                TraceSpan span("fwrite", "disk", TRACE_IO_MIN_USEC);
+                n = fwrite(buffer2, 1, nacteno, fd);
+            }
+            digests.Update(buffer2, n);
         }
         else {
             if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) nacteno = EraseEOR(buffer, nacteno);
-            n = fwrite(buffer, 1, nacteno, fd);
+            {
+                TraceSpan span("fwrite", "disk", TRACE_IO_MIN_USEC);
+                n = fwrite(buffer, 1, nacteno, fd);
+            }
+            digests.Update(buffer, n);
         }
         
         memset(buffer,0, BUF_SIZE);
         memset(buffer2,0, BUF_SIZE);
         if (n != nacteno) {
             ret = FTPReply(451, "STOR aborted: local error in processing.");
-            fclose(fd);
+            UploadAbort(fd, temp_name);
             if (secure_dc) TLSDataShutdown();
                 else close(client_data_socket);
             if (passive) close(server_data_socket); 
             passive = false;
             return ret;
         }
+
+        unsynced += n;
+        if (unsynced >= DURABLE_WRITEBACK_CHUNK) {
+            DataWriteback(fileno(fd));
+            unsynced = 0;
+        }
     }
-    fclose(fd);
+    DataStreamDone(true, vfs.ShareName(tmp));
 
-    //doplnime informace o souboru
+    //informace o souboru - do databaze je ulozi UploadCommit(), pri
+    //atomic_uploads jeste pred prejmenovanim docasneho souboru na cilovy
     file.UserRights(R_ALL);
     file.OthersRights(R_NONE);
     file.UserName(current_user.name);
@@ -1217,18 +1708,33 @@ int fstor(list<string> &args, VFS &vfs) {
     cout << "fstor: oth_r = " << file.OthersRights() << endl;
     cout << "fstor: usr_n = " << file.UserName() << endl;
 #endif
-    
-    //a ulozime je do databaze
-    ret = vfs.PutFileInfo(file);
-    
-#ifdef DEBUG
-    if (ret < 0) cout << "*** fstor(): chyba pri praci s databazi ... " << ret << endl;
-#endif
+
+    renamed = (temp_name != "");
+    ret = UploadCommit(fd, tmp, temp_name, file, vfs);
+    synced = (ret == 1);
+    if (ret == -1) {
+        ret = FTPReply(451, "STOR aborted: local error in processing.");
+        if (secure_dc) TLSDataShutdown();
+            else close(client_data_socket);
+        if (passive) close(server_data_socket); 
+        passive = false;
+        return ret;
+    }
+    StatCacheInvalidate(tmp);
+
+    //kontrolni soucty jsou hotove driv, nez klient dostane 226
+    digests.Final();
+    digests.Store(tmp.c_str());
     
     if (secure_dc) TLSDataShutdown();
         else close(client_data_socket);
     
-    ret = FTPReply(226,"Closing data connection. STOR successful.");
+    //po prejmenovani uz klient novy soubor vidi a 451 by ho mylilo, chybu
+    //zapisu na disk jen oznamime v odpovedi 226
+    if (ret == -4 && !renamed) ret = FTPReply(451, "STOR aborted: unable to commit file information to disk.");
+        else if (ret == -4 || !synced)
+            ret = FTPReply(226, "Closing data connection. STOR successful, but the file may not survive a system crash.");
+        else ret = FTPReply(226,"Closing data connection. STOR successful.");
     if (passive) close(server_data_socket); 
     passive = false;
     return ret;
@@ -1269,6 +1775,7 @@ int frein(list<string> &args, VFS &vfs) {
         current_user.Clear(); 
         logged_in = false;
         vfs.ChangeDir("/");
+        SessionUser("");
     }
     
     ret = FTPReply(220, "smallFTPd ready for new user.");
@@ -1355,6 +1862,10 @@ int fstou(list<string> &args, VFS &vfs) {
     char        buffer2[BUF_SIZE]; //do nej se prevede buffer s tim, ze misto LF se zapise CRLF
     int         nacteno;
     bool        CR = false;
+    DigestSet   digests; //< kontrolni soucty pocitane behem prenosu
+    unsigned long long unsynced = 0; //< kolik bytu se zapsalo od posledniho DataWriteback()
+
+    allo_size = 0; //ALLO plati jen pro nasledujici prikaz, tady se nevyuzije
 
     
     if (!logged_in) {
@@ -1362,6 +1873,12 @@ int fstou(list<string> &args, VFS &vfs) {
         return ret;
     }
 
+    if (range) {
+        range = false;
+        ret = FTPReply(504, "RANG is supported only for RETR and HASH.");
+        return ret;
+    }
+
     if (args.size() != 1) {
         ret = FTPReply(501,"STOU command doesn't have a parameter."); 
         return ret;
@@ -1385,10 +1902,12 @@ int fstou(list<string> &args, VFS &vfs) {
     
     file.Path(dir);
     file.Name(name);
+    digests.Start(digest_mask);
     
 //    ret = FTPReply(150,"File status Okay, about to open data connection.");
 //    if (ret < 0) return ret;
 
+    if (dir != "/") DataStreamFile(true, dir + "/" + name); else DataStreamFile(true, "/" + name);
     ret = CreateDataConnection();
     if (ret < 0) {
         close(fd);
@@ -1442,6 +1961,7 @@ int fstou(list<string> &args, VFS &vfs) {
             } else if (buffer[0] != '\n' && CR) {
                 CR = false;
                 write(fd, "\r", 1);
+                digests.Update("\r", 1);
             }
         
             if (buffer[nacteno-1] == '\r') { 
@@ -1455,9 +1975,11 @@ int fstou(list<string> &args, VFS &vfs) {
         if (transfer_type == TYPE_ASCII) {
             if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) nacteno = EraseEOR(buffer2, nacteno);
             n = write(fd, buffer2, nacteno);
+            digests.Update(buffer2, n);
         } else {
             if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) nacteno = EraseEOR(buffer, nacteno);
             n = write(fd, buffer, nacteno);
+            digests.Update(buffer, n);
         }
         
         memset(buffer,0, BUF_SIZE);
@@ -1470,10 +1992,31 @@ int fstou(list<string> &args, VFS &vfs) {
             passive = false;
             return ret;
         }
+
+        unsynced += n;
+        if (unsynced >= DURABLE_WRITEBACK_CHUNK) {
+            DataWriteback(fd);
+            unsynced = 0;
+        }
     }
+    DataStreamDone(true, vfs.ShareName(dir));
   
+    if (DataSync(fd) < 0) {
+        ret = FTPReply(451, "STOU aborted: unable to write data to disk.");
+        close(fd);
+        close(client_data_socket);
+        if (passive) close(server_data_socket); 
+        passive = false;
+        return ret;
+    }
     close(fd);
 
+    //kontrolni soucty jsou hotove driv, nez klient dostane 226
+    digests.Final();
+    if (dir != "/") digests.Store((dir + "/" + name).c_str());
+        else digests.Store(("/" + name).c_str());
+    StatCacheInvalidate((dir != "/") ? dir + "/" + name : "/" + name);
+
     //doplnime informace o souboru
     file.UserRights(R_ALL);
     file.OthersRights(R_NONE);
@@ -1488,7 +2031,8 @@ int fstou(list<string> &args, VFS &vfs) {
     
     string s;
     s = file.Name() + " - file transfer successful."; 
-    ret = FTPReply(226,s.c_str());
+    if (ret == -4) ret = FTPReply(451, "STOU aborted: unable to commit file information to disk.");
+        else ret = FTPReply(226,s.c_str());
     close(client_data_socket);
     if (passive) close(server_data_socket); 
     passive = false;
@@ -1515,6 +2059,10 @@ int fappe(list<string> &args, VFS &vfs) {
     char        buffer2[BUF_SIZE]; //do nej se prevede buffer s tim, ze misto LF se zapise CRLF
     int         nacteno;
     bool        CR = false;
+    DigestSet   digests; //< kontrolni soucty pocitane behem prenosu
+    unsigned long long unsynced = 0; //< kolik bytu se zapsalo od posledniho DataWriteback()
+
+    allo_size = 0; //ALLO plati jen pro nasledujici prikaz, tady se nevyuzije
 
     
     if (!logged_in) {
@@ -1522,6 +2070,12 @@ int fappe(list<string> &args, VFS &vfs) {
         return ret;
     }
 
+    if (range) {
+        range = false;
+        ret = FTPReply(504, "RANG is supported only for RETR and HASH.");
+        return ret;
+    }
+
     if (args.size() == 1) {
         ret = FTPReply(501,"APPE command needs a parameter specifying a file to be transfered."); 
         return ret;
@@ -1552,7 +2106,7 @@ int fappe(list<string> &args, VFS &vfs) {
         file.Path(path);
     }
     
-    if ( !vfs.AllowedToWriteToDir(dir) ) {
+    if ( !vfs.AllowedToWriteToDir(dir) || IsUploadTemp(file.Name()) ) {
         ret = FTPReply(553, "Filename or directory not allowed.");
         return ret;
     }
@@ -1565,10 +2119,17 @@ int fappe(list<string> &args, VFS &vfs) {
         ret = FTPReply(450,"APPE not taken, unable to create or open file."); 
         return ret;
     }
+
+    //do kontrolnich souctu musime zapocitat i puvodni obsah souboru
+    struct stat st;
+    digests.Start(digest_mask);
+    if (fstat(fileno(fd), &st) == 0) digests.Prime(tmp.c_str(), st.st_size);
+        else digests.Start(0);
     
 //    ret = FTPReply(150,"File status Okay, about to open data connection.");
 //    if (ret < 0) return ret;
 
+    DataStreamFile(true, tmp);
     ret = CreateDataConnection();
     if (ret < 0) {
         fclose(fd);
@@ -1623,6 +2184,7 @@ int fappe(list<string> &args, VFS &vfs) {
             } else if (buffer[0] != '\n' && CR) {
                 CR = false;
                 fwrite("\r", 1, 1, fd);
+                digests.Update("\r", 1);
             }
         
             if (buffer[nacteno-1] == '\r') { 
@@ -1636,9 +2198,11 @@ int fappe(list<string> &args, VFS &vfs) {
         if (transfer_type == TYPE_ASCII) { 
             if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) nacteno = EraseEOR(buffer2, nacteno);
             n = fwrite(buffer2, 1, nacteno, fd);
+            digests.Update(buffer2, n);
         } else { 
             if (transfer_mode == MODE_STREAM && file_structure == STRU_RECORD) nacteno = EraseEOR(buffer, nacteno);
             n = fwrite(buffer, 1, nacteno, fd);
+            digests.Update(buffer, n);
         }
         
         memset(buffer,0, BUF_SIZE);
@@ -1651,9 +2215,29 @@ int fappe(list<string> &args, VFS &vfs) {
             passive = false;
             return ret;
         }
+
+        unsynced += n;
+        if (unsynced >= DURABLE_WRITEBACK_CHUNK) {
+            DataWriteback(fileno(fd));
+            unsynced = 0;
+        }
     }
+    DataStreamDone(true, vfs.ShareName(tmp));
   
+    if (fflush(fd) != 0 || DataSync(fileno(fd)) < 0) {
+        ret = FTPReply(451, "APPE aborted: unable to write data to disk.");
+        fclose(fd);
+        close(client_data_socket);
+        if (passive) close(server_data_socket); 
+        passive = false;
+        return ret;
+    }
     fclose(fd);
+    StatCacheInvalidate(tmp);
+
+    //kontrolni soucty jsou hotove driv, nez klient dostane 226
+    digests.Final();
+    digests.Store(tmp.c_str());
 
     //doplnime informace o souboru
     file.UserRights(R_ALL);
@@ -1667,7 +2251,8 @@ int fappe(list<string> &args, VFS &vfs) {
     if (ret < 0) cout << "*** fappe(): chyba pri praci s databazi ... " << ret << endl;
 #endif
     
-    ret = FTPReply(226, "Closing data connection. APPE successful.");
+    if (ret == -4) ret = FTPReply(451, "APPE aborted: unable to commit file information to disk.");
+        else ret = FTPReply(226, "Closing data connection. APPE successful.");
     close(client_data_socket);
     if (passive) close(server_data_socket); 
     passive = false;
@@ -1677,19 +2262,36 @@ int fappe(list<string> &args, VFS &vfs) {
 
 /** Funkce obsluhujici FTP prikaz ALLO.
  *
- * Funkce ma vyhradit misto pro ulozeni souboru. Velikost dopredu znat
- * nepotrebujeme, takze v nasem pripade se chova jako NOOP.
+ * Zapamatuje si velikost souboru, ktery klient hodla nahrat. Nasledujici
+ * STOR pro nej pak vyhradi misto pres fallocate() (viz. UploadOpen()).
+ * Pripadny parametr R (maximalni velikost zaznamu) ignorujeme.
  *
  */
 int fallo(list<string> &args, VFS &) {
     int         ret;
+    char      * x;
+    unsigned long long size;
 
     if (!logged_in) {
         ret = FTPReply(530,"Not logged in."); 
         return ret;
     }
-   
-    ret = FTPReply(202, "No storage allocation necessary.");    
+
+    if (args.size() < 2) {
+        ret = FTPReply(501, "ALLO needs a parameter specifying the size of the file.");
+        return ret;
+    }
+    args.pop_front();
+
+    errno = 0;
+    size = strtoull(args.front().c_str(), &x, 10);
+    if (*x != 0 || errno != 0 || args.front()[0] == '-') {
+        ret = FTPReply(501, "Bad file size.");
+        return ret;
+    }
+
+    allo_size = size;
+    ret = FTPReply(200, "ALLO command successful.");
     return ret;
 }
 
@@ -1820,7 +2422,7 @@ int frnto(list<string> &args, VFS &vfs) {
         physical_path = s;
     }
     
-    if ( !vfs.AllowedToWriteToDir(dir) ) {
+    if ( !vfs.AllowedToWriteToDir(dir) || IsUploadTemp(name) ) {
         ret = FTPReply(553, "Filename or directory not allowed.");
         rename_from = "";
         
@@ -1845,6 +2447,13 @@ int frnto(list<string> &args, VFS &vfs) {
         rename_from = "";
         return ret;
     }
+    StatCacheInvalidate(rename_from);
+    StatCacheInvalidate(rename_to);
+    //u adresare se zmenily cesty ke vsem souborum v nem
+    if (vfs.IsDir(rename_to.c_str())) {
+        StatCacheFlush();
+        vfs.DirMoved(); //kontrola zaznamu by jeho soubory mohla minout
+    }
 
     //smazeme stary zaznam z databaze
     vfs.DeleteFileInfo(rename_from_info);
@@ -1945,6 +2554,7 @@ int fdele(list<string> &args, VFS &vfs) {
     
     //a smazeme ho
     ret = unlink(name.c_str());
+    StatCacheInvalidate(name);
     if (ret < 0) {
         ret = FTPReply(450, "An error occured while deleting the file.");
         vfs.PutFileInfo(file); //musime vratit zaznam do databaze!!
@@ -2040,6 +2650,7 @@ int frmd(list<string> &args, VFS &vfs) {
     
     //a smazeme adresar
     ret = rmdir(name.c_str());
+    StatCacheInvalidate(name);
     if (ret < 0) {
         ret = FTPReply(450, "An error occured while removing the directory (it is not empty?).");
 #ifdef DEBUG
@@ -2129,6 +2740,7 @@ int fmkd(list<string> &args, VFS &vfs) {
         ret = FTPReply(550, "Unable to create specified directory.");
         return ret;
     }
+    StatCacheInvalidate(tmp);
     
     
     /* ulozime informace o vytvorenem adresari do databaze */
@@ -2154,9 +2766,146 @@ int fmkd(list<string> &args, VFS &vfs) {
 
 
 
+/** Vypise pripojene klienty (SITE WHO, jen pro administratora).
+ *
+ * Na kazde radce je PID procesu, ktery klienta obsluhuje, IP adresa,
+ * uzivatel, doba od pripojeni a od posledniho prikazu, prave provadeny
+ * prikaz, pocet prenesenych bytu, rychlost probihajiciho prenosu a soubor
+ * (posledniho) prenosu.
+ */
+static int SiteWho() {
+    int                 ret;
+    unsigned int        i;
+    string              line;
+    vector<SessionInfo> list;
+
+    if (!current_user.is_admin) {
+        ret = FTPReply(530, "Sorry, you have to be an administrator to list sessions.");
+        return ret;
+    }
+
+    if (SessionList(session_table, list) < 0) {
+        ret = FTPReply(502, "Session table is not available.");
+        return ret;
+    }
+
+    ret = FTPMultiReply(200, "   PID IP              USER                 ONLINE  IDLE CMD         TRANSFERRED           RATE    FILE");
+    for (i = 0; i < list.size() && ret >= 0; i++) {
+        SessionFormat(list[i], line);
+        ret = FTPMultiReply(200, line.c_str());
+    }
+    if (ret < 0) return ret;
+
+    ret = FTPReply(200, "End of session list.");
+    return ret;
+}
+
+
+/** Ukonci spojeni s klientem, ktereho obsluhuje proces s PID arg (SITE KILL,
+ * jen pro administratora).
+ *
+ * Proces dostane SIGTERM, prerusi pripadny prenos a zavre spojeni (viz.
+ * TermHandler()). Ukoncit lze jen procesy z tabulky klientu, a ne ten vlastni.
+ */
+static int SiteKill(const string &arg) {
+    int         ret;
+    long        pid;
+    char      * np;
+
+    if (!current_user.is_admin) {
+        ret = FTPReply(530, "Sorry, you have to be an administrator to kill a session.");
+        return ret;
+    }
+
+    pid = strtol(arg.c_str(), &np, 10);
+    if (arg.c_str() == np || *np != 0 || pid <= 0) {
+        ret = FTPReply(501, "Syntax error in parameter.");
+        return ret;
+    }
+
+    if (pid == getpid()) {
+        ret = FTPReply(200, "Use QUIT to end your own session.");
+        return ret;
+    }
+
+    if (!SessionOwns(session_table, pid)) {
+        ret = FTPReply(200, "No such session.");
+        return ret;
+    }
+
+    if (kill(pid, SIGTERM) == -1) {
+        ret = FTPReply(200, "Unable to kill the session.");
+        return ret;
+    }
+
+    ret = FTPReply(200, "Session killed.");
+    return ret;
+}
+
+
+/** Trasovani obsluhy (SITE TRACE, jen pro administratora).
+ *
+ * Bez argumentu zapise useky vlastni obsluhy do souboru trace.<pid>.json v
+ * pracovnim adresari, ON a OFF trasovani vlastni obsluhy zapne a vypne a s
+ * PID procesu z tabulky klientu posle tomuto procesu SIGUSR1, aby svuj
+ * buffer zapsal sam (viz. TraceHandler()).
+ */
+static int SiteTrace(list<string> &args) {
+    int         ret;
+    long        pid;
+    char      * np;
+    string      arg;
+    string      s;
+
+    if (!current_user.is_admin) {
+        ret = FTPReply(530, "Sorry, you have to be an administrator to trace sessions.");
+        return ret;
+    }
+
+    if (args.size() == 2) {
+        if (TraceDump() < 0) {
+            ret = FTPReply(200, "Unable to write the trace.");
+            return ret;
+        }
+        s = string("Trace written to ") + TraceFile() + ".";
+        ret = FTPReply(200, s.c_str());
+        return ret;
+    }
+
+    arg = args.back();
+    s   = arg;
+    ToLower(s);
+    if (s == "on" || s == "off") {
+        TraceEnable(s == "on");
+        ret = FTPReply(200, (s == "on") ? "Tracing enabled." : "Tracing disabled.");
+        return ret;
+    }
+
+    pid = strtol(arg.c_str(), &np, 10);
+    if (arg.c_str() == np || *np != 0 || pid <= 0) {
+        ret = FTPReply(501, "Syntax error in parameter.");
+        return ret;
+    }
+
+    if (!SessionOwns(session_table, pid)) {
+        ret = FTPReply(200, "No such session.");
+        return ret;
+    }
+
+    if (kill(pid, SIGUSR1) == -1) {
+        ret = FTPReply(200, "Unable to signal the session.");
+        return ret;
+    }
+
+    s = "Session asked to write " + working_dir + "/" TRACE_FILE_PREFIX + arg + ".json.";
+    ret = FTPReply(200, s.c_str());
+    return ret;
+}
+
+
 /** Funkce obsluhujici FTP prikaz SITE.
  *
- * Momentalne je podporovano SITE CHMOD.
+ * Momentalne je podporovano SITE CHMOD, SITE WHO, SITE KILL a SITE TRACE.
  * RFC959 povoluje jen pozitivni odezvu, takze vzdy odpovidame kodem 200.
  *
  */
@@ -2173,6 +2922,13 @@ int fsite(list<string> &args, VFS &vfs) {
         return ret;
     }
     
+    if (args.size() >= 2) { //  --->  site who, site kill <pid>, site trace [on|off|<pid>]
+        s = *(++args.begin());
+        ToLower(s);
+        if (s == "who" && args.size() == 2) return SiteWho();
+        if (s == "kill" && args.size() == 3) return SiteKill(args.back());
+        if (s == "trace" && args.size() <= 3) return SiteTrace(args);
+    }
     
     if (args.size() != 4) { //  --->  site chmod 0xyz <cesta>
         ret = FTPReply(501, "Syntax error in parameter.");
@@ -2216,6 +2972,7 @@ int fsite(list<string> &args, VFS &vfs) {
     if (file.Path()!="/") s = file.Path() + "/" + file.Name(); else s = "/" + file.Name();
 
     ret = chmod(s.c_str(), mod);
+    StatCacheInvalidate(s);
     if (ret == -1) {
         ret = FTPReply(200, "Error while changing the mode.");
         return ret;
@@ -2228,7 +2985,8 @@ int fsite(list<string> &args, VFS &vfs) {
 
 /** Funkce pro obsluhu smallFTPd prikazu DENYIP.
  *
- * Zaradi prijatou IP adresu do ip_deny_list.
+ * Zaradi prijatou IP adresu do ip_deny_list. IPv4 adresa muze byt zadana
+ * jako c1,c2,c3,c4 nebo c1.c2.c3.c4, IPv6 adresa v obvyklem tvaru.
  *
  * Navratove hodnoty:
  *
@@ -2251,7 +3009,7 @@ int fdenyip(list<string> &args, VFS &) {
         return ret;
     }
     
-    if (argc != 5) {
+    if (argc != 5 && argc != 2) {
         ret = FTPReply(501,"Syntax error."); 
         return ret;
     }
@@ -2263,19 +3021,26 @@ int fdenyip(list<string> &args, VFS &) {
 
     args.pop_front();//vyhodime jmeno prikazu;
     
-    c1 = args.front();
-    args.pop_front();
-    
-    c2 = args.front();
-    args.pop_front();
-    
-    c3 = args.front();
-    args.pop_front();
-    
-    c4 = args.front();
-    args.pop_front();
-       
-    s = c1 + "." + c2 + "." + c3 + "." + c4;
+    if (argc == 2) { // jedna adresa (IPv6 nebo c1.c2.c3.c4)
+        if (NormalizeIP(args.front().c_str(), s) == -1) {
+            ret = FTPReply(501,"Syntax error in IP address.");
+            return ret;
+        }
+    } else {
+        c1 = args.front();
+        args.pop_front();
+        
+        c2 = args.front();
+        args.pop_front();
+        
+        c3 = args.front();
+        args.pop_front();
+        
+        c4 = args.front();
+        args.pop_front();
+           
+        s = c1 + "." + c2 + "." + c3 + "." + c4;
+    }
     
     fd = fopen(ip_deny_list_file.c_str(), "a");
     if (fd == 0) {
@@ -2286,7 +3051,7 @@ int fdenyip(list<string> &args, VFS &) {
         return ret;
     }
     
-    fprintf(fd,"%s.%s.%s.%s\n", c1.c_str(), c2.c_str(), c3.c_str(), c4.c_str());
+    fprintf(fd,"%s\n", s.c_str());
     fclose(fd);
     
     ip_deny_list.push_back(s);
@@ -2328,13 +3093,10 @@ int fsize(list<string> &args, VFS &vfs) {
     int         ret;
     int         argc = args.size();
     unsigned long file_size = 0;
-    bool        cti = true;
     int         BUF_SIZE = 1024;
     char        buffer[BUF_SIZE];
-    int         i;
     string      name;
     FILE      * fd;
-    long        nacteno;
     VFS_file    file("","");
     
     
@@ -2373,18 +3135,16 @@ int fsize(list<string> &args, VFS &vfs) {
     }
 
     if (transfer_type == TYPE_ASCII) {
-        while (cti) {
-            nacteno = fread(buffer, 1, BUF_SIZE, fd);
-            if (feof(fd)) { cti = false; }
-            if (ferror(fd)) {
-                cti = false;
-                FTPReply(450,"Error while determining file size.");
-                fclose(fd);
-                return 1;
-            }
-            file_size += nacteno;
-            for (i=0; i < nacteno; i++) if (buffer[i] == '\n') file_size++;
-        }//while cti
+        //pocty LF se berou z indexu, cely soubor se prochazi jen poprve
+        unsigned long long ascii_size;
+        
+        ret = AsciiTransferSize(name.c_str(), ascii_size);
+        if (ret < 0) {
+            FTPReply(450,"Error while determining file size.");
+            fclose(fd);
+            return 1;
+        }
+        file_size = ascii_size;
     } else {
         ret = fseek(fd, 0, SEEK_END);
         if (ret < 0) {
@@ -2448,7 +3208,7 @@ int fmdtm(list<string> &args, VFS &vfs) {
     }
  
     if (file.Path()!="/") name = file.Path() + "/" + file.Name(); else name = "/" + file.Name();
-    ret = stat(name.c_str(), &statbuf);
+    ret = StatCacheStat(name.c_str(), statbuf);
     if (ret == -1){
         ret = FTPReply(450, "Error while determining file properties.");
         return ret;
@@ -2506,12 +3266,78 @@ int frest(list<string> &args, VFS &vfs) {
     
     restart = true;
     restart_offset = cislo;
+    range = false; //REST a RANG se navzajem rusi
 
     ret = FTPReply(350, "REST supported. Ready to resume at given byte offset.");
     return ret;
 }//frest
 
 
+/** Funkce obsluhujici FTP prikaz RANG (draft-bryan-ftp-range).
+ *
+ * Nastavi rozsah bytu <start> az <end> (vcetne), ktery posle nasledujici
+ * RETR, nebo ze ktereho spocita kontrolni soucet nasledujici HASH. RETR pak
+ * skonci presne na konci rozsahu, takze klient muze stahovat ruzne casti
+ * jednoho souboru soucasne pres vic spojeni. "RANG 1 0" rozsah zrusi.
+ * RANG a REST se navzajem rusi.
+ *
+ */
+int frang(list<string> &args, VFS &) {
+    int                 ret;
+    string              s;
+    unsigned long long  start, end;
+    char              * p;
+    char                odpoved[100];
+
+    if (!logged_in) {
+        ret = FTPReply(530,"Not logged in."); 
+        return ret;
+    }
+
+    if (args.size() != 3) {
+        ret = FTPReply(501,"Syntax error."); 
+        return ret;
+    }
+
+    args.pop_front();
+    s = args.front(); args.pop_front();
+    errno = 0;
+    start = strtoull(s.c_str(), &p, 10);
+    if (errno != 0 || p == s.c_str() || *p != 0 || s[0] == '-') {
+        ret = FTPReply(501,"Syntax error."); 
+        return ret;
+    }
+
+    s = args.front(); args.pop_front();
+    end = strtoull(s.c_str(), &p, 10);
+    if (errno != 0 || p == s.c_str() || *p != 0 || s[0] == '-') {
+        ret = FTPReply(501,"Syntax error."); 
+        return ret;
+    }
+
+    if (start == 1 && end == 0) {
+        range = false;
+        ret = FTPReply(350, "Restarting at 0. Ending at EOF.");
+        return ret;
+    }
+
+    if (start > end) {
+        ret = FTPReply(501,"Invalid range."); 
+        return ret;
+    }
+
+    range       = true;
+    range_start = start;
+    range_end   = end;
+    restart     = false;
+    restart_offset = 0;
+
+    snprintf(odpoved, 100, "Restarting at %llu. Ending at %llu.", start, end);
+    ret = FTPReply(350, odpoved);
+    return ret;
+}//frang
+
+
 /** Funkce obsluhujici administratorsky prikaz FINISH.
  *
  * Pokud ma uzivatel dostatecna prava, posle rodicovskemu procesu SIGTERM,
@@ -2595,6 +3421,16 @@ int fsettings(list<string> &args, VFS &) {
     ret = FTPMultiReply(200, s.c_str());
     if (ret < 0) return ret;
 
+    if (file_cache_max > 0) {
+        unsigned long long  hits, misses, bytes;
+
+        FileCacheCounters(hits, misses, bytes);
+        snprintf(tmp, BUF_SIZE, "File cache: %llu hits, %llu misses (%.1f %% hit rate), %llu bytes served",
+                 hits, misses, (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0, bytes);
+        ret = FTPMultiReply(200, tmp);
+        if (ret < 0) return ret;
+    }
+
     ret = FTPReply(200, "End of settings.");
     return ret;
 }
@@ -2694,3 +3530,392 @@ int fprot(list<string> &args, VFS &) {
 }
 
 
+
+
+/** Funkce obsluhujici FTP prikaz FEAT.
+ *
+ * Posle klientovi seznam podporovanych rozsireni (RFC 2389). Kazde
+ * rozsireni je na samostatnem radku zacinajicim mezerou.
+ *
+ */
+int ffeat(list<string> &, VFS &) {
+    int         ret;
+    string      s;
+    int         i;
+
+    ret = FTPMultiReply(211, "Features:");
+    if (ret < 0) return ret;
+
+    ret = FTPReplyLine(" SIZE");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" MDTM");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" REST STREAM");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" RANG STREAM");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" MODE Z");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" EPSV");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" EPRT");
+    if (ret < 0) return ret;
+
+    if (use_tls) {
+        ret = FTPReplyLine(" AUTH TLS");
+        if (ret < 0) return ret;
+        ret = FTPReplyLine(" PBSZ");
+        if (ret < 0) return ret;
+        ret = FTPReplyLine(" PROT");
+        if (ret < 0) return ret;
+    }
+
+    //aktualne vybrany algoritmus je oznacen hvezdickou
+    s = " HASH ";
+    for (i = 0; i < DIGEST_COUNT; i++) {
+        if (i != 0) s = s + ";";
+        s = s + DigestName(i);
+        if (i == hash_algorithm) s = s + "*";
+    }
+    ret = FTPReplyLine(s.c_str());
+    if (ret < 0) return ret;
+
+    ret = FTPReplyLine(" XCRC");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" XMD5");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" XSHA1");
+    if (ret < 0) return ret;
+    ret = FTPReplyLine(" XSHA256");
+    if (ret < 0) return ret;
+
+    ret = FTPReply(211, "End");
+    return ret;
+}//ffeat()
+
+
+/** Obsluha prikazu OPTS MODE Z LEVEL <n>.
+ *
+ * Nastavi uroven komprese (0-9) pro MODE Z, bez parametru vrati aktualni.
+ * V args uz zbyvaji jen parametry za "OPTS MODE".
+ *
+ */
+static int OptsModeZ(list<string> &args) {
+    int         ret;
+    string      s;
+    char        odpoved[50];
+    int         level;
+
+    if (args.size() < 1) {
+        ret = FTPReply(501, "Syntax error.");
+        return ret;
+    }
+    s = args.front(); args.pop_front();
+    ToLower(s);
+    if (s != "z") {
+        ret = FTPReply(501, "Option not understood.");
+        return ret;
+    }
+
+    if (args.size() == 2) {
+        s = args.front(); args.pop_front();
+        ToLower(s);
+        if (s != "level" || args.front().size() != 1 || !isdigit(args.front()[0])) {
+            ret = FTPReply(501, "Syntax error, use OPTS MODE Z LEVEL <0-9>.");
+            return ret;
+        }
+        level = args.front()[0] - '0';
+        args.pop_front();
+        mode_z_level = level;
+    } else if (args.size() != 0) {
+        ret = FTPReply(501, "Syntax error, use OPTS MODE Z LEVEL <0-9>.");
+        return ret;
+    }
+
+    snprintf(odpoved, 50, "MODE Z LEVEL set to %d.", mode_z_level);
+    ret = FTPReply(200, odpoved);
+    return ret;
+}
+
+
+/** Funkce obsluhujici FTP prikaz OPTS.
+ *
+ * Umi OPTS HASH (draft-bryan-ftp-hash) - bez parametru vrati aktualne
+ * vybrany algoritmus pro prikaz HASH, s parametrem ho zmeni - a OPTS MODE Z
+ * LEVEL pro nastaveni urovne komprese.
+ *
+ */
+int fopts(list<string> &args, VFS &) {
+    int         ret;
+    string      s;
+    int         id;
+
+    if (args.size() < 2) {
+        ret = FTPReply(501, "Syntax error.");
+        return ret;
+    }
+
+    args.pop_front();
+    s = args.front(); args.pop_front();
+    ToLower(s);
+
+    if (s == "mode") return OptsModeZ(args);
+
+    if (s != "hash") {
+        ret = FTPReply(501, "Option not understood.");
+        return ret;
+    }
+
+    if (args.size() == 0) {
+        ret = FTPReply(200, DigestName(hash_algorithm));
+        return ret;
+    }
+
+    s = args.front(); args.pop_front();
+    id = DigestByName(s.c_str());
+    if (id == -1) {
+        ret = FTPReply(501, "Unknown algorithm, current selection not changed.");
+        return ret;
+    }
+
+    hash_algorithm = id;
+    digest_mask   |= 1 << id; //klient ho bude nejspis chtit i pro uploady
+    ret = FTPReply(200, DigestName(hash_algorithm));
+    return ret;
+}//fopts()
+
+
+/** Zjisti fyzicke jmeno souboru, ke kteremu ma byt spocitan kontrolni soucet.
+ *
+ * Kontroluje, jestli ma uzivatel pravo soubor cist.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, jmeno je v name
+ *      - -1      soubor neexistuje nebo ho uzivatel nesmi cist
+ *
+ */
+static int DigestFileName(string &name, VFS &vfs) {
+    int         ret;
+    VFS_file    file("","");
+
+    ret = vfs.GetFileInfo(name.c_str(), file);
+    if ( (ret < 0) 
+            || !(   (current_user.name == file.UserName() && (file.UserRights() & R_READ)) 
+                                                    || (file.OthersRights() & R_READ)     ) 
+            ) {
+        return -1;
+    }
+
+    if (file.Path()!="/") name = file.Path() + "/" + file.Name(); else name = "/" + file.Name();
+    return 1;
+}
+
+
+/** Funkce obsluhujici FTP prikaz HASH (draft-bryan-ftp-hash).
+ *
+ * Vrati kontrolni soucet souboru algoritmem vybranym prikazem OPTS HASH.
+ * Odpoved ma tvar "213 <algoritmus> <od>-<do> <soucet> <soubor>".
+ *
+ */
+int fhash(list<string> &args, VFS &vfs) {
+    int                 ret;
+    string              name;
+    string              path;
+    string              hex;
+    string              s;
+    unsigned long long  start = 0;
+    unsigned long long  end = DIGEST_TO_EOF;
+    char                rozsah[50];
+
+    if (!logged_in) {
+        ret = FTPReply(530,"Not logged in."); 
+        return ret;
+    }
+
+    if (args.size() != 2) {
+        ret = FTPReply(501,"Syntax error."); 
+        return ret;
+    }
+
+    args.pop_front();
+    name = args.front(); args.pop_front();
+
+    path = name;
+    if (DigestFileName(path, vfs) < 0) {
+        ret = FTPReply(550, "File not available.");
+        return ret;
+    }
+
+    //rozsah zadany prikazem RANG plati jen pro jeden prikaz
+    if (range) {
+        start = range_start;
+        end   = range_end + 1;
+        range = false;
+    }
+
+    ret = FileDigest(path.c_str(), hash_algorithm, start, end, hex);
+    if (ret == -2) {
+        ret = FTPReply(556, "Invalid range.");
+        return ret;
+    }
+    if (ret < 0) {
+        ret = FTPReply(450, "Error while computing file hash.");
+        return ret;
+    }
+
+    snprintf(rozsah, 50, "%llu-%llu", start, (end > start) ? end - 1 : start);
+    s = DigestName(hash_algorithm);
+    s = s + " " + rozsah + " " + hex + " " + name;
+    ret = FTPReply(213, s.c_str());
+    return ret;
+}//fhash()
+
+
+/** Spolecna obsluha prikazu XCRC, XMD5, XSHA1 a XSHA256.
+ *
+ * Odpoved ma tvar "250 <soucet>". Pouzity algoritmus se zaroven prida do
+ * digest_mask, takze pri dalsich uploadech v teto session uz se soucet
+ * spocita behem prenosu.
+ *
+ */
+static int XDigest(list<string> &args, VFS &vfs, int id) {
+    int                 ret;
+    string              name;
+    string              hex;
+    unsigned long long  end = DIGEST_TO_EOF;
+
+    if (!logged_in) {
+        ret = FTPReply(530,"Not logged in."); 
+        return ret;
+    }
+
+    if (args.size() != 2) {
+        ret = FTPReply(501,"Syntax error."); 
+        return ret;
+    }
+
+    args.pop_front();
+    name = args.front(); args.pop_front();
+
+    if (DigestFileName(name, vfs) < 0) {
+        ret = FTPReply(550, "File not available.");
+        return ret;
+    }
+
+    digest_mask |= 1 << id;
+
+    ret = FileDigest(name.c_str(), id, 0, end, hex);
+    if (ret < 0) {
+        ret = FTPReply(450, "Error while computing file hash.");
+        return ret;
+    }
+
+    ret = FTPReply(250, hex.c_str());
+    return ret;
+}
+
+
+/** Funkce obsluhujici FTP prikaz XCRC.
+ *
+ */
+int fxcrc(list<string> &args, VFS &vfs) {
+    return XDigest(args, vfs, DIGEST_CRC32);
+}
+
+
+/** Funkce obsluhujici FTP prikaz XMD5.
+ *
+ */
+int fxmd5(list<string> &args, VFS &vfs) {
+    return XDigest(args, vfs, DIGEST_MD5);
+}
+
+
+/** Funkce obsluhujici FTP prikaz XSHA1.
+ *
+ */
+int fxsha1(list<string> &args, VFS &vfs) {
+    return XDigest(args, vfs, DIGEST_SHA1);
+}
+
+
+/** Funkce obsluhujici FTP prikaz XSHA256.
+ *
+ */
+int fxsha256(list<string> &args, VFS &vfs) {
+    return XDigest(args, vfs, DIGEST_SHA256);
+}
+
+
+/** Vypise jeden histogram prikazu METRICS.
+ *
+ */
+static int MetricsLine(const char * name, const Histogram &h, const char * unit) {
+    char    tmp[200];
+
+    snprintf(tmp, sizeof(tmp), "%s: %llu, avg %llu %s, p50 %llu %s, p90 %llu %s, p99 %llu %s, max %llu %s",
+             name, h.count, h.sum / h.count, unit,
+             HistogramQuantile(h, 0.5), unit, HistogramQuantile(h, 0.9), unit,
+             HistogramQuantile(h, 0.99), unit, h.max, unit);
+    return FTPMultiReply(200, tmp);
+}
+
+
+/** Vypise metriky vsech procesu serveru (viz. metrics.cpp).
+ *
+ * Doby jsou v mikrosekundach, rychlost prenosu v bytech za sekundu.
+ */
+int fmetrics(list<string> &, VFS &) {
+    int             ret;
+    int             i;
+    unsigned int    j;
+    char            tmp[200];
+    string          s;
+    MetricsTotals * t;
+
+    if (!logged_in) {
+        ret = FTPReply(530, "Not logged in.");
+        return ret;
+    }
+
+    if (!current_user.is_admin) {
+        ret = FTPReply(530, "Sorry you have to be an administrator to get daemon metrics.");
+        return ret;
+    }
+
+    t = new MetricsTotals;
+    if (MetricsSnapshot(*t) < 0) {
+        delete t;
+        ret = FTPReply(502, "Metrics are not available.");
+        return ret;
+    }
+
+    snprintf(tmp, sizeof(tmp), "Uptime: %ld s, active sessions: %d", (long)(time(0) - t->started), t->workers);
+    ret = FTPMultiReply(200, tmp);
+
+    snprintf(tmp, sizeof(tmp), "Bytes sent: %llu, bytes received: %llu", t->bytes_sent, t->bytes_received);
+    if (ret >= 0) ret = FTPMultiReply(200, tmp);
+
+    for (i = 0; i < number_of_commands && i < METRICS_MAX_COMMANDS && ret >= 0; i++)
+        if (t->commands[i].count > 0) {
+            s = command_table[i].name;
+            for (j = 0; j < s.size(); j++) s[j] = toupper(s[j]);
+            ret = MetricsLine(s.c_str(), t->commands[i], "us");
+        }
+
+    if (ret >= 0 && t->other[METRIC_DATA_CONNECT].count > 0)
+        ret = MetricsLine("Data connection", t->other[METRIC_DATA_CONNECT], "us");
+    if (ret >= 0 && t->other[METRIC_TLS_HANDSHAKE].count > 0)
+        ret = MetricsLine("TLS handshake", t->other[METRIC_TLS_HANDSHAKE], "us");
+    if (ret >= 0 && t->other[METRIC_DB_LOOKUP].count > 0)
+        ret = MetricsLine("Database lookup", t->other[METRIC_DB_LOOKUP], "us");
+    if (ret >= 0 && t->other[METRIC_TRANSFER_RATE].count > 0)
+        ret = MetricsLine("Transfer rate", t->other[METRIC_TRANSFER_RATE], "B/s");
+
+    delete t;
+    if (ret < 0) return ret;
+
+    ret = FTPReply(200, "End of metrics.");
+    return ret;
+}
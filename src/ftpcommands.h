@@ -23,6 +23,17 @@ extern "C" {
 #include "security.h"
 #include "pomocne.h"
 #include "network.h"
+#include "resume.h"
+#include "digest.h"
+#include "upload.h"
+#include "durable.h"
+#include "statcache.h"
+#include "listcache.h"
+#include "filecache.h"
+#include "pagecache.h"
+#include "sessions.h"
+#include "trace.h"
+#include "pasvpool.h"
 
 extern bool run;
 extern bool use_tls;
@@ -35,6 +46,7 @@ extern string account_file;
 extern string vfs_config_file;
 extern string ip_deny_list_file;
 extern string working_dir;
+extern string pasv_address;
 extern vector<string>  ip_deny_list;
 extern string ip_deny_list_file;
 extern command command_table[];
@@ -42,7 +54,7 @@ extern int number_of_commands;
 extern int server_data_socket; //pouziva ho fpasv
 extern int client_data_socket;
 extern int client_socket; //< soket pro control connection
-extern struct sockaddr_in client_data_address;
+extern struct sockaddr_storage client_data_address;
 extern bool ftp_abort;
 extern bool tls_up;
 extern bool tls_dc;
@@ -63,10 +75,6 @@ extern SSL             * ssl;
 #define STRU_RECORD 'R'
 #define STRU_PAGE   'P'
 
-#define MODE_STREAM 'S'
-#define MODE_BLOCK  'B'
-#define MODE_COMPRESSED 'C'
-
 #define HOST_NAME_MAX 100
 #define ADDR_LENGTH_MAX 100
 
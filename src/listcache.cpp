@@ -0,0 +1,241 @@
+/** @file listcache.cpp
+ *  \brief Implementace cache vypisu adresaru.
+ *
+ * Na zrcadlech posila mnoho klientu LIST tychz nekolika adresaru a kazdy
+ * LIST znovu cte adresar, stat()uje vsechny polozky, hleda je v databazi a
+ * formatuje radky. Hotovy vypis adresare se proto uklada do adresare cache
+ * (viz. cache.h, pripona LIST_CACHE_SUFFIX) spolecne s verzi adresare podle
+ * sdilene cache stat() (viz. StatCacheVersion()). Kazda zmena v adresari,
+ * kterou zaznamena sledovani zmen, nebo zmena zaznamu v databazi zmeni verzi
+ * a vypis se pri pristim LIST sestavi znovu. Pokud se zmeny nesleduji (cache
+ * stat() je vypnuta), vypis se sestavi pokazde a neuklada se.
+ *    Vypis obsahuje vsechny polozky, ktere muze videt aspon nektery
+ * uzivatel. Obycejne soubory jinych uzivatelu se vyradi az pri odesilani -
+ * pro kazdeho vlastnika ve vypisu se jednou urci, jestli jeho soubory
+ * uzivatel vidi, a polozky se pak jen porovnaji s touto tabulkou.
+ *    Posledni nacteny vypis si proces pamatuje, takze opakovany LIST teze
+ * verze adresare uz nic necte ani z cache souboru.
+ *
+ */
+
+#include "listcache.h"
+#include "statcache.h"
+#include "cache.h"
+#include "upload.h"
+
+extern "C" {
+#include <string.h>
+}
+
+extern char FTP_EOR[2];
+
+
+/** Hlavicka vypisu v cache souboru (za CacheStamp adresare).
+ *
+ */
+struct ListCacheHeader {
+    unsigned long long  generation; ///< verze adresare (viz. StatCacheVersion())
+    unsigned int        inval;
+    unsigned int        owners;     ///< pocet vlastniku
+    unsigned int        entries;    ///< pocet polozek
+    unsigned int        text_size;  ///< delka vsech radku dohromady
+};
+
+
+static DirListing           last_listing;           //< posledni vypis, ktery tento proces pouzil
+static string               last_dir;               //< ... jeho adresar
+static unsigned long long   last_generation = 0;    //< ... a verze
+static unsigned int         last_inval      = 0;
+
+
+/** Sestavi vypis aktualniho adresare vfs.
+ *
+ */
+static void ListBuild(VFS &vfs, DirListing &listing) {
+    VFS_file      * file;
+    ListEntry       entry;
+    string          s;
+    unsigned int    i;
+
+    listing.owners.clear();
+    listing.entries.clear();
+    listing.text = "";
+
+    vfs.ResetFiles();
+    while ((file = vfs.NextFile()) != 0) {
+        //rozpracovane uploady (viz. upload.h) nikdo nevidi
+        if (file->GetLslInfo(s) < 0 || IsUploadTemp(file->Name())) {
+            delete file; //nelze ziskat info o souboru, jdem na dalsi
+            continue;
+        }
+
+        for (i = 0; i < listing.owners.size(); i++)
+            if (listing.owners[i] == file->UserName()) break;
+        if (i == listing.owners.size()) listing.owners.push_back(file->UserName());
+
+        entry.owner  = i;
+        entry.flags  = file->IsRegularFile() ? LIST_ENTRY_REGULAR : 0;
+        entry.offset = listing.text.size();
+        entry.len    = s.size();
+        listing.entries.push_back(entry);
+        listing.text += s;
+
+        delete file;
+    }
+}
+
+
+/** Nacte vypis z cache souboru fd (nastaveneho za CacheStamp).
+ *
+ * Vrati 1, pokud se vypis povedlo nacist a ma verzi generation a inval,
+ * jinak -1.
+ */
+static int ListRead(int fd, DirListing &listing, unsigned long long generation, unsigned int inval) {
+    ListCacheHeader h;
+    unsigned int    len;
+    unsigned int    i;
+    char            buf[256];
+
+    if (CacheRead(fd, &h, sizeof(h)) < 0) return -1;
+    if (h.generation != generation || h.inval != inval) return -1;
+    if (h.text_size > LIST_CACHE_MAX_SIZE || h.entries > LIST_CACHE_MAX_SIZE || h.owners > h.entries) return -1;
+
+    listing.owners.resize(h.owners);
+    for (i = 0; i < h.owners; i++) {
+        if (CacheRead(fd, &len, sizeof(len)) < 0 || len >= sizeof(buf)) return -1;
+        if (CacheRead(fd, buf, len) < 0) return -1;
+        listing.owners[i].assign(buf, len);
+    }
+
+    listing.entries.resize(h.entries);
+    if (h.entries > 0 && CacheRead(fd, &listing.entries[0], h.entries * sizeof(ListEntry)) < 0) return -1;
+    for (i = 0; i < h.entries; i++)
+        if (listing.entries[i].owner >= h.owners || listing.entries[i].offset > h.text_size
+                || listing.entries[i].len > h.text_size - listing.entries[i].offset) return -1;
+
+    listing.text.resize(h.text_size);
+    if (h.text_size > 0 && CacheRead(fd, &listing.text[0], h.text_size) < 0) return -1;
+    return 1;
+}
+
+
+/** Ulozi vypis listing adresare se znamkou stamp a verzi generation, inval.
+ *
+ */
+static void ListWrite(CacheStamp &stamp, DirListing &listing, unsigned long long generation, unsigned int inval) {
+    ListCacheHeader h;
+    string          tmp_name;
+    unsigned int    len;
+    unsigned int    i;
+    int             fd;
+
+    if (listing.text.size() > LIST_CACHE_MAX_SIZE) return;
+    for (i = 0; i < listing.owners.size(); i++)
+        if (listing.owners[i].size() >= 256) return;
+
+    fd = CacheCreate(stamp, LIST_CACHE_SUFFIX, tmp_name);
+    if (fd == -1) return;
+
+    memset(&h, 0, sizeof(h));
+    h.generation = generation;
+    h.inval      = inval;
+    h.owners     = listing.owners.size();
+    h.entries    = listing.entries.size();
+    h.text_size  = listing.text.size();
+
+    if (CacheWrite(fd, &h, sizeof(h)) < 0) goto CHYBA;
+    for (i = 0; i < listing.owners.size(); i++) {
+        len = listing.owners[i].size();
+        if (CacheWrite(fd, &len, sizeof(len)) < 0 || CacheWrite(fd, listing.owners[i].data(), len) < 0) goto CHYBA;
+    }
+    if (h.entries > 0 && CacheWrite(fd, &listing.entries[0], h.entries * sizeof(ListEntry)) < 0) goto CHYBA;
+    if (h.text_size > 0 && CacheWrite(fd, listing.text.data(), h.text_size) < 0) goto CHYBA;
+
+    CacheCommit(fd, stamp, LIST_CACHE_SUFFIX, tmp_name);
+    return;
+
+CHYBA:
+    close(fd);
+    unlink(tmp_name.c_str());
+}
+
+
+/** Vrati vypis aktualniho adresare vfs - z pameti procesu, z cache souboru,
+ * nebo ho sestavi (a ulozi do cache).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vypis je z cache
+ *      -  2      vypis se sestavil znovu
+ *
+ */
+int ListCacheGet(VFS &vfs, DirListing &listing) {
+    CacheStamp          stamp;
+    struct stat         st;
+    unsigned long long  generation;
+    unsigned int        inval;
+    string              dir;
+    int                 fd;
+    int                 ret;
+
+    dir = vfs.ListingDir();
+    if (dir == "" || StatCacheVersion(dir, generation, inval) < 0 || StatCacheStat(dir.c_str(), st) == -1) {
+        ListBuild(vfs, listing);
+        return 2;
+    }
+
+    if (dir == last_dir && generation == last_generation && inval == last_inval) {
+        listing = last_listing;
+        return 1;
+    }
+
+    MakeCacheStamp(st, stamp);
+    ret = -1;
+    fd  = CacheOpen(stamp, LIST_CACHE_SUFFIX);
+    if (fd != -1) {
+        ret = ListRead(fd, listing, generation, inval);
+        close(fd);
+    }
+    if (ret < 0) {
+        //verze je zjistena pred ctenim adresare - pokud se behem nej neco
+        //zmeni, ulozeny vypis uz nebude platit
+        ListBuild(vfs, listing);
+        ListWrite(stamp, listing, generation, inval);
+        ret = 2;
+    }
+
+    last_dir        = dir;
+    last_generation = generation;
+    last_inval      = inval;
+    last_listing    = listing;
+    return ret;
+}
+
+
+/** Sestavi z vypisu listing data, ktera se poslou uzivateli user_name.
+ *
+ * Obycejne soubory jinych uzivatelu (krome souboru bez vlastnika a souboru
+ * anonymniho uzivatele) se vynechaji, adresare se posilaji vsechny. Radky
+ * konci CRLF (crlf je true, TYPE A) nebo LF, pri record je za kazdym
+ * radkem znacka konce zaznamu.
+ */
+void ListCachePayload(DirListing &listing, const string &user_name, bool crlf, bool record, string &payload) {
+    vector<char>    visible(listing.owners.size());
+    unsigned int    i;
+    ListEntry     * e;
+
+    for (i = 0; i < listing.owners.size(); i++)
+        visible[i] = (listing.owners[i] == user_name || listing.owners[i] == NO_USER || listing.owners[i] == "anonymous");
+
+    payload = "";
+    payload.reserve(listing.text.size() + listing.entries.size() * 4);
+    for (i = 0; i < listing.entries.size(); i++) {
+        e = &listing.entries[i];
+        if ((e->flags & LIST_ENTRY_REGULAR) && !visible[e->owner]) continue;
+
+        payload.append(listing.text, e->offset, e->len);
+        if (crlf) payload += "\r\n";
+            else payload += "\n";
+        if (record) payload += FTP_EOR;
+    }
+}
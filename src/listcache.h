@@ -0,0 +1,48 @@
+/** @file listcache.h
+ *  \brief Deklarace cache vypisu adresaru (prikaz LIST).
+ *
+ */
+
+#ifndef __listcache_h
+#define __listcache_h
+
+#include <string>
+#include <vector>
+
+#include "VFS.h"
+
+using namespace std;
+
+#define LIST_CACHE_SUFFIX    "list"           //< pripona cache souboru s vypisem adresare
+#define LIST_CACHE_MAX_SIZE  (64*1024*1024)   //< vetsi vypisy se do cache neukladaji
+#define LIST_ENTRY_REGULAR   1                //< polozka je obycejny soubor (viz. ListEntry::flags)
+#define LIST_SEND_CHUNK      (64*1024)        //< po kolika bytech se vypis posila klientovi
+
+
+/** Jedna polozka vypisu adresare.
+ *
+ */
+struct ListEntry {
+    unsigned int    owner;  ///< index vlastnika v DirListing::owners
+    unsigned int    flags;  ///< LIST_ENTRY_REGULAR
+    unsigned int    offset; ///< zacatek radku v DirListing::text
+    unsigned int    len;    ///< delka radku (bez konce radku)
+};
+
+
+/** Vypis adresare - radky ve tvaru ls -l (bez koncu radku) a ke kazde
+ * polozce jeji vlastnik, podle ktereho se pri odesilani urci, ktere polozky
+ * smi uzivatel videt.
+ *
+ */
+struct DirListing {
+    vector<string>      owners;
+    vector<ListEntry>   entries;
+    string              text;
+};
+
+
+int  ListCacheGet(VFS &vfs, DirListing &listing);
+void ListCachePayload(DirListing &listing, const string &user_name, bool crlf, bool record, string &payload);
+
+#endif //__listcache_h
@@ -0,0 +1,597 @@
+/** @file maintenance.cpp
+ *  \brief Implementace procesu udrzby.
+ *
+ * Proces udrzby forkuje hlavni proces serveru pred prijetim prvniho klienta.
+ * Dela praci, ktera nesouvisi s zadnym konkretnim klientem a nesmi ho
+ * zdrzovat:
+ *
+ *      - uklid smazanych zaznamu databaze (viz.
+ *        DirectoryDatabase::Compact()). Spousti se, kdyz podil smazanych
+ *        slotu tabulky (ulozeny v jeji hlavicce) presahne
+ *        TABLE_COMPACT_THRESHOLD procent, a probiha po malych krocich, ktere
+ *        se vzdy vzdaji, pokud databazi prave zamyka nektery klient.
+ *      - kontrola zaznamu databaze (viz. DirectoryDatabase::ReconcileDir()).
+ *        Jednou za RECONCILE_PERIOD projde vsechny sdilene adresare a smaze
+ *        zaznamy souboru, ktere byly smazany mimo server, nebo jejichz inode
+ *        mezitim dostal jiny soubor (ten by jinak zdedil vlastnika a prava).
+ *        Bezi s nejnizsi prioritou I/O, nanejvys RECONCILE_RATE souboru za
+ *        sekundu, a svuj stav prubezne uklada do souboru
+ *        RECONCILE_STATE_FILE, takze po restartu serveru pokracuje tam, kde
+ *        skoncila. Ze stejneho souboru lze vycist, jak daleko kontrola je.
+ *        Pri pruchodu zaroven smaze docasne soubory uploadu (viz.
+ *        upload.cpp), ktere zustaly po zabite nebo spadle obsluze klienta.
+ *
+ * Ve druhem procesu (spousti se take pres MaintenanceStart()) bezi sledovani
+ * zmen sdilenych adresaru pro sdilenou cache stat() (viz. statcache.cpp a
+ * StatCacheWatch()).
+ *
+ * Soubor, ktery nekdo mimo server presune z dosud neprosleho adresare do
+ * uz prosleho, by kontrola v danem pruchodu neuvidela. Proces sledovani
+ * zmen proto kazdemu souboru, ktery se ve sdilenem adresari objevi, zaznam
+ * oznaci jako videny (viz. DirectoryDatabase::ReconcileSeen()); pokud zmeny
+ * nesleduje nebo mohl nejakou propasnout (preteceni fronty, nove nastaveni
+ * sledovani), nemaze se v danem pruchodu nic. Prejmenovani souboru pres
+ * RNFR/RNTO zaznam ulozi znovu; po prejmenovani adresare se v danem
+ * pruchodu nemaze nic (viz. DirectoryDatabase::DirMoved()). Stejne tak se
+ * nemaze nic, pokud nektery adresar nebo soubor nesel precist.
+ * Adresare, na ktere vedou symbolicke odkazy, se projdou take (kazdy jen
+ * jednou, i kdyz lezi mimo sdilene adresare).
+ *
+ */
+
+#include "maintenance.h"
+
+extern "C" {
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+}
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+#include "statcache.h"
+#include "upload.h"
+
+#ifndef IOPRIO_CLASS_IDLE
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_WHO_PROCESS  1
+#endif
+
+extern bool parent;
+extern bool daemonize;
+
+
+#define RECONCILE_IDLE  0 //< zadny pruchod kontroly zaznamu neprobiha
+#define RECONCILE_WALK  1 //< prochazi se sdilene adresare
+#define RECONCILE_PURGE 2 //< mazou se zaznamy, ktere pruchod nevidel
+
+
+/** Stav kontroly zaznamu (uklada se do souboru RECONCILE_STATE_FILE).
+ *
+ */
+struct ReconcileState {
+    int             phase;     ///< RECONCILE_IDLE, RECONCILE_WALK nebo RECONCILE_PURGE
+    int             epoch;     ///< cislo pruchodu (viz. DirectoryDatabase::ReconcileBegin())
+    bool            blocked;   ///< nektery adresar nebo soubor nesel precist - zaznamy se nesmi mazat
+    time_t          started;   ///< kdy zacal aktualni (posledni) pruchod
+    time_t          finished;  ///< kdy skoncil posledni pruchod
+    unsigned int    purge_pos; ///< kde pokracuje mazani zaznamu
+    ReconcileStats  stats;
+    vector<string>  roots;     ///< sdilene adresare
+    vector<string>  pending;   ///< adresare, ktere zbyva projit
+    vector<string>  linked;    ///< adresare mimo roots, na ktere vedl symbolicky odkaz (uz zarazene do pending)
+};
+
+static ReconcileState reconcile;
+static time_t         maintenance_started; //< kdy zacal proces udrzby
+
+
+/** Jmeno souboru se stavem kontroly zaznamu.
+ *
+ */
+static string ReconcileStateFile() {
+    return cache_dir + "/" RECONCILE_STATE_FILE;
+}
+
+
+/** Ulozi stav kontroly zaznamu (do docasneho souboru, ktery pak nahradi
+ * puvodni - pri padu zustane platny alespon predchozi stav).
+ *
+ */
+static void ReconcileSave() {
+    string          name = ReconcileStateFile();
+    string          tmp  = name + ".tmp";
+    unsigned int    i;
+
+    ofstream f(tmp.c_str());
+    if (!f) return;
+
+    f << "phase "     << reconcile.phase << "\n"
+      << "epoch "     << reconcile.epoch << "\n"
+      << "blocked "   << reconcile.blocked << "\n"
+      << "started "   << reconcile.started << "\n"
+      << "finished "  << reconcile.finished << "\n"
+      << "purge_pos " << reconcile.purge_pos << "\n"
+      << "dirs "      << reconcile.stats.dirs << "\n"
+      << "entries "   << reconcile.stats.entries << "\n"
+      << "purged "    << reconcile.stats.purged << "\n"
+      << "repaired "  << reconcile.stats.repaired << "\n"
+      << "orphans "   << reconcile.stats.orphans << "\n"
+      << "errors "    << reconcile.stats.errors << "\n"
+      << "pending "   << reconcile.pending.size() << "\n";
+    //jmena se zbytek radku, adresare s koncem radku ve jmenu se neulozi
+    for (i = 0; i < reconcile.roots.size(); i++)
+        if (reconcile.roots[i].find('\n') == string::npos) f << "root " << reconcile.roots[i] << "\n";
+    for (i = 0; i < reconcile.pending.size(); i++)
+        if (reconcile.pending[i].find('\n') == string::npos) f << "dir " << reconcile.pending[i] << "\n";
+    for (i = 0; i < reconcile.linked.size(); i++)
+        if (reconcile.linked[i].find('\n') == string::npos) f << "link " << reconcile.linked[i] << "\n";
+    f.close();
+
+    if (f.fail() || rename(tmp.c_str(), name.c_str()) == -1) unlink(tmp.c_str());
+}
+
+
+/** Nacte stav kontroly zaznamu ulozeny funkci ReconcileSave().
+ *
+ * Pokud soubor neexistuje, zustane stav prazdny a prvni pruchod zacne hned.
+ */
+static void ReconcileLoad() {
+    string          line;
+    string          key;
+    string          rest;
+    size_t          n;
+
+    reconcile.phase     = RECONCILE_IDLE;
+    reconcile.epoch     = 0;
+    reconcile.blocked   = false;
+    reconcile.started   = 0;
+    reconcile.finished  = 0;
+    reconcile.purge_pos = 0;
+    memset(&reconcile.stats, 0, sizeof(reconcile.stats));
+
+    ifstream f(ReconcileStateFile().c_str());
+    while (getline(f, line)) {
+        n = line.find(' ');
+        if (n == string::npos) continue;
+        key  = line.substr(0, n);
+        rest = line.substr(n + 1);
+        istringstream v(rest);
+
+        if      (key == "phase")     v >> reconcile.phase;
+        else if (key == "epoch")     v >> reconcile.epoch;
+        else if (key == "blocked")   v >> reconcile.blocked;
+        else if (key == "started")   v >> reconcile.started;
+        else if (key == "finished")  v >> reconcile.finished;
+        else if (key == "purge_pos") v >> reconcile.purge_pos;
+        else if (key == "dirs")      v >> reconcile.stats.dirs;
+        else if (key == "entries")   v >> reconcile.stats.entries;
+        else if (key == "purged")    v >> reconcile.stats.purged;
+        else if (key == "repaired")  v >> reconcile.stats.repaired;
+        else if (key == "orphans")   v >> reconcile.stats.orphans;
+        else if (key == "errors")    v >> reconcile.stats.errors;
+        else if (key == "root")      reconcile.roots.push_back(rest);
+        else if (key == "dir")       reconcile.pending.push_back(rest);
+        else if (key == "link")      reconcile.linked.push_back(rest);
+    }
+    if (reconcile.phase < RECONCILE_IDLE || reconcile.phase > RECONCILE_PURGE) reconcile.phase = RECONCILE_IDLE;
+}
+
+
+/** Lezi cesta path v adresari dir (nebo je to on sam)?
+ *
+ */
+static bool PathUnder(const string &path, const string &dir) {
+    if (dir == "/") return true;
+    return path.compare(0, dir.size(), dir) == 0 && (path.size() == dir.size() || path[dir.size()] == '/');
+}
+
+
+/** Zaradi do pruchodu adresar, na ktery vede symbolicky odkaz link.
+ *
+ * Soubory pod nim maji zaznamy (odkazy se pri praci se soubory
+ * nasleduji), takze je pruchod musi videt. Adresar, ktery lezi v nekterem
+ * sdilenem adresari nebo v uz zarazenem adresari, se znovu neprochazi - to
+ * zaroven zabrani smycce. Vrati false, pokud cil odkazu nelze zjistit.
+ */
+static bool ReconcileLink(const string &link) {
+    char            buf[PATH_MAX];
+    string          target;
+    unsigned int    i;
+
+    if (realpath(link.c_str(), buf) == 0) return errno == ENOENT; //odkaz mezitim prestal vest do adresare
+    target = buf;
+
+    for (i = 0; i < reconcile.linked.size(); i++)
+        if (PathUnder(target, reconcile.linked[i])) return true;
+    for (i = 0; i < reconcile.roots.size(); i++)
+        if (realpath(reconcile.roots[i].c_str(), buf) != 0 && PathUnder(target, buf)) return true;
+
+    reconcile.linked.push_back(target);
+    reconcile.pending.push_back(target);
+    return true;
+}
+
+
+/** Smaze v adresari dir docasne soubory uploadu, jejichz proces uz nebezi.
+ *
+ * Jmeno docasneho souboru obsahuje PID procesu, ktery ho zapisuje (viz.
+ * UploadOpen()). Soubor procesu, ktery bezi (nebo na ktery nemame prava),
+ * zustane.
+ */
+static void RemoveStaleUploads(const string &dir) {
+    DIR           * d;
+    struct dirent * entry;
+    string          name;
+    char          * x;
+    long            pid;
+
+    d = opendir(dir.c_str());
+    if (d == 0) return;
+    while ((entry = readdir(d)) != 0) {
+        name = entry->d_name;
+        if (!IsUploadTemp(name)) continue;
+        pid = strtol(name.c_str() + sizeof(UPLOAD_TEMP_PREFIX) - 1, &x, 10);
+        if (*x != '.' || pid <= 0) continue;
+        if (kill(pid, 0) == 0 || errno != ESRCH) continue;
+        unlink((dir + "/" + name).c_str());
+    }
+    closedir(d);
+}
+
+
+/** Provede jeden krok kontroly zaznamu databaze.
+ *
+ * Vrati true, pokud neco udelal (a uz si sam pockal, aby nepresahl
+ * RECONCILE_RATE), false, pokud zrovna nema co delat.
+ */
+static bool ReconcileStep(VFS &vfs) {
+    vector<string>  subdirs;
+    vector<string>  links;
+    string          dir;
+    unsigned long   entries = 0;
+    unsigned long long errors;
+    unsigned int    i;
+    bool            root;
+    int             ioprio;
+    int             ret;
+
+    switch (reconcile.phase) {
+    case RECONCILE_IDLE:
+        if (time(0) - reconcile.finished < RECONCILE_PERIOD) return false;
+        //bez sledovani zmen by pruchod nic nesmazal - chvili pockame, nez
+        //ho proces sledovani nastavi
+        if (!StatCacheWatched() && time(0) - maintenance_started < RECONCILE_WATCH_WAIT) return false;
+
+        ret = vfs.ReconcileBegin();
+        if (ret < 0) return false;
+        reconcile.phase     = RECONCILE_WALK;
+        reconcile.epoch     = ret;
+        reconcile.blocked   = false;
+        reconcile.started   = time(0);
+        reconcile.purge_pos = 0;
+        memset(&reconcile.stats, 0, sizeof(reconcile.stats));
+        vfs.PhysicalDirs(reconcile.roots);
+        reconcile.pending = reconcile.roots;
+        reconcile.linked.clear();
+        ReconcileSave();
+        return true;
+
+    case RECONCILE_WALK:
+        //cteni adresaru nesmi brzdit prenosy klientu
+        ioprio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+        while (entries < RECONCILE_BATCH && !reconcile.pending.empty()) {
+            dir = reconcile.pending.back();
+            reconcile.pending.pop_back();
+            subdirs.clear();
+            links.clear();
+
+            //cokoli, co nejde precist (napr. neprimontovany disk nebo adresar
+            //bez prav), by vypadalo jako smazane - zaznamy pak mazat nebudeme;
+            //smazany adresar (-6) vadi jen u sdileneho adresare
+            errors = reconcile.stats.errors;
+            ret = vfs.ReconcileDir(dir, subdirs, links, reconcile.stats);
+            if (ret >= 0) {
+                entries += ret;
+                RemoveStaleUploads(dir);
+            } else {
+                for (i = 0, root = false; i < reconcile.roots.size(); i++)
+                    if (reconcile.roots[i] == dir) root = true;
+                if (root || ret != -6) reconcile.blocked = true;
+                entries++;
+            }
+            if (reconcile.stats.errors != errors) reconcile.blocked = true;
+
+            for (i = 0; i < subdirs.size(); i++) reconcile.pending.push_back(subdirs[i]);
+            for (i = 0; i < links.size(); i++)
+                if (!ReconcileLink(links[i])) {
+                    reconcile.stats.errors++;
+                    reconcile.blocked = true;
+                }
+        }
+
+        if (ioprio >= 0) syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio);
+
+        if (reconcile.pending.empty()) reconcile.phase = RECONCILE_PURGE;
+        ReconcileSave();
+        usleep(entries * 1000000 / RECONCILE_RATE);
+        return true;
+
+    case RECONCILE_PURGE:
+        //bez sledovani zmen nevime, jestli se nektery soubor nepresunul
+        //do uz prosleho adresare (viz. StatCacheWatch())
+        if (!StatCacheWatched()) reconcile.blocked = true;
+        if (reconcile.blocked) ret = 1;
+            else ret = vfs.ReconcilePurge(TABLE_COMPACT_STEP, reconcile.purge_pos, reconcile.stats);
+        if (ret == -5) reconcile.blocked = true; //behem pruchodu se prejmenoval adresar
+        if (ret == 0) {
+            usleep(MAINTENANCE_STEP_PAUSE);
+            return true;
+        }
+
+        reconcile.phase    = RECONCILE_IDLE;
+        reconcile.finished = time(0);
+        reconcile.roots.clear();
+        reconcile.linked.clear();
+        ReconcileSave();
+        if (!daemonize) {
+            cout << "Kontrola databaze: adresaru " << reconcile.stats.dirs << ", souboru " << reconcile.stats.entries
+                 << ", smazano zaznamu (jiny soubor / soubor neexistuje) " << reconcile.stats.purged << " / "
+                 << reconcile.stats.orphans << ", doplneno " << reconcile.stats.repaired << ", chyb "
+                 << reconcile.stats.errors << ", " << (reconcile.finished - reconcile.started) << " s" << endl;
+            if (reconcile.blocked || ret < 0) cout << "Kontrola databaze: nektere adresare nebylo mozne precist, behem kontroly se prejmenovaly nebo se nesledovaly zmeny, zaznamy se nemazaly." << endl;
+        }
+        return true;
+    }
+    return false;
+}
+
+
+/** Spusti proces udrzby.
+ *
+ * V rodici vrati PID procesu udrzby (nebo -1, pokud se fork() nepovedl),
+ * v potomkovi vrati 0 - ten pak ma zavolat Maintenance().
+ */
+pid_t MaintenanceStart(VFS &, int server_socket) {
+    pid_t   pid;
+
+    pid = fork();
+    if (pid != 0) return pid;
+
+    parent = false;
+    close(server_socket); //klienty obsluhuje jen hlavni proces
+    //az hlavni proces skonci, dostaneme SIGTERM a skoncime taky
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    return 0;
+}
+
+
+/** Hlavni smycka procesu udrzby.
+ *
+ * Bezi, dokud proces nedostane SIGTERM (viz. TermHandler()) nebo dokud
+ * neskonci hlavni proces serveru.
+ */
+void Maintenance(VFS &vfs) {
+    time_t  last_check = 0;
+    int     ret;
+
+    maintenance_started = time(0);
+    ReconcileLoad();
+
+    while (run) {
+        if (getppid() == 1) break;
+
+        //po SIGHUP se mohly zmenit sdilene adresare
+        if (reload_config_file) {
+            vfs.ReloadConfigFile(vfs_config_file.c_str());
+            reload_config_file = false;
+        }
+
+        if (time(0) - last_check >= MAINTENANCE_INTERVAL) {
+            last_check = time(0);
+
+            //uklizime po krocich, dokud smazane sloty nezabiraji mene nez 1 %
+            //tabulky - mezi kroky se ke slovu dostanou klienti
+            if (vfs.DbFragmentation() >= TABLE_COMPACT_THRESHOLD) do {
+                ret = vfs.CompactDb(TABLE_COMPACT_STEP);
+                if (ret < 0) {
+                    if (!daemonize) cout << "Udrzba: chyba pri uklidu databaze (" << ret << ")" << endl;
+                    break;
+                }
+                usleep(MAINTENANCE_STEP_PAUSE);
+            } while (run && vfs.DbFragmentation() > 0);
+        }
+
+        if (!ReconcileStep(vfs)) sleep(1);
+    }
+}
+
+
+#define WATCH_MASK (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF \
+                    | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DONT_FOLLOW | IN_ONLYDIR)
+
+static map<int, string> watches; //< sledovane adresare podle cisla sledovani (wd)
+
+
+/** Zacne sledovat adresar dir a vsechny jeho podadresare (symbolicke odkazy
+ * se nenasleduji - cache je neuklada, viz. statcache.cpp).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se sledovat nektery adresar (errno)
+ *
+ */
+static int WatchTree(int ifd, const string &dir) {
+    vector<string>  pending;
+    string          name;
+    string          path;
+    DIR           * d;
+    struct dirent * entry;
+    int             wd;
+
+    pending.push_back(dir);
+    while (!pending.empty()) {
+        name = pending.back();
+        pending.pop_back();
+
+        wd = inotify_add_watch(ifd, name.c_str(), WATCH_MASK);
+        if (wd == -1) {
+            if (errno == ENOENT || errno == ENOTDIR || errno == EACCES) continue; //mezitim zmizel
+            return -1;
+        }
+        watches[wd] = name;
+
+        d = opendir(name.c_str());
+        if (d == 0) continue;
+        while ((entry = readdir(d)) != 0) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) continue;
+            path = (name == "/") ? name + entry->d_name : name + "/" + entry->d_name;
+            if (entry->d_type == DT_UNKNOWN) {
+                struct stat st;
+                if (lstat(path.c_str(), &st) == -1 || !S_ISDIR(st.st_mode)) continue;
+            }
+            pending.push_back(path);
+        }
+        closedir(d);
+    }
+    return 1;
+}
+
+
+/** Zrusi vsechna sledovani a zacne znovu sledovat vsechny sdilene adresare.
+ *
+ * Cache se behem toho vypne a zapne se, jen pokud se podari sledovat
+ * uplne vsechno.
+ */
+static int WatchAll(VFS &vfs, int ifd) {
+    map<int, string>::iterator  it;
+    vector<string>              roots;
+    unsigned int                i;
+
+    StatCacheEnable(false);
+    for (it = watches.begin(); it != watches.end(); it++) inotify_rm_watch(ifd, it->first);
+    watches.clear();
+
+    vfs.PhysicalDirs(roots);
+    for (i = 0; i < roots.size(); i++)
+        if (WatchTree(ifd, roots[i]) < 0) {
+            if (!daemonize) {
+                cout << "Cache stat(): nelze sledovat adresar " << roots[i] << " (" << strerror(errno) << "), cache bude vypnuta." << endl;
+                if (errno == ENOSPC) cout << "Cache stat(): zvyste fs.inotify.max_user_watches." << endl;
+            }
+            return -1;
+        }
+
+    vfs.DirMoved(); //co se presunulo, dokud se nesledovalo, mohl pruchod kontroly minout
+    StatCacheEnable(true);
+    return 1;
+}
+
+
+/** Hlavni smycka procesu sledovani zmen pro sdilenou cache stat().
+ *
+ * Kazda zmena v nekterem sdilenem adresari zneplatni zaznam zmeneneho
+ * souboru a adresare, ve kterem lezi. Pokud jadro zahodi udalosti (preteceni
+ * fronty) nebo se presune cely adresar, zneplatni se cela cache. Bezi, dokud
+ * proces nedostane SIGTERM nebo dokud neskonci hlavni proces serveru; potom
+ * (nebo pokud sledovani nejde nastavit) zustane cache vypnuta.
+ */
+void StatCacheWatch(VFS &vfs) {
+    char                        buf[64 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event      * ev;
+    struct pollfd               pfd;
+    map<int, string>::iterator  it;
+    string                      name;
+    bool                        rewatch;
+    ssize_t                     len;
+    char                      * p;
+    int                         ifd;
+
+    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd == -1) {
+        if (!daemonize) cout << "Cache stat(): inotify neni k dispozici, cache bude vypnuta." << endl;
+        return;
+    }
+    WatchAll(vfs, ifd);
+    rewatch = false;
+
+    pfd.fd     = ifd;
+    pfd.events = POLLIN;
+    while (run) {
+        if (getppid() == 1) break;
+
+        //po SIGHUP se mohly zmenit sdilene adresare
+        if (reload_config_file) {
+            vfs.ReloadConfigFile(vfs_config_file.c_str());
+            reload_config_file = false;
+            rewatch = true;
+        }
+        //pokud se sledovani nepodari nastavit, zustane cache vypnuta
+        if (rewatch) {
+            rewatch = false;
+            WatchAll(vfs, ifd);
+        }
+
+        if (poll(&pfd, 1, 1000) <= 0) continue;
+        len = read(ifd, buf, sizeof(buf));
+        if (len <= 0) continue;
+
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (struct inotify_event *)p;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                StatCacheFlush();
+                vfs.DirMoved(); //nevime, co se presunulo
+                continue;
+            }
+            it = watches.find(ev->wd);
+            if (it == watches.end()) continue;
+
+            if (ev->mask & IN_IGNORED) {
+                watches.erase(it);
+                continue;
+            }
+            name = it->second;
+            if (ev->len > 0 && ev->name[0] != 0) name += (name == "/") ? ev->name : string("/") + ev->name;
+            StatCacheInvalidate(name);
+
+            //presunuty adresar - vsechny cesty pod nim jsou jine
+            if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_MOVED_FROM | IN_MOVED_TO))) {
+                rewatch = true;
+                continue;
+            }
+            if (ev->mask & IN_MOVE_SELF) {
+                rewatch = true;
+                continue;
+            }
+            //soubor mohl prijit z adresare, ktery kontrola zaznamu jeste neprosla
+            if (!(ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) vfs.ReconcileSeen(name);
+            //novy podadresar - muze uz v nem neco byt, co jsme nevideli
+            if ((ev->mask & IN_ISDIR) && (ev->mask & IN_CREATE)) {
+                if (WatchTree(ifd, name) < 0) rewatch = true;
+                StatCacheFlush();
+            }
+        }
+    }
+
+    StatCacheEnable(false);
+    close(ifd);
+}
@@ -0,0 +1,35 @@
+/** @file maintenance.h
+ *  \brief Deklarace funkci procesu udrzby.
+ *
+ */
+
+#ifndef __maintenance_h
+#define __maintenance_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include "VFS.h"
+
+#define MAINTENANCE_INTERVAL   5     //< po kolika sekundach proces udrzby zkontroluje stav databaze
+#define MAINTENANCE_STEP_PAUSE 10000 //< pauza mezi kroky uklidu databaze (v mikrosekundach)
+
+#define RECONCILE_PERIOD     86400   //< po kolika sekundach od konce pruchodu kontroly zaznamu zacne dalsi
+#define RECONCILE_RATE       2000    //< kolik souboru za sekundu nanejvys kontrola zaznamu zkontroluje
+#define RECONCILE_BATCH      500     //< po kolika souborech se kontrola zaznamu zastavi a ulozi svuj stav
+#define RECONCILE_WATCH_WAIT 60      //< jak dlouho po startu se s pruchodem kontroly ceka na sledovani zmen
+#define RECONCILE_STATE_FILE "reconcile.state" //< soubor se stavem kontroly zaznamu (v adresari cache)
+
+extern bool run;
+extern bool reload_config_file;
+extern string vfs_config_file;
+extern string cache_dir;
+
+
+pid_t MaintenanceStart(VFS &vfs, int server_socket);
+void  Maintenance(VFS &vfs);
+void  StatCacheWatch(VFS &vfs);
+
+#endif //__maintenance_h
@@ -0,0 +1,345 @@
+/** @file metrics.cpp
+ *  \brief Implementace sdilenych metrik serveru.
+ *
+ * Kazdy proces obsluhujici klienta si po fork() zabere vlastni misto ve
+ * sdilene pameti (MetricsWorkerStart()) a metriky do nej zapisuje bez
+ * zamykani - nikdo jiny do nej nepise. Ctenar (prikaz METRICS) secte vsechna
+ * mista, ktera uz nekdo pouzil, cte pritom bez zamku - muze dostat hodnoty
+ * o par udalosti stare, ale nikdy nezdrzi obsluhu klientu.
+ *
+ */
+
+#include "metrics.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <string.h>
+#include <time.h>
+}
+
+
+static MetricsShared * metrics = 0; //< sdilene metriky, 0 = metriky se nevedou
+static MetricsWorker * worker  = 0; //< misto tohoto procesu
+static bool            shared_slot = false; //< misto sdili vic procesu, pricita se atomicky
+
+
+/** Pripravi sdilenou pamet pro metriky.
+ *
+ * Musi se zavolat pred prvnim fork().
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se vytvorit sdilenou pamet
+ *
+ */
+int MetricsInit() {
+    void * p;
+
+    p = mmap(0, sizeof(MetricsShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return -1;
+    metrics = (MetricsShared *)p;
+    metrics->started = time(0);
+    return 1;
+}
+
+
+/** Zabere pro tento proces misto v metrikach.
+ *
+ * Vola se v potomkovi po fork(), pred obsluhou klienta.
+ */
+void MetricsWorkerStart() {
+    pid_t   me = getpid();
+    int     i;
+
+    if (metrics == 0) return;
+
+    for (i = 0; i < METRICS_MAX_WORKERS; i++)
+        if (metrics->workers[i].pid == 0 && __sync_bool_compare_and_swap(&metrics->workers[i].pid, 0, me)) {
+            worker = &metrics->workers[i];
+            worker->used = 1;
+            shared_slot  = false;
+            return;
+        }
+
+    worker = &metrics->workers[METRICS_MAX_WORKERS];
+    worker->used = 1;
+    shared_slot  = true;
+}
+
+
+/** Uvolni misto procesu pid, ktery prave skoncil (vola se z ReapChild()).
+ *
+ */
+void MetricsChildExited(pid_t pid) {
+    int i;
+
+    if (metrics == 0 || pid <= 0) return;
+    for (i = 0; i < METRICS_MAX_WORKERS; i++)
+        if (metrics->workers[i].pid == pid) {
+            metrics->workers[i].pid = 0;
+            return;
+        }
+}
+
+
+/** Vrati aktualni cas v mikrosekundach.
+ *
+ */
+unsigned long long MetricsNow() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+
+/** Vrati index intervalu histogramu pro hodnotu v.
+ *
+ */
+static int HistogramBucket(unsigned long long v) {
+    int msb;
+    int shift;
+    int b;
+
+    if (v < METRICS_SUB_BUCKETS) return v;
+    msb   = 63 - __builtin_clzll(v);
+    shift = msb - METRICS_SUB_BITS;
+    b     = (shift + 1) * METRICS_SUB_BUCKETS + ((v >> shift) & (METRICS_SUB_BUCKETS - 1));
+    return (b < METRICS_BUCKETS) ? b : METRICS_BUCKETS - 1;
+}
+
+
+/** Vrati nejmensi hodnotu, ktera patri do intervalu b.
+ *
+ */
+static unsigned long long HistogramLow(int b) {
+    int shift;
+
+    if (b < METRICS_SUB_BUCKETS) return b;
+    shift = b / METRICS_SUB_BUCKETS - 1;
+    return (unsigned long long)(METRICS_SUB_BUCKETS + b % METRICS_SUB_BUCKETS) << shift;
+}
+
+
+/** Zapocita hodnotu v do histogramu h.
+ *
+ */
+static void HistogramAdd(Histogram &h, unsigned long long v) {
+    unsigned long long  old;
+    int                 b = HistogramBucket(v > 0 ? v - 1 : 0); //interval (low, high]
+
+    if (!shared_slot) {
+        h.count++;
+        h.sum += v;
+        h.buckets[b]++;
+        if (v > h.max) h.max = v;
+        return;
+    }
+
+    __sync_fetch_and_add(&h.count, 1);
+    __sync_fetch_and_add(&h.sum, v);
+    __sync_fetch_and_add(&h.buckets[b], 1);
+    while ((old = h.max) < v && !__sync_bool_compare_and_swap(&h.max, old, v)) ;
+}
+
+
+/** Zapocita dobu obsluhy prikazu s indexem command v command_table.
+ *
+ */
+void MetricsCommand(int command, unsigned long long usec) {
+    if (worker == 0 || command < 0 || command >= METRICS_MAX_COMMANDS) return;
+    HistogramAdd(worker->commands[command], usec);
+}
+
+
+/** Zapocita hodnotu metriky metric (METRIC_*).
+ *
+ */
+void MetricsRecord(int metric, unsigned long long value) {
+    if (worker == 0 || metric < 0 || metric >= METRIC_COUNT) return;
+    HistogramAdd(worker->other[metric], value);
+}
+
+
+/** Pricte n k citaci c.
+ *
+ */
+static void CounterAdd(unsigned long long &c, unsigned long long n) {
+    if (shared_slot) __sync_fetch_and_add(&c, n);
+        else c += n;
+}
+
+
+/** Vrati index sdileneho adresare share v MetricsShared::shares_table,
+ * pripadne ho tam prida.
+ *
+ * Vrati -1, pokud share je prazdne nebo uz neni misto.
+ */
+static int MetricsShareIndex(const string &share) {
+    int     i;
+    int     n = metrics->shares;
+
+    if (share == "" || share.size() >= METRICS_SHARE_NAME_LEN) return -1;
+
+    if (n > METRICS_MAX_SHARES) n = METRICS_MAX_SHARES;
+    for (i = 0; i < n; i++)
+        if (metrics->shares_table[i].ready && share == metrics->shares_table[i].name) return i;
+
+    i = __sync_fetch_and_add(&metrics->shares, 1);
+    if (i >= METRICS_MAX_SHARES) return -1;
+    strcpy(metrics->shares_table[i].name, share.c_str());
+    __sync_synchronize();
+    metrics->shares_table[i].ready = 1;
+    return i;
+}
+
+
+/** Zapocita jeden dokonceny prenos bytes bytu z/do sdileneho adresare share
+ * (virtualni jmeno), ktery trval usec mikrosekund.
+ *
+ */
+void MetricsTransfer(bool upload, unsigned long long bytes, unsigned long long usec, const string &share) {
+    int i;
+
+    if (worker == 0) return;
+
+    CounterAdd(upload ? worker->bytes_received : worker->bytes_sent, bytes);
+    i = MetricsShareIndex(share);
+    if (i >= 0) CounterAdd(upload ? worker->share_received[i] : worker->share_sent[i], bytes);
+
+    if (usec == 0) usec = 1;
+    HistogramAdd(worker->other[METRIC_TRANSFER_RATE], bytes * 1000000.0 / usec);
+}
+
+
+/** Zapocita prijeti spojeni (vola jen hlavni proces).
+ *
+ */
+void MetricsAccept() {
+    if (metrics != 0) metrics->accepts++;
+}
+
+
+/** Zapocita hits zasahu a misses minuti cache (METRICS_CACHE_*).
+ *
+ */
+void MetricsCache(int cache, unsigned long long hits, unsigned long long misses) {
+    if (worker == 0 || cache < 0 || cache >= METRICS_CACHES) return;
+    if (hits > 0) CounterAdd(worker->cache_hits[cache], hits);
+    if (misses > 0) CounterAdd(worker->cache_misses[cache], misses);
+}
+
+
+/** Zapocita zasahy a minuti cache, ktera je pocita sama za cely proces.
+ *
+ * hits a misses jsou soucty od zacatku procesu, do metrik se pricte jen
+ * rozdil od minuleho volani.
+ */
+void MetricsCacheTotals(int cache, unsigned long long hits, unsigned long long misses) {
+    static unsigned long long   last_hits[METRICS_CACHES];
+    static unsigned long long   last_misses[METRICS_CACHES];
+
+    if (cache < 0 || cache >= METRICS_CACHES) return;
+    MetricsCache(cache, hits - last_hits[cache], misses - last_misses[cache]);
+    last_hits[cache]   = hits;
+    last_misses[cache] = misses;
+}
+
+
+/** Pricte histogram from do histogramu to.
+ *
+ */
+static void HistogramMerge(Histogram &to, const Histogram &from) {
+    int i;
+
+    if (from.count == 0) return;
+    to.count += from.count;
+    to.sum   += from.sum;
+    if (from.max > to.max) to.max = from.max;
+    for (i = 0; i < METRICS_BUCKETS; i++) to.buckets[i] += from.buckets[i];
+}
+
+
+/** Secte metriky vsech procesu do t.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      metriky se nevedou
+ *
+ */
+int MetricsSnapshot(MetricsTotals &t) {
+    int i, j;
+
+    memset(&t, 0, sizeof(t));
+    if (metrics == 0) return -1;
+
+    t.started = metrics->started;
+    t.accepts = metrics->accepts;
+    t.shares  = metrics->shares;
+    if (t.shares > METRICS_MAX_SHARES) t.shares = METRICS_MAX_SHARES;
+    for (i = 0; i < t.shares; i++)
+        if (metrics->shares_table[i].ready) strcpy(t.share_names[i], metrics->shares_table[i].name);
+
+    for (i = 0; i <= METRICS_MAX_WORKERS; i++) {
+        MetricsWorker &w = metrics->workers[i];
+
+        if (!w.used) continue;
+        if (w.pid != 0) t.workers++;
+        for (j = 0; j < METRICS_MAX_COMMANDS; j++) HistogramMerge(t.commands[j], w.commands[j]);
+        for (j = 0; j < METRIC_COUNT; j++) HistogramMerge(t.other[j], w.other[j]);
+        t.bytes_sent     += w.bytes_sent;
+        t.bytes_received += w.bytes_received;
+        for (j = 0; j < t.shares; j++) {
+            t.share_sent[j]     += w.share_sent[j];
+            t.share_received[j] += w.share_received[j];
+        }
+        for (j = 0; j < METRICS_CACHES; j++) {
+            t.cache_hits[j]   += w.cache_hits[j];
+            t.cache_misses[j] += w.cache_misses[j];
+        }
+    }
+    return 1;
+}
+
+
+/** Vrati odhad kvantilu q (0 az 1) hodnot histogramu h.
+ *
+ * Vysledkem je stred intervalu, do ktereho kvantil padne (nejvys h.max).
+ */
+unsigned long long HistogramQuantile(const Histogram &h, double q) {
+    unsigned long long  rank;
+    unsigned long long  seen = 0;
+    unsigned long long  low, high;
+    int                 i;
+
+    if (h.count == 0) return 0;
+    rank = (unsigned long long)(q * h.count);
+    if (rank >= h.count) rank = h.count - 1;
+
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        seen += h.buckets[i];
+        if (seen > rank) {
+            low  = HistogramLow(i);
+            high = (i + 1 < METRICS_BUCKETS) ? HistogramLow(i + 1) : low + 1;
+            low  = low + (high - low + 1) / 2; //interval je (low, high]
+            return (low < h.max) ? low : h.max;
+        }
+    }
+    return h.max;
+}
+
+
+/** Vrati pocet hodnot histogramu h mensich nebo rovnych limit.
+ *
+ * Presne jen pro limit, ktery je mocninou 2 (nebo mensi nez
+ * METRICS_SUB_BUCKETS) - to jsou hranice intervalu histogramu.
+ */
+unsigned long long HistogramAtMost(const Histogram &h, unsigned long long limit) {
+    unsigned long long  n = 0;
+    int                 last = (limit == 0) ? 0 : HistogramBucket(limit);
+    int                 i;
+
+    for (i = 0; i < last; i++) n += h.buckets[i];
+    return n;
+}
@@ -0,0 +1,134 @@
+/** @file metrics.h
+ *  \brief Deklarace sdilenych metrik serveru (histogramy doby trvani prikazu,
+ *  navazani spojeni, dotazu do databaze a rychlosti prenosu).
+ *
+ */
+
+#ifndef __metrics_h
+#define __metrics_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define METRICS_SUB_BITS     3   //< kolik bitu hodnoty urcuje pozici v ramci mocniny 2 (presnost 12,5 %)
+#define METRICS_SUB_BUCKETS  (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS      280 //< pocet intervalu histogramu - hodnoty do 2^36 (v us asi 19 hodin)
+#define METRICS_MAX_WORKERS  256 //< pro kolik soucasnych procesu maji metriky vlastni misto
+#define METRICS_MAX_COMMANDS 64  //< pro kolik prikazu z command_table se metriky vedou
+#define METRICS_MAX_SHARES   64  //< pro kolik sdilenych adresaru se pocitaji prenesena data
+#define METRICS_SHARE_NAME_LEN 256
+
+#define METRIC_DATA_CONNECT  0 //< navazani data connection vcetne TLS (us)
+#define METRIC_TLS_HANDSHAKE 1 //< TLS handshake control i data connection (us)
+#define METRIC_DB_LOOKUP     2 //< DirectoryDatabase::GetFileInfo() (us)
+#define METRIC_TRANSFER_RATE 3 //< rychlost prenosu dat (byty za sekundu)
+#define METRIC_DB_LOCK_WAIT  4 //< cekani na zamek databaze (us)
+#define METRIC_COUNT         5
+
+#define METRICS_CACHE_STAT   0 //< sdilena cache stat() (viz. statcache.h)
+#define METRICS_CACHE_LIST   1 //< cache vypisu adresaru (viz. listcache.h)
+#define METRICS_CACHES       2
+
+
+/** Histogram s logaritmickymi intervaly (jako HDR histogram).
+ *
+ * Hodnoty mensi nez METRICS_SUB_BUCKETS maji kazda svuj interval, vetsi
+ * hodnoty se deli na METRICS_SUB_BUCKETS intervalu v ramci kazde mocniny 2.
+ * Intervaly zahrnuji svou horni hranici (jako "le" v OpenMetrics).
+ */
+struct Histogram {
+    unsigned long long  count;
+    unsigned long long  sum;
+    unsigned long long  max;
+    unsigned long long  buckets[METRICS_BUCKETS];
+};
+
+
+/** Metriky jednoho procesu obsluhujiciho klienta.
+ *
+ * Zapisuje je jen proces, kteremu misto patri (pid), takze se nezamyka.
+ * Po skonceni procesu misto prevezme dalsi proces a pricita dal - hodnoty
+ * jsou soucty za celou dobu behu serveru.
+ */
+struct MetricsWorker {
+    volatile pid_t      pid;     ///< komu misto patri (0 = volne)
+    volatile int        used;    ///< misto uz nekdo pouzil (ma smysl ho cist)
+    Histogram           commands[METRICS_MAX_COMMANDS];
+    Histogram           other[METRIC_COUNT];
+    unsigned long long  bytes_sent;
+    unsigned long long  bytes_received;
+    unsigned long long  share_sent[METRICS_MAX_SHARES];     ///< podle indexu v MetricsShared::shares
+    unsigned long long  share_received[METRICS_MAX_SHARES];
+    unsigned long long  cache_hits[METRICS_CACHES];
+    unsigned long long  cache_misses[METRICS_CACHES];
+};
+
+
+/** Jmeno sdileneho adresare v metrikach.
+ *
+ * Jmena pridavaji procesy obsluhujici klienty pri prvnim prenosu z/do
+ * adresare a uz se nemazou. Dva procesy muzou soucasne pridat stejne jmeno
+ * dvakrat - ctenar hodnoty se stejnym jmenem secte.
+ */
+struct MetricsShare {
+    volatile int        ready;   ///< jmeno uz je zapsane
+    char                name[METRICS_SHARE_NAME_LEN];
+};
+
+
+/** Sdilene metriky (mmap MAP_SHARED, vytvari se pred fork()).
+ *
+ * Posledni misto (METRICS_MAX_WORKERS) je spolecne pro procesy, na ktere
+ * vlastni misto nezbylo - do nej se pricita atomicky.
+ */
+struct MetricsShared {
+    time_t              started;
+    unsigned long long  accepts;  ///< prijata spojeni (pise jen hlavni proces)
+    volatile int        shares;   ///< kolik mist v shares uz je zabrano
+    MetricsShare        shares_table[METRICS_MAX_SHARES];
+    MetricsWorker       workers[METRICS_MAX_WORKERS + 1];
+};
+
+
+/** Soucet metrik vsech procesu (viz. MetricsSnapshot()).
+ *
+ */
+struct MetricsTotals {
+    time_t              started;
+    int                 workers;  ///< kolik procesu prave bezi
+    unsigned long long  accepts;
+    Histogram           commands[METRICS_MAX_COMMANDS];
+    Histogram           other[METRIC_COUNT];
+    unsigned long long  bytes_sent;
+    unsigned long long  bytes_received;
+    int                 shares;
+    char                share_names[METRICS_MAX_SHARES][METRICS_SHARE_NAME_LEN];
+    unsigned long long  share_sent[METRICS_MAX_SHARES];
+    unsigned long long  share_received[METRICS_MAX_SHARES];
+    unsigned long long  cache_hits[METRICS_CACHES];
+    unsigned long long  cache_misses[METRICS_CACHES];
+};
+
+
+int                MetricsInit();
+void               MetricsWorkerStart();
+void               MetricsChildExited(pid_t pid);
+unsigned long long MetricsNow();
+void               MetricsCommand(int command, unsigned long long usec);
+void               MetricsRecord(int metric, unsigned long long value);
+void               MetricsTransfer(bool upload, unsigned long long bytes, unsigned long long usec, const string &share);
+void               MetricsAccept();
+void               MetricsCache(int cache, unsigned long long hits, unsigned long long misses);
+void               MetricsCacheTotals(int cache, unsigned long long hits, unsigned long long misses);
+int                MetricsSnapshot(MetricsTotals &t);
+unsigned long long HistogramQuantile(const Histogram &h, double q);
+unsigned long long HistogramAtMost(const Histogram &h, unsigned long long limit);
+
+#endif //__metrics_h
@@ -0,0 +1,673 @@
+/** @file microbench.cpp
+ *  \brief Mikrobenchmarky funkci, ktere se objevuji v profilech serveru.
+ *
+ * Kazdy benchmark opakuje jednu funkci tak dlouho, aby mereni trvalo aspon
+ * zadany cas (pocet opakovani se postupne zvysuje, jako v Google Benchmark),
+ * a vypise pocet opakovani, cas jednoho volani a u funkci, ktere zpracovavaji
+ * data, i propustnost. Meri se:
+ *
+ *      - LF2CRLF, CRLF2LF a EraseEOR (prevody dat pri TYPE A a MODE B)
+ *      - ParseCommand a GetCommandIndex
+ *      - CutPathIntoParts
+ *      - VFS::ConvertToPhysicalPath, VFS::ChangeDir a VFS::GetFileInfo na
+ *        vygenerovanem stromu (hluboke adresare, mnoho virtualnich adresaru)
+ *      - VFS_file::GetLslInfo
+ *      - CheckIP se seznamy zakazanych adres ruzne delky
+ *      - DirectoryDatabase::PutFileInfo, GetFileInfo a DeleteFileInfo, ktere
+ *        soucasne vola 1 az 64 procesu (kazdy nad svymi soubory)
+ *
+ * Data pro benchmarky (strom adresaru, vfs.cfg, seznamy zakazanych adres,
+ * soubory pro databazi) program pripravi v pracovnim adresari; soubory,
+ * ktere uz existuji, necha byt. Prepinac -f vybere jen benchmarky, jejichz
+ * jmeno obsahuje zadany retezec, takze lze zmerit jen tu funkci, kterou
+ * prave nekdo optimalizuje.
+ *
+ * Pouziti: microbench [-w adresar] [-f filtr] [-t ms] [-P procesu] [-c] [-g] [-l]
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+}
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+
+#include "pomocne.h"
+#include "VFS.h"
+#include "VFS_file.h"
+#include "DirectoryDatabase.h"
+#include "durable.h"
+#include "statcache.h"
+
+using namespace std;
+
+#define MB_TREE_DEPTH     8       //< hloubka vygenerovaneho stromu adresaru
+#define MB_TREE_FILES     100     //< pocet souboru v kazdem adresari stromu
+#define MB_VIRTUAL_DIRS   32      //< pocet virtualnich adresaru ve vfs.cfg
+#define MB_DB_FILES       16384   //< pocet souboru pro benchmark databaze
+#define MB_DB_GET_ROUNDS  4       //< kolikrat kazdy proces precte zaznamy vsech svych souboru
+#define MB_DATA_SIZE      65536   //< velikost dat pro prevody LF2CRLF, ...
+#define MB_MAX_ITERATIONS 1000000000ULL
+#define MB_MAX_PROCESSES  64
+
+int durability = DURABILITY_NONE; //< databaze se pri benchmarku nesynchronizuje
+
+//globalni promenne, ktere pomocne.o ocekava ve smallFTPd.cpp a ftpcommands.cpp
+vector<user>    users;
+vector<string>  ip_deny_list;
+char            FTP_EOR[2] = {(char)255, 1};
+
+//tabulka prikazu jako v smallFTPd.cpp, jen bez napovedy a handleru (ty by
+//vyzadovaly cely server) - GetCommandIndex() i ParseCommand() v ni hledaji
+//stejne jako v serveru
+#define COMMAND(name, help, handler, max_args) {name, 0, 0, max_args},
+command command_table[]={
+#include "commands.h"
+};
+#undef COMMAND
+
+int number_of_commands = sizeof(command_table) / sizeof(command_table[0]);
+
+
+/** Stav jednoho mereni - kolikrat se ma funkce zavolat a kolik dat jedno
+ * volani zpracuje (pro vypocet propustnosti, 0 = nevypisuje se).
+ *
+ */
+struct BenchState {
+    unsigned long long  iterations;
+    long                arg;
+    unsigned long long  bytes;
+};
+
+/** Jeden benchmark: jmeno (pro vypis a filtr), funkce a jeji parametr.
+ *
+ */
+struct Benchmark {
+    const char    * name;
+    void         (* fn)(BenchState &);
+    long            arg;
+};
+
+
+static string           dir = "/tmp/microbench"; //< pracovni adresar s daty
+static VFS            * vfs = 0;
+static volatile int     sink;                    //< aby prekladac vysledky nevyhodil
+static char             data_in[MB_DATA_SIZE];
+static char             data_out[2 * MB_DATA_SIZE];
+
+
+/** Vrati aktualni cas v nanosekundach.
+ *
+ */
+static unsigned long long Now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+/** Virtualni cesta k adresari v hloubce depth stromu (/d0/d1/...).
+ *
+ */
+static string TreePath(int depth) {
+    string  s;
+    char    tmp[20];
+    int     i;
+
+    for (i = 0; i < depth; i++) {
+        snprintf(tmp, sizeof(tmp), "/d%d", i);
+        s += tmp;
+    }
+    return s;
+}
+
+
+/*************************************************************************
+ *                              Benchmarky                               *
+ *************************************************************************/
+
+/** Naplni data_in textem s radky dlouhymi line znaku, ktere konci eol.
+ *
+ */
+static void FillText(const char * eol, int line) {
+    int len = strlen(eol);
+    int i, j;
+
+    for (i = 0, j = 0; i < MB_DATA_SIZE; i++, j++) {
+        if (j == line && i + len <= MB_DATA_SIZE) {
+            memcpy(data_in + i, eol, len);
+            i += len - 1;
+            j = -1;
+        } else data_in[i] = 'a' + j % 26;
+    }
+}
+
+
+static void BenchLF2CRLF(BenchState &s) {
+    unsigned long long i;
+
+    FillText("\n", s.arg);
+    for (i = 0; i < s.iterations; i++) sink = LF2CRLF(data_out, data_in, MB_DATA_SIZE);
+    s.bytes = MB_DATA_SIZE;
+}
+
+
+static void BenchCRLF2LF(BenchState &s) {
+    unsigned long long i;
+
+    FillText("\r\n", s.arg);
+    for (i = 0; i < s.iterations; i++) sink = CRLF2LF(data_out, data_in, MB_DATA_SIZE);
+    s.bytes = MB_DATA_SIZE;
+}
+
+
+static void BenchEraseEOR(BenchState &s) {
+    unsigned long long i;
+    char               eor[3] = {FTP_EOR[0], FTP_EOR[1], 0};
+
+    FillText(eor, s.arg);
+    for (i = 0; i < s.iterations; i++) {
+        memcpy(data_out, data_in, MB_DATA_SIZE); //EraseEOR data meni na miste
+        sink = EraseEOR(data_out, MB_DATA_SIZE);
+    }
+    s.bytes = MB_DATA_SIZE;
+}
+
+
+static const char * commands[] = {
+    "NOOP\r\n",
+    "RETR /pub/linux/distributions/archive/file name.iso\r\n",
+    "PORT 127,0,0,1,195,80\r\n",
+    "SITE CHMOD 0755 jmeno souboru.avi\r\n",
+    "XYZZ unknown\r\n"
+};
+
+static void BenchParseCommand(BenchState &s) {
+    unsigned long long  i;
+    list<string>        atoms;
+    string              cmd = commands[s.arg];
+
+    for (i = 0; i < s.iterations; i++) {
+        atoms.clear();
+        sink = ParseCommand(cmd, atoms);
+    }
+}
+
+
+static void BenchGetCommandIndex(BenchState &s) {
+    unsigned long long  i;
+    string              cmd;
+
+    //prvni, posledni a neznamy prikaz
+    if (s.arg == 0) cmd = command_table[0].name;
+    else if (s.arg == 1) cmd = command_table[number_of_commands - 1].name;
+    else cmd = "xyzw";
+
+    for (i = 0; i < s.iterations; i++) sink = GetCommandIndex(cmd);
+}
+
+
+static void BenchCutPathIntoParts(BenchState &s) {
+    unsigned long long  i;
+    deque<string>       parts;
+    string              path = TreePath(s.arg) + "/f000";
+
+    for (i = 0; i < s.iterations; i++) {
+        parts.clear();
+        sink = CutPathIntoParts(path, parts);
+    }
+}
+
+
+/** Cesta k souboru pro benchmarky VFS: arg < 0 vede pres posledni virtualni
+ * adresar, jinak do hloubky arg stromu pod korenem.
+ *
+ */
+static string VFSPath(long arg) {
+    char tmp[40];
+
+    if (arg >= 0) return TreePath(arg) + "/f050";
+    snprintf(tmp, sizeof(tmp), "/v%02d", MB_VIRTUAL_DIRS - 1);
+    return tmp + TreePath(-arg) + "/f050";
+}
+
+
+static void BenchConvertToPhysicalPath(BenchState &s) {
+    unsigned long long  i;
+    string              path = VFSPath(s.arg);
+    string              physical;
+
+    vfs->ChangeDir("/");
+    for (i = 0; i < s.iterations; i++) sink = vfs->ConvertToPhysicalPath(path, physical);
+}
+
+
+static void BenchChangeDir(BenchState &s) {
+    unsigned long long  i;
+    string              path = VFSPath(s.arg);
+
+    path.erase(path.rfind('/'));
+    if (path == "") path = "/";
+    for (i = 0; i < s.iterations; i++) sink = vfs->ChangeDir(path.c_str());
+    vfs->ChangeDir("/");
+}
+
+
+static void BenchGetFileInfo(BenchState &s) {
+    unsigned long long  i;
+    string              path = VFSPath(s.arg);
+    VFS_file            file("", "");
+
+    vfs->ChangeDir("/");
+    for (i = 0; i < s.iterations; i++) sink = vfs->GetFileInfo(path.c_str(), file);
+}
+
+
+static void BenchGetLslInfo(BenchState &s) {
+    unsigned long long  i;
+    string              result;
+    VFS_file            file("f050", dir + "/share" + TreePath(s.arg));
+
+    for (i = 0; i < s.iterations; i++) sink = file.GetLslInfo(result);
+}
+
+
+static void BenchCheckIP(BenchState &s) {
+    unsigned long long  i;
+    char                tmp[40];
+    char                ip[] = "192.168.1.1"; //v seznamu neni - projde se cely
+
+    snprintf(tmp, sizeof(tmp), "/deny_%ld.cfg", s.arg);
+    LoadIPDenyList((dir + tmp).c_str());
+    for (i = 0; i < s.iterations; i++) sink = CheckIP(ip);
+    ip_deny_list.clear();
+}
+
+
+static Benchmark benchmarks[] = {
+    {"LF2CRLF/line:80",                     BenchLF2CRLF,               80},
+    {"LF2CRLF/line:4096",                   BenchLF2CRLF,               4096},
+    {"CRLF2LF/line:80",                     BenchCRLF2LF,               80},
+    {"CRLF2LF/line:4096",                   BenchCRLF2LF,               4096},
+    {"EraseEOR/record:80",                  BenchEraseEOR,              80},
+    {"EraseEOR/record:4096",                BenchEraseEOR,              4096},
+    {"ParseCommand/noop",                   BenchParseCommand,          0},
+    {"ParseCommand/retr",                   BenchParseCommand,          1},
+    {"ParseCommand/port",                   BenchParseCommand,          2},
+    {"ParseCommand/site_chmod",             BenchParseCommand,          3},
+    {"ParseCommand/unknown",                BenchParseCommand,          4},
+    {"GetCommandIndex/first",               BenchGetCommandIndex,       0},
+    {"GetCommandIndex/last",                BenchGetCommandIndex,       1},
+    {"GetCommandIndex/unknown",             BenchGetCommandIndex,       2},
+    {"CutPathIntoParts/depth:1",            BenchCutPathIntoParts,      1},
+    {"CutPathIntoParts/depth:8",            BenchCutPathIntoParts,      8},
+    {"VFS::ConvertToPhysicalPath/depth:1",  BenchConvertToPhysicalPath, 1},
+    {"VFS::ConvertToPhysicalPath/depth:8",  BenchConvertToPhysicalPath, 8},
+    {"VFS::ConvertToPhysicalPath/virtual:4", BenchConvertToPhysicalPath, -4},
+    {"VFS::ChangeDir/depth:1",              BenchChangeDir,             1},
+    {"VFS::ChangeDir/depth:8",              BenchChangeDir,             8},
+    {"VFS::ChangeDir/virtual:4",            BenchChangeDir,             -4},
+    {"VFS::GetFileInfo/depth:1",            BenchGetFileInfo,           1},
+    {"VFS::GetFileInfo/depth:8",            BenchGetFileInfo,           8},
+    {"VFS::GetFileInfo/virtual:4",          BenchGetFileInfo,           -4},
+    {"VFS_file::GetLslInfo",                BenchGetLslInfo,            1},
+    {"CheckIP/deny:10",                     BenchCheckIP,               10},
+    {"CheckIP/deny:1000",                   BenchCheckIP,               1000},
+    {"CheckIP/deny:100000",                 BenchCheckIP,               100000},
+    {0, 0, 0}
+};
+
+
+/** Spusti benchmark b - zvysuje pocet opakovani, dokud mereni netrva aspon
+ * min_ns, a vypise vysledek.
+ *
+ */
+static void RunBenchmark(Benchmark &b, unsigned long long min_ns) {
+    BenchState          s;
+    unsigned long long  start;
+    unsigned long long  elapsed;
+    double              next;
+
+    s.iterations = 1;
+    s.arg        = b.arg;
+    while (1) {
+        s.bytes = 0;
+        start   = Now();
+        b.fn(s);
+        elapsed = Now() - start;
+        if (elapsed >= min_ns || s.iterations >= MB_MAX_ITERATIONS) break;
+
+        //odhad potrebneho poctu opakovani s rezervou, nejvys desetkrat vic
+        next = (elapsed > 0) ? (double)s.iterations * min_ns * 1.4 / elapsed : s.iterations * 10.0;
+        if (next > s.iterations * 10.0) next = s.iterations * 10.0;
+        if (next < s.iterations + 1.0) next = s.iterations + 1.0;
+        s.iterations = (unsigned long long)next;
+    }
+
+    printf("%-40s %12llu %12.1f ns", b.name, s.iterations, (double)elapsed / s.iterations);
+    if (s.bytes > 0) printf(" %10.1f MB/s", (double)s.bytes * s.iterations / elapsed * 1e9 / 1048576);
+    printf("\n");
+    fflush(stdout);
+}
+
+
+/*************************************************************************
+ *                  DirectoryDatabase ve vice procesech                  *
+ *************************************************************************/
+
+#define DB_PUT    0
+#define DB_GET    1
+#define DB_DELETE 2
+
+static const char * db_op_names[] = { "PutFileInfo", "GetFileInfo", "DeleteFileInfo" };
+
+
+/** Jmeno i-teho souboru pro benchmark databaze.
+ *
+ */
+static string DbFile(int i) {
+    char tmp[30];
+
+    snprintf(tmp, sizeof(tmp), "/db/f%05d", i);
+    return dir + "/share" + tmp;
+}
+
+
+/** Telo procesu benchmarku databaze: pocka na spolecny start a provede
+ * operaci op se soubory id, id + processes, ... Cas konce zapise do end.
+ *
+ */
+static int DbWorker(int op, int id, int processes, unsigned long long start, unsigned long long * end) {
+    FileInfo    info;
+    string      name;
+    int         errors = 0;
+    int         r;
+    int         i;
+
+    try {
+        DirectoryDatabase db((dir + "/vfstable").c_str());
+
+        while (Now() < start) ;
+        for (r = 0; r < ((op == DB_GET) ? MB_DB_GET_ROUNDS : 1); r++)
+            for (i = id; i < MB_DB_FILES; i += processes) {
+                name = DbFile(i);
+                switch (op) {
+                    case DB_PUT:
+                        info.name          = name;
+                        info.user_name     = (i % 2) ? "alice" : "bob";
+                        info.user_rights   = R_ALL;
+                        info.others_rights = R_READ;
+                        if (db.PutFileInfo(info) != 1) errors++;
+                        break;
+                    case DB_GET:
+                        if (db.GetFileInfo(name, info) != 1) errors++;
+                        break;
+                    case DB_DELETE:
+                        if (db.DeleteFileInfo(name) != 1) errors++;
+                        break;
+                }
+            }
+        end[id] = Now();
+    } catch (exception &x) {
+        return 1;
+    }
+    return (errors > 0) ? 1 : 0;
+}
+
+
+/** Zmeri operaci op databaze, kterou soucasne provadi processes procesu.
+ *
+ */
+static void RunDatabase(int op, int processes) {
+    unsigned long long  * end;
+    unsigned long long    start;
+    unsigned long long    last = 0;
+    unsigned long long    ops;
+    pid_t                 pid;
+    int                   status;
+    int                   failed = 0;
+    int                   i;
+    char                  name[80];
+
+    end = (unsigned long long *)mmap(0, sizeof(unsigned long long) * processes, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (end == MAP_FAILED) return;
+
+    //procesy zacnou merit ve stejny okamzik, az budou vsechny spustene
+    start = Now() + 50000000ULL + processes * 1000000ULL;
+    for (i = 0; i < processes; i++) {
+        pid = fork();
+        if (pid == 0) _exit(DbWorker(op, i, processes, start, end));
+        if (pid == -1) failed++;
+    }
+    while ((pid = wait(&status)) > 0 || (pid == -1 && errno == EINTR))
+        if (pid > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) failed++;
+
+    for (i = 0; i < processes; i++)
+        if (end[i] > last) last = end[i];
+    munmap(end, sizeof(unsigned long long) * processes);
+
+    ops = (unsigned long long)MB_DB_FILES * ((op == DB_GET) ? MB_DB_GET_ROUNDS : 1);
+    snprintf(name, sizeof(name), "DirectoryDatabase::%s/procs:%d", db_op_names[op], processes);
+    if (failed > 0 || last <= start) {
+        printf("%-40s chyba (neuspesnych procesu: %d)\n", name, failed);
+        return;
+    }
+    //cas jedne operace z pohledu procesu a celkova propustnost
+    printf("%-40s %12llu %12.1f ns %10.0f op/s\n", name, ops, (double)(last - start) * processes / ops,
+           ops * 1e9 / (last - start));
+    fflush(stdout);
+}
+
+
+/*************************************************************************
+ *                          Priprava dat                                 *
+ *************************************************************************/
+
+/** Zapise do souboru name retezec data.
+ *
+ */
+static int WriteFile(const string &name, const string &data) {
+    FILE * fd;
+
+    fd = fopen(name.c_str(), "w");
+    if (fd == 0) return -1;
+    if (data.size() > 0 && fwrite(data.c_str(), data.size(), 1, fd) != 1) {
+        fclose(fd);
+        return -1;
+    }
+    return (fclose(fd) == 0) ? 1 : -1;
+}
+
+
+/** Vytvori prazdny soubor (pokud jeste neexistuje).
+ *
+ */
+static int Touch(const string &name) {
+    int fd;
+
+    fd = open(name.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) return -1;
+    close(fd);
+    return 1;
+}
+
+
+/** Vytvori v adresari path strom hloubky MB_TREE_DEPTH, v kazdem adresari
+ * MB_TREE_FILES souboru.
+ *
+ */
+static int CreateTree(string path) {
+    char    tmp[20];
+    int     d, i;
+
+    for (d = 0; d <= MB_TREE_DEPTH; d++) {
+        mkdir(path.c_str(), 0755);
+        for (i = 0; i < MB_TREE_FILES; i++) {
+            snprintf(tmp, sizeof(tmp), "/f%03d", i);
+            if (Touch(path + tmp) < 0) return -1;
+        }
+        snprintf(tmp, sizeof(tmp), "/d%d", d);
+        path += tmp;
+    }
+    return 1;
+}
+
+
+/** Vytvori v pracovnim adresari data pro benchmarky: strom sdileneho
+ * adresare, virtualni adresare, vfs.cfg, soubory pro databazi a seznamy
+ * zakazanych adres.
+ *
+ */
+static int CreateFixture() {
+    string      share = dir + "/share";
+    string      cfg;
+    string      s;
+    char        tmp[100];
+    struct stat st;
+    int         n, i;
+
+    mkdir(dir.c_str(), 0755);
+    mkdir((dir + "/virtual").c_str(), 0755);
+    if (CreateTree(share) < 0) return -1;
+
+    cfg = share + "\n";
+    for (i = 0; i < MB_VIRTUAL_DIRS; i++) {
+        snprintf(tmp, sizeof(tmp), "/virtual/v%02d", i);
+        if (CreateTree(dir + tmp) < 0) return -1;
+        cfg += dir + tmp + " " + (tmp + 8) + " " NO_USER " 0 1\n";
+    }
+    if (WriteFile(dir + "/vfs.cfg", cfg) < 0) return -1;
+
+    mkdir((share + "/db").c_str(), 0755);
+    for (i = 0; i < MB_DB_FILES; i++)
+        if (Touch(DbFile(i)) < 0) return -1;
+
+    for (n = 10; n <= 100000; n *= 100) {
+        snprintf(tmp, sizeof(tmp), "/deny_%d.cfg", n);
+        if (stat((dir + tmp).c_str(), &st) == 0 && st.st_size > 0) continue;
+        s = "";
+        for (i = 0; i < n; i++) {
+            snprintf(tmp, sizeof(tmp), "10.%d.%d.%d\n", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+            s += tmp;
+        }
+        snprintf(tmp, sizeof(tmp), "/deny_%d.cfg", n);
+        if (WriteFile(dir + tmp, s) < 0) return -1;
+    }
+    return 1;
+}
+
+
+static void Usage(const char * name) {
+    cout << "Pouziti: " << name << " [-w adresar] [-f filtr] [-t ms] [-P procesu] [-c] [-g] [-l]" << endl;
+    cout << "   -w <adresar>   pracovni adresar s daty (vychozi /tmp/microbench)" << endl;
+    cout << "   -f <filtr>     spusti jen benchmarky, jejichz jmeno obsahuje filtr" << endl;
+    cout << "   -t <ms>        jak dlouho nejmene ma trvat mereni jednoho benchmarku (vychozi 200)" << endl;
+    cout << "   -P <procesu>   nejvyssi pocet procesu pro benchmark databaze (vychozi 64)" << endl;
+    cout << "   -c             pouzije sdilenou cache stat() jako server" << endl;
+    cout << "   -g             jen pripravi data" << endl;
+    cout << "   -l             vypise jmena benchmarku" << endl;
+}
+
+
+int main(int argc, char ** argv) try {
+    string      filter;
+    char        cwd[MAX_PATH_LEN];
+    unsigned long long min_ns = 200000000ULL;
+    int         max_processes = MB_MAX_PROCESSES;
+    bool        generate_only = false;
+    bool        stat_cache = false;
+    bool        list_only = false;
+    int         zn;
+    int         op, p, i;
+
+    while ((zn = getopt(argc, argv, "w:f:t:P:cglh")) != -1) {
+        switch (zn) {
+            case 'w': dir    = optarg; break;
+            case 'f': filter = optarg; break;
+            case 't': min_ns = strtoull(optarg, 0, 10) * 1000000ULL; break;
+            case 'P': max_processes = atoi(optarg); break;
+            case 'c': stat_cache    = true; break;
+            case 'g': generate_only = true; break;
+            case 'l': list_only     = true; break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (min_ns == 0 || max_processes < 1 || max_processes > MB_MAX_PROCESSES) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    if (list_only) {
+        for (i = 0; benchmarks[i].name != 0; i++) cout << benchmarks[i].name << endl;
+        for (op = DB_PUT; op <= DB_DELETE; op++)
+            cout << "DirectoryDatabase::" << db_op_names[op] << "/procs:N" << endl;
+        return 0;
+    }
+
+    if (dir[0] != '/' && getcwd(cwd, sizeof(cwd)) != 0) dir = string(cwd) + "/" + dir;
+    if (CreateFixture() < 0) {
+        cerr << "Nepodarilo se pripravit data v " << dir << endl;
+        return 1;
+    }
+    if (generate_only) return 0;
+
+    if (stat_cache) {
+        if (StatCacheInit() < 0) {
+            cerr << "Nepodarilo se vytvorit cache stat()." << endl;
+            return 1;
+        }
+        StatCacheEnable(true);
+    }
+
+    vfs = new VFS((dir + "/vfs.cfg").c_str(), (dir + "/vfstable").c_str());
+
+    printf("%-40s %12s %15s\n", "benchmark", "opakovani", "cas");
+    for (i = 0; benchmarks[i].name != 0; i++)
+        if (filter == "" || string(benchmarks[i].name).find(filter) != string::npos)
+            RunBenchmark(benchmarks[i], min_ns);
+
+    //zaznamy se vlozi, prectou a smazou, takze tabulka je po kazdem kole
+    //prazdna; cteni a mazani potrebuji zaznamy, PutFileInfo se proto spusti
+    //vzdy s nimi
+    for (p = 1; p <= max_processes; p *= 2) {
+        bool selected[DB_DELETE + 1];
+
+        for (op = DB_PUT; op <= DB_DELETE; op++) {
+            snprintf(cwd, sizeof(cwd), "DirectoryDatabase::%s/procs:%d", db_op_names[op], p);
+            selected[op] = (filter == "" || string(cwd).find(filter) != string::npos);
+        }
+        if (selected[DB_GET] || selected[DB_DELETE]) selected[DB_PUT] = true;
+        for (op = DB_PUT; op <= DB_DELETE; op++)
+            if (selected[op]) RunDatabase(op, p);
+    }
+
+    delete vfs;
+    return 0;
+
+} catch (VFSError &x) {
+    cerr << "Chyba VFS: " << x.what() << endl;
+    return 1;
+} catch (DatabaseError &x) {
+    cerr << "Chyba databaze: " << x.what() << endl;
+    return 1;
+} catch (FileError &x) {
+    cerr << "Chyba pri praci se souborem: " << x.what() << endl;
+    return 1;
+}
@@ -8,7 +8,6 @@
 
 extern "C" {
 #include <errno.h>
-#include <gdbm.h>
 }
 
 #include <exception>
@@ -42,29 +41,21 @@ public:
 
 
 
-/** Trida vyjimky pro praci s GDBM.
- * Pouzije se v pripade, ze selze nejaka operace s databazi. Zjisti a
- * uschova v sobe dostupne informace o chybe. Je potreba dat pozor na
- * funkci vracejici popis chyby k jejimu kodu, pokud by se pouzivala
- * vlakna.
+/** Trida vyjimky pro praci s databazi (viz. DirectoryDatabase).
+ * Pouzije se v pripade, ze databazi nelze vytvorit nebo otevrit, pripadne
+ * soubor neobsahuje databazi. Krome popisu chyby nese i errno.
  */
-class GdbmError : public exception { 
+class DatabaseError : public exception { 
     int    num;
-    int    gdbm_err;
-    char * msg;
+    string msg;
     
 public:
-    /** Vyplni informace o chybe. */
-    GdbmError() {
-        msg      = gdbm_strerror(gdbm_errno);
-        num      = errno;
-        gdbm_err = gdbm_errno;
-    }
+    DatabaseError(const char * zprava, int i = -1) { msg = zprava; num = i; }
+    ~DatabaseError() throw() {} //pokud to tu neni, bouri se prekladac
     
     /** Predefinovani virtualni funkce zdedene po exception. */
-    char *what() { return msg; }
+    char *what() { return (char *)msg.c_str(); }
     int GetErrno() { return num;}
-    int GetGdbmErrno() { return gdbm_err; }
 }; 
 
 
@@ -10,6 +10,14 @@
  */
 
 #include "network.h"
+#include "trace.h"
+#include "pasvpool.h"
+
+extern "C" {
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <zlib.h>
+}
 
 //#define DEBUG
 #ifdef DEBUG
@@ -17,6 +25,53 @@
 #endif
 
 
+/* Stav komprese pro MODE Z. Pro kazde data connection se proud zacina znovu
+ * (viz. DataStreamBegin()), odesilatel ho musi ukoncit funkci FinishData(). */
+static z_stream zs_out;               //< komprese odesilanych dat
+static z_stream zs_in;                //< dekomprese prijimanych dat
+static bool     zs_out_init = false;  //< je zs_out inicializovany?
+static bool     zs_in_init  = false;  //< je zs_in inicializovany?
+static bool     zs_out_done = false;  //< proud uz byl ukoncen (Z_FINISH)
+static bool     zs_in_done  = false;  //< prijimany proud uz skoncil
+static char     z_out_buf[Z_BUF_SIZE];
+static char     z_in_buf[Z_BUF_SIZE];
+
+/* Pri odesilani muze byt komprimovany proud zaroven ukladan do cache souboru,
+ * aby se priste stejny soubor nemusel komprimovat znovu. */
+static int        zcache_fd = -1;     //< docasny cache soubor, nebo -1
+static string     zcache_tmp;         //< jmeno docasneho cache souboru
+static string     zcache_suffix;
+static CacheStamp zcache_stamp;
+
+/* Stav pro MODE B (RFC 959, block mode). Offset se pocita v prenasenych
+ * datech od mista, odkud prenos zacal (REST/RANG), takze znacky pro obnovu
+ * prenosu lze primo pouzit jako parametr prikazu REST. */
+static unsigned long long b_offset;        //< kolik dat uz bylo poslano/prijato
+static unsigned long long b_next_marker;   //< kdy poslat dalsi restart marker
+static int      b_in_remaining = 0;        //< kolik dat zbyva z prave cteneho bloku
+static int      b_in_desc      = 0;        //< deskriptor prave cteneho bloku
+static bool     b_in_eof       = false;    //< prisel blok s priznakem EOF
+static char     b_in_buf[Z_BUF_SIZE];      //< buffer pro cteni hlavicek a dat
+static int      b_in_pos = 0, b_in_len = 0;
+static char     b_out_buf[BLOCK_MAX_SIZE + 64]; //< pro TLS se bloky skladaji sem
+
+/* Pro metriky rychlosti prenosu (viz. DataStreamDone()) */
+static unsigned long long data_started;    //< kdy bylo navazano data connection (us)
+static unsigned long long data_bytes;      //< kolik dat (pred kompresi) se preneslo
+
+/* Pro log prenosu (viz. DataStreamLog()) */
+static string   data_file;                 //< prenaseny soubor, "" = nejde o prenos souboru (LIST)
+static bool     data_upload;
+static bool     data_open = false;         //< behem prikazu bylo navazano data connection
+static unsigned long long data_wall;       //< kdy bylo navazano (us od 1.1.1970)
+static unsigned long long data_ended;      //< kdy prisla prvni odpoved po navazani (us)
+static int      data_code;                 //< prvni odpoved po navazani (226, 426, ...)
+
+static int SendRawData(const char * data, int size);
+int SendSecureData(const char * data, int size);
+static int ReceiveRawData(char * data, int size);
+
+
 /** Cte pozadavek od klienta.
  *
  * Pokud je read prerusen signalem, zkousi cist znova.
@@ -148,6 +203,12 @@ int FTPReply(int code, const char * msg) {
 #ifdef DEBUG
     cout << getpid() << ": " << code << " " << msg << endl;
 #endif
+
+    //prvni odpoved po navazani data connection rika, jak prenos dopadl
+    if (data_open && data_code == 0 && code >= 200) {
+        data_code  = code;
+        data_ended = MetricsNow();
+    }
     
     ret = snprintf(cislo, 5, "%d", code);
     if (ret < 0) {
@@ -210,6 +271,153 @@ int FTPMultiReply(int code, const char * msg) {
 }
 
 
+/** Odesle klientovi jeden radek viceradkove odpovedi bez kodu.
+ *
+ * Pouziva se pro radky uvnitr viceradkove odpovedi, ktere nesmi zacinat
+ * kodem (napr. seznam rozsireni v odpovedi na FEAT, kazdy zacina mezerou).
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako SendReply()
+ *
+ */
+int FTPReplyLine(const char * line) {
+    string      odpoved;
+    int         ret;
+
+#ifdef DEBUG
+    cout << getpid() << ": " << line << endl;
+#endif
+
+    odpoved = line;
+    odpoved = odpoved + "\r\n"; // Pridame CR LF
+
+    if (secure_cc) ret = SendSecureReply(odpoved.c_str());
+        else ret = SendReply(odpoved.c_str());
+    if (ret < 0) return ret; else return 1;
+}
+
+
+/** Zahodi rozpracovany cache soubor s komprimovanymi daty.
+ *
+ * Vola se i po ABOR a pri ukonceni obsluhy klienta, aby po prerusenem
+ * prenosu nezustal v adresari cache docasny soubor.
+ *
+ */
+void ZCacheDiscard() {
+    if (zcache_fd == -1) return;
+    close(zcache_fd);
+    unlink(zcache_tmp.c_str());
+    zcache_fd = -1;
+}
+
+
+/** Pripravi stav pro nove data connection (MODE Z a MODE B).
+ *
+ * Pripadny zbytek stavu z predchoziho (napr. preruseneho) prenosu zahodi.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se inicializovat zlib
+ *
+ */
+static int DataStreamBegin() {
+    ZCacheDiscard();
+    zs_out_done = false;
+    zs_in_done  = false;
+
+    b_offset       = 0;
+    b_next_marker  = BLOCK_MARKER_INTERVAL;
+    b_in_remaining = 0;
+    b_in_desc      = 0;
+    b_in_eof       = false;
+    b_in_pos       = 0;
+    b_in_len       = 0;
+
+    if (transfer_mode != MODE_ZLIB) return 1;
+
+    //uroven komprese se mohla od minula zmenit, proto deflateInit() pokazde
+    if (zs_out_init) deflateEnd(&zs_out);
+    memset(&zs_out, 0, sizeof(zs_out));
+    zs_out_init = (deflateInit(&zs_out, mode_z_level) == Z_OK);
+
+    if (zs_in_init) inflateReset(&zs_in);
+    else {
+        memset(&zs_in, 0, sizeof(zs_in));
+        zs_in_init = (inflateInit(&zs_in) == Z_OK);
+    }
+
+    return (zs_out_init && zs_in_init) ? 1 : -1;
+}
+
+
+/** Nastavi offset, od ktereho prenos zacina (po REST nebo RANG).
+ *
+ * V MODE B se od nej pocitaji restart markery. Musi se zavolat po
+ * CreateDataConnection() a pred prenosem prvnich dat.
+ */
+void DataStreamOffset(unsigned long long offset) {
+    b_offset      = offset;
+    b_next_marker = offset + BLOCK_MARKER_INTERVAL;
+}
+
+
+/** Zapocita dokonceny prenos z/do sdileneho adresare share do metrik
+ * (mnozstvi dat a rychlost).
+ *
+ * Vola se po uspesnem prenosu, tesne pred odpovedi 226.
+ */
+void DataStreamDone(bool upload, const string &share) {
+    MetricsTransfer(upload, data_bytes, MetricsNow() - data_started, share);
+}
+
+
+/** Zapamatuje si, ktery soubor (fyzicke jmeno) se bude prenaset a kterym
+ * smerem - pro tabulku klientu a log prenosu.
+ *
+ * Vola se pred CreateDataConnection() v prikazech, ktere prenaseji soubor.
+ */
+void DataStreamFile(bool upload, const string &file) {
+    data_file   = file;
+    data_upload = upload;
+    SessionFile(upload, file);
+}
+
+
+/** Zapise do logu prenosu prenos souboru, ktery probehl behem prave
+ * obslouzeneho prikazu, pokud nejaky probehl. user a ip jsou prihlaseny
+ * uzivatel a adresa klienta.
+ *
+ * Vola se po kazdem prikazu. Zaznam se jen zkopiruje do fronty ve sdilene
+ * pameti (viz. XferLogAppend()).
+ */
+void DataStreamLog(const string &user, const char * ip) {
+    XferRecord  r;
+
+    if (data_open && data_file != "") {
+        memset(&r, 0, sizeof(r));
+        r.start     = data_wall;
+        r.usec      = ((data_code != 0) ? data_ended : MetricsNow()) - data_started;
+        r.bytes     = data_bytes;
+        r.pid       = getpid();
+        r.code      = data_code;
+        r.direction = data_upload ? 'i' : 'o';
+        r.type      = transfer_type;
+        r.mode      = transfer_mode;
+        r.tls       = secure_dc;
+        r.anonymous = (user == "anonymous");
+        strncpy(r.user, user.c_str(), MAX_USER_NAME_LEN - 1);
+        strncpy(r.ip, ip, XFERLOG_IP_LEN - 1);
+        strncpy(r.file, data_file.c_str(), XFERLOG_FILE_LEN - 1);
+        XferLogAppend(r);
+    }
+
+    data_open = false;
+    data_file = "";
+}
+
+
 /** Funkce vytvarejici data connection.
  * 
  * Jakym zpusobem funkce vytvori data connection zavisi na globalni promenne
@@ -226,17 +434,19 @@ int FTPMultiReply(int code, const char * msg) {
 int CreateDataConnection() {
     int                 ret;
     int                 _errno;
-    int                 delka;
-    struct sockaddr_in  tmp; //snad nebudeme potrebovat a nechceme si prepsat client_data_addr ...
+    struct sockaddr_storage tmp; //snad nebudeme potrebovat a nechceme si prepsat client_data_addr ...
+    unsigned long long  start = MetricsNow();
+    TraceSpan           span("data connection", "net");
 
     if (!passive) { // jsme aktivni, budeme se pripojovat
-        client_data_socket = socket(PF_INET, SOCK_STREAM, 0);
+        client_data_socket = socket(client_data_address.ss_family, SOCK_STREAM, 0);
         if (client_data_socket == -1) return -1;
 
         ret = FTPReply(150,"Ok, about to open data connection.");
         if (ret < 0) return ret;
 
-        ret = connect(client_data_socket,(struct sockaddr *)&client_data_address, sizeof(client_data_address));
+        ret = connect(client_data_socket,(struct sockaddr *)&client_data_address,
+                      (client_data_address.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
         if (ret == -1) {
             _errno = errno;
 #ifdef DEBUG
@@ -263,25 +473,26 @@ int CreateDataConnection() {
             }
         }//if secure data connection
     } else { // jsme v pasivnim modu, cekame na spojeni
-	do {
-            client_data_socket = accept(server_data_socket, (struct sockaddr *)&tmp, (socklen_t *)&delka);
-        } while (client_data_socket == -1 && errno == EINTR);
+        client_data_socket = PasvAccept(server_data_socket, tmp);
+        _errno = errno;
         
+        // kopie poslouchajiciho socketu uz neni potreba (viz. pasvpool.cpp)
+        close(server_data_socket);
         passive = false;
         
         if (client_data_socket == -1) {
-            _errno = errno;
 #ifdef DEBUG
+            errno = _errno;
             perror("CreateDataConnection():accept");
 #endif
             FTPReply(425,"Ooops, can't open data connection.");
-            close(server_data_socket); 
 
             switch (_errno) {
                 case ENOMEM: return -4;
                 case ENOTSOCK: return -2;
                 case EBADF: return -2;
 		case EOPNOTSUPP: return -1;
+                case ETIMEDOUT: return -8;
                 default: return -1;
             }
         }// if client_data_socket == -1
@@ -293,12 +504,24 @@ int CreateDataConnection() {
         if (secure_dc) {
             ret = TLSDataNeg();   
             if (ret < 0) {
-                close(server_data_socket);
                 FTPReply(522,"TLS negotiation for data connection failed.");
                 return -20;
             }
         }//if secure data connection
     }
+
+    data_started = MetricsNow();
+    data_bytes   = 0;
+    MetricsRecord(METRIC_DATA_CONNECT, data_started - start);
+    SessionTransferStart();
+
+    struct timeval now;
+    gettimeofday(&now, 0);
+    data_wall = (unsigned long long)now.tv_sec * 1000000 + now.tv_usec;
+    data_open = true;
+    data_code = 0;
+
+    DataStreamBegin();
     return 1;
 }
 
@@ -335,6 +558,8 @@ int SendSecureDataLine(const char * data) {
 int SendDataLine(const char * data) {
     int         ret;
     
+    if (transfer_mode == MODE_ZLIB || transfer_mode == MODE_BLOCK) return SendData(data, strlen(data));
+
     if (secure_dc) {
         ret = SendSecureDataLine(data);
         return ret;
@@ -381,7 +606,7 @@ int SendSecureData(const char * data, int size) {
 }
 
 
-/** Funkce posilajici data po data connection.
+/** Posila data po data connection tak, jak jsou (bez komprese).
  *
  * V data musi byt ulozeno size znaku.
  * Automaticky se podle promenne secure_dc rozhodne, jestli posilat data
@@ -395,7 +620,7 @@ int SendSecureData(const char * data, int size) {
  *      - -3      klient ukoncil spojeni
  *
  */
-int SendData(const char * data, int size) {
+static int SendRawData(const char * data, int size) {
     int         ret;
     
     
@@ -425,6 +650,256 @@ int SendData(const char * data, int size) {
 }
 
 
+/** Zkomprimuje data a posle je po data connection (MODE Z).
+ *
+ * Pri flush == Z_FINISH zaroven ukonci komprimovany proud.
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako SendData()
+ *
+ */
+static int SendZData(const char * data, int size, int flush) {
+    int         ret;
+    int         zret;
+    int         n;
+
+    if (!zs_out_init || zs_out_done) return -1;
+
+    zs_out.next_in  = (Bytef *)data;
+    zs_out.avail_in = size;
+    do {
+        zs_out.next_out  = (Bytef *)z_out_buf;
+        zs_out.avail_out = Z_BUF_SIZE;
+        zret = deflate(&zs_out, flush);
+        if (zret == Z_STREAM_ERROR) return -1;
+
+        n = Z_BUF_SIZE - zs_out.avail_out;
+        if (n > 0) {
+            ret = SendRawData(z_out_buf, n);
+            if (ret < 0) return ret;
+
+            //kdyz se nepovede zapis do cache, prenos kvuli tomu nerusime
+            if (zcache_fd != -1 && CacheWrite(zcache_fd, z_out_buf, n) < 0) ZCacheDiscard();
+        }
+    } while (zs_out.avail_out == 0 || (flush == Z_FINISH && zret != Z_STREAM_END));
+
+    if (flush == Z_FINISH) zs_out_done = true;
+    return 1;
+}
+
+
+/** Posle po data connection nekolik kusu dat najednou (writev()).
+ *
+ * Pri sifrovanem spojeni se data nejdriv slozi do jednoho bufferu, aby se
+ * poslala jednim BIO_write().
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako SendData()
+ *
+ */
+static int SendRawDataV(struct iovec * iov, int count) {
+    int         ret;
+    int         i;
+    int         size = 0;
+
+    if (secure_dc) {
+        for (i = 0; i < count; i++) {
+            memcpy(b_out_buf + size, iov[i].iov_base, iov[i].iov_len);
+            size += iov[i].iov_len;
+        }
+        return SendSecureData(b_out_buf, size);
+    }
+
+    while (count > 0) {
+        ret = writev(client_data_socket, iov, count);
+        if (ret == -1 && errno == EINTR) continue; //pokud nas prerusil signal, zapiseme data znovu
+        if (ret == -1)
+            switch (errno) {
+                case EBADF: return -2; // spatny deskriptor
+                case EPIPE: return -3; // klient ukoncil spojeni
+                default: return -1; //jina chyba;                    
+            }//switch
+
+        //writev nemusel zapsat vsechno, preskocime to, co uz odeslo
+        while (count > 0 && (unsigned int)ret >= iov[0].iov_len) {
+            ret -= iov[0].iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov[0].iov_base = (char *)iov[0].iov_base + ret;
+            iov[0].iov_len -= ret;
+        }
+    }
+
+    return 1;
+}
+
+
+/** Posle data v MODE B.
+ *
+ * Kazdy blok ma tri bajty hlavicky (deskriptor a delku), ktere se posilaji
+ * spolu s daty jednim writev(). Vzdy po BLOCK_MARKER_INTERVAL bytech se za
+ * datovy blok prida blok s restart markerem - markerem je offset v
+ * prenasenych datech zapsany desitkove, klient ho muze rovnou pouzit v REST.
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako SendData()
+ *
+ */
+static int SendBlockData(const char * data, int size) {
+    struct iovec    iov[4];
+    unsigned char   header[3];
+    unsigned char   marker_header[3];
+    char            marker[30];
+    int             count;
+    int             n;
+    int             ret;
+
+    while (size > 0) {
+        n = (size > BLOCK_MAX_SIZE) ? BLOCK_MAX_SIZE : size;
+
+        header[0] = 0;
+        header[1] = (n >> 8) & 0xff;
+        header[2] =  n       & 0xff;
+        iov[0].iov_base = header;
+        iov[0].iov_len  = 3;
+        iov[1].iov_base = (void *)data;
+        iov[1].iov_len  = n;
+        count = 2;
+
+        b_offset += n;
+        if (b_offset >= b_next_marker) {
+            ret = snprintf(marker, 30, "%llu", b_offset);
+            marker_header[0] = BLOCK_RESTART;
+            marker_header[1] = 0;
+            marker_header[2] = ret;
+            iov[2].iov_base = marker_header;
+            iov[2].iov_len  = 3;
+            iov[3].iov_base = marker;
+            iov[3].iov_len  = ret;
+            count = 4;
+            b_next_marker = b_offset + BLOCK_MARKER_INTERVAL;
+        }
+
+        ret = SendRawDataV(iov, count);
+        if (ret < 0) return ret;
+
+        data += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+
+/** Funkce posilajici data po data connection.
+ *
+ * V data musi byt ulozeno size znaku.
+ * Automaticky se podle promenne secure_dc rozhodne, jestli posilat data
+ * sifrovane nebo normalne, a podle transfer_mode, jestli je komprimovat
+ * (MODE Z) nebo rozdelit do bloku (MODE B).
+ * 
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK.
+ *      - -1      jina chyba
+ *      - -2      spatny deskriptor
+ *      - -3      klient ukoncil spojeni
+ *
+ */
+int SendData(const char * data, int size) {
+    data_bytes += size;
+    SessionBytes(data_bytes);
+    if (transfer_mode == MODE_ZLIB) return SendZData(data, size, Z_NO_FLUSH);
+    if (transfer_mode == MODE_BLOCK) return SendBlockData(data, size);
+    return SendRawData(data, size);
+}
+
+
+/** Posle data, ktera uz jsou zkomprimovana (MODE Z), napr. z cache.
+ *
+ * Data musi tvorit cely komprimovany proud vcetne jeho ukonceni - proud se
+ * oznaci jako ukonceny a FinishData() uz nic neposle.
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako SendData()
+ *
+ */
+int SendCompressedStream(const char * data, int size) {
+    data_bytes += size;
+    SessionBytes(data_bytes);
+    zs_out_done = true;
+    ZCacheDiscard();
+    return SendRawData(data, size);
+}
+
+
+/** Dokonci odesilani dat po data connection.
+ *
+ * V MODE Z posle konec komprimovaneho proudu a pripadne ulozi komprimovana
+ * data do cache (viz. ZCacheStart()), v MODE B posle blok s priznakem EOF.
+ * Musi se zavolat po odeslani vsech dat a pred odpovedi 226. V MODE S
+ * nedela nic.
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako SendData()
+ *
+ */
+int FinishData() {
+    int         ret;
+
+    if (transfer_mode == MODE_BLOCK) {
+        //prazdny blok s priznakem EOF
+        const char eof[3] = { BLOCK_EOF, 0, 0 };
+        return SendRawData(eof, 3);
+    }
+
+    if (transfer_mode != MODE_ZLIB || zs_out_done) return 1;
+
+    ret = SendZData("", 0, Z_FINISH);
+    if (ret < 0) {
+        ZCacheDiscard();
+        return ret;
+    }
+
+    if (zcache_fd != -1) {
+        CacheCommit(zcache_fd, zcache_stamp, zcache_suffix.c_str(), zcache_tmp);
+        zcache_fd = -1;
+    }
+    return 1;
+}
+
+
+/** Zacne ukladat komprimovana data odesilana v tomto prenosu do cache.
+ *
+ * Musi se zavolat po CreateDataConnection() a pred odeslanim prvnich dat.
+ * Cache soubor se ulozi jen tehdy, pokud FinishData() ukonci proud v poradku.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      cache soubor nelze vytvorit
+ *
+ */
+int ZCacheStart(CacheStamp &stamp, const char * suffix) {
+    ZCacheDiscard();
+    if (transfer_mode != MODE_ZLIB) return -1;
+
+    zcache_fd = CacheCreate(stamp, suffix, zcache_tmp);
+    if (zcache_fd == -1) return -1;
+
+    zcache_stamp  = stamp;
+    zcache_suffix = suffix;
+    return 1;
+}
+
+
 /** TLS/SSL verze funkce ReceiveData().
  *
  */
@@ -451,7 +926,7 @@ int ReceiveSecureData(char * data, int size) {
     return ret;    
 }
 
-/** Funkce prijimajici data po data connection.
+/** Prijima data po data connection tak, jak prisla (bez dekomprese).
  *
  * V promenne data musi byt ulozeno size znaku. Automaticky se podle promenne
  * secure_dc rozhodne, jestli prijimat data sifrovane nebo ne.
@@ -464,7 +939,7 @@ int ReceiveSecureData(char * data, int size) {
  *      - -2                    spatny deskriptor
  *
  */
-int ReceiveData(char * data, int size) {
+static int ReceiveRawData(char * data, int size) {
     int         ret;
 
     if (secure_dc) {
@@ -487,4 +962,155 @@ int ReceiveData(char * data, int size) {
 }
 
 
+/** Prijme a rozbali data komprimovana v MODE Z.
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako ReceiveData(), pokud spojeni skonci driv nez komprimovany
+ * proud, vrati -1
+ *
+ */
+static int ReceiveZData(char * data, int size) {
+    int         ret;
+    int         zret;
+
+    if (!zs_in_init) return -1;
+    if (zs_in_done) return 0;
+
+    zs_in.next_out  = (Bytef *)data;
+    zs_in.avail_out = size;
+    while (zs_in.avail_out == (unsigned int)size) {
+        if (zs_in.avail_in == 0) {
+            ret = ReceiveRawData(z_in_buf, Z_BUF_SIZE);
+            if (ret <= 0) return (ret == 0) ? -1 : ret; //proud nebyl ukoncen
+            zs_in.next_in  = (Bytef *)z_in_buf;
+            zs_in.avail_in = ret;
+        }
+
+        zret = inflate(&zs_in, Z_NO_FLUSH);
+        if (zret == Z_STREAM_END) {
+            zs_in_done = true;
+            break;
+        }
+        if (zret != Z_OK && zret != Z_BUF_ERROR) return -1;
+    }
+
+    return size - zs_in.avail_out;
+}
+
+
+/** Precte z data connection az size bytu pres buffer b_in_buf (MODE B).
+ *
+ * Vrati pocet prectenych bytu, 0 na konci spojeni, zaporne cislo pri chybe.
+ */
+static int BlockRead(char * data, int size) {
+    int         ret;
+
+    if (b_in_pos == b_in_len) {
+        ret = ReceiveRawData(b_in_buf, Z_BUF_SIZE);
+        if (ret <= 0) return ret;
+        b_in_pos = 0;
+        b_in_len = ret;
+    }
+
+    if (size > b_in_len - b_in_pos) size = b_in_len - b_in_pos;
+    memcpy(data, b_in_buf + b_in_pos, size);
+    b_in_pos += size;
+    return size;
+}
+
+
+/** Precte z data connection presne size bytu (MODE B).
+ *
+ * Vrati 1, pokud se to povede, jinak -1 (chyba nebo konec spojeni).
+ */
+static int BlockReadAll(char * data, int size) {
+    int         ret;
+
+    while (size > 0) {
+        ret = BlockRead(data, size);
+        if (ret <= 0) return -1;
+        data += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+
+/** Prijme data poslana v MODE B.
+ *
+ * Cte hlavicky bloku a vraci jen jejich data. Na blok s restart markerem
+ * odpovi klientovi "110 MARK <marker> = <offset>", kde offset je pocet
+ * dosud prijatych bytu - ten muze klient pouzit v REST pri obnove prenosu.
+ *
+ * Navratove hodnoty:
+ *
+ * stejne jako ReceiveData(), pokud spojeni skonci bez bloku s priznakem
+ * EOF, vrati -1
+ *
+ */
+static int ReceiveBlockData(char * data, int size) {
+    unsigned char   header[3];
+    char            marker[BLOCK_MAX_SIZE + 1];
+    string          s;
+    char            offset[30];
+    int             ret;
+
+    while (b_in_remaining == 0) {
+        if (b_in_eof) return 0;
+
+        if (BlockReadAll((char *)header, 3) < 0) return -1; //spojeni skoncilo bez EOF
+        b_in_desc      = header[0];
+        b_in_remaining = (header[1] << 8) | header[2];
+        if (b_in_desc & BLOCK_EOF) b_in_eof = true;
+
+        if (b_in_desc & BLOCK_RESTART) {
+            if (BlockReadAll(marker, b_in_remaining) < 0) return -1;
+            marker[b_in_remaining] = 0;
+            b_in_remaining = 0;
+
+            snprintf(offset, 30, "%llu", b_offset);
+            s = "MARK ";
+            s = s + marker + " = " + offset;
+            ret = FTPReply(110, s.c_str());
+            if (ret < 0) return -1;
+        }
+    }
+
+    if (size > b_in_remaining) size = b_in_remaining;
+    ret = BlockRead(data, size);
+    if (ret <= 0) return -1;
+
+    b_in_remaining -= ret;
+    b_offset       += ret;
+    return ret;
+}
+
+
+/** Funkce prijimajici data po data connection.
+ *
+ * V promenne data musi byt ulozeno size znaku. Automaticky se podle promenne
+ * secure_dc rozhodne, jestli prijimat data sifrovane nebo ne, a podle
+ * transfer_mode, jestli je rozbalovat (MODE Z) nebo skladat z bloku
+ * (MODE B).
+ * 
+ * Navratove hodnoty:
+ *
+ *      -  kladna hodnota       pocet prectenych bytu
+ *      -  0                    "konec souboru"
+ *      - -1                    jina chyba
+ *      - -2                    spatny deskriptor
+ *
+ */
+int ReceiveData(char * data, int size) {
+    int ret;
 
+    if (transfer_mode == MODE_ZLIB) ret = ReceiveZData(data, size);
+        else if (transfer_mode == MODE_BLOCK) ret = ReceiveBlockData(data, size);
+        else ret = ReceiveRawData(data, size);
+    if (ret > 0) {
+        data_bytes += ret;
+        SessionBytes(data_bytes);
+    }
+    return ret;
+}
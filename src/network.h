@@ -25,6 +25,10 @@ extern "C" {
 #include <string>
 
 #include "security.h"
+#include "cache.h"
+#include "metrics.h"
+#include "sessions.h"
+#include "xferlog.h"
 
 using namespace std;
 
@@ -32,12 +36,13 @@ using namespace std;
 extern int server_data_socket; //pouziva ho fpasv
 extern int client_data_socket;
 extern int client_socket; //< soket pro control connection
-extern struct sockaddr_in client_data_address;
+extern struct sockaddr_storage client_data_address;
 extern bool passive;
 extern char transfer_type;  //< pro type command, implicitne ASCII
 extern char transfer_typep; //< parametr transfer type, implicitne Non-print
 extern char transfer_mode;  //< pro mode command, implicitne Stream
 extern char file_structure; //< pro stru command, implicitne File
+extern int  mode_z_level;   //< uroven komprese pro MODE Z
 extern bool secure_cc; //< pouzivat sifrovane control connection?
 extern bool secure_dc; //< pouzivat sifrovane data connection?
 extern int server_default_data_port;
@@ -55,13 +60,36 @@ int ClientRequest(string &req);
 int ClientSecureRequest(string &req);
 int FTPReply(int code, const char * msg);
 int FTPMultiReply(int code, const char * msg);
+int FTPReplyLine(const char * line);
 int CreateDataConnection();
 int SendDataLine(const char * data);
 int SendData(const char * data, int size);
+int SendCompressedStream(const char * data, int size);
+int FinishData();
+void DataStreamOffset(unsigned long long offset);
+void DataStreamDone(bool upload, const string &share);
+void DataStreamFile(bool upload, const string &file);
+void DataStreamLog(const string &user, const char * ip);
+int ZCacheStart(CacheStamp &stamp, const char * suffix);
+void ZCacheDiscard();
 int ReceiveData(char * data, int size);
 
 
 
+#define MODE_STREAM 'S'
+#define MODE_BLOCK  'B'
+#define MODE_COMPRESSED 'C'
+#define MODE_ZLIB   'Z' //< MODE Z - data se posilaji komprimovana zlibem (deflate)
+
+#define BLOCK_EOR       128 //< deskriptor bloku v MODE B: konec zaznamu
+#define BLOCK_EOF       64  //< deskriptor bloku v MODE B: konec souboru
+#define BLOCK_ERRORS    32  //< deskriptor bloku v MODE B: data mohou byt poskozena
+#define BLOCK_RESTART   16  //< deskriptor bloku v MODE B: blok obsahuje restart marker
+#define BLOCK_MAX_SIZE  65535 //< nejvetsi delka dat v jednom bloku
+#define BLOCK_MARKER_INTERVAL (16*1024*1024ULL) //< jak casto posilat restart markery
+#define Z_BUF_SIZE  (64*1024) //< velikost bufferu pro komprimovana data
+#define ZCACHE_MIN_SIZE (64*1024) //< mensi soubory se v MODE Z do cache neukladaji
+
 #define MAX_CLIENT_REPLY_LEN 1024 //musi byt velke c. (delka cesty k souboru + jmena souboru ...)
 
 #endif //__network_h
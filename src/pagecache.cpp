@@ -0,0 +1,143 @@
+/** @file pagecache.cpp
+ *  \brief Implementace rad jadru pro page cache pri cteni souboru.
+ *
+ * RETR cte soubor sekvencne od zacatku do konce. Jadru se to oznami
+ * (POSIX_FADV_SEQUENTIAL) a navic se mu prubezne rika, co bude potreba
+ * nacist dopredu (POSIX_FADV_WILLNEED) - okno odpovida tomu, kolik dat klient
+ * stahne za STREAM_WINDOW_MSEC, takze rychly klient neceka na disk a pomaly
+ * nezabira page cache daty, ktera si stahne az za dlouho.
+ *    Velky soubor stazeny jednou by z page cache vytlacil male casto
+ * stahovane soubory. Podle nastaveni sdileneho adresare ve vfs.cfg (viz.
+ * CACHE_POLICY_NORMAL, _HOT a _ARCHIVE) se proto za ctenim page cache
+ * uvolnuje (POSIX_FADV_DONTNEED). Pri CACHE_POLICY_NORMAL jen u souboru od
+ * STREAM_DROP_MIN_SIZE a jen pokud zacatek souboru v page cache jeste neni -
+ * jinak ho nejspis prave stahuje nekdo dalsi a uvolnenim bychom mu jen
+ * pridali cteni z disku.
+ *
+ */
+
+#include "pagecache.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+}
+
+
+/** Vrati aktualni cas v sekundach.
+ *
+ */
+static double Now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/** Zjisti, jestli je zacatek souboru fd od offset (aspon z poloviny) v page
+ * cache.
+ *
+ */
+static bool Resident(int fd, off_t offset, off_t size) {
+    long            page = sysconf(_SC_PAGESIZE);
+    size_t          len;
+    size_t          n;
+    size_t          i;
+    size_t          in = 0;
+    unsigned char   vec[STREAM_PROBE_SIZE / 4096 + 1];
+    void          * p;
+
+    offset -= offset % page;
+    if (offset >= size) return false;
+    len = size - offset;
+    if (len > STREAM_PROBE_SIZE) len = STREAM_PROBE_SIZE;
+    n = (len + page - 1) / page;
+    if (n > sizeof(vec)) n = sizeof(vec);
+
+    p = mmap(0, len, PROT_READ, MAP_SHARED, fd, offset);
+    if (p == MAP_FAILED) return false;
+    if (mincore(p, len, vec) == 0)
+        for (i = 0; i < n; i++) if (vec[i] & 1) in++;
+    munmap(p, len);
+
+    return in * 2 > n;
+}
+
+
+/** Zacne cteni souboru fd od offset s nastavenim sdileneho adresare policy.
+ *
+ */
+void PageCacheStart(PageCacheStream &s, int fd, int policy, off_t offset) {
+    struct stat st;
+
+    memset(&s, 0, sizeof(s));
+    s.fd      = fd;
+    s.start   = offset;
+    s.pos     = offset;
+    s.dropped = offset;
+    s.window  = STREAM_WINDOW_MIN;
+    s.started = Now();
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, offset, s.window, POSIX_FADV_WILLNEED);
+    s.ahead = offset + s.window;
+
+    if (policy == CACHE_POLICY_ARCHIVE) s.drop = true;
+    else if (policy == CACHE_POLICY_NORMAL && fstat(fd, &st) == 0 && st.st_size >= STREAM_DROP_MIN_SIZE)
+        s.drop = !Resident(fd, offset, st.st_size);
+}
+
+
+/** Zapocita dalsich bytes prectenych bytu - pripadne necha jadro nacist
+ * dalsi okno a uvolni page cache za ctenim.
+ *
+ */
+void PageCacheAdvance(PageCacheStream &s, off_t bytes) {
+    double  elapsed;
+    off_t   window;
+
+    s.pos += bytes;
+
+    //dalsi okno zadame, kdyz se dostaneme do poloviny predchoziho
+    if (s.pos + s.window / 2 >= s.ahead) {
+        elapsed = Now() - s.started;
+        window  = (elapsed > 0) ? (off_t)((s.pos - s.start) / elapsed * STREAM_WINDOW_MSEC / 1000) : STREAM_WINDOW_MAX;
+        if (window < STREAM_WINDOW_MIN) window = STREAM_WINDOW_MIN;
+        if (window > STREAM_WINDOW_MAX) window = STREAM_WINDOW_MAX;
+        s.window = window;
+
+        if (s.ahead < s.pos) s.ahead = s.pos;
+        posix_fadvise(s.fd, s.ahead, window, POSIX_FADV_WILLNEED);
+        s.ahead += window;
+    }
+
+    if (s.drop && s.pos - s.dropped >= STREAM_DROP_CHUNK) {
+        posix_fadvise(s.fd, s.dropped, s.pos - s.dropped, POSIX_FADV_DONTNEED);
+        s.dropped = s.pos;
+    }
+}
+
+
+/** Ukonci cteni souboru - uvolni page cache za zbytkem prectenych dat.
+ *
+ */
+void PageCacheEnd(PageCacheStream &s) {
+    if (s.drop && s.pos > s.dropped) posix_fadvise(s.fd, s.dropped, 0, POSIX_FADV_DONTNEED);
+    s.drop = false;
+}
+
+
+/** Prevede jmeno nastaveni page cache z vfs.cfg na CACHE_POLICY_*.
+ *
+ * Vrati -1, pokud jmeno nezna.
+ */
+int CachePolicyFromName(const char * name) {
+    if (strcasecmp(name, "normal") == 0)  return CACHE_POLICY_NORMAL;
+    if (strcasecmp(name, "hot") == 0)     return CACHE_POLICY_HOT;
+    if (strcasecmp(name, "archive") == 0) return CACHE_POLICY_ARCHIVE;
+    return -1;
+}
@@ -0,0 +1,48 @@
+/** @file pagecache.h
+ *  \brief Deklarace funkci, ktere radi jadru, jak zachazet s page cache pri
+ *  cteni souboru (prikaz RETR).
+ *
+ */
+
+#ifndef __pagecache_h
+#define __pagecache_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#define CACHE_POLICY_NORMAL  0 //< velke soubory po sobe uvolni page cache, pokud je necte nikdo jiny
+#define CACHE_POLICY_HOT     1 //< soubory zustavaji v page cache
+#define CACHE_POLICY_ARCHIVE 2 //< kazdy prenos po sobe uvolni page cache
+
+#define STREAM_BUF_SIZE      (256*1024)         //< velikost bufferu stdio pro cteni souboru
+#define STREAM_WINDOW_MIN    (512*1024)         //< nejmensi okno, ktere se nacita dopredu
+#define STREAM_WINDOW_MAX    (32*1024*1024)     //< nejvetsi okno, ktere se nacita dopredu
+#define STREAM_WINDOW_MSEC   1000               //< okno odpovida tomu, co klient stihne stahnout za tuto dobu
+#define STREAM_DROP_MIN_SIZE (128*1024*1024)    //< od jake velikosti se pri CACHE_POLICY_NORMAL uvolnuje page cache
+#define STREAM_DROP_CHUNK    (8*1024*1024)      //< po kolika prectenych bytech se page cache uvolnuje
+#define STREAM_PROBE_SIZE    (1024*1024)        //< jak velky zacatek souboru se kontroluje, jestli uz je v page cache
+
+
+/** Stav cteni jednoho souboru.
+ *
+ */
+struct PageCacheStream {
+    int                 fd;
+    bool                drop;       ///< uvolnovat page cache za ctenim
+    off_t               start;      ///< odkud se zacalo cist
+    off_t               pos;        ///< kolik uz je precteno
+    off_t               ahead;      ///< do kama uz jadro dostalo pokyn nacist data dopredu
+    off_t               dropped;    ///< do kama uz je page cache uvolnena
+    off_t               window;     ///< aktualni velikost okna
+    double              started;    ///< kdy cteni zacalo (v sekundach)
+};
+
+
+void PageCacheStart(PageCacheStream &s, int fd, int policy, off_t offset);
+void PageCacheAdvance(PageCacheStream &s, off_t bytes);
+void PageCacheEnd(PageCacheStream &s);
+int  CachePolicyFromName(const char * name);
+
+#endif //__pagecache_h
@@ -0,0 +1,228 @@
+/** @file pasvpool.cpp
+ *  \brief Pasivni data connection.
+ *
+ * Drive fpasv() pri kazdem PASV vytvoril novy socket, nechal si pridelit
+ * nahodny port a po prenosu socket zase zavrel. Ted si proces obsluhujici
+ * klienta pri prvnim PASV vybere port z rozsahu pasv_port_min az
+ * pasv_port_max (prepinac -P, jinak libovolny volny port), socket na nem
+ * nechava poslouchat az do konce obsluhy a kazde dalsi PASV dostane jen jeho
+ * kopii (dup()). Ostatni funkce tak mohou server_data_socket po prenosu
+ * zavrit jako driv a poslouchajici socket se pritom nezavre. Rozsah -P tak
+ * omezuje pocet soucasne prihlasenych klientu, kteri pouzivaji PASV, ne
+ * jen tech, kteri prave prenaseji data.
+ *    Ktery port je volny, rozhoduje jadro - bind(), nebo listen() na portu,
+ * na kterem uz posloucha jiny proces serveru, selze s EADDRINUSE a zkusi se
+ * dalsi port. Aby procesy nezkousely porty vsechny od zacatku rozsahu,
+ * zacina kazdy na miste danem svym PID.
+ *    Socket ma stejnou rodinu adres jako control connection - klient
+ * pripojeny pres IPv6 dostane IPv6 socket (u IPv4 klientu pripojenych pres
+ * dual-stack socket serveru prijima i IPv4 spojeni).
+ *    PasvAccept() ceka na spojeni nejdele PASV_ACCEPT_TIMEOUT sekund a
+ * prijme jen spojeni z adresy, ze ktere je klient pripojeny na control
+ * connection; ostatni spojeni hned zavre.
+ *
+ */
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <string.h>
+#include <sys/stat.h>
+}
+
+#include "pasvpool.h"
+
+extern int client_socket; //< soket pro control connection
+extern bool run;
+extern bool ftp_abort;
+
+
+static int  listen_socket = -1; //< poslouchajici socket obsluhy, -1 = zatim zadny
+static int  listen_port   = 0;
+
+
+/** Vytvori poslouchajici socket obsluhy.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, socket je v listen_socket
+ *      - -1      chyba (errno), EADDRINUSE = vsechny porty rozsahu jsou obsazene
+ *
+ */
+static int PasvBind() {
+    struct sockaddr_storage addr;
+    socklen_t               delka = sizeof(addr);
+    int                     family;
+    int                     range;
+    int                     first;
+    int                     port;
+    int                     i;
+    int                     yes = 1;
+    int                     no  = 0;
+    int                     sock;
+
+    if (getsockname(client_socket, (struct sockaddr *)&addr, &delka) == -1) return -1;
+    family = addr.ss_family;
+
+    range = (pasv_port_min > 0) ? pasv_port_max - pasv_port_min + 1 : 1;
+    first = getpid() % range;
+
+    for (i = 0; i < range; i++) {
+        sock = socket(family, SOCK_STREAM, 0);
+        if (sock == -1) return -1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        port = (pasv_port_min > 0) ? htons(pasv_port_min + (first + i) % range) : 0;
+        memset(&addr, 0, sizeof(addr));
+        if (family == AF_INET6) {
+            setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+            ((struct sockaddr_in6 *)&addr)->sin6_family = AF_INET6;
+            ((struct sockaddr_in6 *)&addr)->sin6_addr   = in6addr_any;
+            ((struct sockaddr_in6 *)&addr)->sin6_port   = port;
+            delka = sizeof(struct sockaddr_in6);
+        } else {
+            ((struct sockaddr_in *)&addr)->sin_family      = AF_INET;
+            ((struct sockaddr_in *)&addr)->sin_addr.s_addr = htonl(INADDR_ANY);
+            ((struct sockaddr_in *)&addr)->sin_port        = port;
+            delka = sizeof(struct sockaddr_in);
+        }
+
+        if (bind(sock, (struct sockaddr *)&addr, delka) == 0 && listen(sock, PASV_BACKLOG) == 0) break;
+
+        close(sock);
+        if (errno != EADDRINUSE) return -1;
+    }
+    if (i == range) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+
+    delka = sizeof(addr);
+    if (getsockname(sock, (struct sockaddr *)&addr, &delka) == -1) {
+        close(sock);
+        return -1;
+    }
+    //accept() az po poll(), aby ho spojeni zrusene mezi tim nezablokovalo
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    listen_socket = sock;
+    listen_port   = ntohs((family == AF_INET6) ? ((struct sockaddr_in6 *)&addr)->sin6_port
+                                               : ((struct sockaddr_in *)&addr)->sin_port);
+    return 1;
+}
+
+
+/** Vrati kopii poslouchajiciho socketu obsluhy (pri prvnim volani ho
+ * vytvori), do port zapise jeho port. Kopii je treba po prenosu zavrit.
+ *
+ * Spojeni, ktera cekaji ve fronte z predchoziho PASV (klient se pripojil,
+ * ale prikaz pro prenos skoncil chybou), se zavrou, jinak by je prijal
+ * pristi prenos.
+ *
+ * Navratove hodnoty:
+ *
+ *      - >= 0    socket
+ *      - -1      chyba (errno), EADDRINUSE = v rozsahu neni volny port
+ *
+ */
+int PasvListen(int &port) {
+    int     fd;
+
+    if (listen_socket == -1 && PasvBind() == -1) return -1;
+
+    while ((fd = accept(listen_socket, NULL, NULL)) != -1) close(fd);
+
+    port = listen_port;
+    return dup(listen_socket);
+}
+
+
+/** Zavre kopii poslouchajiciho socketu z predchoziho PASV, ktere klient
+ * nepouzil. Chybove vetve prikazu kopii zaviraji, ale passive nechavaji
+ * nastavene, proto se sock zavre jen tehdy, kdyz je to porad kopie
+ * poslouchajiciho socketu (stejny inode) - cislo deskriptoru uz mezitim mohl
+ * dostat jiny soubor.
+ *
+ */
+void PasvRelease(int sock) {
+    struct stat a, b;
+
+    if (listen_socket == -1 || sock == listen_socket) return;
+    if (fstat(sock, &a) == -1 || fstat(listen_socket, &b) == -1) return;
+    if (a.st_dev == b.st_dev && a.st_ino == b.st_ino) close(sock);
+}
+
+
+/** Zjisti, jestli jsou a a b adresy stejneho pocitace (porty neporovnava).
+ *
+ */
+static bool SameHost(const struct sockaddr_storage &a, const struct sockaddr_storage &b) {
+    if (a.ss_family != b.ss_family) return false;
+    if (a.ss_family == AF_INET)
+        return ((const struct sockaddr_in *)&a)->sin_addr.s_addr == ((const struct sockaddr_in *)&b)->sin_addr.s_addr;
+    if (a.ss_family == AF_INET6)
+        return IN6_ARE_ADDR_EQUAL(&((const struct sockaddr_in6 *)&a)->sin6_addr, &((const struct sockaddr_in6 *)&b)->sin6_addr);
+    return false;
+}
+
+
+/** Prijme data connection na socketu sock. Ceka nejdele
+ * PASV_ACCEPT_TIMEOUT sekund a prijme jen spojeni ze stejne adresy, ze
+ * ktere prislo control connection. Adresu klienta zapise do peer.
+ *
+ * Navratove hodnoty:
+ *
+ *      - >= 0    socket data connection
+ *      - -1      chyba (errno), ETIMEDOUT = klient se nepripojil vcas,
+ *                  EINTR = obsluha konci (run) nebo klient poslal ABOR
+ *
+ */
+int PasvAccept(int sock, struct sockaddr_storage &peer) {
+    struct sockaddr_storage control;
+    socklen_t               delka = sizeof(control);
+    struct pollfd           pfd;
+    time_t                  deadline = time(0) + PASV_ACCEPT_TIMEOUT;
+    time_t                  left;
+    int                     ret;
+    int                     fd;
+
+    if (getpeername(client_socket, (struct sockaddr *)&control, &delka) == -1) return -1;
+
+    pfd.fd     = sock;
+    pfd.events = POLLIN;
+    while (1) {
+        if (!run || ftp_abort) {
+            errno = EINTR;
+            return -1;
+        }
+
+        left = deadline - time(0);
+        if (left <= 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        ret = poll(&pfd, 1, left * 1000);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret == -1) return -1;
+        if (ret == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        delka = sizeof(peer);
+        fd = accept(sock, (struct sockaddr *)&peer, &delka);
+        if (fd == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) continue;
+            return -1;
+        }
+
+        if (!SameHost(peer, control)) { // cizi spojeni
+            close(fd);
+            continue;
+        }
+        return fd;
+    }
+}
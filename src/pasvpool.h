@@ -0,0 +1,28 @@
+/** @file pasvpool.h
+ *  \brief Deklarace funkci pro pasivni data connection (rozsah portu pro
+ *  PASV, poslouchajici socket obsluhy a accept() s casovym limitem).
+ *
+ */
+
+#ifndef __pasvpool_h
+#define __pasvpool_h
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+}
+
+#define PASV_BACKLOG        8       //< fronta spojeni na poslouchajicim socketu
+#define PASV_ACCEPT_TIMEOUT 30      //< kolik sekund se ceka, nez se klient pripoji na data port
+
+extern int pasv_port_min;   //< rozsah portu pro PASV (prepinac -P), 0 = libovolny volny port
+extern int pasv_port_max;
+
+
+int PasvListen(int &port);
+void PasvRelease(int sock);
+int PasvAccept(int sock, struct sockaddr_storage &peer);
+
+#endif //__pasvpool_h
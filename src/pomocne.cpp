@@ -179,13 +179,23 @@ int LoadIPDenyList(const char * path)
     //soubor je otevreny, smazeme pripadne stare zaznamy
     if (!ip_deny_list.empty()) ip_deny_list.erase(ip_deny_list.begin(), ip_deny_list.end());
     
-w:  while ((p=fgets(line, MAX_CFG_LINE_LEN, fd)) != 0) if (strlen(line)>5) //IP bude mit urcite vic jak 5 znaku
+w:  while ((p=fgets(line, MAX_CFG_LINE_LEN, fd)) != 0) if (strlen(line)>3) //IP bude mit urcite aspon 3 znaky (::1)
     {
         radek++;
         p = line;
         while (isspace(*p) && (p - line) < (MAX_CFG_LINE_LEN - 5) && (*p != 0)) p++; //preskocime prazdne znaky
         if ((p - line) > (MAX_CFG_LINE_LEN - 5) || (*p == 0)) continue; //prilis dlouhy nebo prazdny radek
         zacatek = p; //jestli je to IP, pak zacina tady
+
+        //IPv6 adresa - ulozi se ve stejnem tvaru, v jakem ji vypisuje
+        //AddressToString(), aby ji CheckIP() nasla
+        memset(tmp, 0, MAX_CFG_LINE_LEN);
+        strncpy(tmp, zacatek, strcspn(zacatek, " \t\r\n"));
+        if (strchr(tmp, ':') != 0) {
+            if (NormalizeIP(tmp, ip_string) == 1) ip_deny_list.push_back(ip_string);
+                else if (spatna_ip_radek == 0) spatna_ip_radek = radek;
+            continue;
+        }
         
         for (i=0; i<4; i++) {
             cislo = strtol(p,&np,10);
@@ -328,7 +338,8 @@ int PocetArgumentu(const char  * line) //pocet slov (oddelenych delimitery)
 /** Kontroluje jestli neni dana IP v deny listu.
  * 
  * Pokud ne, vrati 1, pokud je bannuta vrati 0.
- * IP musi byt tvaru c1,c2,c3,c4.
+ * IP musi byt tvaru c1.c2.c3.c4, IPv6 adresa ve tvaru, v jakem ji vypisuje
+ * AddressToString().
  * 
 */
 int CheckIP(char *IP) {
@@ -351,6 +362,63 @@ int CheckIP(char *IP) {
 
 
 
+/** Zapise adresu addr (IPv4 nebo IPv6) do buf jako text. IPv4 adresy
+ * klientu pripojenych pres IPv6 socket (::ffff:c1.c2.c3.c4) zapise jako
+ * obycejnou IPv4 adresu, aby se na ne vztahoval deny list i vypisy klientu.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      neznama rodina adres nebo maly buffer
+ *
+ */
+int AddressToString(const struct sockaddr * addr, char * buf, int len) {
+    const struct sockaddr_in6 * a6;
+    const void                * a;
+    int                         family = addr->sa_family;
+
+    if (family == AF_INET) {
+        a = &((const struct sockaddr_in *)addr)->sin_addr;
+    } else if (family == AF_INET6) {
+        a6 = (const struct sockaddr_in6 *)addr;
+        a  = &a6->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&a6->sin6_addr)) {
+            family = AF_INET;
+            a      = &a6->sin6_addr.s6_addr[12];
+        }
+    } else return -1;
+
+    return (inet_ntop(family, a, buf, len) != 0) ? 1 : -1;
+}
+
+
+/** Prevede IPv4 nebo IPv6 adresu text do tvaru, v jakem ji vypisuje
+ * AddressToString() (napr. 2001:DB8:0:0::1 na 2001:db8::1).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, adresa je v ip
+ *      - -1      text neni IP adresa
+ *
+ */
+int NormalizeIP(const char * text, string &ip) {
+    struct sockaddr_storage addr;
+    char                    buf[INET6_ADDRSTRLEN];
+
+    memset(&addr, 0, sizeof(addr));
+    if (inet_pton(AF_INET, text, &((struct sockaddr_in *)&addr)->sin_addr) == 1) {
+        addr.ss_family = AF_INET;
+    } else if (inet_pton(AF_INET6, text, &((struct sockaddr_in6 *)&addr)->sin6_addr) == 1) {
+        addr.ss_family = AF_INET6;
+    } else return -1;
+
+    if (AddressToString((struct sockaddr *)&addr, buf, sizeof(buf)) == -1) return -1;
+    ip = buf;
+    return 1;
+}
+
+
+
 /** Pomocna ladici funkce.
  *
  * Vypise seznam nactenych uctu.
@@ -433,11 +501,11 @@ void ToLower(string &x) {
 int ParseCommand(string command, list<string> &atoms) {
     string      delimiters = " ,\r\n"; //mezera, tecka, carka, CR, LF
     string      whitespace = " \r\n";
-    int         zacatek_atomu;
-    int         konec_atomu;
+    string::size_type zacatek_atomu;
+    string::size_type konec_atomu;
     int         velikost_atomu;
     int         pocet_atomu;
-    int         mez;
+    string::size_type mez;
     int         size;
     int         command_index;
     string      command_name;
@@ -505,8 +573,9 @@ int ParseCommand(string command, list<string> &atoms) {
         //podivame se, jestli ted uz nema nasledovat jen jeden argument
         //pokud ano, vezmeme ho jako cast az po prvni nedelimiter odzadu
         //tj. v pripade SITE CHMOD 0775 jmeno souboru.avi se vezme jmeno souboru.avi
-        //jako jeden argument (SITE ma totiz maxargs 3)
-        if ((command_table[command_index].max_args == atoms.size()) && command_name == "site") {
+        //jako jeden argument (SITE ma totiz maxargs 3); u SITE KILL <pid> uz
+        //zadny dalsi argument nenasleduje
+        if ((zacatek_atomu != string::npos) && ((unsigned int)command_table[command_index].max_args == atoms.size()) && command_name == "site") {
 	    konec_atomu = command.find_last_not_of(delimiters);
             if (konec_atomu == string::npos) return command_index; //k tomu nedojde, musely by tam byt same delimitery
             velikost_atomu = konec_atomu - zacatek_atomu + 1;
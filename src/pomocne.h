@@ -21,6 +21,9 @@ extern "C" {
 #include <sys/types.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 }
 
 #include "VFS.h"
@@ -45,8 +48,9 @@ public:
     bool is_admin; ///< ma user admin prava?
 };
 
+/// polozka tabulky prikazu (seznam prikazu je v commands.h)
 struct command {
-        char *name;
+        const char *name;
 	char *help;
 	int (*handler)(list<string> &, VFS &);
         int   max_args;
@@ -76,6 +80,8 @@ int IsDelim(char zn);
 int PocetArgumentu(char *line);
 int GetCommandIndex(string cmd);
 int CheckIP(char *IP);
+int AddressToString(const struct sockaddr * addr, char * buf, int len);
+int NormalizeIP(const char * text, string &ip);
 int CutPathIntoParts(string path, deque<string> &x);
 int CheckRights(int x);
 int CheckDir(const char * path);
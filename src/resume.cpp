@@ -0,0 +1,321 @@
+/** @file resume.cpp
+ *  \brief Implementace obnovy prenosu (REST) v rezimu TYPE ASCII.
+ *
+ * V rezimu ASCII se kazdy znak LF posila jako dvojice CRLF, takze offset,
+ * ktery klient zada prikazem REST, neodpovida offsetu v souboru na disku.
+ * Prevod se dela pomoci indexu LFIndex: binarnim vyhledavanim se najde blok,
+ * ve kterem zadany offset lezi, a prohleda se uz jen tento jeden blok. Stejne
+ * tak se pro SIZE nemusi prochazet cely soubor, ale jen jeho posledni
+ * (necely) blok.
+ *
+ */
+
+#include "resume.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+
+
+/** Zacne pocitat novy index pro soubor popsany st.
+ *
+ */
+void LFIndex::Start(struct stat &st) {
+    MakeCacheStamp(st, stamp);
+    blocks.clear();
+    fed      = 0;
+    lf_count = 0;
+    counting = true;
+}
+
+
+/** Zapocita do indexu dalsi cast souboru.
+ *
+ * Data musi prichazet postupne od zacatku souboru, mohou ale byt libovolne
+ * dlouha - nemusi byt zarovnana na bloky.
+ */
+void LFIndex::Feed(const char * data, int size) {
+    unsigned long long  to_boundary;
+    int                 n;
+    const char        * p;
+
+    if (!counting) return;
+
+    while (size > 0) {
+        to_boundary = RESUME_BLOCK_SIZE - fed % RESUME_BLOCK_SIZE;
+        n = (to_boundary < (unsigned long long)size) ? to_boundary : size;
+
+        for (p = data; p < data + n; p++) if (*p == '\n') lf_count++;
+
+        data += n;
+        size -= n;
+        fed  += n;
+        if (fed % RESUME_BLOCK_SIZE == 0) blocks.push_back(lf_count);
+    }
+}
+
+
+/** Ulozi napocitany index do cache souboru.
+ *
+ * Index se ulozi jen tehdy, pokud pres Feed() prosel cely soubor a soubor
+ * ma aspon jeden cely blok (u mensich souboru se index nevyplati).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      index byl ulozen
+ *      -  0      index se neukladal
+ *      - -1      chyba pri zapisu
+ *
+ */
+int LFIndex::Store() {
+    int                 fd;
+    string              tmp_name;
+    unsigned int        block_size = RESUME_BLOCK_SIZE;
+    unsigned long long  count = blocks.size();
+
+    if (!counting || fed != stamp.size || count == 0) return 0;
+    counting = false;
+
+    fd = CacheCreate(stamp, RESUME_INDEX_SUFFIX, tmp_name);
+    if (fd == -1) return -1;
+
+    if (CacheWrite(fd, &block_size, sizeof(block_size)) < 0
+            || CacheWrite(fd, &count, sizeof(count)) < 0
+            || CacheWrite(fd, &blocks[0], count * sizeof(unsigned long long)) < 0) {
+        close(fd);
+        unlink(tmp_name.c_str());
+        return -1;
+    }
+
+    return CacheCommit(fd, stamp, RESUME_INDEX_SUFFIX, tmp_name);
+}
+
+
+/** Nahraje index souboru popsaneho st z cache.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      index byl nahran
+ *      - -1      v cache neni platny index
+ *
+ */
+int LFIndex::Load(struct stat &st) {
+    int                 fd;
+    unsigned int        block_size;
+    unsigned long long  count;
+
+    counting = false;
+    blocks.clear();
+    MakeCacheStamp(st, stamp);
+
+    fd = CacheOpen(stamp, RESUME_INDEX_SUFFIX);
+    if (fd == -1) return -1;
+
+    if (CacheRead(fd, &block_size, sizeof(block_size)) < 0 || block_size != RESUME_BLOCK_SIZE
+            || CacheRead(fd, &count, sizeof(count)) < 0 || count != stamp.size / RESUME_BLOCK_SIZE) {
+        close(fd);
+        return -1;
+    }
+
+    blocks.resize(count);
+    if (CacheRead(fd, &blocks[0], count * sizeof(unsigned long long)) < 0) {
+        blocks.clear();
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return 1;
+}
+
+
+/** Zjisti, jestli index patri k souboru popsanemu st (v aktualni verzi).
+ *
+ */
+bool LFIndex::Matches(struct stat &st) {
+    CacheStamp  now;
+
+    MakeCacheStamp(st, now);
+    return memcmp(&now, &stamp, sizeof(now)) == 0;
+}
+
+
+/** Vrati offset v prenasenych datech, na kterem zacina i-ty blok souboru.
+ *
+ * i muze byt i rovno Blocks() - pak jde o zacatek posledniho necele bloku.
+ */
+unsigned long long LFIndex::BlockStart(unsigned long long i) {
+    if (i == 0) return 0;
+    return i * RESUME_BLOCK_SIZE + blocks[i-1];
+}
+
+
+/** Otevre soubor a pripravi pro nej index.
+ *
+ * Pokud platny index neni v cache, projde cely soubor, index spocita a
+ * ulozi ho. Vrati file descriptor otevreneho souboru nebo -1.
+ *
+ */
+static int OpenWithIndex(const char * name, struct stat &st, LFIndex &index) {
+    int         fd;
+    int         nacteno;
+    char      * buffer;
+
+    fd = open(name, O_RDONLY);
+    if (fd == -1) return -1;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    if (index.Load(st) > 0) return fd;
+
+    buffer = new char[RESUME_BLOCK_SIZE];
+    index.Start(st);
+    while ((nacteno = read(fd, buffer, RESUME_BLOCK_SIZE)) != 0) {
+        if (nacteno == -1 && errno == EINTR) continue;
+        if (nacteno == -1) {
+            delete [] buffer;
+            close(fd);
+            return -1;
+        }
+        index.Feed(buffer, nacteno);
+    }
+    delete [] buffer;
+
+    //pokud se index nepovede ulozit, nevadi - priste se spocita znovu
+    index.Store();
+
+    return fd;
+}
+
+
+/** Spocita pocet znaku LF v bloku souboru zacinajicim na offsetu from.
+ *
+ * Vrati pocet LF, nebo -1 pri chybe.
+ */
+static long long CountLF(int fd, unsigned long long from, unsigned long long size) {
+    char              * buffer;
+    long long           count = 0;
+    int                 nacteno;
+    int                 i;
+
+    buffer = new char[RESUME_BLOCK_SIZE];
+    while (size > 0) {
+        nacteno = pread(fd, buffer, (size < RESUME_BLOCK_SIZE) ? size : RESUME_BLOCK_SIZE, from);
+        if (nacteno == -1 && errno == EINTR) continue;
+        if (nacteno <= 0) {
+            delete [] buffer;
+            return -1;
+        }
+        for (i = 0; i < nacteno; i++) if (buffer[i] == '\n') count++;
+        from += nacteno;
+        size -= nacteno;
+    }
+    delete [] buffer;
+    return count;
+}
+
+
+/** Spocita kolik bytu se prenese, kdyz se soubor posle v rezimu ASCII.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, vysledek je v size
+ *      - -1      chyba pri praci se souborem
+ *
+ */
+int AsciiTransferSize(const char * name, unsigned long long &size) {
+    int                 fd;
+    struct stat         st;
+    LFIndex             index;
+    unsigned long long  n;
+    long long           tail;
+
+    fd = OpenWithIndex(name, st, index);
+    if (fd == -1) return -1;
+
+    n    = index.Blocks();
+    tail = CountLF(fd, n * RESUME_BLOCK_SIZE, st.st_size - n * RESUME_BLOCK_SIZE);
+    close(fd);
+    if (tail < 0) return -1;
+
+    size = index.BlockStart(n) + (st.st_size - n * RESUME_BLOCK_SIZE) + tail;
+    return 1;
+}
+
+
+/** Prevede offset v prenasenych datech (TYPE ASCII) na offset v souboru.
+ *
+ * Pokud offset ukazuje mezi CR a LF jednoho konce radku, vrati se offset
+ * znaku LF v souboru a lf_only se nastavi na true - odesilatel pak musi
+ * nejdrive poslat samotny LF (klient uz ma CR).
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK, vysledek je ve file_offset a lf_only
+ *      - -1      chyba pri praci se souborem
+ *      - -2      offset je za koncem souboru
+ *
+ */
+int AsciiOffset2FileOffset(const char * name, unsigned long long offset, unsigned long long &file_offset, bool &lf_only) {
+    int                 fd;
+    struct stat         st;
+    LFIndex             index;
+    unsigned long long  lo, hi, mid;
+    unsigned long long  pos, t, size;
+    char              * buffer;
+    int                 nacteno;
+    int                 i;
+
+    fd = OpenWithIndex(name, st, index);
+    if (fd == -1) return -1;
+
+    //najdeme posledni blok, ktery zacina pred offsetem (nebo na nem)
+    lo = 0;
+    hi = index.Blocks();
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (index.BlockStart(mid) <= offset) lo = mid;
+            else hi = mid - 1;
+    }
+
+    //a projdeme uz jen tento blok
+    pos  = lo * RESUME_BLOCK_SIZE;
+    t    = index.BlockStart(lo);
+    size = st.st_size - pos;
+    if (size > RESUME_BLOCK_SIZE) size = RESUME_BLOCK_SIZE;
+
+    lf_only = false;
+    buffer  = new char[RESUME_BLOCK_SIZE];
+    while (size > 0 && t < offset) {
+        nacteno = pread(fd, buffer, size, pos);
+        if (nacteno == -1 && errno == EINTR) continue;
+        if (nacteno <= 0) {
+            delete [] buffer;
+            close(fd);
+            return -1;
+        }
+
+        for (i = 0; i < nacteno && t < offset; i++, pos++) {
+            if (buffer[i] == '\n') {
+                if (t + 1 == offset) {
+                    lf_only = true;
+                    break;
+                }
+                t += 2;
+            } else t++;
+        }
+        if (lf_only) break;
+        size -= i;
+    }
+    delete [] buffer;
+    close(fd);
+
+    if (t != offset && !lf_only) return -2;
+
+    file_offset = pos;
+    return 1;
+}
@@ -0,0 +1,53 @@
+/** @file resume.h
+ *  \brief Deklarace funkci pro obnovu prenosu v rezimu TYPE ASCII.
+ *
+ */
+
+#ifndef __resume_h
+#define __resume_h
+
+#include <vector>
+
+#include "cache.h"
+
+using namespace std;
+
+#define RESUME_BLOCK_SIZE   (256*1024) //< velikost bloku, pro ktery se pamatuje pocet znaku LF
+#define RESUME_INDEX_SUFFIX "lfidx"    //< pripona cache souboru s indexem
+
+
+/** Index poctu znaku LF v souboru.
+ *
+ * Soubor je rozdelen na bloky velikosti RESUME_BLOCK_SIZE a pro kazdy cely
+ * blok si index pamatuje, kolik znaku LF je v souboru od zacatku az do konce
+ * tohoto bloku. Pri prenosu v rezimu ASCII se kazdy LF posila jako CRLF,
+ * takze z indexu lze primo spocitat, na jakem offsetu v prenasenych datech
+ * dany blok zacina. Index se uklada do cache souboru (viz. cache.h), aby se
+ * nemusel pri kazde obnove prenosu pocitat znovu.
+ */
+class LFIndex {
+public:
+    LFIndex() : counting(false) {}
+
+    void Start(struct stat &st);
+    void Feed(const char * data, int size);
+    int  Store();
+    int  Load(struct stat &st);
+    bool Matches(struct stat &st);
+
+    /// pocet celych bloku v souboru
+    unsigned long long Blocks() { return blocks.size(); }
+    unsigned long long BlockStart(unsigned long long i);
+
+private:
+    CacheStamp                  stamp;
+    bool                        counting; ///< probiha pocitani pres Feed()?
+    vector<unsigned long long>  blocks;   ///< kumulativni pocty LF na konci kazdeho celeho bloku
+    unsigned long long          fed;      ///< kolik bytu souboru uz proslo pres Feed()
+    unsigned long long          lf_count; ///< kolik LF zatim Feed() napocital
+};
+
+int AsciiTransferSize(const char * name, unsigned long long &size);
+int AsciiOffset2FileOffset(const char * name, unsigned long long offset, unsigned long long &file_offset, bool &lf_only);
+
+#endif //__resume_h
@@ -13,6 +13,8 @@
  */
 
 #include "security.h"
+#include "metrics.h"
+#include "trace.h"
 #include <openssl/err.h>
 
 int     client_auth     = 0;
@@ -139,6 +141,7 @@ void generate_eph_rsa_key(SSL_CTX *ctx) {
 int TLSInit() {
     ctx = initialize_ctx(key_file.c_str(),PASSWORD);
     load_dh_params(ctx,dh_file.c_str());
+    return 1;
 }
 
 /** Provadi TLS handshake pro control connection.
@@ -147,6 +150,8 @@ int TLSInit() {
 int TLSNeg() {
     BIO *       sbio;
     int         r;
+    unsigned long long start;
+    TraceSpan   span("TLS handshake", "tls");
 
     //s je to co vrati accept(sock)
 
@@ -155,7 +160,10 @@ int TLSNeg() {
     SSL_set_bio(ssl,sbio,sbio);
         
     //ted udelame SSL handshake
-    if ((r=SSL_accept(ssl) <= 0))
+    start = MetricsNow();
+    r = SSL_accept(ssl);
+    MetricsRecord(METRIC_TLS_HANDSHAKE, MetricsNow() - start);
+    if (r <= 0)
         return -1; //SSL accept error
     
     //vytvorime buffrovane BIO pro pohodlnejsi praci
@@ -163,7 +171,7 @@ int TLSNeg() {
     ssl_bio = BIO_new(BIO_f_ssl());
     BIO_set_ssl(ssl_bio,ssl,BIO_CLOSE);
     BIO_push(io,ssl_bio);
-
+    return 1;
 }//TLSNeg()
 
 /** Ukoncuje bezpecne control connection.
@@ -212,6 +220,7 @@ int TLSClean() {
 int TLSDataInit() {
     data_ctx = initialize_ctx(key_file.c_str(),PASSWORD);
     load_dh_params(data_ctx,dh_file.c_str());
+    return 1;
 }
 
 /** Provadi TLS handshake pro data connection.
@@ -220,6 +229,8 @@ int TLSDataInit() {
 int TLSDataNeg() {
     BIO *       sbio;
     int         r;
+    unsigned long long start;
+    TraceSpan   span("TLS data handshake", "tls");
 
     //s je to co vrati accept(sock)
 
@@ -228,7 +239,10 @@ int TLSDataNeg() {
     SSL_set_bio(data_ssl,sbio,sbio);
         
     //ted udelame SSL handshake
-    if ((r=SSL_accept(data_ssl) <= 0))
+    start = MetricsNow();
+    r = SSL_accept(data_ssl);
+    MetricsRecord(METRIC_TLS_HANDSHAKE, MetricsNow() - start);
+    if (r <= 0)
         return -1; //SSL accept error
     
     //vytvorime buffrovane BIO pro pohodlnejsi praci
@@ -236,7 +250,7 @@ int TLSDataNeg() {
     data_ssl_bio = BIO_new(BIO_f_ssl());
     BIO_set_ssl(data_ssl_bio,data_ssl,BIO_CLOSE);
     BIO_push(data_io,data_ssl_bio);
-
+    return 1;
 }//TLSNeg()
 
 /** Uzavira bezpecne data connection.
@@ -268,6 +282,7 @@ int TLSDataShutdown() {
       default:
         return -1; //shutdown failed
     }
+    return 1;
 }
 
 /** Uvolni prostredky alokovane pro TLS data connection.
@@ -0,0 +1,359 @@
+/** @file sessions.cpp
+ *  \brief Implementace sdilene tabulky pripojenych klientu.
+ *
+ * Tabulka je soubor SESSION_TABLE_NAME v pracovnim adresari, ktery si
+ * namapuji vsechny procesy serveru (MAP_SHARED) - cist ji tak muze i
+ * samostatny program sftpwho, ne jen prikaz SITE WHO. Kazdy proces
+ * obsluhujici klienta si po fork() zabere v tabulce jeden zaznam
+ * (SessionStart()) a dal do nej pise jen on, bez zamykani. Zmeny behem
+ * obsluhy prikazu a prenosu jsou jednotlive zarovnane zapisy, ktere ctenar
+ * nikdy nevidi napul; retezce chrani seqlock (viz. SessionSlot).
+ *
+ */
+
+#include "sessions.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+}
+
+
+SessionTable * session_table = 0; //< tabulka klientu, 0 = tabulka neni k dispozici
+static SessionSlot * session = 0; //< zaznam tohoto procesu
+
+
+/** Vrati aktualni cas v mikrosekundach (CLOCK_MONOTONIC).
+ *
+ */
+static unsigned long long SessionNow() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+
+/** Vytvori (prepise) soubor name s prazdnou tabulkou klientu a namapuje ho.
+ *
+ * Musi se zavolat pred prvnim fork().
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se vytvorit nebo namapovat soubor
+ *
+ */
+int SessionInit(const string &name) {
+    void  * p;
+    int     fd;
+
+    fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1) return -1;
+    if (ftruncate(fd, sizeof(SessionTable)) == -1) {
+        close(fd);
+        return -1;
+    }
+    p = mmap(0, sizeof(SessionTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    session_table = (SessionTable *)p;
+    session_table->version = SESSION_TABLE_VERSION;
+    session_table->slots   = SESSION_MAX;
+    session_table->server  = getpid();
+    __sync_synchronize();
+    session_table->magic   = SESSION_TABLE_MAGIC;
+    return 1;
+}
+
+
+/** Zkopiruje retezec src do pole dst velikosti size (vzdy ukonceneho nulou).
+ *
+ */
+static void SessionCopy(char * dst, const char * src, int size) {
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = 0;
+}
+
+
+/** Zabere pro tento proces zaznam v tabulce klientu.
+ *
+ * Vola se v potomkovi po fork(), pred obsluhou klienta s IP adresou ip.
+ * Pokud uz neni volny zaznam, klient se v tabulce proste nezobrazi.
+ */
+void SessionStart(const char * ip) {
+    pid_t   me = getpid();
+    int     i;
+
+    if (session_table == 0) return;
+
+    for (i = 0; i < SESSION_MAX; i++)
+        if (session_table->slot[i].pid == 0 && __sync_bool_compare_and_swap(&session_table->slot[i].pid, 0, me)) {
+            session = &session_table->slot[i];
+            break;
+        }
+    if (session == 0) return;
+
+    session->seq++;
+    __sync_synchronize();
+    session->connected      = time(0);
+    session->active         = session->connected;
+    session->command        = 0;
+    session->transfer_start = 0;
+    session->bytes          = 0;
+    session->bytes_total    = 0;
+    session->transfers      = 0;
+    session->upload         = 0;
+    session->user[0]        = 0;
+    session->file[0]        = 0;
+    SessionCopy(session->ip, ip, SESSION_IP_LEN);
+    __sync_synchronize();
+    session->seq++;
+}
+
+
+/** Uvolni zaznam procesu pid, ktery prave skoncil (vola se z ReapChild()).
+ *
+ */
+void SessionChildExited(pid_t pid) {
+    int i;
+
+    if (session_table == 0 || pid <= 0) return;
+    for (i = 0; i < SESSION_MAX; i++)
+        if (session_table->slot[i].pid == pid) {
+            session_table->slot[i].pid = 0;
+            return;
+        }
+}
+
+
+/** Vrati true, pokud tento proces obsluhuje klienta.
+ *
+ */
+bool SessionActive() {
+    return session != 0;
+}
+
+
+/** Zapise jmeno prihlaseneho uzivatele.
+ *
+ */
+void SessionUser(const string &user) {
+    if (session == 0) return;
+    session->seq++;
+    __sync_synchronize();
+    SessionCopy(session->user, user.c_str(), MAX_USER_NAME_LEN);
+    __sync_synchronize();
+    session->seq++;
+}
+
+
+/** Zapise, ze se prave zacal provadet prikaz name.
+ *
+ */
+void SessionCommand(const char * name) {
+    unsigned long long  c = 0;
+
+    char              * p = (char *)&c;
+    unsigned int        i;
+
+    if (session == 0) return;
+    for (i = 0; i < sizeof(c) && name[i] != 0; i++) p[i] = toupper(name[i]);
+    session->command = c;
+    session->active  = time(0);
+}
+
+
+/** Zapise, ze prikaz skoncil a pripadny prenos s nim.
+ *
+ */
+void SessionIdle() {
+    if (session == 0) return;
+    if (session->transfer_start != 0) {
+        session->bytes_total    = session->bytes_total + session->bytes;
+        session->transfer_start = 0;
+        session->bytes          = 0;
+    }
+    session->command = 0;
+}
+
+
+/** Zapise, ktery soubor (fyzicke jmeno, u LIST adresar) a kterym smerem se
+ * bude prenaset.
+ *
+ */
+void SessionFile(bool upload, const string &file) {
+    if (session == 0) return;
+    session->seq++;
+    __sync_synchronize();
+    SessionCopy(session->file, file.c_str(), SESSION_FILE_LEN);
+    __sync_synchronize();
+    session->seq++;
+    session->upload = upload;
+}
+
+
+/** Zapise, ze bylo navazano data connection a zacal prenos.
+ *
+ */
+void SessionTransferStart() {
+    if (session == 0) return;
+    session->bytes     = 0;
+    session->transfers = session->transfers + 1;
+    session->transfer_start = SessionNow();
+}
+
+
+/** Zapise, kolik bytu uz se v probihajicim prenosu preneslo.
+ *
+ */
+void SessionBytes(unsigned long long bytes) {
+    if (session != 0) session->bytes = bytes;
+}
+
+
+/** Namapuje existujici tabulku klientu name jen pro cteni (pro sftpwho).
+ *
+ * Vrati 0, pokud soubor neexistuje nebo neobsahuje tabulku.
+ */
+SessionTable * SessionTableOpen(const string &name) {
+    SessionTable  * t;
+    struct stat     st;
+    void          * p;
+    int             fd;
+
+    fd = open(name.c_str(), O_RDONLY);
+    if (fd == -1) return 0;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(SessionTable)) {
+        close(fd);
+        return 0;
+    }
+    p = mmap(0, sizeof(SessionTable), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return 0;
+
+    t = (SessionTable *)p;
+    if (t->magic != SESSION_TABLE_MAGIC || t->version != SESSION_TABLE_VERSION) {
+        munmap(p, sizeof(SessionTable));
+        return 0;
+    }
+    return t;
+}
+
+
+/** Vrati true, pokud proces pid existuje.
+ *
+ * Zaznam procesu, po kterem server neuklidil (SIGKILL serveru, ...), se
+ * nezobrazuje.
+ */
+static bool SessionAlive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+
+/** Precte do list vsechny obsazene zaznamy tabulky table.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  n      pocet prectenych zaznamu
+ *      - -1      tabulka neni k dispozici
+ *
+ */
+int SessionList(SessionTable * table, vector<SessionInfo> &list) {
+    SessionSlot       * s;
+    SessionInfo         info;
+    char                user[MAX_USER_NAME_LEN];
+    char                ip[SESSION_IP_LEN];
+    char                file[SESSION_FILE_LEN];
+    char                cmd[sizeof(unsigned long long) + 1];
+    unsigned long long  c, start, now, bytes;
+    unsigned int        seq;
+    int                 spin;
+    unsigned int        i;
+
+    if (table == 0) return -1;
+    list.clear();
+    now = SessionNow();
+
+    for (i = 0; i < table->slots && i < SESSION_MAX; i++) {
+        s = &table->slot[i];
+        info.pid = s->pid;
+        if (info.pid == 0 || !SessionAlive(info.pid)) continue;
+
+        //retezce se ctou, dokud se behem cteni nezmenily
+        for (spin = 0; spin < SESSION_SPIN_LIMIT; spin++) {
+            seq = s->seq;
+            __sync_synchronize();
+            if (seq & 1) continue;
+            memcpy(user, s->user, sizeof(user));
+            memcpy(ip, s->ip, sizeof(ip));
+            memcpy(file, s->file, sizeof(file));
+            __sync_synchronize();
+            if (s->seq == seq) break;
+        }
+        if (spin == SESSION_SPIN_LIMIT) continue;
+        user[MAX_USER_NAME_LEN - 1] = 0;
+        ip[SESSION_IP_LEN - 1]      = 0;
+        file[SESSION_FILE_LEN - 1]  = 0;
+
+        c = s->command;
+        memcpy(cmd, &c, sizeof(c));
+        cmd[sizeof(c)] = 0;
+        start = s->transfer_start;
+        bytes = s->bytes;
+
+        info.connected    = s->connected;
+        info.active       = s->active;
+        info.user         = user;
+        info.ip           = ip;
+        info.command      = cmd;
+        info.file         = file;
+        info.transferring = (start != 0);
+        info.upload       = s->upload;
+        info.transfers    = s->transfers;
+        info.bytes        = s->bytes_total + (info.transferring ? bytes : 0);
+        info.rate         = (info.transferring && now > start) ? bytes * 1000000 / (now - start) : 0;
+
+        if (info.pid != s->pid) continue; //zaznam mezitim prevzal jiny proces
+        list.push_back(info);
+    }
+    return list.size();
+}
+
+
+/** Vrati true, pokud proces pid obsluhuje klienta zapsaneho v tabulce table.
+ *
+ */
+bool SessionOwns(SessionTable * table, pid_t pid) {
+    unsigned int    i;
+
+    if (table == 0 || pid <= 0) return false;
+    for (i = 0; i < table->slots && i < SESSION_MAX; i++)
+        if (table->slot[i].pid == pid) return true;
+    return false;
+}
+
+
+/** Naformatuje zaznam s do jedne radky (pro SITE WHO a sftpwho).
+ *
+ */
+void SessionFormat(const SessionInfo &s, string &line) {
+    char        tmp[200];
+    time_t      now = time(0);
+    string      cmd = s.command;
+
+    if (cmd == "") cmd = "-";
+    snprintf(tmp, sizeof(tmp), "%6d %-15s %-*s %6lds %5lds %-4s %12llu B %10llu B/s ",
+            (int)s.pid, s.ip.c_str(), MAX_USER_NAME_LEN - 1, (s.user == "") ? "-" : s.user.c_str(),
+            (long)(now - s.connected), (long)(now - s.active), cmd.c_str(), s.bytes, s.rate);
+    line = tmp;
+    if (s.transferring) line += s.upload ? "<- " : "-> ";
+        else line += "   ";
+    line += (s.file == "") ? "-" : s.file;
+}
@@ -0,0 +1,104 @@
+/** @file sessions.h
+ *  \brief Deklarace sdilene tabulky pripojenych klientu (SITE WHO, SITE KILL
+ *  a program sftpwho).
+ *
+ */
+
+#ifndef __sessions_h
+#define __sessions_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+}
+
+#include <string>
+#include <vector>
+
+#include "DirectoryDatabase.h"
+
+using namespace std;
+
+#define SESSION_TABLE_NAME    "sessions"   //< jmeno souboru s tabulkou (v pracovnim adresari)
+#define SESSION_TABLE_MAGIC   0x53465353   //< "SFSS"
+#define SESSION_TABLE_VERSION 1
+#define SESSION_MAX           256          //< nejvyssi pocet soucasne zobrazenych klientu
+#define SESSION_IP_LEN        46           //< INET6_ADDRSTRLEN
+#define SESSION_FILE_LEN      256
+#define SESSION_SPIN_LIMIT    1000         //< kolikrat se zkusi precist zaznam, ktery se prave meni
+
+
+/** Zaznam jednoho klienta.
+ *
+ * Caste zmeny (prikaz, pocet prenesenych bytu) jsou jednotlive zarovnane
+ * zapisy, ktere ctenar vidi vzdy cele. Retezce (uzivatel, IP, soubor) se
+ * meni jen obcas a chrani je seqlock seq (liche = prave probiha zapis).
+ */
+struct SessionSlot {
+    volatile pid_t              pid;            ///< proces, ktery klienta obsluhuje (0 = volne)
+    volatile unsigned int       seq;
+    time_t                      connected;      ///< kdy se klient pripojil
+    volatile time_t             active;         ///< kdy naposledy poslal prikaz
+    volatile unsigned long long command;        ///< jmeno prave provadeneho prikazu (8 znaku), 0 = ceka na prikaz
+    volatile unsigned long long transfer_start; ///< kdy zacal prave probihajici prenos (us, CLOCK_MONOTONIC), 0 = zadny
+    volatile unsigned long long bytes;          ///< kolik bytu uz se v probihajicim prenosu preneslo
+    volatile unsigned long long bytes_total;    ///< kolik bytu se preneslo v dokoncenych prenosech
+    volatile unsigned int       transfers;      ///< pocet prenosu
+    volatile int                upload;         ///< probihajici prenos je upload
+    char                        user[MAX_USER_NAME_LEN];
+    char                        ip[SESSION_IP_LEN];
+    char                        file[SESSION_FILE_LEN]; ///< soubor posledniho prenosu
+};
+
+
+/** Tabulka klientu (soubor SESSION_TABLE_NAME namapovany MAP_SHARED).
+ *
+ */
+struct SessionTable {
+    unsigned int    magic;
+    unsigned int    version;
+    unsigned int    slots;
+    pid_t           server;         ///< hlavni proces serveru
+    SessionSlot     slot[SESSION_MAX];
+};
+
+
+/** Kopie zaznamu klienta pro ctenare (viz. SessionList()).
+ *
+ */
+struct SessionInfo {
+    pid_t               pid;
+    time_t              connected;
+    time_t              active;
+    string              user;
+    string              ip;
+    string              command;
+    string              file;
+    bool                transferring;
+    bool                upload;
+    unsigned long long  bytes;          ///< vcetne probihajiciho prenosu
+    unsigned long long  rate;           ///< rychlost probihajiciho prenosu (B/s)
+    unsigned int        transfers;
+};
+
+
+int  SessionInit(const string &name);
+void SessionStart(const char * ip);
+void SessionChildExited(pid_t pid);
+bool SessionActive();
+void SessionUser(const string &user);
+void SessionCommand(const char * name);
+void SessionIdle();
+void SessionFile(bool upload, const string &file);
+void SessionTransferStart();
+void SessionBytes(unsigned long long bytes);
+
+SessionTable * SessionTableOpen(const string &name);
+int  SessionList(SessionTable * table, vector<SessionInfo> &list);
+bool SessionOwns(SessionTable * table, pid_t pid);
+void SessionFormat(const SessionInfo &s, string &line);
+
+extern SessionTable * session_table;
+
+#endif //__sessions_h
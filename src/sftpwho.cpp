@@ -0,0 +1,85 @@
+/** @file sftpwho.cpp
+ *  \brief Vypis klientu pripojenych k bezicimu serveru (obdoba SITE WHO).
+ *
+ * Cte tabulku klientu (viz. sessions.cpp) ze souboru SESSION_TABLE_NAME
+ * v pracovnim adresari serveru, jen pro cteni a bez zamykani - server tim
+ * nijak nezdrzuje.
+ *
+ * Pouziti: sftpwho [-w pracovni_adresar] [-i sekund]
+ *
+ *      - -w    pracovni adresar serveru (implicitne aktualni adresar)
+ *      - -i    vypisovat tabulku znovu po zadanem poctu sekund
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+}
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sessions.h"
+
+using namespace std;
+
+
+static void Usage(const char * name) {
+    cout << "Pouziti: " << name << " [-w pracovni_adresar] [-i sekund]" << endl;
+}
+
+
+int main(int argc, char ** argv) {
+    SessionTable      * table;
+    vector<SessionInfo> list;
+    string              dir = ".";
+    string              line;
+    int                 interval = 0;
+    unsigned int        i;
+    int                 zn;
+
+    while ((zn = getopt(argc, argv, "w:i:")) != -1) {
+        switch (zn) {
+            case 'w': dir = optarg;
+                      break;
+            case 'i': interval = atoi(optarg);
+                      if (interval <= 0) {
+                          Usage(argv[0]);
+                          return 1;
+                      }
+                      break;
+            default:  Usage(argv[0]);
+                      return 1;
+        }
+    }
+    if (optind != argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    if (dir != "/") dir = dir + "/" + SESSION_TABLE_NAME;
+        else dir = "/" SESSION_TABLE_NAME;
+    table = SessionTableOpen(dir);
+    if (table == 0) {
+        cout << "Nelze otevrit tabulku klientu " << dir << " (bezi server?)" << endl;
+        return 1;
+    }
+
+    do {
+        SessionList(table, list);
+        cout << "   PID IP              USER                 ONLINE  IDLE CMD         TRANSFERRED           RATE    FILE" << endl;
+        for (i = 0; i < list.size(); i++) {
+            SessionFormat(list[i], line);
+            cout << line << endl;
+        }
+        if (interval > 0) {
+            cout << endl;
+            sleep(interval);
+        }
+    } while (interval > 0);
+
+    return 0;
+}
@@ -1,7 +1,8 @@
 /** @file signaly.cpp
  *  \brief Implementace handleru signalu.
  *
- * smallFTPd odchytava signaly SIGCHLD, SIGTERM, SIGHUP, SIGPIPE a SIGURG.
+ * smallFTPd odchytava signaly SIGCHLD, SIGTERM, SIGHUP, SIGPIPE, SIGURG a
+ * SIGUSR1 (vypis trasovani obsluhy klienta, viz. trace.h).
  * Signaly se odchytavaji z bezpecnostnich duvodu - napr. SIGPIPE pro
  * pripad, ze klient neocekavane ukonci spojeni, a take jako komunikacni
  * prostredek mezi klientem a serverem a mezi potomky a rodicovskym procesem -
@@ -20,12 +21,18 @@ extern "C" {
 #include <sys/wait.h>
 #include <sys/socket.h>
 #include <fcntl.h>
+#include <errno.h>
 }
 
 #include <string>
 #include "pomocne.h"
 #include "signaly.h"
 #include "network.h"
+#include "statcache.h"
+#include "metrics.h"
+#include "sessions.h"
+#include "xferlog.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -62,15 +69,29 @@ struct sigaction TermAction = {
 };
 
 
+void TraceHandler(int arg);
+struct sigaction TraceAction = {
+    TraceHandler, 0, SA_RESTART, 0
+};
+
+
 /* *** *** Handlery *** *** */
 
 void ReapChild(int pid) {
     int status,val;
+    int saved_errno = errno; //handler muze prerusit kod, ktery errno prave testuje
     
-    val=wait(&status); //hned se vrati, protoze tahle fce je zavolana hned po SIGCHLD
+    //SIGCHLD se nescitaji - nez se handler zavola, mohlo skoncit procesu vic
+    while ((val = waitpid(-1, &status, WNOHANG)) > 0) {
+        StatCacheChildExited(val); //skoncilo sledovani zmen -> cache se nesmi pouzivat
+        MetricsChildExited(val);
+        SessionChildExited(val);
+        XferLogChildExited(val);
 #ifdef DEBUG
-    cout << "Proces s PID " << val << " prave skoncil." << endl;
+        cout << "Proces s PID " << val << " prave skoncil." << endl;
 #endif
+    }
+    errno = saved_errno;
 }
 
 /** Obsluha signalu SIGURG.
@@ -214,9 +235,24 @@ void PipeHandler(int arg) {
 
 
 
+/** Obsluha signalu SIGUSR1.
+ *
+ * Proces obsluhujici klienta zapise useky obsluhy do souboru
+ * trace.<pid>.json (viz. TraceDump(), ktera se smi volat z obsluhy signalu).
+ *
+ */
+void TraceHandler(int arg) {
+    if (!parent) TraceDump();
+}
+
+
+
 /** Obsluha signalu SIGTERM.
  *
- * Smaze soubor s cislem PID a zpusobi ukonceni serveru.
+ * Smaze soubor s cislem PID a zpusobi ukonceni serveru. Proces obsluhujici
+ * klienta (SITE KILL) prerusi prenos a zavre control connection - cteni
+ * dalsiho prikazu se po signalu restartuje, samotne run = false by ho
+ * neprerusilo.
  *
  */
 void TermHandler(int arg) {
@@ -226,7 +262,13 @@ void TermHandler(int arg) {
     if (parent) {
         unlink(pid_file.c_str());
         finish = true;
-    } else run = false;
+    } else {
+        run = false;
+        if (SessionActive()) {
+            ftp_abort = true;
+            shutdown(client_socket, SHUT_RDWR);
+        }
+    }
 }
 
 
@@ -267,6 +309,11 @@ void InitSignalHandlers() {
 #ifdef DEBUG
     ERR(ret, InitSignalHandlers());
 #endif
+
+    ret = sigaction(SIGUSR1, &TraceAction, NULL);
+#ifdef DEBUG
+    ERR(ret, InitSignalHandlers());
+#endif
 }
 
 
@@ -40,6 +40,17 @@
 #include "network.h"
 #include "security.h"
 #include "my_exceptions.h"
+#include "cache.h"
+#include "durable.h"
+#include "maintenance.h"
+#include "statcache.h"
+#include "filecache.h"
+#include "metrics.h"
+#include "sessions.h"
+#include "xferlog.h"
+#include "exporter.h"
+#include "trace.h"
+#include "pasvpool.h"
 
 
 
@@ -58,6 +69,9 @@ string pid_file("smallFTPd.PID");
 string ca_list_file("root.pem");
 string key_file("server.pem");
 string dh_file("dh1024.pem");
+string cache_dir(CACHE_DIR_NAME);
+string xferlog_file(""); //< log prenosu (viz. xferlog.h), "" = log je vypnuty
+string pasv_address(""); //< adresa ohlasovana v odpovedi na PASV (server za NATem), "" = adresa control connection
 
 bool   anonymous_allowed = true;
 
@@ -78,12 +92,20 @@ bool parent     = true;
 bool finish     = false; //< rekl nam administrator, ze mame skoncit?
 bool ftp_abort  = false; //< dostali jsme OOB data a prikaz ABOR?
 bool assume_abor= false; //< pokud dostaneme SIGURG, mame predpokladat, ze to je ABOR?
+bool atomic_uploads = false; //< mame STOR zapisovat do docasneho souboru a pak ho prejmenovat?
+int  durability = DURABILITY_NONE; //< co vsechno musi byt na disku, nez klient dostane odpoved (viz. durable.h)
+unsigned int file_cache_max = FILE_CACHE_DEFAULT_MAX; //< soubory do teto velikosti posila RETR ze sdilene pameti (viz. filecache.h)
+int  metrics_port = 0; //< port, na kterem se exportuji metriky (viz. exporter.h), 0 = export je vypnuty
+string metrics_address(""); //< adresa, na ktere export metrik posloucha, "" = vsechna rozhrani
+int  pasv_port_min = 0; //< rozsah portu pro PASV (viz. pasvpool.h), 0 = libovolny volny port
+int  pasv_port_max = 0;
+int  trace_sample = 0; //< trasuje se kazde trace_sample-te spojeni (viz. trace.h), 0 = zadne
 
 int server_data_socket; //pouziva ho fpasv
 int client_data_socket;
 
 int client_socket; //< soket pro control connection
-struct sockaddr_in client_data_address;
+struct sockaddr_storage client_data_address;
 /*
  * normalne je adresa data connection stejna jako adresa klienta
  * prikazem PORT ji muze zmenit na jakoukoliv jinou
@@ -96,17 +118,20 @@ handler fuser, fpass, fpasv, fport, ftype, fmode, fstru, fhelp;
 handler fquit, fnoop, fpwd,  flist, fcwd , fcdup, fretr, fstor;
 handler fsyst, frein, fstou, fappe, fallo, frnfr, frnto, fdele;
 handler fmkd , frmd , fsite, fsize, fmdtm, frest, fauth, fpbsz;
-handler fprot;
+handler fprot, ffeat, fopts, fhash, fxcrc, fxmd5, fxsha1, fxsha256;
+handler frang, fepsv, feprt;
 
-handler fdenyip, ffinish, fsettings;
+handler fdenyip, ffinish, fsettings, fmetrics;
 
 char user_help[]="USER <username>         :::> login command";
 char pass_help[]="PASS <password>         :::> users password";
 char pasv_help[]="PASV         :::> makes server enter passive mode.";
 
 char port_help[]="PORT h1,h2,h3,h4,p1,p2         :::> makes server connect to given address and port";
+char epsv_help[]="EPSV [1|2|ALL]                :::> extended passive mode, the reply contains only the port (IPv4 and IPv6)";
+char eprt_help[]="EPRT |proto|address|port|     :::> like PORT, proto 1 = IPv4, 2 = IPv6";
 char type_help[]="TYPE A|E|I N|T|C         :::> sets data type";
-char mode_help[]="MODE S|B|C         :::> sets data mode";
+char mode_help[]="MODE S|B|C|Z         :::> sets data mode";
 char stru_help[]="STRU F|R|P         :::> sets data structure";
 char help_help[]="HELP <command>         :::> prints help for a given command";
 char quit_help[]="QUIT         :::> makes server close control connection.";
@@ -127,7 +152,7 @@ char rnto_help[]="RNTO <file_name>        :::> sets the rename to name and compl
 char dele_help[]="DELE <file_name>        :::> deletes specified file.";
 char rmd_help[] ="RMD <directory_name>          :::> removes specified directory, even if it is empty.";
 char mkd_help[] ="MKD <directory_name>          :::> creates specified directory.";
-char site_help[]="SITE CHMOD 0xyz <path>          :::> changes mode of <path> to 0xyz";
+char site_help[]="SITE CHMOD 0xyz <path> | WHO | KILL <pid> | TRACE [ON|OFF|<pid>] :::> changes mode of <path> to 0xyz, lists, kills or traces sessions (admin)";
 char size_help[]="SIZE <file_name>              :::> returns size of the specified file";
 char mdtm_help[]="MDTM <file_name>              :::> returns modification time of the specified file";
 char rest_help[]="REST <number>                 :::> sets byte offset for resume";
@@ -135,66 +160,37 @@ char abor_help[]="ABOR                          :::> aborts runnig file transfer
 char auth_help[]="AUTH TLS                      :::> initialize secure connection";
 char pbsz_help[]="PBSZ 0                        :::> sets buffer size to zero";
 char prot_help[]="PROT C                        :::> insecure data connection";
-
-char denyip_help[]="DENYIP x1,x2,x3,x4		:::> denies access from the given IP";
+char feat_help[]="FEAT                          :::> lists supported extensions";
+char opts_help[]="OPTS HASH [<algorithm>] | MODE Z [LEVEL <n>] :::> sets options of HASH or MODE Z";
+char hash_help[]="HASH <file_name>              :::> returns checksum of the specified file";
+char xcrc_help[]="XCRC <file_name>              :::> returns CRC32 of the specified file";
+char xmd5_help[]="XMD5 <file_name>              :::> returns MD5 of the specified file";
+char xsha1_help[]="XSHA1 <file_name>            :::> returns SHA-1 of the specified file";
+char xsha256_help[]="XSHA256 <file_name>        :::> returns SHA-256 of the specified file";
+char rang_help[]="RANG <start> <end>            :::> sets byte range for the next RETR or HASH";
+
+char denyip_help[]="DENYIP x1,x2,x3,x4 | <ip>	:::> denies access from the given IP (IPv4 or IPv6)";
 char finish_help[]="FINISH                      :::> kills the parent FTP process";
 char settings_help[]="SETTINGS                  :::> prints daemon settings";
+char metrics_help[]="METRICS                    :::> prints latency and transfer statistics";
 
 
+/** Tabulka prikazu (seznam je v commands.h).
+ *
+ */
+#define COMMAND(name, help, handler, max_args) {name, help, handler, max_args},
 command command_table[]={
-  {"user",user_help, fuser, 1},//1
-  {"pass",pass_help, fpass, 1},
-  {"pasv",pasv_help, fpasv, 0},
-  {"port",port_help, fport, 6},
-  {"type",type_help, ftype, 2},
-  {"mode",mode_help, fmode, 1},
-  {"stru",stru_help, fstru, 1},
-  {"help",help_help, fhelp, 1},
-  {"quit",quit_help, fquit, 0},
-  {"noop",noop_help, fnoop, 0},//10
-  {"pwd" , pwd_help, fpwd , 0},
-  {"list",list_help, flist, 1},
-  {"cwd" , cwd_help, fcwd , 1},
-  {"cdup",cdup_help, fcdup, 0},
-  {"retr",retr_help, fretr, 1},
-  {"stor",stor_help, fstor, 1},
-  {"syst",syst_help, fsyst, 0},
-  {"rein",rein_help, frein, 0},
-  {"stou",stou_help, fstou, 0},
-  {"appe",appe_help, fappe, 1},//20
-  {"allo",allo_help, fallo, 2},
-  {"rnfr",rnfr_help, frnfr, 1},
-  {"rnto",rnto_help, frnto, 1},
-  {"dele",dele_help, fdele, 1},
-  {"rmd" , rmd_help, frmd , 1},
-  {"mkd" , mkd_help, fmkd , 1},
-  {"site",site_help, fsite, 3},
-  {"size",size_help, fsize, 1},
-  {"mdtm",mdtm_help, fmdtm, 1},
-  {"rest",rest_help, frest, 1},//30
-  {"abor",abor_help, fnoop, 0},
-  {"auth",auth_help, fauth, 1},
-  {"pbsz",pbsz_help, fpbsz, 1},
-  {"prot",prot_help, fprot, 1},
-  {"denyip",denyip_help, fdenyip, 4},
-  {"finish",finish_help, ffinish, 0},
-  {"settings",settings_help, fsettings, 0},
-	0
+#include "commands.h"
 };
+#undef COMMAND
 
-int number_of_commands = 37;
+int number_of_commands = sizeof(command_table) / sizeof(command_table[0]);
 
 /** Vytiskne na stdout informace o pouziti programu.
  *
  */
 void PrintHelp() {
-    string s;
-
-    s = gdbm_version;
-    if (s.find("This is ") == 0) s.erase(0, strlen("This is "));
-    
     cout << MY_NAME " " MY_VERSION << " (" << __DATE__ << ")" << endl;
-    //cout << "(" << s << ")" << endl;
 
     cout << endl << MY_NAME " " << " [PREPINACE]" << endl;
     cout << "   -a <jmeno_souboru>    jmeno souboru s ucty (bez cesty)" << endl;
@@ -208,6 +204,24 @@ void PrintHelp() {
     cout << "                         povoli jen sifrovne prikazy, pokud je zadano" << endl;
     cout << "                         dvakrat, tak povoli i sifrovane prenosy souboru" << endl;
     cout << "   -u                    alternativni chovani prikazu ABOR" << endl;
+    cout << "   -t                    STOR zapisuje do docasneho souboru, ktery se po" << endl;
+    cout << "                         uspesnem prenosu prejmenuje na cilovy soubor" << endl;
+    cout << "   -y <uroven>           durabilita: 0 = nic se nesynchronizuje, 1 = data" << endl;
+    cout << "                         uploadu jsou pred 226 na disku, 2 = navic i zmeny" << endl;
+    cout << "                         databaze (skupinove)" << endl;
+    cout << "   -c <velikost>         soubory do teto velikosti (v bytech) posila RETR" << endl;
+    cout << "                         ze sdilene pameti, 0 = vypnuto" << endl;
+    cout << "   -m <cislo>            port, na kterem se metriky serveru exportuji po HTTP" << endl;
+    cout << "                         ve formatu OpenMetrics (GET /metrics)" << endl;
+    cout << "   -M <ip>               adresa, na ktere export metrik posloucha (napr." << endl;
+    cout << "                         127.0.0.1), jinak vsechna rozhrani" << endl;
+    cout << "   -l <jmeno_souboru>    soubor, do ktereho se loguji prenosy souboru (bez" << endl;
+    cout << "                         cesty), textovy tvar vypise program xferlog_dump" << endl;
+    cout << "   -i <ip>               adresa, kterou server ohlasuje v odpovedi na PASV" << endl;
+    cout << "                         (server za NATem), jinak adresa control connection" << endl;
+    cout << "   -P <od>-<do>          rozsah portu pro PASV (napr. 50000-50999)" << endl;
+    cout << "   -r <n>                trasuje obsluhu kazdeho n-teho spojeni (1 = vsech)," << endl;
+    cout << "                         vypis vytvori SITE TRACE nebo signal SIGUSR1" << endl;
     cout << "   -n                    vypise vychozi nastaveni" << endl;
     cout << "   -h                    vypise tento help" << endl;
     //cout << endl;
@@ -226,6 +240,24 @@ void PrintDefaultSetting() {
     cout << "vychozi cislo portu    : "   << server_listening_port << endl;
     cout << "ucet anonymous je      : ";
     if (anonymous_allowed) cout << "povolen" << endl; else cout << "zakazan" << endl; 
+    cout << "atomicke uploady jsou  : ";
+    if (atomic_uploads) cout << "zapnuty" << endl; else cout << "vypnuty" << endl;
+    cout << "uroven durability      : "   << durability << endl;
+    cout << "cache malych souboru do: "   << file_cache_max << " B" << endl;
+    cout << "export metrik          : ";
+    if (metrics_port > 0) {
+        cout << "port " << metrics_port;
+        if (metrics_address != "") cout << " na adrese " << metrics_address;
+        cout << endl;
+    } else cout << "vypnuty" << endl;
+    cout << "log prenosu            : ";
+    if (xferlog_file != "") cout << xferlog_file << endl; else cout << "vypnuty" << endl;
+    cout << "adresa pro PASV        : ";
+    if (pasv_address != "") cout << pasv_address << endl; else cout << "adresa control connection" << endl;
+    cout << "porty pro PASV         : ";
+    if (pasv_port_min > 0) cout << pasv_port_min << "-" << pasv_port_max << endl; else cout << "libovolny volny port" << endl;
+    cout << "trasovani spojeni      : ";
+    if (trace_sample > 0) cout << "kazde " << trace_sample << ". spojeni" << endl; else cout << "vypnuto" << endl;
     //cout << endl;
 }
 
@@ -241,10 +273,12 @@ void ZpracujArgumenty(int argc, char ** argv) {
     int ret;
     char *x;
     char buf[MAX_PATH_LEN];
+    struct in_addr pasv_in_addr;
+    struct in_addr metrics_in_addr;
     
     opterr = 0;
     while (1) {
-        zn = getopt(argc, argv, "a:v:x:w:dp:hsung");
+        zn = getopt(argc, argv, "a:v:x:w:dp:y:c:m:M:l:r:i:P:hsungt");
         if (zn == -1) 
             break;
 
@@ -317,6 +351,70 @@ void ZpracujArgumenty(int argc, char ** argv) {
             case 'u':
                 assume_abor = true;
                 break;
+            case 't':
+                atomic_uploads = true;
+                break;
+            case 'y':
+                n = strtol(optarg, &x, 10);
+                if (*x != 0 || n < DURABILITY_NONE || n > DURABILITY_FULL) {
+                    cout << "Chybna uroven durability." << endl;
+                    exit(-1);
+                }
+                durability = n;
+                break;
+            case 'c':
+                n = strtol(optarg, &x, 10);
+                if (*x != 0 || n < 0 || n > FILE_CACHE_MEMORY / FILE_CACHE_WAYS) {
+                    cout << "Chybna velikost souboru pro cache." << endl;
+                    exit(-1);
+                }
+                file_cache_max = n;
+                break;
+            case 'm':
+                n = strtol(optarg, &x, 10);
+                if (*x != 0 || n < 1 || n > 65535) {
+                    cout << "Chybne cislo portu pro export metrik." << endl;
+                    exit(-1);
+                }
+                metrics_port = n;
+                break;
+            case 'M':
+                if (inet_aton(optarg, &metrics_in_addr) == 0) {
+                    cout << "Chybna adresa pro export metrik, zadejte IP adresu ve tvaru 127.0.0.1." << endl;
+                    exit(-1);
+                }
+                metrics_address = inet_ntoa(metrics_in_addr);
+                break;
+            case 'l':
+                xferlog_file = optarg;
+                if (xferlog_file.find('/') != string::npos) {
+                    cout << "Zadejte prosim jen jmeno souboru bez cesty. Jako cesta se pouzije pracovni adresar." << endl;
+                    exit(-1);
+                }
+                break;
+            case 'i':
+                if (inet_aton(optarg, &pasv_in_addr) == 0) {
+                    cout << "Chybna adresa pro PASV, zadejte IP adresu ve tvaru 192.168.1.1." << endl;
+                    exit(-1);
+                }
+                pasv_address = inet_ntoa(pasv_in_addr);
+                break;
+            case 'P':
+                pasv_port_min = strtol(optarg, &x, 10);
+                if (*x == '-') pasv_port_max = strtol(x + 1, &x, 10);
+                if (*x != 0 || pasv_port_min < 1024 || pasv_port_max < pasv_port_min || pasv_port_max > 65535) {
+                    cout << "Chybny rozsah portu pro PASV, zadejte napr. 50000-50999." << endl;
+                    exit(-1);
+                }
+                break;
+            case 'r':
+                n = strtol(optarg, &x, 10);
+                if (*x != 0 || n < 0) {
+                    cout << "Chybny interval trasovani spojeni." << endl;
+                    exit(-1);
+                }
+                trace_sample = n;
+                break;
             case 'n':
                 PrintDefaultSetting();
                 exit(0);
@@ -378,9 +476,13 @@ int main(int argc, char *argv[]) try {
     int         ret;
     int         child_pid;
     int         server_len;
+    int         server_family = AF_INET6;
+    int         v6only  = 0;
+    int         nodelay = 1;
 
     //pro pripad ze nam unikne nejaka vyjimka --> aspon spadneme kulturne
     set_unexpected(my_unexpected);
+
     
     // Nastavime handlery signalu
     InitSignalHandlers();
@@ -442,6 +544,8 @@ int main(int argc, char *argv[]) try {
         ca_list_file    = working_dir + "/" + ca_list_file;
         key_file        = working_dir + "/" + key_file;
         dh_file         = working_dir + "/" + dh_file;
+        cache_dir       = working_dir + "/" + cache_dir;
+        if (xferlog_file != "") xferlog_file = working_dir + "/" + xferlog_file;
     } else {
         db_name         = "/";
         db_name         = db_name + VFS_DATABASE_NAME;
@@ -450,28 +554,99 @@ int main(int argc, char *argv[]) try {
         key_file        = "/" + key_file;
         ca_list_file    = "/" + ca_list_file;
         dh_file         = "/" + dh_file;
+        cache_dir       = "/" + cache_dir;
+        if (xferlog_file != "") xferlog_file = "/" + xferlog_file;
+    }
+
+    // Adresar pro pomocne soubory (indexy pro REST v ASCII rezimu, ...) - bez
+    // nej server funguje taky, jen pomaleji
+    ret = CacheInit();
+    if (ret < 0) {
+        cout << "Nepodarilo se vytvorit adresar " << cache_dir << endl;
     }
     
+    // Databaze starsi verze (gdbm) se musi nejdriv prevest - bez ni by
+    // soubory prisly o vlastniky a prava
+    string gdbm_name = db_name.substr(0, db_name.rfind('/') + 1) + VFS_GDBM_DATABASE_NAME;
+    struct stat db_st;
+    if (stat(gdbm_name.c_str(), &db_st) == 0 && stat(db_name.c_str(), &db_st) == -1 && errno == ENOENT) {
+        cout << "Nalezena databaze starsi verze " << gdbm_name << ", ale chybi " << db_name << "." << endl;
+        cout << "Prevedte ji prosim programem vfsdb_migrate (viz. INSTALL):" << endl;
+        cout << "    vfsdb_migrate " << gdbm_name << " " << db_name << endl;
+        exit(-1);
+    }
+
     VFS vfs(vfs_config_file.c_str(), db_name.c_str());
 #ifdef DEBUG
     vfs.PrintVirtualTree();
 #endif
+
+    // Sdileny stav pro skupinovy commit databaze - musi vzniknout pred fork()
+    ret = DurableInit();
+    if (ret < 0) {
+        cout << "Nepodarilo se pripravit skupinovy commit, databaze se bude synchronizovat po kazde zmene." << endl;
+    }
+
+    // Sdilena cache stat() - take musi vzniknout pred fork()
+    ret = StatCacheInit();
+    if (ret < 0) {
+        cout << "Nepodarilo se vytvorit sdilenou cache udaju o souborech, bude vypnuta." << endl;
+    }
+
+    // Sdilena cache obsahu malych souboru
+    ret = FileCacheInit();
+    if (ret < 0) {
+        cout << "Nepodarilo se vytvorit sdilenou cache malych souboru, bude vypnuta." << endl;
+    }
+
+    // Sdilene metriky (viz. prikaz METRICS)
+    ret = MetricsInit();
+    if (ret < 0) {
+        cout << "Nepodarilo se vytvorit sdilenou pamet pro metriky, nebudou se vest." << endl;
+    }
+
+    // Tabulka pripojenych klientu (SITE WHO, sftpwho)
+    if (working_dir != "/") ret = SessionInit(working_dir + "/" + SESSION_TABLE_NAME);
+        else ret = SessionInit("/" SESSION_TABLE_NAME);
+    if (ret < 0) {
+        cout << "Nepodarilo se vytvorit tabulku klientu, SITE WHO nebude k dispozici." << endl;
+    }
+
+    // Log prenosu - fronty zaznamu musi vzniknout pred fork()
+    if (xferlog_file != "") {
+        ret = XferLogInit(xferlog_file);
+        if (ret == -2) cout << "Soubor " << xferlog_file << " neni log prenosu teto verze, prenosy se nebudou logovat." << endl;
+            else if (ret < 0) cout << "Nepodarilo se otevrit log prenosu " << xferlog_file << ", prenosy se nebudou logovat." << endl;
+    }
         
     /* Pripravime socket a struktury na poslouchani */
-    // vytvorime socket
-    int server_socket = socket(PF_INET, SOCK_STREAM,0);	
+    // vytvorime socket - IPv6 socket, ktery prijima i IPv4 spojeni (adresy
+    // klientu pak jsou ::ffff:c1.c2.c3.c4); bez podpory IPv6 v systemu jen IPv4
+    int server_socket = socket(PF_INET6, SOCK_STREAM,0);	
+    if (server_socket == -1 && (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT)) {
+        server_family = AF_INET;
+        server_socket = socket(PF_INET, SOCK_STREAM,0);
+    }
     if (server_socket == -1) {
         cout << "Nelze vytvorit socket." << endl;
         //exit(-1);
         goto KONEC;
     }
     
-    struct sockaddr_in server_addr;
+    struct sockaddr_storage server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family      = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY; //nekdo prirazuje htonl(INADDR_ANY), imho je spravne neprevadet
-    server_addr.sin_port        = htons(server_listening_port);
-    server_len = sizeof(server_addr);
+    if (server_family == AF_INET6) {
+        setsockopt(server_socket, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        ((struct sockaddr_in6 *)&server_addr)->sin6_family = AF_INET6;
+        ((struct sockaddr_in6 *)&server_addr)->sin6_addr   = in6addr_any;
+        ((struct sockaddr_in6 *)&server_addr)->sin6_port   = htons(server_listening_port);
+        server_len = sizeof(struct sockaddr_in6);
+    } else {
+        ((struct sockaddr_in *)&server_addr)->sin_family      = AF_INET;
+        ((struct sockaddr_in *)&server_addr)->sin_addr.s_addr = INADDR_ANY; //nekdo prirazuje htonl(INADDR_ANY), imho je spravne neprevadet
+        ((struct sockaddr_in *)&server_addr)->sin_port        = htons(server_listening_port);
+        server_len = sizeof(struct sockaddr_in);
+    }
     
     ret = bind(server_socket, (struct sockaddr *)&server_addr, server_len);
     if (ret == -1) {
@@ -522,17 +697,74 @@ int main(int argc, char *argv[]) try {
         fclose(fd);
     }
     
+    // Uklid databaze a dalsi udrzba bezi v samostatnem procesu, aby nikdy
+    // nezdrzovala obsluhu klientu
+    ret = MaintenanceStart(vfs, server_socket);
+    if (ret == 0) {
+        XferLogClose();
+        Maintenance(vfs);
+        goto KONEC;
+    }
+    if (ret == -1 && !daemonize) {
+        cout << "Nepodarilo se spustit proces udrzby, databaze se nebude uklizet." << endl;
+    }
+
+    // Sledovani zmen sdilenych adresaru pro cache stat() - bez nej zustane
+    // cache vypnuta
+    ret = MaintenanceStart(vfs, server_socket);
+    if (ret == 0) {
+        XferLogClose();
+        StatCacheWatch(vfs);
+        goto KONEC;
+    }
+    if (ret == -1 && !daemonize) {
+        cout << "Nepodarilo se spustit sledovani zmen, cache udaju o souborech bude vypnuta." << endl;
+    }
+
+    // Export metrik po HTTP - metriky cte jen ze sdilene pameti
+    if (metrics_port > 0) {
+        int metrics_socket = ExporterOpen(metrics_address, metrics_port);
+
+        if (metrics_socket == -1) {
+            if (!daemonize) cout << "Nepodarilo se otevrit port " << metrics_port << " pro export metrik." << endl;
+        } else {
+            ret = MaintenanceStart(vfs, server_socket);
+            if (ret == 0) {
+                XferLogClose();
+                Exporter(metrics_socket);
+                goto KONEC;
+            }
+            close(metrics_socket);
+            if (ret == -1 && !daemonize) {
+                cout << "Nepodarilo se spustit export metrik." << endl;
+            }
+        }
+    }
+
+    // Zapisovac logu prenosu - procesy obsluhujici klienty zaznamy jen
+    // zaradi do fronty ve sdilene pameti
+    if (xferlog_file != "") {
+        ret = MaintenanceStart(vfs, server_socket);
+        if (ret == 0) {
+            XferLogWriter();
+            goto KONEC;
+        }
+        if (ret == -1 && !daemonize) {
+            cout << "Nepodarilo se spustit zapisovac logu prenosu, prenosy se nebudou logovat." << endl;
+        }
+    }
+    
     
     /* *** *** *** Hlavni cyklus *** *** *** */
     while (1) {
         string      request;
-        char    *   adresa;
+        char        adresa[INET6_ADDRSTRLEN];
     
         
 #ifdef DEBUG
         cout << "server ceka na spojeni" << endl;
 #endif
-        struct sockaddr_in client_address;
+        struct sockaddr_storage client_address;
         
 	int client_len = sizeof(client_address);
         do {
@@ -550,9 +782,15 @@ int main(int argc, char *argv[]) try {
             //exit(-1); 
             goto KONEC;
         }
+        MetricsAccept();
+        TraceAccept();
+        //odpovedi jsou kratke a kazda se posila jednim write() - bez
+        //TCP_NODELAY by napr. 226 po prenosu cekala na ACK predchozi 150
+        //(Nagle), ktere klient posila az po 40 ms (delayed ACK)
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
         client_data_address = client_address; //defaultne se data connection vytvari na stejnou adresu a port
         
-	adresa = inet_ntoa(client_address.sin_addr);
+	if (AddressToString((struct sockaddr *)&client_address, adresa, sizeof(adresa)) == -1) strcpy(adresa, "?");
 #ifdef DEBUG
 	cout << "Prijato spojeni od " << adresa << endl;
 #endif
@@ -578,6 +816,10 @@ int main(int argc, char *argv[]) try {
 	if (child_pid == 0) { //pokud jsem potomek
             
             parent = false;
+            MetricsWorkerStart();
+            SessionStart(adresa);
+            XferLogWorkerStart();
+            TraceSessionStart(trace_sample, working_dir, adresa);
             if (CheckIP(adresa) == 0) {
                 if (!daemonize) { // pokud jsem daemon, nebudu nic tisknout
                     cout << "Pokus o spojeni ze zakazane IP " << adresa << endl;
@@ -637,7 +879,21 @@ int main(int argc, char *argv[]) try {
 		if (!args.empty()) args.erase(args.begin(), args.end());
                 ret = ParseCommand(request, args);
                 if (ret >= 0) {
-                   ret = command_table[ret].handler(args, vfs); // zavolame handler, ktery obslouzi pozadavek
+                   int                  cmd   = ret;
+                   unsigned long long   start = MetricsNow();
+
+                   SessionCommand(command_table[cmd].name);
+                   {
+                       TraceSpan span(command_table[cmd].name, "command");
+                       ret = command_table[cmd].handler(args, vfs); // zavolame handler, ktery obslouzi pozadavek
+                   }
+                   MetricsCommand(cmd, MetricsNow() - start);
+                   DataStreamLog(current_user.name, adresa);
+                   SessionIdle();
+
+                   unsigned long long   hits, misses;
+                   StatCacheCounters(hits, misses);
+                   MetricsCacheTotals(METRICS_CACHE_STAT, hits, misses);
 		   if (ret < 0)
                    switch (ret) {
                         case -1: if (!daemonize) cout << "---  Chyba pri posilani odpovedi klientovi" << endl;
@@ -703,6 +959,7 @@ int main(int argc, char *argv[]) try {
     // destruktory a skoncilo se ciste.
 KONEC:
     if (parent) unlink(pid_file.c_str()); // label musi ukazovat na nejaky konkretni kod
+    ZCacheDiscard(); // rozpracovany cache soubor MODE Z po prerusenem prenosu
     if (tls_up && use_tls) { 
         TLSClean();
         TLSDataClean();
@@ -715,8 +972,8 @@ KONEC:
     }
     exit(-1);
     
-} catch (GdbmError &x) {
-    if (!daemonize) cout << MY_NAME " (PID " << getpid() << "): Chyba knihovny Gdbm: " << x.what() << endl;
+} catch (DatabaseError &x) {
+    if (!daemonize) cout << MY_NAME " (PID " << getpid() << "): Chyba databaze: " << x.what() << endl;
     exit(-1);
 } catch (FileError &x) {
     if (!daemonize) cout << MY_NAME " (PID " << getpid() << "): Chyba pri praci se souborem: " << x.what() << endl;
@@ -21,6 +21,7 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <dirent.h>
@@ -33,7 +34,8 @@ extern "C" {
 #include "VFS.h"
 
 #define MY_VERSION "1.0" //< cislo verze smallFTPd
-#define VFS_DATABASE_NAME "vfsdb" //< jmeno pro soubor databaze gdbm, kterou pouzivaji objekty VFS a DirectoryDatabase.
+#define VFS_DATABASE_NAME "vfstable" //< jmeno pro soubor databaze, kterou pouzivaji objekty VFS a DirectoryDatabase.
+#define VFS_GDBM_DATABASE_NAME "vfsdb" //< jmeno puvodni databaze gdbm (viz. vfsdb_migrate)
 
 
 #define MAX_IP_LIST 100
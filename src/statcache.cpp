@@ -0,0 +1,486 @@
+/** @file statcache.cpp
+ *  \brief Implementace sdilene cache udaju o souborech.
+ *
+ * Kazdy proces obsluhujici klienta zacina s prazdnou cache jadra pro sve
+ * struktury a pri LIST, RETR a dalsich prikazech stat()uje tytez soubory
+ * porad dokola (GetLslInfo(), IsRegularFile(), IsFile(), IsDir(), klic do
+ * databaze). Vysledky se proto ukladaji do cache sdilene vsemi procesy,
+ * klicem je absolutni cesta k souboru.
+ *    Cache se smi pouzivat jen tehdy, kdyz proces sledovani zmen (viz.
+ * StatCacheWatch() v maintenance.cpp) sleduje pres inotify vsechny sdilene
+ * adresare - kazda zmena souboru pak zneplatni jeho zaznam (a zaznam
+ * adresare, ve kterem lezi). Zmeny, ktere dela sam server, zneplatnuji
+ * procesy klientu primo (StatCacheInvalidate()), aby klient hned po STOR
+ * nevidel stare udaje.
+ *    Aby proces, ktery soubor stat()oval pred zmenou, neulozil do cache
+ * stary vysledek az po zneplatneni, kazde zneplatneni zvysi citac ve
+ * skupine podle hashe cesty a vysledek se ulozi jen tehdy, kdyz se citac
+ * behem stat() nezmenil.
+ *    Zmena souboru s vice pevnymi odkazy se ohlasi jen pod jednou jeho
+ * cestou (a smazani nebo prepsani jednoho odkazu pod zadnou z ostatnich),
+ * takze se takove soubory (krome adresaru) do cache neukladaji. Kdyz soubor
+ * ziska dalsi odkaz, zneplatneni nove cesty zvysi citac podle (dev, ino)
+ * souboru - zaznam plati, jen dokud se citac jeho inodu nezmeni.
+ *    Cesty, ve kterych je symbolicky odkaz (v kterekoli casti, nejen na
+ * konci), se do cache neukladaji - odkaz muze vest mimo sledovane adresare
+ * a zmenu souboru, na ktery ukazuje, by nic nezneplatnilo.
+ *
+ */
+
+#include "statcache.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+}
+
+
+static StatCacheHeader    * cache   = 0; //< sdilena cache, 0 = cache neni k dispozici
+static StatCacheEntry     * entries = 0;
+static unsigned long long   hits    = 0; //< pocet zasahu cache v tomto procesu
+static unsigned long long   misses  = 0;
+
+
+/** Hashe cesty - dva ruzne, aby se ruzne cesty prakticky nemohly splest.
+ *
+ */
+static void PathHash(const char * path, unsigned long long &h1, unsigned long long &h2) {
+    const unsigned char * p;
+
+    h1 = 0xCBF29CE484222325ULL; //FNV-1a
+    h2 = 0x9E3779B97F4A7C15ULL;
+    for (p = (const unsigned char *)path; *p; p++) {
+        h1 = (h1 ^ *p) * 0x100000001B3ULL;
+        h2 = (h2 + *p) * 0xFF51AFD7ED558CCDULL;
+        h2 ^= h2 >> 29;
+    }
+    if (h1 == 0) h1 = 1; //0 oznacuje prazdny slot
+}
+
+
+/** Skupina citacu zneplatneni pro soubor (dev, ino).
+ *
+ */
+static unsigned int InodeBucket(dev_t dev, ino_t ino) {
+    unsigned long long h;
+
+    h = ((unsigned long long)dev * 0x9E3779B97F4A7C15ULL) ^ (unsigned long long)ino;
+    h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ULL;
+    return (h ^ (h >> 32)) & (STAT_CACHE_INODE_BUCKETS - 1);
+}
+
+
+/** Zneplatni zaznam souboru (dev, ino) pod kteroukoli cestou.
+ *
+ */
+static void InodeInvalidate(dev_t dev, ino_t ino) {
+    __sync_fetch_and_add(&cache->inode_inval[InodeBucket(dev, ino)], 1);
+}
+
+
+/** Prevede vysledek statx() na struct stat.
+ *
+ */
+static void StatxToStat(const struct statx &stx, struct stat &st) {
+    memset(&st, 0, sizeof(st));
+    st.st_dev          = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    st.st_ino          = stx.stx_ino;
+    st.st_mode         = stx.stx_mode;
+    st.st_nlink        = stx.stx_nlink;
+    st.st_uid          = stx.stx_uid;
+    st.st_gid          = stx.stx_gid;
+    st.st_rdev         = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+    st.st_size         = stx.stx_size;
+    st.st_blksize      = stx.stx_blksize;
+    st.st_blocks       = stx.stx_blocks;
+    st.st_atim.tv_sec  = stx.stx_atime.tv_sec;
+    st.st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    st.st_mtim.tv_sec  = stx.stx_mtime.tv_sec;
+    st.st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+    st.st_ctim.tv_sec  = stx.stx_ctime.tv_sec;
+    st.st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+}
+
+
+/** Prevede vysledek statx() na struct stat a cas vzniku souboru.
+ *
+ */
+static void StatxResult(const struct statx &stx, struct stat &st, unsigned long long &birth) {
+    StatxToStat(stx, st);
+    birth = (stx.stx_mask & STATX_BTIME) ? (unsigned long long)stx.stx_btime.tv_sec * 1000000000ULL + stx.stx_btime.tv_nsec : 0;
+}
+
+
+/** Zjisti udaje o souboru primo od jadra (symbolicke odkazy se nasleduji).
+ *
+ * Vrati 0, nebo -1 pri chybe (errno jako u stat()).
+ */
+static int StatFollow(const char * path, struct stat &st, unsigned long long &birth) {
+    struct statx    stx;
+
+    if (statx(AT_FDCWD, path, 0, STATX_BASIC_STATS | STATX_BTIME, &stx) == -1) {
+        if (errno != ENOSYS) return -1;
+        birth = 0;
+        return stat(path, &st);
+    }
+    StatxResult(stx, st, birth);
+    return 0;
+}
+
+
+/** Zjisti udaje o souboru primo od jadra a zaroven, jestli cesta vede pres
+ * symbolicky odkaz.
+ *
+ * Soubor se otevre pres openat2() s RESOLVE_NO_SYMLINKS (O_PATH, tedy bez
+ * cteni), ktere odmitne odkaz v kterekoli casti cesty - jednim volanim
+ * misto lstat() kazde casti. Starsi jadro odkaz pozna podle toho, ze se
+ * cesta lisi od realpath().
+ *
+ * Vrati 1, pokud cesta vede pres symbolicky odkaz (vysledek se nesmi ulozit
+ * do cache), 0, pokud vse probehlo v poradku, a -1 pri chybe (errno jako u
+ * stat()).
+ */
+static int StatFile(const char * path, struct stat &st, unsigned long long &birth) {
+    struct statx    stx;
+    char            real[PATH_MAX];
+    int             fd;
+    int             ret;
+
+#ifdef SYS_openat2
+    struct open_how how;
+
+    memset(&how, 0, sizeof(how));
+    how.flags   = O_PATH | O_CLOEXEC;
+    how.resolve = RESOLVE_NO_SYMLINKS;
+    fd = syscall(SYS_openat2, AT_FDCWD, path, &how, sizeof(how));
+    if (fd >= 0) {
+        ret = statx(fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS | STATX_BTIME, &stx);
+        close(fd);
+        if (ret == -1) return -1;
+        StatxResult(stx, st, birth);
+        return 0;
+    }
+    if (errno == ELOOP) return (StatFollow(path, st, birth) < 0) ? -1 : 1;
+    if (errno != ENOSYS) return -1;
+#endif
+
+    if (StatFollow(path, st, birth) < 0) return -1;
+    if (realpath(path, real) == 0 || strcmp(real, path) != 0) return 1;
+    return 0;
+}
+
+
+/** Zamkne slot e pro zapis - zapise se do owner a seq bude liche. Slot,
+ * jehoz vlastnik uz nebezi (umrel uprostred zapisu), prevezme; seq pritom
+ * zustane liche, ale zmeni se, takze ctenar, ktery zacal pred padem,
+ * zaznam nepouzije.
+ *
+ * Vrati nove (liche) seq, ktere se preda SlotUnlock(). Pokud wait je false
+ * a slot je zamceny, vrati -1 a slot nezamyka.
+ */
+static long long SlotLock(StatCacheEntry * e, bool wait) {
+    pid_t           me = getpid();
+    pid_t           o;
+    unsigned int    s;
+
+    while (1) {
+        o = e->owner;
+        if (o == 0) {
+            if (__sync_bool_compare_and_swap(&e->owner, 0, me)) break;
+            continue;
+        }
+        if (!wait) return -1;
+        if (kill(o, 0) == -1 && errno == ESRCH) {
+            if (__sync_bool_compare_and_swap(&e->owner, o, me)) break;
+            continue;
+        }
+        sched_yield();
+    }
+
+    //liche seq po mrtvem vlastnikovi - zaznam mohl zustat rozepsany
+    s = e->seq;
+    e->seq = (s & 1) ? s + 2 : s + 1;
+    __sync_synchronize();
+    if (s & 1) e->hash1 = 0;
+    return e->seq;
+}
+
+
+/** Odemkne slot e zamceny funkci SlotLock(), ktera vratila locked.
+ *
+ */
+static void SlotUnlock(StatCacheEntry * e, long long locked) {
+    __sync_synchronize();
+    e->seq = locked + 1;
+    __sync_synchronize();
+    e->owner = 0;
+}
+
+
+/** Vytvori sdilenou cache.
+ *
+ * Musi se zavolat pred prvnim fork(). Cache zustane vypnuta, dokud ji
+ * nezapne proces sledovani zmen.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      nepodarilo se vytvorit sdilenou pamet
+ *
+ */
+int StatCacheInit() {
+    size_t  size = sizeof(StatCacheHeader) + (size_t)STAT_CACHE_SLOTS * sizeof(StatCacheEntry);
+    void  * p;
+
+    p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return -1;
+
+    cache   = (StatCacheHeader *)p;
+    entries = (StatCacheEntry *)((char *)p + sizeof(StatCacheHeader));
+    //generace se nesmi opakovat ani po restartu serveru - podle ni se
+    //overuji i vypisy adresaru ulozene na disku (viz. StatCacheVersion())
+    cache->generation = ((unsigned long long)time(0) << 20) ^ getpid();
+    return 1;
+}
+
+
+/** Obdoba stat() - vrati udaje o souboru path (symbolicke odkazy se
+ * nasleduji), pokud mozno ze sdilene cache.
+ *
+ * Pokud birth neni 0, ulozi do nej cas vzniku souboru (0 = neznamy).
+ * Vrati 0, nebo -1 pri chybe (errno jako u stat()).
+ */
+int StatCacheStat(const char * path, struct stat &st, unsigned long long * birth) {
+    StatCacheEntry        * e;
+    StatCacheEntry        * victim;
+    unsigned long long      h1, h2;
+    unsigned long long      gen;
+    unsigned long long      b;
+    unsigned int            mask = STAT_CACHE_SLOTS - 1;
+    unsigned int            inv;
+    unsigned int            bucket;
+    unsigned int            inode_inv;
+    unsigned int            s;
+    unsigned int            i;
+    long long               locked;
+    int                     ret;
+
+    if (cache == 0 || !cache->enabled || path[0] != '/') {
+        ret = StatFollow(path, st, b);
+        if (birth != 0) *birth = b;
+        return ret;
+    }
+
+    PathHash(path, h1, h2);
+    gen = cache->generation;
+    for (i = 0; i < STAT_CACHE_PROBE; i++) {
+        e = &entries[(h1 + i) & mask];
+        s = e->seq;
+        __sync_synchronize();
+        if ((s & 1) || e->hash1 != h1 || e->hash2 != h2 || e->generation != gen) continue;
+        st        = e->st;
+        b         = e->birth;
+        inode_inv = e->inode_inval;
+        __sync_synchronize();
+        if (e->seq != s) continue;
+        if (cache->inode_inval[InodeBucket(st.st_dev, st.st_ino)] != inode_inv) continue;
+        if (birth != 0) *birth = b;
+        hits++;
+        return 0;
+    }
+
+    //v cache neni - zeptame se jadra a vysledek ulozime
+    misses++;
+    bucket = h1 & (STAT_CACHE_INVAL_BUCKETS - 1);
+    inv    = cache->inval[bucket];
+    __sync_synchronize();
+
+    ret = StatFile(path, st, b);
+    if (birth != 0) *birth = b;
+    if (ret < 0) return -1;
+    if (ret == 1) return 0; //cesta vede pres symbolicky odkaz
+    if (st.st_nlink > 1 && !S_ISDIR(st.st_mode)) return 0; //soubor ma vice pevnych odkazu
+    inode_inv = cache->inode_inval[InodeBucket(st.st_dev, st.st_ino)];
+
+    //misto: zaznam teze cesty, prazdny nebo neplatny slot, jinak nektery z okna
+    victim = &entries[(h1 + h2 % STAT_CACHE_PROBE) & mask];
+    for (i = 0; i < STAT_CACHE_PROBE; i++) {
+        e = &entries[(h1 + i) & mask];
+        if ((e->hash1 == h1 && e->hash2 == h2) || e->hash1 == 0 || e->generation != gen) {
+            victim = e;
+            break;
+        }
+    }
+
+    locked = SlotLock(victim, false);
+    if (locked < 0) return 0; //slot zrovna zapisuje nekdo jiny, neukladame
+
+    //behem stat() se soubor mohl zmenit - pak by byl vysledek stary
+    if (cache->inval[bucket] == inv && cache->generation == gen && cache->enabled) {
+        victim->hash1       = h1;
+        victim->hash2       = h2;
+        victim->generation  = gen;
+        victim->inode_inval = inode_inv;
+        victim->birth       = b;
+        victim->st          = st;
+    }
+    SlotUnlock(victim, locked);
+    return 0;
+}
+
+
+/** Zneplatni zaznam cesty path a zaznam adresare, ve kterem lezi.
+ *
+ * Pokud path v cache neni, muze to byt novy pevny odkaz - zaznam souboru
+ * pod puvodni cestou se zneplatni pres citac jeho inodu.
+ * Zmeni se i verze (viz. StatCacheVersion()) o uroven vyssiho adresare -
+ * v jeho vypisu jsou udaje adresare, ve kterem path lezi.
+ * Relativni cesta se bere vzhledem k aktualnimu adresari procesu.
+ */
+void StatCacheInvalidate(const string &path) {
+    StatCacheEntry        * e;
+    unsigned long long      h1, h2;
+    unsigned int            mask = STAT_CACHE_SLOTS - 1;
+    unsigned int            i;
+    long long               locked;
+    size_t                  n;
+    string                  name = path;
+    char                    cwd[PATH_MAX];
+    struct stat             st;
+    unsigned long long      b;
+    bool                    found;
+    int                     round;
+
+    if (cache == 0 || path == "") return;
+    if (path[0] != '/') {
+        if (getcwd(cwd, PATH_MAX) == 0) {
+            StatCacheFlush();
+            return;
+        }
+        name = (strcmp(cwd, "/") == 0) ? "/" + path : string(cwd) + "/" + path;
+    }
+
+    for (round = 0; round < 3; round++) {
+        PathHash(name.c_str(), h1, h2);
+        __sync_fetch_and_add(&cache->inval[h1 & (STAT_CACHE_INVAL_BUCKETS - 1)], 1);
+        if (round == 2) break;
+
+        found = false;
+        for (i = 0; i < STAT_CACHE_PROBE; i++) {
+            e = &entries[(h1 + i) & mask];
+            if ((e->seq & 1) == 0 && (e->hash1 != h1 || e->hash2 != h2)) continue;
+            locked = SlotLock(e, true);
+            if (e->hash1 == h1 && e->hash2 == h2) {
+                e->hash1 = 0;
+                found = true;
+            }
+            SlotUnlock(e, locked);
+        }
+        //nova cesta - muze to byt novy pevny odkaz na soubor, ktery uz je
+        //v cache pod jinou cestou
+        if (round == 0 && !found && StatFollow(name.c_str(), st, b) == 0) InodeInvalidate(st.st_dev, st.st_ino);
+
+        n = name.rfind('/');
+        if (n == string::npos || name == "/") break;
+        name = (n == 0) ? "/" : name.substr(0, n);
+    }
+}
+
+
+/** Zneplatni celou cache.
+ *
+ */
+void StatCacheFlush() {
+    if (cache == 0) return;
+    __sync_fetch_and_add(&cache->generation, 1);
+}
+
+
+/** Zjisti, v jake verzi je cesta path - verze se zmeni pri kazdem
+ * zneplatneni path nebo nektereho souboru v nem (pokud je path adresar).
+ *
+ * Sledovani zmen pouzivaji i dalsi cache, ktere si ulozi verzi spolu s
+ * daty: data plati, dokud StatCacheVersion() vraci stejnou verzi.
+ * Zneplatneni jine cesty se stejnym hashem zmeni verzi take.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      zmeny se nesleduji (nebo cesta vede pres symbolicky
+ *                odkaz), verzi nelze pouzit
+ *
+ */
+int StatCacheVersion(const string &path, unsigned long long &generation, unsigned int &inval) {
+    unsigned long long  h1, h2;
+    unsigned long long  b;
+    struct stat         st;
+
+    if (cache == 0 || !cache->enabled || path == "" || path[0] != '/') return -1;
+    if (StatFile(path.c_str(), st, b) != 0) return -1;
+
+    PathHash(path.c_str(), h1, h2);
+    generation = cache->generation;
+    inval      = cache->inval[h1 & (STAT_CACHE_INVAL_BUCKETS - 1)];
+    __sync_synchronize();
+    if (!cache->enabled) return -1;
+    return 1;
+}
+
+
+/** Zapne (po nastaveni sledovani vsech sdilenych adresaru) nebo vypne
+ * pouzivani cache. Vola ho proces sledovani zmen.
+ *
+ */
+void StatCacheEnable(bool enabled) {
+    if (cache == 0) return;
+    if (enabled) {
+        cache->watcher = getpid();
+        StatCacheFlush(); //co se ulozilo bez sledovani zmen, neplati
+        __sync_synchronize();
+        cache->enabled = 1;
+    } else {
+        cache->enabled = 0;
+        __sync_synchronize();
+        cache->watcher = 0;
+    }
+}
+
+
+/** Sleduje prave nekdo zmeny vsech sdilenych adresaru?
+ *
+ */
+bool StatCacheWatched() {
+    return cache != 0 && cache->enabled;
+}
+
+
+/** Vola se (v obsluze SIGCHLD), kdyz skonci potomek pid. Pokud to byl
+ * proces sledovani zmen, zmeny uz nikdo nesleduje a cache se vypne.
+ *
+ */
+void StatCacheChildExited(pid_t pid) {
+    if (cache == 0 || pid <= 0 || cache->watcher != pid) return;
+    cache->enabled = 0;
+    cache->watcher = 0;
+}
+
+
+/** Vrati pocet zasahu a minuti cache v tomto procesu.
+ *
+ */
+void StatCacheCounters(unsigned long long &h, unsigned long long &m) {
+    h = hits;
+    m = misses;
+}
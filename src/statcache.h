@@ -0,0 +1,68 @@
+/** @file statcache.h
+ *  \brief Deklarace sdilene cache udaju o souborech (vysledku stat()).
+ *
+ */
+
+#ifndef __statcache_h
+#define __statcache_h
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define STAT_CACHE_SLOTS         65536 //< pocet zaznamu cache (mocnina 2)
+#define STAT_CACHE_PROBE         8     //< v kolika sousednich slotech se zaznam hleda
+#define STAT_CACHE_INVAL_BUCKETS 1024  //< pocet citacu zneplatneni (mocnina 2)
+#define STAT_CACHE_INODE_BUCKETS 1024  //< pocet citacu zneplatneni podle (dev, ino) (mocnina 2)
+
+
+/** Jeden zaznam cache - vysledek stat() pro jednu cestu.
+ *
+ * Cesta se neuklada, zaznam identifikuji dva ruzne 64bitove hashe cesty a
+ * (dev, ino) souboru (st) - zaznam plati, jen dokud se nezmeni citac
+ * zneplatneni jeho inodu (viz. statcache.cpp).
+ * Konzistenci cteni zajistuje seqlock seq (liche = prave probiha zapis),
+ * zapisujici procesy se vylucuji pres owner.
+ */
+struct StatCacheEntry {
+    volatile unsigned int   seq;
+    volatile pid_t          owner;      ///< proces, ktery slot prave zapisuje (0 = nikdo)
+    unsigned long long      hash1;      ///< 0 = prazdny slot
+    unsigned long long      hash2;
+    unsigned long long      generation; ///< zaznam plati, jen pokud souhlasi s generaci cache
+    unsigned int            inode_inval; ///< citac zneplatneni inodu v dobe ulozeni
+    unsigned int            reserved;
+    unsigned long long      birth;      ///< cas vzniku souboru (viz. TableRecord)
+    struct stat             st;
+};
+
+
+/** Hlavicka sdilene cache (mmap MAP_SHARED, vytvari se pred fork()).
+ *
+ */
+struct StatCacheHeader {
+    volatile unsigned long long generation; ///< zvyseni zneplatni celou cache
+    volatile unsigned int       enabled;    ///< sleduji se zmeny vsech sdilenych adresaru, cache se smi pouzivat
+    volatile pid_t              watcher;    ///< proces, ktery zmeny sleduje (viz. StatCacheWatch())
+    volatile unsigned int       inval[STAT_CACHE_INVAL_BUCKETS]; ///< citace zneplatneni podle hashe cesty
+    volatile unsigned int       inode_inval[STAT_CACHE_INODE_BUCKETS]; ///< citace zneplatneni podle (dev, ino)
+};
+
+
+int  StatCacheInit();
+int  StatCacheStat(const char * path, struct stat &st, unsigned long long * birth = 0);
+void StatCacheInvalidate(const string &path);
+void StatCacheFlush();
+int  StatCacheVersion(const string &path, unsigned long long &generation, unsigned int &inval);
+void StatCacheEnable(bool enabled);
+bool StatCacheWatched();
+void StatCacheChildExited(pid_t pid);
+void StatCacheCounters(unsigned long long &hits, unsigned long long &misses);
+
+#endif //__statcache_h
@@ -0,0 +1,279 @@
+/** @file trace.cpp
+ *  \brief Trasovani obsluhy klienta.
+ *
+ * Proces obsluhujici klienta si do kruhoveho bufferu zapisuje dokoncene
+ * useky obsluhy (prikaz, zamek databaze, prevod cesty ve VFS, navazani TLS,
+ * data connection, zapis na disk, ...) s casy CLOCK_MONOTONIC. Useky se do
+ * sebe vnoruji podle casu, takze prohlizec (chrome://tracing, Perfetto) z
+ * nich slozi casovou osu obsluhy.
+ *    Trasuje se jen kazde trace_sample-te spojeni (prepinac -r), nebo
+ * spojeni, ve kterem administrator zadal SITE TRACE ON. Na vyzadani (SITE
+ * TRACE, nebo signal SIGUSR1) proces zapise buffer do souboru
+ * trace.<pid>.json v pracovnim adresari. Zapis se muze volat i z obsluhy
+ * signalu, proto pouziva jen open(), write() a close() a cisla si prevadi
+ * sam. Pokud signal prijde prave behem zapisu useku, muze byt tento jeden
+ * usek ve vypisu poskozeny.
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+}
+
+#include "trace.h"
+
+#define TRACE_PATH_LEN 600
+#define TRACE_OUT_BUF  4096
+
+
+bool trace_on = false; //< trasuje se prave obsluhovane spojeni?
+
+/** Rozpracovany (jeste neukonceny) usek.
+ *
+ */
+struct TraceOpen {
+    unsigned long long  start;
+    const char        * name;
+    const char        * category;
+};
+
+static unsigned long long   connections = 0;            //< poradi spojeni (pocita hlavni proces)
+static TraceEvent           ring[TRACE_RING_SIZE];
+static unsigned long long   head = 0;                   //< kolik useku uz bylo zapsano
+static TraceOpen            open_spans[TRACE_MAX_DEPTH];
+static int                  depth = 0;
+static char                 path[TRACE_PATH_LEN] = "";
+static char                 process_name[64] = "smallFTPd";
+
+
+/** Vrati aktualni cas v nanosekundach.
+ *
+ */
+static unsigned long long TraceNow() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+/** Zapocita prijate spojeni (vola hlavni proces pred fork()).
+ *
+ */
+void TraceAccept() {
+    connections++;
+}
+
+
+/** Rozhodne, jestli se bude spojeni trasovat, a pripravi jmeno souboru pro
+ * vypis. Vola se v potomkovi po fork(), dir je pracovni adresar serveru a
+ * sample urcuje, kolikate spojeni se trasuje (0 = zadne, 1 = vsechna).
+ *
+ */
+void TraceSessionStart(int sample, const string &dir, const char * ip) {
+    head     = 0;
+    depth    = 0;
+    trace_on = (sample > 0 && connections % sample == 0);
+    snprintf(path, sizeof(path), "%s/" TRACE_FILE_PREFIX "%d.json", dir.c_str(), (int)getpid());
+    snprintf(process_name, sizeof(process_name), "smallFTPd %s", ip);
+}
+
+
+/** Zapne nebo vypne trasovani zbytku obsluhy (SITE TRACE ON/OFF).
+ *
+ */
+void TraceEnable(bool enabled) {
+    trace_on = enabled;
+}
+
+
+/** Zacne usek name kategorie category.
+ *
+ */
+void TraceBegin(const char * name, const char * category) {
+    if (depth < TRACE_MAX_DEPTH) {
+        open_spans[depth].name     = name;
+        open_spans[depth].category = category;
+        open_spans[depth].start    = TraceNow();
+    }
+    depth++;
+}
+
+
+/** Ukonci posledni zacaty usek a zapise ho do bufferu (pokud trval aspon
+ * min_ns).
+ *
+ */
+void TraceEnd(unsigned long long min_ns) {
+    unsigned long long  now;
+    TraceEvent        * e;
+    TraceOpen         * o;
+
+    if (depth == 0) return;
+    depth--;
+    if (depth >= TRACE_MAX_DEPTH) return;
+
+    o   = &open_spans[depth];
+    now = TraceNow();
+    if (now - o->start < min_ns) return;
+
+    e = &ring[head & (TRACE_RING_SIZE - 1)];
+    e->start    = o->start;
+    e->duration = now - o->start;
+    e->name     = o->name;
+    e->category = o->category;
+    head++;
+}
+
+
+/** Buffer pro zapis vypisu - jen pomoci write(), bez alokace pameti.
+ *
+ */
+struct TraceOut {
+    int     fd;
+    int     len;
+    bool    error;
+    char    buf[TRACE_OUT_BUF];
+};
+
+
+static void OutFlush(TraceOut &o) {
+    int     done = 0;
+    int     n;
+
+    while (done < o.len && !o.error) {
+        n = write(o.fd, o.buf + done, o.len - done);
+        if (n > 0) done += n;
+            else if (n == -1 && errno == EINTR) continue;
+            else o.error = true;
+    }
+    o.len = 0;
+}
+
+
+static void OutString(TraceOut &o, const char * s) {
+    while (*s) {
+        if (o.len == TRACE_OUT_BUF) OutFlush(o);
+        o.buf[o.len++] = *s++;
+    }
+}
+
+
+/** Zapise jmeno useku nebo procesu. Jmena jsou konstanty serveru a IP
+ * adresa, pro jistotu se ale uvozovky a zpetna lomitka nahradi.
+ */
+static void OutName(TraceOut &o, const char * s) {
+    while (*s) {
+        if (o.len == TRACE_OUT_BUF) OutFlush(o);
+        o.buf[o.len++] = (*s == '"' || *s == '\\' || (unsigned char)*s < ' ') ? '_' : *s;
+        s++;
+    }
+}
+
+
+static void OutNumber(TraceOut &o, unsigned long long x) {
+    char    tmp[24];
+    int     i = sizeof(tmp);
+
+    tmp[--i] = 0;
+    do {
+        tmp[--i] = '0' + x % 10;
+        x /= 10;
+    } while (x > 0);
+    OutString(o, tmp + i);
+}
+
+
+/** Zapise cas v ns jako mikrosekundy s desetinnou casti (jednotka formatu).
+ *
+ */
+static void OutMicro(TraceOut &o, unsigned long long ns) {
+    char tmp[5];
+
+    OutNumber(o, ns / 1000);
+    tmp[0] = '.';
+    tmp[1] = '0' + ns / 100 % 10;
+    tmp[2] = '0' + ns / 10 % 10;
+    tmp[3] = '0' + ns % 10;
+    tmp[4] = 0;
+    OutString(o, tmp);
+}
+
+
+static void OutEvent(TraceOut &o, const char * phase, const char * name, const char * category,
+                     unsigned long long start, unsigned long long duration, unsigned long long pid) {
+    OutString(o, ",\n{\"name\":\"");
+    OutName(o, name);
+    OutString(o, "\",\"cat\":\"");
+    OutName(o, category);
+    OutString(o, "\",\"ph\":\"");
+    OutString(o, phase);
+    OutString(o, "\",\"ts\":");
+    OutMicro(o, start);
+    if (phase[0] == 'X') {
+        OutString(o, ",\"dur\":");
+        OutMicro(o, duration);
+    }
+    OutString(o, ",\"pid\":");
+    OutNumber(o, pid);
+    OutString(o, ",\"tid\":");
+    OutNumber(o, pid);
+    OutString(o, "}");
+}
+
+
+/** Zapise buffer useku do souboru TraceFile() ve formatu Chrome trace
+ * (JSON). Useky, ktere jeste neskoncily (napr. prave probihajici prenos),
+ * se zapisou jako zacate ("B").
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      soubor se nepodarilo vytvorit nebo zapsat
+ *
+ */
+int TraceDump() {
+    TraceOut            o;
+    unsigned long long  pid = getpid();
+    unsigned long long  end = head;
+    unsigned long long  i;
+    int                 d;
+
+    if (path[0] == 0) return -1;
+    o.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+    if (o.fd == -1) return -1;
+    o.len   = 0;
+    o.error = false;
+
+    OutString(o, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+    OutNumber(o, pid);
+    OutString(o, ",\"args\":{\"name\":\"");
+    OutName(o, process_name);
+    OutString(o, "\"}}");
+
+    for (i = (end > TRACE_RING_SIZE) ? end - TRACE_RING_SIZE : 0; i < end; i++) {
+        TraceEvent &e = ring[i & (TRACE_RING_SIZE - 1)];
+        OutEvent(o, "X", e.name, e.category, e.start, e.duration, pid);
+    }
+    for (d = 0; d < depth && d < TRACE_MAX_DEPTH; d++)
+        OutEvent(o, "B", open_spans[d].name, open_spans[d].category, open_spans[d].start, 0, pid);
+
+    OutString(o, "\n]}\n");
+    OutFlush(o);
+    if (close(o.fd) == -1) o.error = true;
+    return o.error ? -1 : 1;
+}
+
+
+/** Vrati jmeno souboru, do ktereho TraceDump() zapisuje.
+ *
+ */
+const char * TraceFile() {
+    return path;
+}
@@ -0,0 +1,73 @@
+/** @file trace.h
+ *  \brief Deklarace trasovani obsluhy klienta (useky prikazu s casy ve
+ *  formatu Chrome trace / Perfetto).
+ *
+ */
+
+#ifndef __trace_h
+#define __trace_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include <string>
+
+using namespace std;
+
+#define TRACE_RING_SIZE   4096      //< kolik poslednich useku si proces pamatuje (mocnina 2)
+#define TRACE_MAX_DEPTH   32        //< nejvetsi zanoreni useku, hlubsi useky se nezaznamenaji
+#define TRACE_FILE_PREFIX "trace."  //< soubor s vypisem: trace.<pid>.json v pracovnim adresari
+#define TRACE_IO_MIN_USEC 1000      //< cteni a zapis souboru se zaznamena, jen pokud trva aspon tolik us
+
+extern int  trace_sample;
+extern bool trace_on;
+
+
+/** Jeden dokonceny usek (udalost "X" formatu Chrome trace).
+ *
+ * Jmeno a kategorie jsou ukazatele na konstantni retezce, ktere plati po
+ * celou dobu behu procesu.
+ */
+struct TraceEvent {
+    unsigned long long  start;      ///< zacatek (ns, CLOCK_MONOTONIC)
+    unsigned long long  duration;   ///< delka (ns)
+    const char        * name;
+    const char        * category;
+};
+
+
+void TraceAccept();
+void TraceSessionStart(int sample, const string &dir, const char * ip);
+void TraceEnable(bool enabled);
+void TraceBegin(const char * name, const char * category);
+void TraceEnd(unsigned long long min_ns);
+int  TraceDump();
+const char * TraceFile();
+
+
+/** Usek obsluhy (RAII) - zacina vytvorenim objektu a konci jeho zanikem.
+ *
+ * Pokud trasovani neni zapnute, stoji vytvoreni useku jen jednu dobre
+ * predvidatelnou podminku (test trace_on), destruktor uz testuje jen lokalni
+ * promennou. Useky kratsi nez min_usec se nezaznamenaji (pouziva se u casto
+ * opakovanych operaci, jako je cteni souboru, aby nezahltily buffer).
+ */
+class TraceSpan {
+public:
+    TraceSpan(const char * name, const char * category, unsigned int min_usec = 0) {
+        active = trace_on;
+        if (active) {
+            min_ns = min_usec * 1000ULL;
+            TraceBegin(name, category);
+        }
+    }
+    ~TraceSpan() { if (active) TraceEnd(min_ns); }
+
+private:
+    bool                active;
+    unsigned long long  min_ns;
+};
+
+#endif //__trace_h
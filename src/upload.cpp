@@ -0,0 +1,155 @@
+/** @file upload.cpp
+ *  \brief Implementace zapisu souboru nahravanych klientem (STOR).
+ *
+ * Pokud je zapnut prepinac atomic_uploads (-t), STOR nezapisuje primo do
+ * ciloveho souboru, ale do docasneho souboru ve stejnem adresari, ktery se
+ * po uspesnem prenosu prejmenuje na cilove jmeno. Kdo soubor prave stahuje,
+ * dal cte puvodni verzi (ma otevreny stary inode) a novy klient uvidi az
+ * kompletni novou verzi. Nepovedeny upload po sobe nenechava zadny napul
+ * zapsany soubor.
+ *      Pokud klient predem poslal ALLO, misto pro soubor se vyhradi pres
+ * fallocate() - soubor pak neni fragmentovany a pripadny nedostatek mista se
+ * projevi hned. Pokud klient posle mene dat, nez ohlasil, vyhrazene misto za
+ * koncem souboru se na konci uploadu uvolni.
+ *    Docasne soubory nejsou videt v LIST ani v prikazech pracujicich se
+ * soubory (VFS::GetFileInfo() je odmitne) a klient je nemuze vytvorit ani
+ * prepsat.
+ *
+ */
+
+#include "upload.h"
+#include "durable.h"
+
+extern "C" {
+#include <string.h>
+#include <fcntl.h>
+}
+
+
+static char upload_buffer[UPLOAD_BUF_SIZE]; //< buffer pro stdio, v procesu je vzdy jen jeden upload
+static bool preallocated = false;           //< misto pro soubor bylo vyhrazeno (ALLO)
+
+
+/** Uvolni misto vyhrazene fallocate() za aktualnim koncem souboru. Soubor
+ * se zapisuje postupne, takze jeho konec je aktualni pozice.
+ *
+ */
+static void UploadTrim(FILE * fd) {
+    off_t   size;
+
+    if (!preallocated) return;
+    preallocated = false;
+    if (fflush(fd) != 0) return;
+    size = ftello(fd);
+    if (size >= 0) ftruncate(fileno(fd), size);
+}
+
+
+/** Otevre soubor name pro zapis nahravanych dat.
+ *
+ * Pri zapnutem atomic_uploads se otevre docasny soubor a jeho jmeno se ulozi
+ * do temp_name, jinak se primo otevre (a zkrati) soubor name a temp_name bude
+ * prazdny. Je-li prealloc nenulove, vyhradi se pro soubor misto (velikost
+ * souboru se tim nemeni). Vrati otevreny soubor nebo 0.
+ *
+ */
+FILE * UploadOpen(const string &name, unsigned long long prealloc, string &temp_name) {
+    FILE          * fd;
+    struct stat     st;
+    char            pid[20];
+    int             n;
+
+    temp_name = "";
+    if (atomic_uploads) {
+        n = name.rfind('/');
+        snprintf(pid, 20, "%d.", getpid());
+        temp_name = name.substr(0, n + 1) + UPLOAD_TEMP_PREFIX + pid + name.substr(n + 1);
+
+        fd = fopen(temp_name.c_str(), "w");
+        if (fd == 0) {
+            temp_name = "";
+            return 0;
+        }
+
+        //novy soubor prebira prava toho, ktery nahrazuje
+        if (stat(name.c_str(), &st) == 0) fchmod(fileno(fd), st.st_mode & 07777);
+    } else {
+        fd = fopen(name.c_str(), "w");
+        if (fd == 0) return 0;
+    }
+
+    setvbuf(fd, upload_buffer, _IOFBF, UPLOAD_BUF_SIZE);
+
+    //pokud se misto vyhradit nepovede (napr. fs fallocate() neumi), nevadi;
+    //velikost souboru zustava podle zapsanych dat, prebytek se na konci
+    //uvolni (viz. UploadTrim())
+    preallocated = (prealloc > 0 && fallocate(fileno(fd), FALLOC_FL_KEEP_SIZE, 0, prealloc) == 0);
+
+    return fd;
+}
+
+
+/** Dokonci zapis souboru otevreneho pres UploadOpen() a ulozi do databaze
+ * jeho zaznam (vlastnik a prava z file).
+ *
+ * Podle urovne durability zapise data na disk, zavre soubor a pokud se
+ * zapisovalo do docasneho souboru, prejmenuje ho na name. Zaznam noveho
+ * souboru se ulozi a zaznam souboru, ktery tim zanikne, smaze v tomtez kroku
+ * jako prejmenovani (viz. DirectoryDatabase::ReplaceFile()) - soubor tak
+ * nikdy neni videt s vychozimi pravy. Pri chybe docasny soubor smaze.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      chyba pri zavirani nebo prejmenovani souboru, nebo se
+ *                nepodarilo ulozit zaznam docasneho souboru
+ *      - -2      soubor je prejmenovany (klient ho uz vidi), ale adresar se
+ *                nepodarilo zapsat na disk
+ *      - -4      zaznam je ulozeny, ale zmenu databaze se nepodarilo zapsat
+ *                na disk (jen pri DURABILITY_FULL)
+ *
+ */
+int UploadCommit(FILE * fd, const string &name, string &temp_name, VFS_file &file, VFS &vfs) {
+    int ret = 1;
+
+    UploadTrim(fd);
+
+    //data musi byt na disku drive nez nove jmeno, jinak by po padu systemu
+    //mohl pod cilovym jmenem zustat prazdny soubor
+    if (fflush(fd) != 0 || DataSync(fileno(fd)) < 0) ret = -1;
+
+    if (fclose(fd) != 0 || ret < 0) {
+        if (temp_name != "") unlink(temp_name.c_str());
+        temp_name = "";
+        return -1;
+    }
+
+    if (temp_name == "") {
+        //ostatni chyby databaze upload nezdrzi, soubor zustane s vychozimi
+        //pravy (stejne jako driv)
+        return (vfs.PutFileInfo(file) == -4) ? -4 : 1;
+    }
+
+    ret = vfs.ReplaceFile(temp_name, name, file);
+    if (ret == -1 || ret == -2 || ret == -3) {
+        unlink(temp_name.c_str());
+        temp_name = "";
+        return -1;
+    }
+    temp_name = "";
+    if (DirSync(name) < 0) return -2;
+    return (ret == -4) ? -4 : 1;
+}
+
+
+/** Zavre soubor otevreny pres UploadOpen() po nepovedenem prenosu.
+ *
+ * Docasny soubor smaze, puvodni soubor (pokud existoval) zustane beze zmeny.
+ */
+void UploadAbort(FILE * fd, string &temp_name) {
+    if (temp_name == "") UploadTrim(fd);
+    preallocated = false;
+    fclose(fd);
+    if (temp_name != "") unlink(temp_name.c_str());
+    temp_name = "";
+}
@@ -0,0 +1,42 @@
+/** @file upload.h
+ *  \brief Deklarace funkci pro zapis souboru nahravanych klientem.
+ *
+ */
+
+#ifndef __upload_h
+#define __upload_h
+
+extern "C" {
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+}
+
+#include <string>
+#include "VFS.h"
+
+using namespace std;
+
+#define UPLOAD_TEMP_PREFIX ".sFTPtmp." //< zacatek jmena docasneho souboru, LIST takove soubory nezobrazuje
+#define UPLOAD_BUF_SIZE    (1024*1024) //< velikost bufferu pro zapis do souboru
+
+extern bool atomic_uploads;
+extern unsigned long long allo_size;
+
+
+FILE * UploadOpen(const string &name, unsigned long long prealloc, string &temp_name);
+int    UploadCommit(FILE * fd, const string &name, string &temp_name, VFS_file &file, VFS &vfs);
+void   UploadAbort(FILE * fd, string &temp_name);
+
+
+/** Zjisti, jestli jde o docasny soubor rozpracovaneho uploadu.
+ *
+ */
+inline bool IsUploadTemp(const string &name) {
+    return name.compare(0, sizeof(UPLOAD_TEMP_PREFIX) - 1, UPLOAD_TEMP_PREFIX) == 0;
+}
+
+#endif //__upload_h
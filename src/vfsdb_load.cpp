@@ -0,0 +1,97 @@
+/** @file vfsdb_load.cpp
+ *  \brief Hromadne nahrani adresaru do tabulky DirectoryDatabase.
+ *
+ * Projde zadane adresare (vcetne vsech podadresaru) a kazdemu nalezenemu
+ * souboru a adresari, ktery jeste v databazi neni, vytvori zaznam s
+ * vychozimi pravy. Hodi se pri pridani noveho sdileneho adresare s velkym
+ * mnozstvim souboru - tabulka se postavi bokem a databaze se zamkne jen na
+ * jeji vymenu (viz. DirectoryDatabase::BulkLoad()), takze program muze bezet
+ * i za chodu serveru.
+ *
+ * Pouziti: vfsdb_load [-j vlaken] [-a] [-n] <vfstable> <adresar>...
+ *
+ *      - -j    pocet vlaken, ktera prochazi adresare (implicitne pocet CPU)
+ *      - -a    nahrat i skryte soubory (zacinajici teckou)
+ *      - -n    neprochazet podadresare
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+}
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "DirectoryDatabase.h"
+#include "durable.h"
+
+using namespace std;
+
+int durability = DURABILITY_NONE; //< BulkLoad() novou tabulku zapise na disk sam
+
+
+static void Usage(const char * name) {
+    cout << "Pouziti: " << name << " [-j vlaken] [-a] [-n] <vfstable> <adresar>..." << endl;
+}
+
+
+int main(int argc, char ** argv) try {
+    vector<string>      roots;
+    BulkLoadStats       stats;
+    string              dir;
+    bool                recursive = true;
+    bool                hidden = false;
+    int                 threads;
+    int                 zn;
+    int                 ret;
+    int                 i;
+
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((zn = getopt(argc, argv, "j:an")) != -1) {
+        switch (zn) {
+            case 'j': threads = atoi(optarg); break;
+            case 'a': hidden = true; break;
+            case 'n': recursive = false; break;
+            default : Usage(argv[0]); return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    //server ma v databazi absolutni cesty, klice se ale deli podle inodu,
+    //takze na tvaru cesty nezalezi - jen lomitko na konci zbytecne zdvojuje
+    for (i = optind + 1; i < argc; i++) {
+        dir = argv[i];
+        while (dir.size() > 1 && dir[dir.size()-1] == '/') dir.erase(dir.size()-1);
+        roots.push_back(dir);
+    }
+
+    DirectoryDatabase db(argv[optind]);
+    db.IgnoreHidden(!hidden);
+
+    ret = db.BulkLoad(roots, recursive, threads, stats);
+    switch (ret) {
+        case  1: break;
+        case -5: cout << "Zadny z adresaru nelze otevrit." << endl; return 1;
+        default: cout << "Chyba pri nahravani do databaze (" << ret << ")." << endl; return 1;
+    }
+
+    cout << "Adresaru: " << stats.dirs << ", souboru: " << stats.files << ", chyb: " << stats.errors
+         << ", zaznamu v tabulce: " << stats.records << endl;
+    cout << "Cas: " << stats.seconds << " s, " << (unsigned long long)(stats.files / (stats.seconds > 0 ? stats.seconds : 1))
+         << " souboru/s (" << threads << " vlaken)" << endl;
+    return 0;
+
+} catch (DatabaseError &x) {
+    cout << "Chyba databaze: " << x.what() << endl;
+    return 1;
+} catch (FileError &x) {
+    cout << "Chyba pri praci se souborem: " << x.what() << endl;
+    return 1;
+}
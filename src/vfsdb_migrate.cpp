@@ -0,0 +1,221 @@
+/** @file vfsdb_migrate.cpp
+ *  \brief Prevod puvodni databaze gdbm (vfsdb) na tabulku DirectoryDatabase.
+ *
+ * Puvodni databaze mela jako klic cislo inodu v desitkove soustave a jako
+ * data strukturu FileInfoGdbmRecord, ve ktere bylo i jmeno souboru. Podle
+ * jmena se soubor najde, overi se, ze ma stale stejny inode, a zaznam se
+ * ulozi do nove tabulky. Zaznamy souboru, ktere uz neexistuji (nebo maji jen
+ * relativni jmeno), se preskoci - server pro ne stejne pouziva vychozi
+ * prava.
+ *      S prepinacem -b program po prevodu zmeri, jak dlouho trva zjisteni
+ * prav k souborum pres gdbm (tak, jak to delal server, i s databazi stale
+ * otevrenou) a pres novou tabulku.
+ *
+ * Pouziti: vfsdb_migrate [-b] <vfsdb> <vfstable>
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <gdbm.h>
+}
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "DirectoryDatabase.h"
+#include "durable.h"
+
+using namespace std;
+
+#define BENCH_ROUNDS 20 //< kolikrat se pri mereni projdou vsechny prevedene soubory
+
+int durability = DURABILITY_NONE; //< prevod se na disk zapise az na konci (viz. main())
+
+
+/** Zaznam puvodni databaze gdbm.
+ *
+ */
+struct FileInfoGdbmRecord {
+    int         user_rights;
+    int         others_rights;
+    char        user_name[MAX_USER_NAME_LEN];
+    char        name[MAX_FILE_NAME_LEN];
+};
+
+
+/** Vrati aktualni cas v nanosekundach.
+ *
+ */
+static double Now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+
+/** Vytvori klic puvodni databaze k souboru (cislo inodu v desitkove soustave).
+ *
+ */
+static string GdbmKey(const char * path) {
+    struct stat st;
+    char        tmp[25];
+
+    if (stat(path, &st) == -1) return "";
+    snprintf(tmp, 25, "%lu", (unsigned long)st.st_ino);
+    return tmp;
+}
+
+
+/** Zmeri zjistovani prav k souborum names pres gdbm a pres tabulku.
+ *
+ */
+static void Benchmark(const char * gdbm_name, DirectoryDatabase &db, vector<string> &names) {
+    GDBM_FILE   dbf;
+    datum       keyd, datad;
+    string      key;
+    string      lock_name;
+    FileInfo    info;
+    struct stat st;
+    double      start;
+    double      n = (double)names.size() * BENCH_ROUNDS;
+    int         fd;
+    int         r;
+    unsigned    i;
+
+    if (names.size() == 0) {
+        cout << "Zadny soubor nebyl preveden, neni co merit." << endl;
+        return;
+    }
+
+    //samotny stat() - ten potrebuji obe databaze kvuli klici
+    start = Now();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < names.size(); i++) stat(names[i].c_str(), &st);
+    cout << "stat()                          : " << (Now() - start) / n << " ns" << endl;
+
+    //tak, jak to delal server: zamek, gdbm_open(), gdbm_fetch(), gdbm_close()
+    lock_name = string(gdbm_name) + "_gdbm_lock";
+    start = Now();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < names.size(); i++) {
+            key = GdbmKey(names[i].c_str());
+            keyd.dptr  = (char *)key.c_str();
+            keyd.dsize = key.size();
+            fd = open(lock_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0444);
+            if (fd != -1) close(fd);
+            dbf = gdbm_open((char *)gdbm_name, 512, GDBM_READER, S_IRUSR | S_IWUSR, 0);
+            if (dbf != 0) {
+                datad = gdbm_fetch(dbf, keyd);
+                if (datad.dptr != 0) free(datad.dptr);
+                gdbm_close(dbf);
+            }
+            unlink(lock_name.c_str());
+        }
+    cout << "gdbm (zamek, open, fetch, close): " << (Now() - start) / n << " ns" << endl;
+
+    //gdbm stale otevrena
+    dbf = gdbm_open((char *)gdbm_name, 512, GDBM_READER, S_IRUSR | S_IWUSR, 0);
+    if (dbf != 0) {
+        start = Now();
+        for (r = 0; r < BENCH_ROUNDS; r++)
+            for (i = 0; i < names.size(); i++) {
+                key = GdbmKey(names[i].c_str());
+                keyd.dptr  = (char *)key.c_str();
+                keyd.dsize = key.size();
+                datad = gdbm_fetch(dbf, keyd);
+                if (datad.dptr != 0) free(datad.dptr);
+            }
+        cout << "gdbm (otevrena, fetch)          : " << (Now() - start) / n << " ns" << endl;
+        gdbm_close(dbf);
+    }
+
+    start = Now();
+    for (r = 0; r < BENCH_ROUNDS; r++)
+        for (i = 0; i < names.size(); i++) db.GetFileInfo(names[i], info);
+    cout << "tabulka (GetFileInfo)           : " << (Now() - start) / n << " ns" << endl;
+}
+
+
+int main(int argc, char ** argv) try {
+    GDBM_FILE           dbf;
+    datum               keyd, nextkeyd, datad;
+    FileInfoGdbmRecord  record;
+    FileInfo            info;
+    vector<string>      names;
+    bool                bench = false;
+    int                 skipped = 0;
+    int                 zn;
+
+    while ((zn = getopt(argc, argv, "b")) != -1) {
+        if (zn == 'b') bench = true;
+        else {
+            cout << "Pouziti: " << argv[0] << " [-b] <vfsdb> <vfstable>" << endl;
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        cout << "Pouziti: " << argv[0] << " [-b] <vfsdb> <vfstable>" << endl;
+        return 1;
+    }
+
+    dbf = gdbm_open(argv[optind], 512, GDBM_READER, S_IRUSR | S_IWUSR, 0);
+    if (dbf == 0) {
+        cout << "Nelze otevrit databazi " << argv[optind] << ": " << gdbm_strerror(gdbm_errno) << endl;
+        return 1;
+    }
+
+    DirectoryDatabase db(argv[optind + 1]);
+
+    keyd = gdbm_firstkey(dbf);
+    while (keyd.dptr) {
+        datad = gdbm_fetch(dbf, keyd);
+        if (datad.dptr != 0 && datad.dsize == sizeof(record)) {
+            memcpy(&record, datad.dptr, sizeof(record));
+            record.user_name[MAX_USER_NAME_LEN-1] = 0;
+            record.name[MAX_FILE_NAME_LEN-1] = 0;
+
+            //soubor musi porad existovat a mit stejny inode jako v klici
+            if (record.name[0] == '/' && GdbmKey(record.name) == string(keyd.dptr, keyd.dsize)) {
+                info.user_rights   = record.user_rights;
+                info.others_rights = record.others_rights;
+                info.user_name     = record.user_name;
+                info.name          = record.name;
+                if (db.PutFileInfo(info) == 1) names.push_back(info.name);
+                    else skipped++;
+            } else skipped++;
+        } else skipped++;
+        if (datad.dptr != 0) free(datad.dptr);
+
+        nextkeyd = gdbm_nextkey(dbf, keyd);
+        free(keyd.dptr);
+        keyd = nextkeyd;
+    }
+    gdbm_close(dbf);
+
+    //cely prevod se zapise na disk najednou
+    durability = DURABILITY_FULL;
+    if (GroupCommit(argv[optind + 1]) < 0) {
+        cout << "Nepodarilo se zapsat tabulku na disk." << endl;
+        return 1;
+    }
+
+    cout << "Prevedeno zaznamu: " << names.size() << ", preskoceno: " << skipped << endl;
+
+    if (bench) Benchmark(argv[optind], db, names);
+    return 0;
+
+} catch (DatabaseError &x) {
+    cout << "Chyba databaze: " << x.what() << endl;
+    return 1;
+} catch (FileError &x) {
+    cout << "Chyba pri praci se souborem: " << x.what() << endl;
+    return 1;
+}
@@ -0,0 +1,215 @@
+/** @file xferlog.cpp
+ *  \brief Implementace logu prenosu souboru (xferlog).
+ *
+ * Log se zapina prepinacem -l. Proces obsluhujici klienta po kazdem
+ * prenosu jen zkopiruje zaznam do sve fronty ve sdilene pameti
+ * (XferLogAppend()) - bez zamku a bez jedineho systemoveho volani, takze
+ * logovani prenos nijak nezdrzi. Fronty vsech procesu vyprazdnuje
+ * samostatny proces zapisovace (XferLogWriter(), spousti se pres
+ * MaintenanceStart()) a zaznamy zapisuje do souboru logu v binarnim tvaru.
+ * Do textoveho formatu xferlog (jako wu-ftpd) ho prevede program
+ * xferlog_dump.
+ *      Kdyz se zaznam do fronty nevejde (zapisovac nestiha) nebo proces
+ * nema vlastni frontu, zaznam se zahodi a zapocita do
+ * XferLogShared::dropped - obsluha klienta na log nikdy neceka.
+ *
+ */
+
+#include "xferlog.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+}
+
+#include <iostream>
+
+extern bool run;
+extern bool daemonize;
+
+
+static XferLogShared  * xferlog = 0;     //< sdilene fronty, 0 = log je vypnuty
+static XferLogRing    * ring    = 0;     //< fronta tohoto procesu
+static int              log_fd  = -1;    //< soubor logu (jen v hlavnim procesu a zapisovaci, viz. XferLogClose())
+
+
+/** Otevre (pripadne vytvori) soubor logu name a pripravi sdilene fronty.
+ *
+ * Musi se zavolat pred prvnim fork(). Do noveho souboru zapise hlavicku,
+ * u existujiciho overi, ze obsahuje zaznamy stejne verze.
+ *
+ * Navratove hodnoty:
+ *
+ *      -  1      vse OK
+ *      - -1      soubor nelze otevrit nebo do nej zapsat
+ *      - -2      soubor neni log prenosu teto verze
+ *      - -3      nepodarilo se vytvorit sdilenou pamet
+ *
+ */
+int XferLogInit(const string &name) {
+    XferLogHeader   h;
+    struct stat     st;
+    void          * p;
+    int             fd;
+
+    fd = open(name.c_str(), O_RDWR | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        memset(&h, 0, sizeof(h));
+        h.magic       = XFERLOG_MAGIC;
+        h.version     = XFERLOG_VERSION;
+        h.record_size = sizeof(XferRecord);
+        if (write(fd, &h, sizeof(h)) != sizeof(h)) {
+            close(fd);
+            return -1;
+        }
+    } else if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != XFERLOG_MAGIC
+            || h.version != XFERLOG_VERSION || h.record_size != sizeof(XferRecord)) {
+        close(fd);
+        return -2;
+    }
+
+    p = mmap(0, sizeof(XferLogShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return -3;
+    }
+    xferlog = (XferLogShared *)p;
+    log_fd  = fd;
+    return 1;
+}
+
+
+/** Zavre soubor logu v procesu, ktery do nej nezapisuje.
+ *
+ * Vola se v kazdem potomkovi hlavniho procesu krome zapisovace - jinak by
+ * soubor zustal otevreny i v pomocnych procesech (udrzba, sledovani zmen,
+ * export metrik).
+ */
+void XferLogClose() {
+    if (log_fd == -1) return;
+    close(log_fd);
+    log_fd = -1;
+}
+
+
+/** Zabere pro tento proces frontu zaznamu.
+ *
+ * Vola se v potomkovi po fork(), pred obsluhou klienta. Soubor logu
+ * potomek nepotrebuje, zapisuje do nej jen zapisovac.
+ */
+void XferLogWorkerStart() {
+    pid_t   me = getpid();
+    int     i;
+
+    if (xferlog == 0) return;
+    XferLogClose();
+
+    for (i = 0; i < XFERLOG_MAX_WORKERS; i++)
+        if (xferlog->rings[i].pid == 0 && __sync_bool_compare_and_swap(&xferlog->rings[i].pid, 0, me)) {
+            ring = &xferlog->rings[i];
+            return;
+        }
+}
+
+
+/** Uvolni frontu procesu pid, ktery prave skoncil (vola se z ReapChild()).
+ *
+ * Zaznamy, ktere ve fronte zustaly, zapisovac zapise pozdeji.
+ */
+void XferLogChildExited(pid_t pid) {
+    int i;
+
+    if (xferlog == 0 || pid <= 0) return;
+    for (i = 0; i < XFERLOG_MAX_WORKERS; i++)
+        if (xferlog->rings[i].pid == pid) {
+            xferlog->rings[i].pid = 0;
+            return;
+        }
+}
+
+
+/** Zaradi zaznam r do fronty tohoto procesu.
+ *
+ */
+void XferLogAppend(const XferRecord &r) {
+    unsigned int    head;
+
+    if (xferlog == 0) return;
+
+    if (ring == 0 || (head = ring->head) - ring->tail >= XFERLOG_RING_SIZE) {
+        __sync_fetch_and_add(&xferlog->dropped, 1);
+        return;
+    }
+
+    memcpy(&ring->rec[head % XFERLOG_RING_SIZE], &r, sizeof(r));
+    __sync_synchronize(); //zapisovac nesmi videt posunuty head drive nez zaznam
+    ring->head = head + 1;
+}
+
+
+/** Zapise do souboru logu vsechny zaznamy, ktere jsou ve frontach.
+ *
+ * Navratove hodnoty:
+ *
+ *      - >= 0    pocet zapsanych zaznamu
+ *      - -1      chyba pri zapisu do souboru
+ *
+ */
+static int XferLogFlush() {
+    static XferRecord   buf[XFERLOG_RING_SIZE];
+    XferLogRing       * q;
+    unsigned int        head, tail, n;
+    int                 total = 0;
+    int                 i;
+
+    for (i = 0; i < XFERLOG_MAX_WORKERS; i++) {
+        q    = &xferlog->rings[i];
+        head = q->head;
+        tail = q->tail;
+        if (head == tail) continue;
+        __sync_synchronize(); //zaznamy az po precteni head
+
+        for (n = 0; tail + n != head; n++)
+            memcpy(&buf[n], &q->rec[(tail + n) % XFERLOG_RING_SIZE], sizeof(XferRecord));
+        __sync_synchronize(); //misto ve fronte se uvolni az po zkopirovani zaznamu
+        q->tail = head;
+
+        if (write(log_fd, buf, n * sizeof(XferRecord)) != (ssize_t)(n * sizeof(XferRecord))) return -1;
+        total += n;
+    }
+    return total;
+}
+
+
+/** Hlavni smycka zapisovace logu.
+ *
+ * Bezi v samostatnem procesu, dokud nedostane SIGTERM (viz. TermHandler())
+ * nebo dokud neskonci hlavni proces serveru. Pred skoncenim zapise, co ve
+ * frontach zbylo.
+ */
+void XferLogWriter() {
+    unsigned long long  dropped = 0;
+
+    if (xferlog == 0) return;
+
+    while (run) {
+        if (XferLogFlush() < 0 && !daemonize)
+            cout << getpid() << ": chyba pri zapisu do logu prenosu: " << strerror(errno) << endl;
+        if (xferlog->dropped != dropped) {
+            dropped = xferlog->dropped;
+            if (!daemonize) cout << "Do logu prenosu se nevesel zaznam, celkem zahozeno: " << dropped << endl;
+        }
+        usleep(XFERLOG_FLUSH_MSEC * 1000);
+    }
+    XferLogFlush();
+    close(log_fd);
+}
@@ -0,0 +1,96 @@
+/** @file xferlog.h
+ *  \brief Deklarace logu prenosu souboru (xferlog).
+ *
+ */
+
+#ifndef __xferlog_h
+#define __xferlog_h
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include <string>
+
+#include "DirectoryDatabase.h"
+
+using namespace std;
+
+#define XFERLOG_MAGIC         0x4c584653 //< "SFXL"
+#define XFERLOG_VERSION       1
+#define XFERLOG_MAX_WORKERS   256  //< pro kolik soucasnych procesu je v pameti vlastni fronta zaznamu
+#define XFERLOG_RING_SIZE     128  //< kolik zaznamu se vejde do fronty jednoho procesu (mocnina 2)
+#define XFERLOG_FLUSH_MSEC    250  //< po kolika milisekundach zapisovac vyprazdni fronty
+#define XFERLOG_IP_LEN        46   //< INET6_ADDRSTRLEN
+#define XFERLOG_FILE_LEN      256
+
+extern string xferlog_file;
+
+
+/** Zaznam o jednom prenosu souboru (RETR, STOR, STOU, APPE).
+ *
+ * V souboru logu jsou zaznamy ulozene tak, jak jsou, za hlavickou
+ * XferLogHeader.
+ */
+struct XferRecord {
+    unsigned long long  start;      ///< kdy bylo navazano data connection (us od 1.1.1970)
+    unsigned long long  usec;       ///< jak dlouho prenos trval (us)
+    unsigned long long  bytes;      ///< kolik dat (pred kompresi) se preneslo
+    int                 pid;        ///< proces, ktery klienta obsluhoval
+    unsigned short      code;       ///< prvni odpoved po navazani data connection (226, 426, ...)
+    char                direction;  ///< 'o' = RETR, 'i' = upload
+    char                type;       ///< TYPE (A, I, ...)
+    char                mode;       ///< MODE (S, B, Z)
+    char                tls;        ///< data connection bylo sifrovane
+    char                anonymous;  ///< uzivatel anonymous
+    char                reserved;
+    char                user[MAX_USER_NAME_LEN];
+    char                ip[XFERLOG_IP_LEN];
+    char                file[XFERLOG_FILE_LEN]; ///< fyzicke jmeno souboru
+};
+
+
+/** Hlavicka souboru logu.
+ *
+ */
+struct XferLogHeader {
+    unsigned int    magic;
+    unsigned int    version;
+    unsigned int    record_size;    ///< sizeof(XferRecord)
+    unsigned int    reserved;
+};
+
+
+/** Fronta zaznamu jednoho procesu (jeden zapisujici, jeden ctenar).
+ *
+ * head zvysuje jen proces, ktery frontu vlastni, tail jen zapisovac logu.
+ * Obe cisla jen rostou, pozice ve fronte je cislo modulo XFERLOG_RING_SIZE.
+ * Fronta se pri zmene vlastnika nenuluje - zaznamy procesu, ktery skoncil,
+ * zapisovac vyprazdni pozdeji.
+ */
+struct XferLogRing {
+    volatile pid_t          pid;    ///< proces, ktery frontu vlastni (0 = volna)
+    volatile unsigned int   head;
+    volatile unsigned int   tail;
+    XferRecord              rec[XFERLOG_RING_SIZE];
+};
+
+
+/** Sdilene fronty vsech procesu (mmap MAP_SHARED, vytvari se pred fork()).
+ *
+ */
+struct XferLogShared {
+    volatile unsigned long long dropped;    ///< zaznamy, ktere se nevesly do fronty
+    XferLogRing                 rings[XFERLOG_MAX_WORKERS];
+};
+
+
+int  XferLogInit(const string &name);
+void XferLogWorkerStart();
+void XferLogClose();
+void XferLogChildExited(pid_t pid);
+void XferLogAppend(const XferRecord &r);
+void XferLogWriter();
+
+#endif //__xferlog_h
@@ -0,0 +1,109 @@
+/** @file xferlog_dump.cpp
+ *  \brief Prevod binarniho logu prenosu (viz. xferlog.cpp) do textoveho tvaru.
+ *
+ * Implicitne vypisuje radky ve formatu xferlog, jak ho zapisuje wu-ftpd
+ * (a jak ho umi zpracovat nastroje na statistiky FTP serveru):
+ *
+ *      cas doba_prenosu adresa bytu soubor typ priznak smer pristup uzivatel
+ *      sluzba metoda_overeni id_uzivatele stav
+ *
+ * Mezery ve jmenu souboru se nahradi podtrzitkem. S prepinacem -r vypise
+ * vsechny polozky zaznamu oddelene tabulatorem (vcetne MODE, TLS, kodu
+ * odpovedi a casu v mikrosekundach).
+ *
+ * Pouziti: xferlog_dump [-r] <log>
+ *
+ */
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+}
+
+#include <iostream>
+#include <string>
+
+#include "xferlog.h"
+
+using namespace std;
+
+
+static void Usage(const char * name) {
+    cout << "Pouziti: " << name << " [-r] <log>" << endl;
+}
+
+
+/** Vypise zaznam r ve formatu xferlog (wu-ftpd).
+ *
+ */
+static void PrintXferlog(XferRecord &r) {
+    time_t      t = r.start / 1000000;
+    char        cas[30];
+    unsigned    i;
+
+    for (i = 0; r.file[i] != 0; i++)
+        if (r.file[i] == ' ' || r.file[i] == '\t') r.file[i] = '_';
+
+    strftime(cas, sizeof(cas), "%a %b %e %H:%M:%S %Y", localtime(&t));
+    printf("%s %llu %s %llu %s %c %c %c %c %s ftp 0 * %c\n",
+           cas, (r.usec + 500000) / 1000000, r.ip, r.bytes, r.file,
+           (r.type == 'A') ? 'a' : 'b', (r.mode == 'Z') ? 'C' : '_', r.direction,
+           r.anonymous ? 'a' : 'r', r.user, (r.code == 226 || r.code == 250) ? 'c' : 'i');
+}
+
+
+/** Vypise vsechny polozky zaznamu r oddelene tabulatorem.
+ *
+ */
+static void PrintRaw(XferRecord &r) {
+    printf("%llu\t%llu\t%d\t%s\t%s\t%c\t%c\t%c\t%d\t%u\t%llu\t%s\n",
+           r.start, r.usec, r.pid, r.ip, r.user, r.direction, r.type, r.mode,
+           r.tls, r.code, r.bytes, r.file);
+}
+
+
+int main(int argc, char ** argv) {
+    XferLogHeader   h;
+    XferRecord      r;
+    FILE          * fd;
+    bool            raw = false;
+    int             zn;
+
+    while ((zn = getopt(argc, argv, "r")) != -1) {
+        if (zn == 'r') raw = true;
+        else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    fd = fopen(argv[optind], "r");
+    if (fd == 0) {
+        cout << "Nelze otevrit log " << argv[optind] << endl;
+        return 1;
+    }
+    if (fread(&h, sizeof(h), 1, fd) != 1 || h.magic != XFERLOG_MAGIC
+            || h.version != XFERLOG_VERSION || h.record_size != sizeof(XferRecord)) {
+        cout << "Soubor " << argv[optind] << " neni log prenosu teto verze." << endl;
+        fclose(fd);
+        return 1;
+    }
+
+    if (raw) printf("#start_us\tusec\tpid\tip\tuser\tdir\ttype\tmode\ttls\tcode\tbytes\tfile\n");
+    while (fread(&r, sizeof(r), 1, fd) == 1) {
+        r.user[MAX_USER_NAME_LEN - 1] = 0;
+        r.ip[XFERLOG_IP_LEN - 1]      = 0;
+        r.file[XFERLOG_FILE_LEN - 1]  = 0;
+        if (raw) PrintRaw(r); else PrintXferlog(r);
+    }
+
+    fclose(fd);
+    return 0;
+}